@@ -42,8 +42,18 @@ Application::Application()
 	pCubeIndexBuffer = nullptr;
 	pPyramidIndexBuffer = nullptr;
 	pPlaneIndexBuffer = nullptr;
-	pConstantBuffer = nullptr;
-	
+	pFrameBuffer = nullptr;
+	pgridIndexBuffer = nullptr;
+	terrainTileIndexCount = 0;
+	terrainTileTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	AtlasRegion notPacked = { ATLAS_NOT_PACKED, 0, 0, 0, 0, 0.0f, 0.0f, 1.0f, 1.0f };
+	crateAtlasRegion = notPacked;
+	mudAtlasRegion = notPacked;
+	sunAtlasRegion = notPacked;
+	cubeInAtlas = false;
+	pyramidInAtlas = false;
+	ZeroMemory(terrainScatterStats, sizeof(terrainScatterStats));
 }
 
 Application::~Application()
@@ -95,8 +105,11 @@ HRESULT Application::Initialise(HINSTANCE hInstance, int nCmdShow)
 	pd3dDevice->CreateSamplerState(&sampDesc, &pSamplerState);
 
 	objPlane = OBJLoader::Load("Hercules.obj", pd3dDevice);
-	objCar = OBJLoader::Load("car.obj", pd3dDevice);
-	objSphere = OBJLoader::Load("sphere.obj", pd3dDevice, false);
+	objCar = OBJLoader::Load("car.obj", pd3dDevice, true, &crateAtlasRegion);
+	objSphere = OBJLoader::Load("sphere.obj", pd3dDevice, false, &sunAtlasRegion);
+
+	//Everything drawn through the render queue
+	InitRenderObjects();
 
 	//Application::HeightMapLoad("Heightmap.bmp");
 	Application::CreateTerrain("Heightmap.bmp");
@@ -146,6 +159,69 @@ HRESULT Application::InitShadersAndInputLayout()
 	if (FAILED(hr))
 		return hr;
 
+	// CDLOD terrain vertex shader, the terrain falls back to the tiles if it is missing
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "VS_Terrain", "vs_4_0", &pPSBlob)))
+	{
+		pd3dDevice->CreateVertexShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pTerrainVertexShader);
+		pPSBlob->Release();
+	}
+
+	// Height-only terrain vertex shader and its one element layout
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "VS_TerrainHeights", "vs_4_0", &pPSBlob)))
+	{
+		D3D11_INPUT_ELEMENT_DESC heightLayout[] =
+		{
+			{ "HEIGHT", 0, DXGI_FORMAT_R16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+
+		if (SUCCEEDED(pd3dDevice->CreateVertexShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pTerrainHeightVertexShader)))
+			pd3dDevice->CreateInputLayout(heightLayout, ARRAYSIZE(heightLayout), pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), &pTerrainHeightLayout);
+		pPSBlob->Release();
+	}
+
+	// Streamed terrain vertex shader, reads its heights from a buffer by vertex id so it needs no input layout
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "VS_TerrainStream", "vs_4_0", &pPSBlob)))
+	{
+		pd3dDevice->CreateVertexShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pTerrainStreamVertexShader);
+		pPSBlob->Release();
+	}
+
+	// Foliage shaders and their layout, the mesh in slot 0 and the instances in slot 1; the terrain scatter is not drawn if they are missing
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "VS_Foliage", "vs_4_0", &pPSBlob)))
+	{
+		D3D11_INPUT_ELEMENT_DESC foliageLayout[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "INSTANCE", 1, DXGI_FORMAT_R32G32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		};
+
+		if (SUCCEEDED(pd3dDevice->CreateVertexShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pFoliageVertexShader)))
+			pd3dDevice->CreateInputLayout(foliageLayout, ARRAYSIZE(foliageLayout), pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), &pFoliageLayout);
+		pPSBlob->Release();
+	}
+
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "PS_Foliage", "ps_4_0", &pPSBlob)))
+	{
+		pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pFoliagePixelShader);
+		pPSBlob->Release();
+	}
+
+	// Virtual texture pixel shaders, the terrain falls back to PS if they are missing
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "PS_VirtualTexture", "ps_4_0", &pPSBlob)))
+	{
+		pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pVirtualTexturePixelShader);
+		pPSBlob->Release();
+	}
+
+	if (SUCCEEDED(CompileShaderFromFile(L"DX11 Framework.fx", "PS_VirtualTextureFeedback", "ps_4_0", &pPSBlob)))
+	{
+		pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &pVirtualTextureFeedbackShader);
+		pPSBlob->Release();
+	}
+
 	// Define the input layout
 	D3D11_INPUT_ELEMENT_DESC layout[] =
 	{
@@ -164,12 +240,160 @@ HRESULT Application::InitShadersAndInputLayout()
 	if (FAILED(hr))
 		return hr;
 
+	// Instanced variant of VS and PS, the instanced props are not drawn if it is missing
+	CreateInstancedShader("VS", "PS", layout, numElements, sceneInstancedShader);
+
 	// Set the input layout
 	pImmediateContext->IASetInputLayout(pVertexLayout);
 
 	return hr;
 }
 
+HRESULT Application::InitTextureAtlas()
+{
+	//Small textures that get packed together. Anything that can't be read or decoded keeps its own SRV.
+	//Sun_COLOR.dds is not shipped with the repo, without it the sphere is drawn with the mud texture.
+	const wchar_t* fileNames[] = { L"Crate_COLOR.dds", L"Mud_COLOR.dds", L"Sun_COLOR.dds" };
+	AtlasRegion* fileRegions[] = { &crateAtlasRegion, &mudAtlasRegion, &sunAtlasRegion };
+	const int numFiles = 3;
+	const int sunFile = 2;
+
+	std::vector<uint8_t> pixels[numFiles];
+	std::vector<AtlasImage> images;
+	std::vector<int> imageFiles;
+
+	for (int i = 0; i < numFiles; ++i)
+	{
+		std::ifstream inFile(fileNames[i], std::ios::in | std::ios::binary | std::ios::ate);
+		if (!inFile.good())
+		{
+			OutputDebugStringW((std::wstring(L"Texture atlas: cannot open ") + fileNames[i] + L"\n").c_str());
+			continue;
+		}
+
+		std::vector<uint8_t> ddsData((size_t)inFile.tellg());
+		inFile.seekg(0);
+		inFile.read((char*)ddsData.data(), ddsData.size());
+		inFile.close();
+
+		size_t width = 0;
+		size_t height = 0;
+		if (ddsData.empty() || !DecodeAtlasImageFromDDS(ddsData.data(), ddsData.size(), pixels[i], width, height))
+		{
+			OutputDebugStringW((std::wstring(L"Texture atlas: cannot decode ") + fileNames[i] + L"\n").c_str());
+			continue;
+		}
+
+		AtlasImage image = { pixels[i].data(), width, height, width * 4 };
+		images.push_back(image);
+		imageFiles.push_back(i);
+	}
+
+	// Nothing to share a binding with
+	if (images.size() < 2)
+	{
+		OutputDebugStringA("Texture atlas: fewer than two textures loaded, every texture keeps its own binding\n");
+		return S_OK;
+	}
+
+	// 2 texels of gutter that survive all 5 mip levels
+	AtlasDesc desc = { 2048, 2, 5 };
+	std::vector<AtlasPage> pages;
+	std::vector<AtlasRegion> regions;
+	if (!BuildTextureAtlas(images.data(), images.size(), desc, pages, regions) || pages.empty())
+		return E_FAIL;
+
+	// Only the first page is used, everything else stays on its own texture
+	const AtlasPage& page = pages[0];
+
+	D3D11_TEXTURE2D_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = (UINT)page.width;
+	texDesc.Height = (UINT)page.height;
+	texDesc.MipLevels = (UINT)page.mipLevels;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initData[D3D11_REQ_MIP_LEVELS];
+	size_t offset = 0;
+	for (size_t level = 0; level < page.mipLevels; ++level)
+	{
+		size_t levelWidth = max(page.width >> level, (size_t)1);
+		size_t levelHeight = max(page.height >> level, (size_t)1);
+		initData[level].pSysMem = &page.pixels[offset];
+		initData[level].SysMemPitch = (UINT)(levelWidth * 4);
+		initData[level].SysMemSlicePitch = (UINT)(levelWidth * levelHeight * 4);
+		offset += levelWidth * levelHeight * 4;
+	}
+
+	ID3D11Texture2D* atlasTexture = nullptr;
+	HRESULT hr = pd3dDevice->CreateTexture2D(&texDesc, initData, &atlasTexture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pd3dDevice->CreateShaderResourceView(atlasTexture, nullptr, &pTextureAtlas);
+	atlasTexture->Release();
+	if (FAILED(hr))
+		return hr;
+
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		if (regions[i].page == 0)
+			*fileRegions[imageFiles[i]] = regions[i];
+	}
+
+	if (pixels[sunFile].empty())
+		sunAtlasRegion = mudAtlasRegion;
+
+	return S_OK;
+}
+
+HRESULT Application::InitTerrainVirtualTexture()
+{
+	//Paged from a tiled copy of the surface texture, written next to it on the first run
+	const char* virtualTextureFile = "Surface_COLOR.vtx";
+
+	if (!pVirtualTexturePixelShader || !pVirtualTextureFeedbackShader)
+		return E_FAIL;
+
+	VirtualTextureLayout layout;
+	if (!ReadVirtualTextureLayout(virtualTextureFile, layout))
+	{
+		std::ifstream inFile(L"Surface_COLOR.dds", std::ios::in | std::ios::binary | std::ios::ate);
+		if (!inFile.good())
+			return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+		std::vector<uint8_t> ddsData((size_t)inFile.tellg());
+		inFile.seekg(0);
+		inFile.read((char*)ddsData.data(), ddsData.size());
+		inFile.close();
+
+		std::vector<uint8_t> pixels;
+		size_t width = 0;
+		size_t height = 0;
+		if (ddsData.empty() || !DecodeAtlasImageFromDDS(ddsData.data(), ddsData.size(), pixels, width, height))
+			return E_FAIL;
+
+		// 128 texel pages with a 4 texel border, so pages are whole BC1 blocks
+		if (!BuildVirtualTextureFile(virtualTextureFile, pixels.data(), width, height, width * 4, 128, 4, BC_FORMAT_BC1))
+			return E_FAIL;
+	}
+
+	pTerrainVirtualTexture = new TerrainVirtualTexture();
+	HRESULT hr = pTerrainVirtualTexture->Initialise(pd3dDevice, pImmediateContext, virtualTextureFile, _WindowWidth, _WindowHeight);
+	if (FAILED(hr))
+	{
+		delete pTerrainVirtualTexture;
+		pTerrainVirtualTexture = nullptr;
+		return hr;
+	}
+
+	return S_OK;
+}
+
 HRESULT Application::InitCubeVertexBuffer()
 {
 	HRESULT hr;
@@ -191,6 +415,9 @@ HRESULT Application::InitCubeVertexBuffer()
 
 
 
+	cubeInAtlas = RemapAtlasTexCoords(crateAtlasRegion, &verticesCube[0].TexC.x, 8, sizeof(SimpleVertex));
+	BoundingBox::CreateFromPoints(cubeBounds, 8, &verticesCube[0].Pos, sizeof(SimpleVertex));
+
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
@@ -229,6 +456,9 @@ HRESULT Application::InitPyramidVertexBuffer()
 
 	};
 
+	pyramidInAtlas = RemapAtlasTexCoords(crateAtlasRegion, &verticesPyramid[0].TexC.x, 5, sizeof(SimpleVertex));
+	BoundingBox::CreateFromPoints(pyramidBounds, 5, &verticesPyramid[0].Pos, sizeof(SimpleVertex));
+
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
@@ -377,7 +607,7 @@ HRESULT Application::InitWindow(HINSTANCE hInstance, int nCmdShow)
 	return S_OK;
 }
 
-HRESULT Application::CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
+HRESULT Application::CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut, const D3D_SHADER_MACRO* pDefines)
 {
 	HRESULT hr = S_OK;
 
@@ -391,7 +621,7 @@ HRESULT Application::CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoin
 #endif
 
 	ID3DBlob* pErrorBlob;
-	hr = D3DCompileFromFile(szFileName, nullptr, nullptr, szEntryPoint, szShaderModel,
+	hr = D3DCompileFromFile(szFileName, pDefines, nullptr, szEntryPoint, szShaderModel,
 		dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
 
 	if (FAILED(hr))
@@ -409,6 +639,53 @@ HRESULT Application::CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoin
 	return S_OK;
 }
 
+HRESULT Application::CreateInstancedShader(LPCSTR vertexEntry, LPCSTR pixelEntry, const D3D11_INPUT_ELEMENT_DESC* layout, UINT elementCount, RenderShader& shader)
+{
+	//The same entry points compiled with INSTANCED defined, and their layout with the RenderInstance stream added in slot 1
+	const D3D_SHADER_MACRO defines[] = { { "INSTANCED", "1" }, { nullptr, nullptr } };
+	const D3D11_INPUT_ELEMENT_DESC instanceElements[] =
+	{
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TINT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	std::vector<D3D11_INPUT_ELEMENT_DESC> elements(layout, layout + elementCount);
+	elements.insert(elements.end(), instanceElements, instanceElements + ARRAYSIZE(instanceElements));
+
+	ZeroMemory(&shader, sizeof(shader));
+	shader.InstanceStride = sizeof(RenderInstance);
+
+	ID3DBlob* pBlob = nullptr;
+	HRESULT hr = CompileShaderFromFile(L"DX11 Framework.fx", vertexEntry, "vs_4_0", &pBlob, defines);
+	if (SUCCEEDED(hr))
+	{
+		hr = pd3dDevice->CreateVertexShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), nullptr, &shader.VertexShader);
+		if (SUCCEEDED(hr))
+			hr = pd3dDevice->CreateInputLayout(elements.data(), (UINT)elements.size(), pBlob->GetBufferPointer(), pBlob->GetBufferSize(), &shader.Layout);
+		pBlob->Release();
+	}
+
+	if (SUCCEEDED(hr))
+		hr = CompileShaderFromFile(L"DX11 Framework.fx", pixelEntry, "ps_4_0", &pBlob, defines);
+	if (SUCCEEDED(hr))
+	{
+		hr = pd3dDevice->CreatePixelShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), nullptr, &shader.PixelShader);
+		pBlob->Release();
+	}
+
+	if (FAILED(hr))
+	{
+		if (shader.VertexShader) shader.VertexShader->Release();
+		if (shader.PixelShader) shader.PixelShader->Release();
+		if (shader.Layout) shader.Layout->Release();
+		ZeroMemory(&shader, sizeof(shader));
+	}
+
+	return hr;
+}
+
 HRESULT Application::InitDevice()
 {
 	HRESULT hr = S_OK;
@@ -512,6 +789,7 @@ HRESULT Application::InitDevice()
 	pImmediateContext->RSSetViewports(1, &vp);
 
 	InitShadersAndInputLayout();
+	InitTextureAtlas();
 
 	//Call Vertex Buffers 
 	InitCubeVertexBuffer();
@@ -536,14 +814,24 @@ HRESULT Application::InitDevice()
 	// Set primitive topology
 	pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// Create the constant buffer
+	// Create the per frame constant buffer
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(ConstantBuffer);
+	bd.ByteWidth = sizeof(FrameConstants);
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	bd.CPUAccessFlags = 0;
-	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &pConstantBuffer);
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &pFrameBuffer);
+
+	if (FAILED(hr))
+		return hr;
+
+	//Per draw constants, 4096 draws before the ring starts over
+	pObjectConstantRing = new ConstantRing();
+	hr = pObjectConstantRing->Initialise(pd3dDevice, pImmediateContext, sizeof(ObjectConstants), 4096);
+
+	if (FAILED(hr))
+		return hr;
 	
 	//Lighting Values
 	lightDirection = XMFLOAT3(0.25f, 0.5f, 1.0f);
@@ -586,16 +874,19 @@ HRESULT Application::InitDevice()
 	if (FAILED(hr))
 		return hr;
 
-	//Texture Loading
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Hercules_COLOR.dds", nullptr, &pTextureHercules);
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Crate_COLOR.dds", nullptr, &pTextureCrate);
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Sun_COLOR.dds", nullptr, &pTextureSun);
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Mud_COLOR.dds", nullptr, &pTextureMud);
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Surface_COLOR.dds", nullptr, &pTextureSurface);
+	//Texture Loading (the cache makes sure each texture is only created once)
+	pTextureCache = new TextureCache(pd3dDevice);
+	hr = pTextureCache->Acquire(L"Hercules_COLOR.dds", &pTextureHercules);
+	hr = pTextureCache->Acquire(L"Crate_COLOR.dds", &pTextureCrate);
+	hr = pTextureCache->Acquire(L"Sun_COLOR.dds", &pTextureSun);
+	hr = pTextureCache->Acquire(L"Mud_COLOR.dds", &pTextureMud);
+	hr = pTextureCache->Acquire(L"Surface_COLOR.dds", &pTextureSurface);
 
 	if (FAILED(hr))
 		return hr;
 
+	InitTerrainVirtualTexture();
+
 		D3D11_BLEND_DESC blendDesc;
 		ZeroMemory(&blendDesc, sizeof(blendDesc));
 		D3D11_RENDER_TARGET_BLEND_DESC rtbd;
@@ -624,18 +915,73 @@ void Application::Cleanup()
 {
 	if (pImmediateContext) pImmediateContext->ClearState();
 
-	if (pConstantBuffer) pConstantBuffer->Release();
+	delete pTerrainVirtualTexture;
+	pTerrainVirtualTexture = nullptr;
+
+	delete pStreamedTerrain;
+	pStreamedTerrain = nullptr;
+
+	delete pObjectConstantRing;
+	pObjectConstantRing = nullptr;
+
+	if (pTextureCache)
+	{
+		pTextureCache->Release(pTextureHercules);
+		pTextureCache->Release(pTextureCrate);
+		pTextureCache->Release(pTextureSun);
+		pTextureCache->Release(pTextureMud);
+		pTextureCache->Release(pTextureSurface);
+		delete pTextureCache;
+		pTextureCache = nullptr;
+	}
+
+	if (pFrameBuffer) pFrameBuffer->Release();
+	for (size_t i = 0; i < renderMaterials.size(); ++i)
+		if (renderMaterials[i].Constants) renderMaterials[i].Constants->Release();
+	renderMaterials.clear();
 	if (pCubeVertexBuffer) pCubeVertexBuffer->Release();
 	if (pCubeIndexBuffer) pCubeIndexBuffer->Release();
 	if (pPyramidVertexBuffer) pPyramidVertexBuffer->Release();
 	if (pPyramidIndexBuffer) pPyramidIndexBuffer->Release();
 	if (pPlaneVertexBuffer) pPlaneVertexBuffer->Release();
 	if (pPlaneIndexBuffer) pPlaneIndexBuffer->Release();
-	if (pgridVertexBuffer) pgridVertexBuffer->Release();
+	for (size_t i = 0; i < terrainVertexBuffers.size(); ++i)
+		terrainVertexBuffers[i]->Release();
+	terrainVertexBuffers.clear();
 	if (pgridIndexBuffer) pgridIndexBuffer->Release();
 	if (pVertexLayout) pVertexLayout->Release();
 	if (pVertexShader) pVertexShader->Release();
+	if (pTerrainVertexShader) pTerrainVertexShader->Release();
+	if (pTerrainHeightVertexShader) pTerrainHeightVertexShader->Release();
+	if (pTerrainStreamVertexShader) pTerrainStreamVertexShader->Release();
+	if (pTerrainHeightLayout) pTerrainHeightLayout->Release();
+	if (pTerrainHeightBuffer) pTerrainHeightBuffer->Release();
+	if (pTerrainPatchVertexBuffer) pTerrainPatchVertexBuffer->Release();
+	if (pTerrainPatchIndexBuffer) pTerrainPatchIndexBuffer->Release();
+	if (pTerrainHeights) pTerrainHeights->Release();
+	if (pTerrainBuffer) pTerrainBuffer->Release();
+	delete pTerrainNodeRing;
+	pTerrainNodeRing = nullptr;
+	if (pTerrainLodIndexBuffer) pTerrainLodIndexBuffer->Release();
+	if (pTerrainRtinIndexBuffer) pTerrainRtinIndexBuffer->Release();
+	for (UINT i = 0; i < SCATTER_LAYER_COUNT; ++i)
+		if (pScatterInstanceBuffers[i]) pScatterInstanceBuffers[i]->Release();
+	if (pScatterMeshVertexBuffer) pScatterMeshVertexBuffer->Release();
+	if (pScatterMeshIndexBuffer) pScatterMeshIndexBuffer->Release();
+	if (pFoliageBuffer) pFoliageBuffer->Release();
+	if (pFoliageVertexShader) pFoliageVertexShader->Release();
+	if (pFoliagePixelShader) pFoliagePixelShader->Release();
+	if (pFoliageLayout) pFoliageLayout->Release();
+	if (sceneInstancedShader.VertexShader) sceneInstancedShader.VertexShader->Release();
+	if (sceneInstancedShader.PixelShader) sceneInstancedShader.PixelShader->Release();
+	if (sceneInstancedShader.Layout) sceneInstancedShader.Layout->Release();
+	//Instance buffers belong to the render objects, the meshes do not
+	for (size_t i = 0; i < renderObjects.size(); ++i)
+		if (renderObjects[i].InstanceBuffer) renderObjects[i].InstanceBuffer->Release();
+	renderObjects.clear();
 	if (pPixelShader) pPixelShader->Release();
+	if (pVirtualTexturePixelShader) pVirtualTexturePixelShader->Release();
+	if (pVirtualTextureFeedbackShader) pVirtualTextureFeedbackShader->Release();
 	if (pRenderTargetView) pRenderTargetView->Release();
 	if (pSwapChain) pSwapChain->Release();
 	if (pImmediateContext) pImmediateContext->Release();
@@ -645,6 +991,7 @@ void Application::Cleanup()
 	if (wireFrame) wireFrame->Release();
 	if (solidFrame) solidFrame->Release();
 	if (Transparency) Transparency->Release();
+	if (pTextureAtlas) pTextureAtlas->Release();
 		
 	//Continue Solid Objects
 }
@@ -717,8 +1064,22 @@ void Application::Update()
 	}
 
 
-	pCarCamera->SetPosition(XMFLOAT3(currentPosX - sin(rotationX), 3, currentPosZ - cos(rotationX)));
-	pCarCamera->SetLookAt(XMFLOAT3(currentPosX,3.0f, currentPosZ));
+	//Car follows the ground, the terrain is drawn lowered by 12 units
+	XMMATRIX terrainWorld = XMMatrixTranslation(0.0f, -12.0f, 0.0f);
+	XMVECTOR carGround = XMVector3Transform(XMVectorSet(currentPosX, 0.0f, currentPosZ, 1.0f), XMMatrixInverse(nullptr, terrainWorld));
+	float groundHeight;
+	if (terrainHeightField.GetHeightAt(XMVectorGetX(carGround), XMVectorGetZ(carGround), &groundHeight))
+	{
+		carGround = XMVector3Transform(XMVectorSetY(carGround, groundHeight), terrainWorld);
+		carPosition.y = XMVectorGetY(carGround);
+	}
+
+	//Ruts and craters, then the changed parts of the terrain are brought up to date
+	EditTerrain();
+	UpdateTerrainEdits();
+
+	pCarCamera->SetPosition(XMFLOAT3(currentPosX - sin(rotationX), carPosition.y + 8.0f, currentPosZ - cos(rotationX)));
+	pCarCamera->SetLookAt(XMFLOAT3(currentPosX, carPosition.y + 8.0f, currentPosZ));
 	pCarCamera->SetView();
 
 
@@ -734,7 +1095,7 @@ void Application::Update()
 	XMStoreFloat4x4(&cube, XMMatrixTranslation(-5.0f, 8.0f, 0.0f) * XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixRotationZ(t)); // Cube
 	XMStoreFloat4x4(&hercules, XMMatrixTranslation(0.0f, 0.0f, 20.0f)); // Hercules Plane
 	XMStoreFloat4x4(&car, XMMatrixScaling(0.1f, 0.1f, 0.1f) * rotation * translation); // Car
-	XMStoreFloat4x4(&terrain, XMMatrixTranslation(0.0f,-12.0f,0.0f)); // Car
+	XMStoreFloat4x4(&terrain, terrainWorld); // Terrain
 
 	if (GetAsyncKeyState('3'))
 	{
@@ -764,6 +1125,58 @@ void Application::Update()
 		isTransparent = false;
 	}
 
+	if (GetAsyncKeyState('O'))
+	{
+		isHorizonCulling = true;
+	}
+	if (GetAsyncKeyState('P'))
+	{
+		isHorizonCulling = false;
+	}
+
+	if (GetAsyncKeyState('F'))
+	{
+		isScatterVisible = true;
+	}
+	if (GetAsyncKeyState('V'))
+	{
+		isScatterVisible = false;
+	}
+
+	if (GetAsyncKeyState('I'))
+	{
+		isPropsVisible = true;
+	}
+	if (GetAsyncKeyState('U'))
+	{
+		isPropsVisible = false;
+	}
+
+	if (GetAsyncKeyState('9') && pTerrainVertexShader && pTerrainNodeRing)
+	{
+		terrainMode = TERRAIN_MODE_QUADTREE;
+	}
+	if (GetAsyncKeyState('0'))
+	{
+		terrainMode = TERRAIN_MODE_TILES;
+	}
+	if (GetAsyncKeyState('G') && pTerrainLodIndexBuffer)
+	{
+		terrainMode = TERRAIN_MODE_GEOMIPMAP;
+	}
+	if (GetAsyncKeyState('K') && pTerrainRtinIndexBuffer)
+	{
+		terrainMode = TERRAIN_MODE_RTIN;
+	}
+	if (GetAsyncKeyState('H') && pTerrainHeightBuffer && pTerrainHeightLayout && pTerrainNodeRing)
+	{
+		terrainMode = TERRAIN_MODE_HEIGHTS;
+	}
+	if (GetAsyncKeyState('J') && pStreamedTerrain && pTerrainStreamVertexShader && pTerrainNodeRing)
+	{
+		terrainMode = TERRAIN_MODE_STREAMED;
+	}
+
 
 }
 
@@ -776,13 +1189,13 @@ void Application::Draw()
 	pImmediateContext->ClearRenderTargetView(pRenderTargetView, ClearColor);
 	pImmediateContext->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-	XMMATRIX world = XMLoadFloat4x4(&sphere);
+	XMMATRIX world;
 	XMMATRIX view = XMLoadFloat4x4(pCurrentCamera->GetView());
 	XMMATRIX projection = XMLoadFloat4x4(pCurrentCamera->GetProjection());
 	//
 	// Update variables
 	//
-	ConstantBuffer cb;
+	FrameConstants frame;
 
 	//Wireframe Modes
 
@@ -796,28 +1209,26 @@ void Application::Draw()
 	}
 
 
-	cb.mWorld = XMMatrixTranspose(world);
-	cb.mView = XMMatrixTranspose(view);
-	cb.mProjection = XMMatrixTranspose(projection);
+	frame.mView = XMMatrixTranspose(view);
+	frame.mProjection = XMMatrixTranspose(projection);
 
-	cb.LightVecw = lightDirection;
-	cb.DiffuseLight = diffuseLight;
-	cb.DiffuseMtrl = diffuseMaterial;
-	cb.AmbientLight = ambientLight;
-	cb.AmbientMtrl = ambientMaterial;
-	cb.SpecularLight = specularLight;
-	cb.SpecularMtrl = specularMaterial;
-	cb.SpecularPower = specularPower;
+	frame.LightVecw = lightDirection;
+	frame.DiffuseLight = diffuseLight;
+	frame.AmbientLight = ambientLight;
+	frame.SpecularLight = specularLight;
+	frame.eyePos = pCurrentCamera->GetPosition();
+	frame.Padding = 0.0f;
 
-	cb.gTime = gTime;
+	frame.gTime = gTime;
 
-	// Set vertex buffer
-	UINT stride = sizeof(SimpleVertex);
-	UINT offset = 0;
+	//Objects behind hills are skipped below
+	CullSceneObjects(view, projection);
 
-	pImmediateContext->IASetVertexBuffers(0, 1, &objSphere.VertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(objSphere.IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
+	//Per frame state, shared by the objects and the terrain; materials and objects have their own buffers
+	pImmediateContext->UpdateSubresource(pFrameBuffer, 0, nullptr, &frame, 0, 0);
+	pImmediateContext->VSSetConstantBuffers(0, 1, &pFrameBuffer);
+	pImmediateContext->PSSetConstantBuffers(0, 1, &pFrameBuffer);
+	constantUploadBytes = sizeof(FrameConstants);
 
 	if (isTransparent == false)
 	{
@@ -829,73 +1240,58 @@ void Application::Draw()
 		float blendFactor2[] = { 0.9f, 0.9f, 0.9f, 1.0f };
 		pImmediateContext->OMSetBlendState(Transparency, blendFactor2, 0xffffffff);
 	}
-	//
-	// Renders a triangle
-	//
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureSun);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
+
+	//Objects, sorted by pass, shader, material and depth so state is only bound where it changes
+	SubmitRenderObjects(view);
+	renderQueue.Sort(&renderQueueStats);
+	DrawRenderQueue();
+
+	//Terrain
+	pImmediateContext->IASetInputLayout(pVertexLayout);
 	pImmediateContext->VSSetShader(pVertexShader, nullptr, 0);
-	pImmediateContext->VSSetConstantBuffers(0, 1, &pConstantBuffer);
-	pImmediateContext->PSSetConstantBuffers(0, 1, &pConstantBuffer);
 	pImmediateContext->PSSetShader(pPixelShader, nullptr, 0);
-	pImmediateContext->DrawIndexed(objSphere.IndexCount, 0, 0);
+	BindRenderMaterial(terrainMaterial);
 
+	world = XMLoadFloat4x4(&terrain);
+	SetObjectConstants(world);
 
-	// Pyramid
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureCrate);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
-	pImmediateContext->IASetVertexBuffers(0, 1, &pPyramidVertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(pPyramidIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
+	//Camera frustum in terrain space, tiles are culled against their own bounds
+	BoundingFrustum terrainFrustum(projection);
+	terrainFrustum.Transform(terrainFrustum, XMMatrixInverse(nullptr, world * view));
 
-	world = XMLoadFloat4x4(&pyramid);
-	cb.mWorld = XMMatrixTranspose(world);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
-	pImmediateContext->DrawIndexed(18, 0, 0);
+	if (terrainMode == TERRAIN_MODE_QUADTREE)
+		SelectTerrainNodes(world, view, projection);
+	else if (terrainMode == TERRAIN_MODE_GEOMIPMAP)
+		SelectTerrainLods(world, projection);
+	else if (terrainMode == TERRAIN_MODE_STREAMED)
+		pStreamedTerrain->Update(pImmediateContext, GetTerrainCameraPosition(world));
 
-	//Cube
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureCrate);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
-	pImmediateContext->IASetVertexBuffers(0, 1, &pCubeVertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(pCubeIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	//Grid, camera and height range, the same for every node and tile of the frame (streamed tiles write their own)
+	if (terrainMode == TERRAIN_MODE_QUADTREE || terrainMode == TERRAIN_MODE_HEIGHTS)
+	{
+		pImmediateContext->UpdateSubresource(pTerrainBuffer, 0, nullptr, &terrainConstants, 0, 0);
+		constantUploadBytes += sizeof(terrainConstants);
+	}
 
-	world = XMLoadFloat4x4(&cube);
-	cb.mWorld = XMMatrixTranspose(world);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
-	pImmediateContext->DrawIndexed(36, 0, 0);
-
-	// Hercules Plane
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureHercules);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
-	pImmediateContext->IASetVertexBuffers(0, 1, &objPlane.VertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(objPlane.IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-
-	world = XMLoadFloat4x4(&hercules);
-	cb.mWorld = XMMatrixTranspose(world);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
-	pImmediateContext->DrawIndexed(objPlane.IndexCount, 0, 0);
-
-	//Car
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureCrate);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
-	pImmediateContext->IASetVertexBuffers(0, 1, &objCar.VertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(objCar.IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-
-	world = XMLoadFloat4x4(&car);
-	cb.mWorld = XMMatrixTranspose(world);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
-	pImmediateContext->DrawIndexed(objCar.IndexCount, 0, 0);
+	if (pTerrainVirtualTexture)
+	{
+		//Pages requested by earlier frames' feedback are uploaded before either pass samples them
+		pTerrainVirtualTexture->Update(pImmediateContext);
 
-	//Terrain
-	pImmediateContext->PSSetShaderResources(0, 1, &pTextureMud);
-	pImmediateContext->PSSetSamplers(0, 1, &pSamplerState);
-	pImmediateContext->IASetVertexBuffers(0, 1, &pgridVertexBuffer, &stride, &offset);
-	pImmediateContext->IASetIndexBuffer(pgridIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		pTerrainVirtualTexture->BeginFeedback(pImmediateContext);
+		pImmediateContext->PSSetShader(pVirtualTextureFeedbackShader, nullptr, 0);
+		DrawTerrain(terrainFrustum);
+		pTerrainVirtualTexture->EndFeedback(pImmediateContext);
 
-	world = XMLoadFloat4x4(&terrain);
-	cb.mWorld = XMMatrixTranspose(world);
-	pImmediateContext->UpdateSubresource(pConstantBuffer, 0, nullptr, &cb, 0, 0);
-	pImmediateContext->DrawIndexed(totalFaces, 0, 0);
+		pImmediateContext->PSSetShader(pVirtualTexturePixelShader, nullptr, 0);
+	}
+	DrawTerrain(terrainFrustum);
+
+	//Grass and rocks, placed in terrain space so drawn with the terrain's world matrix
+	if (isScatterVisible)
+		DrawTerrainScatter(world, view, projection);
+
+	ReportFrameStats();
 
 	// Present our back buffer to our front buffer
 	//
@@ -906,152 +1302,1328 @@ HRESULT Application::CreateTerrain(char* filename)
 {
 	HRESULT hr;
 
-	//Bitmap Loading
+	// Build parameters, every one of them is part of the cache key
+	TerrainHeightFieldDesc heightFieldDesc = { 1.0f, 1.0f, 1.0f };
+	TerrainNormalDesc normalDesc = { 1.0f, 1.0f, 1.0f };
+	TerrainTileDesc tileDesc = { TERRAIN_TILE_QUADS, 1.0f, 1.0f, 1.0f };
+
+#if TERRAIN_PROCEDURAL
+	//Procedural Heights (ridged noise, the same seed always gives the same terrain)
+
+	//Same size and height range as the heightmap it replaces
+	ProceduralTerrainDesc proceduralDesc = { PROCEDURAL_RIDGED, 1337, 6, 1.0f / 96.0f, 2.0f, 0.5f, 0.0f, 25.5f, 0.0f };
+	const UINT proceduralSize = 225;
+
+	//The settings are the source, there is no file to hash
+	const char* cacheFile = "TerrainProcedural.cache";
+	const double sourceParameters[] = { (double)proceduralDesc.noise, (double)proceduralDesc.seed, (double)proceduralDesc.octaves, proceduralDesc.frequency, proceduralDesc.lacunarity,
+		proceduralDesc.gain, proceduralDesc.warpStrength, proceduralDesc.heightScale, proceduralDesc.heightOffset, (double)proceduralSize };
+	TerrainCacheKey cacheKey = { HashTerrainBytes(sourceParameters, sizeof(sourceParameters)), 0 };
+#else
+	//Heightmap Loading (BMP, 16-bit PGM or RAW16, memory mapped)
+
+	//Full scale is 25.5 units, which keeps 8-bit maps at their old byte / 10 heights
+	HeightmapLoadDesc heightmapDesc = { HEIGHTMAP_UNKNOWN, 0, 0, false, 25.5f, 0.0f };
+
+	//The cache sits next to the heightmap and is keyed by its contents, not its name or date
+	std::string cacheName = std::string(filename) + ".cache";
+	const char* cacheFile = cacheName.c_str();
+	const double sourceParameters[] = { (double)heightmapDesc.format, (double)heightmapDesc.rawWidth, (double)heightmapDesc.rawDepth, (double)heightmapDesc.rawBigEndian,
+		heightmapDesc.heightScale, heightmapDesc.heightOffset };
+	TerrainCacheKey cacheKey = { 0, 0 };
+	if (!HashTerrainFile(filename, &cacheKey.sourceHash))
+		return E_FAIL;
+#endif
+	const double buildParameters[] = { heightFieldDesc.spacingX, heightFieldDesc.spacingZ, heightFieldDesc.heightScale, normalDesc.spacingX, normalDesc.spacingZ, normalDesc.heightScale,
+		(double)tileDesc.tileQuads, tileDesc.spacingX, tileDesc.spacingZ, tileDesc.heightScale, (double)TERRAIN_TILE_STRIPS, (double)sizeof(TerrainTileVertex), (double)sizeof(TerrainTile) };
+	cacheKey.buildHash = HashTerrainBytes(buildParameters, sizeof(buildParameters), HashTerrainBytes(sourceParameters, sizeof(sourceParameters)));
 
-	FILE* fileptr;
-	BITMAPFILEHEADER bitmapFileHeader;
-	BITMAPINFOHEADER bitmapInfoHeader;
+	// Build Cache (heights, normals, tiles, indices and the min-max pyramid, mapped in place of the build on later runs)
+	TerrainCache cache;
+	std::vector<TerrainTileVertex> tileVertices;
+	std::vector<uint16_t> indices;
+	const TerrainTileVertex* tileVertexData = nullptr;
 
-	int imageSize, index;
-	unsigned char height;
+	if (LoadTerrainCache(cache, cacheFile, cacheKey, heightFieldDesc, indices))
+	{
+		tileVertexData = (const TerrainTileVertex*)cache.GetSection(TERRAIN_CACHE_TILE_VERTICES);
+	}
+	else
+	{
+#if TERRAIN_PROCEDURAL
+		terrainWidth = proceduralSize;
+		terrainHeight = proceduralSize;
+		if (!GenerateProceduralHeights(proceduralDesc, 0, 0, terrainWidth, terrainHeight, terrainHeights))
+			return E_FAIL;
+#else
+		HeightmapInfo heightmapInfo;
+		if (!LoadHeightmap(filename, heightmapDesc, terrainHeights, &heightmapInfo))
+			return E_FAIL;
+
+		terrainWidth = (UINT)heightmapInfo.width;
+		terrainHeight = (UINT)heightmapInfo.depth;
+#endif
 
-	//Open The File
-	fileptr = fopen(filename, "rb");
+		// Height, normal and ray queries (the car's ground height)
+		if (!terrainHeightField.Build(terrainHeights.data(), terrainWidth, terrainHeight, heightFieldDesc))
+			return E_FAIL;
 
-	// Read the size of the bitmap
-	fread(&bitmapFileHeader, sizeof(BITMAPFILEHEADER), 1, fileptr);
-	fread(&bitmapInfoHeader, sizeof(BITMAPINFOHEADER), 1, fileptr);
+		// Tile Generation
 
-	//Set the terrain width and height the size of the image loading in.
-	terrainWidth = bitmapInfoHeader.biWidth;
-	terrainHeight = bitmapInfoHeader.biHeight;
+		// Normals from the height slopes, same spacing and scale as the tiles
+		terrainNormals.resize(terrainHeights.size() * 3);
+		if (!ComputeTerrainNormals(terrainHeights.data(), terrainWidth, terrainHeight, normalDesc, terrainNormals.data()))
+			return E_FAIL;
 
-	imageSize = terrainHeight * ((terrainWidth * 3) + 1);
+		if (!BuildTerrainTiles(terrainHeights.data(), terrainNormals.data(), terrainWidth, terrainHeight, tileDesc, tileVertices, terrainTiles))
+			return E_FAIL;
 
-	//Creating an array to create memory for the bitmap image data.
-	unsigned char* bitmapImage = new unsigned char[imageSize];
+#if TERRAIN_TILE_STRIPS
+		BuildTerrainTileStripIndices(TERRAIN_TILE_QUADS, TERRAIN_TILE_STRIPS == 1 ? TERRAIN_STRIP_RESTART : TERRAIN_STRIP_DEGENERATE, indices);
+#else
+		BuildTerrainTileIndices(TERRAIN_TILE_QUADS, indices);
+#endif
 
-	//Moving to the beginning of the bitmap data.
-	fseek(fileptr, bitmapFileHeader.bfOffBits, SEEK_SET);
+		// Saved for the next run, which only costs that run a rebuild if it fails
+		std::vector<float> pyramid(terrainHeightField.GetPyramidSize());
+		terrainHeightField.GetPyramid(pyramid.data());
 
-	//Reading the bitmap data
-	fread(bitmapImage, 1, imageSize, fileptr);
+		TerrainCacheSection sections[TERRAIN_CACHE_SECTION_COUNT] =
+		{
+			{ terrainHeights.data(), sizeof(float) * terrainHeights.size() },
+			{ terrainNormals.data(), sizeof(float) * terrainNormals.size() },
+			{ tileVertices.data(), sizeof(TerrainTileVertex) * tileVertices.size() },
+			{ terrainTiles.data(), sizeof(TerrainTile) * terrainTiles.size() },
+			{ indices.data(), sizeof(uint16_t) * indices.size() },
+			{ pyramid.data(), sizeof(float) * pyramid.size() },
+		};
+		WriteTerrainCache(cacheFile, cacheKey, terrainWidth, terrainHeight, sections);
+
+		tileVertexData = tileVertices.data();
+	}
+	const std::vector<float>& heights = terrainHeights;
 
-	fclose(fileptr);
+	// Edited in place from now on, see UpdateTerrainEdits
+	TerrainEditDesc editDesc = { 1.0f, 1.0f, 1.0f };
+	terrainEditor.Attach(terrainHeights.data(), terrainWidth, terrainHeight, editDesc);
 
-	heightMap = new XMFLOAT3[terrainWidth * terrainHeight];
+	// Horizon culling from the same min-max pyramid, blocks of 8x8 quads against 256 screen columns
+	TerrainHorizonDesc horizonDesc = { 256, 8 };
+	terrainHorizon.Build(terrainHeightField, horizonDesc);
 
-	int p = 0;
+#if TERRAIN_TILE_STRIPS
+	terrainTileTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+#else
+	terrainTileTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+#endif
+	terrainTileIndexCount = (UINT)indices.size();
+
+	// Index count and vertex cache misses of the chosen layout, for a 32 entry post-transform cache
+	AnalyseTerrainIndices(indices.data(), indices.size(), TERRAIN_TILE_STRIPS != 0, 32, terrainTileIndexStats);
+
+	char indexReport[192];
+	sprintf_s(indexReport, "Terrain tile %s: %zu indices, %zu triangles, %zu cache misses (ACMR %.3f, ATVR %.3f)\n",
+		TERRAIN_TILE_STRIPS ? "strips" : "list", terrainTileIndexStats.indexCount, terrainTileIndexStats.triangleCount,
+		terrainTileIndexStats.cacheMisses, terrainTileIndexStats.missesPerTriangle, terrainTileIndexStats.missesPerVertex);
+	OutputDebugStringA(indexReport);
+
+	// Vertex Buffers, several tiles each so no single buffer gets too large
+	//Tile vertices are drawn through the SimpleVertex input layout and stride
+	static_assert(sizeof(TerrainTileVertex) == sizeof(SimpleVertex), "TerrainTileVertex must match SimpleVertex");
+	size_t tileVertexCount = TerrainTileVertexCount(TERRAIN_TILE_QUADS);
+	for (size_t first = 0; first < terrainTiles.size(); first += TERRAIN_TILES_PER_BUFFER)
+	{
+		size_t tileCount = min(terrainTiles.size() - first, (size_t)TERRAIN_TILES_PER_BUFFER);
 
-	float heightFactor = 10.0f;
+		D3D11_BUFFER_DESC bd;
+		ZeroMemory(&bd, sizeof(bd));
+		bd.Usage = D3D11_USAGE_DEFAULT;
+		bd.ByteWidth = (UINT)(sizeof(TerrainTileVertex) * tileVertexCount * tileCount);
+		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		bd.CPUAccessFlags = 0;
 
-	for (int j = 0; j < terrainHeight; j++)
-	{
-		for (int i = 0; i < terrainWidth; i++)
-		{
-			index = (terrainWidth * (terrainHeight - 1 - j)) + i;
+		D3D11_SUBRESOURCE_DATA InitData;
+		ZeroMemory(&InitData, sizeof(InitData));
+		InitData.pSysMem = &tileVertexData[terrainTiles[first].firstVertex];
 
-			height = bitmapImage[p];
+		ID3D11Buffer* vertexBuffer = nullptr;
+		hr = pd3dDevice->CreateBuffer(&bd, &InitData, &vertexBuffer);
 
-			heightMap[index].y = (float)height / heightFactor;
+		if (FAILED(hr))
+			return hr;
 
-			p += 3;
-		}
-		p++;
+		terrainVertexBuffers.push_back(vertexBuffer);
 	}
 
-	delete[] bitmapImage;
-	bitmapImage = 0;
+	// CDLOD quadtree over the same heights, the tiles stay as the fallback
+	if (SUCCEEDED(InitTerrainQuadtree(heights)) && pTerrainVertexShader)
+		terrainMode = TERRAIN_MODE_QUADTREE;
+
+	// Geomipmapping over the tiles, selectable with G
+	InitTerrainGeomipmap(heights);
+
+	// Adaptive triangulation of the tiles, selectable with K
+	InitTerrainRtin(heights);
+
+	// Height-only copy of the tiles, selectable with H
+	InitTerrainHeights(heights);
+
+	// Streamed from disk a tile at a time, selectable with J
+	InitStreamedTerrain(heights);
+
+	// Grass and rocks over the height field, shown with F and hidden with V
+	InitTerrainScatter();
+
+	// Crates over the height field drawn with instancing, shown with I and hidden with U
+	InitRenderProps();
+
+	// Index Buffer, shared by every tile
+	D3D11_BUFFER_DESC bd2;
+	ZeroMemory(&bd2, sizeof(bd2));
+
+	bd2.Usage = D3D11_USAGE_DEFAULT;
+	bd2.ByteWidth = sizeof(WORD) * indices.size();
+	bd2.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bd2.CPUAccessFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA InitData2;
+	ZeroMemory(&InitData2, sizeof(InitData2));
+	InitData2.pSysMem = &indices[0];
+	hr = pd3dDevice->CreateBuffer(&bd2, &InitData2, &pgridIndexBuffer);
+
+	if (FAILED(hr))
+		return hr;
 
-	// Grid Generation
 
-	rows = terrainWidth;
-	columns = terrainHeight;
+	return hr;
+}
 
-	depth = columns;
-	width = rows;
+bool Application::LoadTerrainCache(TerrainCache& cache, const char* fileName, const TerrainCacheKey& key, const TerrainHeightFieldDesc& heightFieldDesc, std::vector<uint16_t>& indices)
+{
+	if (!cache.Open(fileName, key))
+		return false;
+
+	//The key says what was built, the sizes still have to agree with each other before anything is used
+	size_t width = cache.GetWidth();
+	size_t depth = cache.GetDepth();
+	size_t heightBytes, normalBytes, vertexBytes, tileBytes, indexBytes, pyramidBytes;
+	const float* heights = (const float*)cache.GetSection(TERRAIN_CACHE_HEIGHTS, &heightBytes);
+	const float* normals = (const float*)cache.GetSection(TERRAIN_CACHE_NORMALS, &normalBytes);
+	cache.GetSection(TERRAIN_CACHE_TILE_VERTICES, &vertexBytes);
+	const TerrainTile* tiles = (const TerrainTile*)cache.GetSection(TERRAIN_CACHE_TILES, &tileBytes);
+	const uint16_t* cachedIndices = (const uint16_t*)cache.GetSection(TERRAIN_CACHE_INDICES, &indexBytes);
+	const float* pyramid = (const float*)cache.GetSection(TERRAIN_CACHE_PYRAMID, &pyramidBytes);
+
+	size_t tileCount = tileBytes / sizeof(TerrainTile);
+	bool valid = width >= 2 && depth >= 2 && width <= UINT_MAX && depth <= UINT_MAX
+		&& heightBytes == sizeof(float) * width * depth
+		&& normalBytes == heightBytes * 3
+		&& tileCount > 0 && tileBytes == sizeof(TerrainTile) * tileCount
+		&& vertexBytes == sizeof(TerrainTileVertex) * tileCount * TerrainTileVertexCount(TERRAIN_TILE_QUADS)
+		&& indexBytes > 0 && indexBytes % sizeof(uint16_t) == 0
+		&& pyramidBytes % sizeof(float) == 0;
+
+	if (valid)
+	{
+		//The height field keeps a pointer to the heights, so it is built over the copy
+		terrainHeights.assign(heights, heights + width * depth);
+		valid = terrainHeightField.BuildFromPyramid(terrainHeights.data(), width, depth, heightFieldDesc, pyramid, pyramidBytes / sizeof(float));
+	}
 
-	rows = rows - 1;
-	columns = columns - 1;
-	totalCells = (rows - 1) * (columns - 1);
-	totalFaces = (rows - 1) * (columns - 1) * 2 * 6;
-	totalVertices = rows * columns;
+	if (!valid)
+	{
+		cache.Close();
+		return false;
+	}
 
-	dx = width / (columns - 1);
-	dz = depth / (rows - 1);
+	//Tile vertices stay in the mapping and are uploaded straight from it
+	terrainWidth = (UINT)width;
+	terrainHeight = (UINT)depth;
+	terrainNormals.assign(normals, normals + width * depth * 3);
+	terrainTiles.assign(tiles, tiles + tileCount);
+	indices.assign(cachedIndices, cachedIndices + indexBytes / sizeof(uint16_t));
+	return true;
+}
 
-	du = 1.0f / (columns - 1);
-	dv = 1.0f / (rows - 1);
+void Application::DrawTerrainTiles(const BoundingFrustum& frustum)
+{
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	UINT tileVertexCount = (UINT)TerrainTileVertexCount(TERRAIN_TILE_QUADS);
+	size_t boundBuffer = terrainVertexBuffers.size();
 
-	std::vector<SimpleVertex> v(totalVertices);
+	pImmediateContext->IASetIndexBuffer(pgridIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pImmediateContext->IASetPrimitiveTopology(terrainTileTopology);
 
-	// Vertex Generation
-	for (int i = 0; i < rows; i++)
+	for (size_t i = 0; i < terrainTiles.size(); ++i)
 	{
-		for (int j = 0; j < columns; j++)
-		{
-			v[i * columns + j].Pos = XMFLOAT3((-0.5 * width) + (float)j * dx, heightMap[i*columns+j].y, (0.5 * depth) - (float)i * dz);
-			v[i * columns + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-		
-			v[i * columns + j].TexC.x = j * du;
-			v[i * columns + j].TexC.y = i * dv;
+		const TerrainTile& tile = terrainTiles[i];
+
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, XMLoadFloat3((const XMFLOAT3*)tile.boundsMin), XMLoadFloat3((const XMFLOAT3*)tile.boundsMax));
+		if (frustum.Contains(bounds) == DISJOINT)
+			continue;
 
+		size_t buffer = i / TERRAIN_TILES_PER_BUFFER;
+		if (buffer != boundBuffer)
+		{
+			pImmediateContext->IASetVertexBuffers(0, 1, &terrainVertexBuffers[buffer], &stride, &offset);
+			boundBuffer = buffer;
 		}
+
+		pImmediateContext->DrawIndexed(terrainTileIndexCount, 0, (INT)((i % TERRAIN_TILES_PER_BUFFER) * tileVertexCount));
 	}
 
-	std::vector<WORD> indices(totalFaces * 3);
+	pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+HRESULT Application::InitTerrainQuadtree(const std::vector<float>& heights)
+{
+	HRESULT hr;
+
+	// Enough levels for the top one to cover the whole heightmap in a node or two
+	size_t lodCount = 1;
+	while ((TERRAIN_PATCH_QUADS << (lodCount - 1)) < max(terrainWidth, terrainHeight) - 1 && lodCount < 16)
+		lodCount++;
+
+	// Each level is drawn out to 3 node widths before the next coarser one takes over
+	TerrainQuadtreeDesc quadtreeDesc = { TERRAIN_PATCH_QUADS, lodCount, 1.0f, 1.0f, 1.0f, TERRAIN_PATCH_QUADS * 3.0f, 0.7f };
+	if (!terrainQuadtree.Build(heights.data(), terrainWidth, terrainHeight, quadtreeDesc))
+		return E_FAIL;
 
-	int k = 0;
-	// Index Generation
-	for (UINT i = 0; i < rows - 1; i++)
+	// Patch mesh, vertex positions are patch grid coordinates
+	UINT patchVertices = TERRAIN_PATCH_QUADS + 1;
+	std::vector<SimpleVertex> patch(patchVertices * patchVertices);
+	for (UINT i = 0; i < patchVertices; i++)
 	{
-		for (UINT j = 0; j < columns -1; j++)
+		for (UINT j = 0; j < patchVertices; j++)
 		{
-			indices[k] = i * columns + j;		
-			indices[k + 1] = i * columns + j + 1;
-			indices[k + 2] = (i + 1)* columns + j;	
-			indices[k + 3] = (i + 1) * columns + j;
-			indices[k + 4] = i * columns + j + 1;
-			indices[k + 5] = (i + 1) * columns + j + 1;
-			
-			k += 6;
+			patch[i * patchVertices + j].Pos = XMFLOAT3((float)j, 0.0f, (float)i);
+			patch[i * patchVertices + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			patch[i * patchVertices + j].TexC = XMFLOAT2(0.0f, 0.0f);
 		}
-
 	}
 
-	// Vertex Buffer
+	std::vector<uint16_t> patchIndices;
+	BuildTerrainTileIndices(TERRAIN_PATCH_QUADS, patchIndices);
+	terrainPatchIndexCount = (UINT)patchIndices.size();
+
 	D3D11_BUFFER_DESC bd;
 	ZeroMemory(&bd, sizeof(bd));
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex) * v.size();
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(SimpleVertex) * patch.size());
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = 0;
 
 	D3D11_SUBRESOURCE_DATA InitData;
 	ZeroMemory(&InitData, sizeof(InitData));
-	InitData.pSysMem = &v[0];
-	hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pgridVertexBuffer);
+	InitData.pSysMem = patch.data();
+	hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pTerrainPatchVertexBuffer);
+	if (FAILED(hr))
+		return hr;
 
+	bd.ByteWidth = (UINT)(sizeof(WORD) * patchIndices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	InitData.pSysMem = patchIndices.data();
+	hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pTerrainPatchIndexBuffer);
 	if (FAILED(hr))
 		return hr;
 
-	// Index Buffer
-	D3D11_BUFFER_DESC bd2;
-	ZeroMemory(&bd2, sizeof(bd2));
+	// Heights for VS_Terrain, one texel per sample
+	D3D11_TEXTURE2D_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = terrainWidth;
+	texDesc.Height = terrainHeight;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA texData;
+	ZeroMemory(&texData, sizeof(texData));
+	texData.pSysMem = heights.data();
+	texData.SysMemPitch = terrainWidth * sizeof(float);
+
+	ID3D11Texture2D* heightTexture = nullptr;
+	hr = pd3dDevice->CreateTexture2D(&texDesc, &texData, &heightTexture);
+	if (FAILED(hr))
+		return hr;
 
-	bd2.Usage = D3D11_USAGE_DEFAULT;
-	bd2.ByteWidth = sizeof(WORD) * indices.size();
-	bd2.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd2.CPUAccessFlags = 0;
+	hr = pd3dDevice->CreateShaderResourceView(heightTexture, nullptr, &pTerrainHeights);
+	heightTexture->Release();
+	if (FAILED(hr))
+		return hr;
 
-	D3D11_SUBRESOURCE_DATA InitData2;
-	ZeroMemory(&InitData2, sizeof(InitData2));
-	InitData2.pSysMem = &indices[0];
-	hr = pd3dDevice->CreateBuffer(&bd2, &InitData2, &pgridIndexBuffer);
+	// Grid, camera and height range, written once a frame
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(TerrainConstants);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &pTerrainBuffer);
+	if (FAILED(hr))
+		return hr;
 
+	// Placement of each node, a slice of the ring per draw; the height-only and streamed tiles use it too
+	pTerrainNodeRing = new ConstantRing();
+	hr = pTerrainNodeRing->Initialise(pd3dDevice, pImmediateContext, sizeof(TerrainNodeConstants), 1024);
 	if (FAILED(hr))
+	{
+		delete pTerrainNodeRing;
+		pTerrainNodeRing = nullptr;
 		return hr;
+	}
 
+	// Same placement as BuildTerrainTiles
+	float lastColumn = (float)(terrainWidth - 1);
+	float lastRow = (float)(terrainHeight - 1);
+	ZeroMemory(&terrainConstants, sizeof(terrainConstants));
+	terrainConstants.TerrainGrid = XMFLOAT4(-0.5f * lastColumn, 0.5f * lastRow, 1.0f, 1.0f);
+	terrainConstants.TerrainSize = XMFLOAT4(lastColumn, lastRow, 1.0f / lastColumn, 1.0f / lastRow);
 
-	return hr;
+	return S_OK;
+}
+
+HRESULT Application::InitTerrainGeomipmap(const std::vector<float>& heights)
+{
+	// Same patches as the tiles so their vertex buffers are reused as they are
+	TerrainGeomipmapDesc geomipmapDesc = { TERRAIN_TILE_QUADS, 1.0f, 1.0f, 1.0f };
+	if (!terrainGeomipmap.Build(heights.data(), terrainWidth, terrainHeight, geomipmapDesc))
+		return E_FAIL;
+
+	const std::vector<uint16_t>& lodIndices = terrainGeomipmap.GetIndices();
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(WORD) * lodIndices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = lodIndices.data();
+
+	return pd3dDevice->CreateBuffer(&bd, &InitData, &pTerrainLodIndexBuffer);
+}
+
+HRESULT Application::InitTerrainRtin(const std::vector<float>& heights)
+{
+	// Same tiles as the vertex buffers, so only the indices differ
+	TerrainRtinDesc rtinDesc = { TERRAIN_TILE_QUADS, 1.0f };
+	if (!terrainRtin.Build(heights.data(), terrainWidth, terrainHeight, rtinDesc))
+		return E_FAIL;
+
+	std::vector<uint16_t> rtinIndices;
+	if (!terrainRtin.BuildIndices(terrainRtinError, rtinIndices, terrainRtinRanges, &terrainRtinStats) || rtinIndices.empty())
+		return E_FAIL;
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(WORD) * rtinIndices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = rtinIndices.data();
+
+	return pd3dDevice->CreateBuffer(&bd, &InitData, &pTerrainRtinIndexBuffer);
+}
+
+HRESULT Application::InitTerrainHeights(const std::vector<float>& heights)
+{
+	TerrainTileDesc tileDesc = { TERRAIN_TILE_QUADS, 1.0f, 1.0f, 1.0f };
+	std::vector<uint16_t> samples;
+	float heightOffset, heightRange;
+	if (!BuildTerrainTileHeights(heights.data(), terrainWidth, terrainHeight, tileDesc, samples, heightOffset, heightRange))
+		return E_FAIL;
+
+	//Patched in place when the terrain is edited
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = (UINT)(sizeof(uint16_t) * samples.size());
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = samples.data();
+
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pTerrainHeightBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	terrainConstants.HeightParams = XMFLOAT4(heightOffset, heightRange, 0.0f, 0.0f);
+	return S_OK;
+}
+
+HRESULT Application::InitStreamedTerrain(const std::vector<float>& heights)
+{
+	//Tiled copy of the heightmap, written next to it on the first run. Larger worlds are written
+	//the same way from rows read a band at a time and never need to fit in memory.
+#if TERRAIN_PROCEDURAL
+	const char* streamFile = "TerrainProcedural.tst";
+#else
+	const char* streamFile = "Terrain.tst";
+#endif
+
+	TerrainStreamLayout layout;
+	if (!ReadTerrainStreamLayout(streamFile, layout) || layout.width != terrainWidth || layout.depth != terrainHeight)
+	{
+		TerrainStreamDesc streamDesc = { TERRAIN_TILE_QUADS, 1.0f, 1.0f, 0.0f, 0.0f };
+		if (!BuildTerrainStreamFile(streamFile, heights.data(), terrainWidth, terrainHeight, streamDesc))
+			return E_FAIL;
+	}
+
+	//16MB of resident heights, tiles are split within two tile widths of the camera
+	pStreamedTerrain = new StreamedTerrain();
+	HRESULT hr = pStreamedTerrain->Initialise(pd3dDevice, pImmediateContext, streamFile, 16 << 20, 2.0f);
+	if (FAILED(hr))
+	{
+		delete pStreamedTerrain;
+		pStreamedTerrain = nullptr;
+		return hr;
+	}
+
+	return S_OK;
+}
+
+HRESULT Application::InitTerrainScatter()
+{
+	HRESULT hr;
+
+	if (!pFoliageVertexShader || !pFoliagePixelShader || !pFoliageLayout)
+		return E_FAIL;
+
+	//Grass on the gentler slopes below the peaks, rocks on the steeper ones at any height (1e30 is no limit)
+	TerrainScatterDesc scatterDesc = { 16.0f, 1337 };
+	TerrainScatterLayerDesc layerDescs[SCATTER_LAYER_COUNT] =
+	{
+		{ 0.35f, 0.9f, -1e30f, 18.0f, 3.0f, 0.7f, 1.0f, 0.05f, 0.7f, 1.3f, 0.6f, 60.0f },
+		{ 2.5f, 0.35f, -1e30f, 1e30f, 0.0f, 0.55f, 0.95f, 0.05f, 0.3f, 0.9f, 1.1f, 150.0f },
+	};
+	if (!terrainScatter.Build(terrainHeightField, scatterDesc, layerDescs, SCATTER_LAYER_COUNT, &terrainScatterBuildStats))
+		return E_FAIL;
+
+	//Instances are updated in place when the ground under them is edited
+	for (UINT layer = 0; layer < SCATTER_LAYER_COUNT; ++layer)
+	{
+		if (!terrainScatter.GetInstanceCount(layer))
+			continue;
+
+		D3D11_BUFFER_DESC bd;
+		ZeroMemory(&bd, sizeof(bd));
+		bd.Usage = D3D11_USAGE_DEFAULT;
+		bd.ByteWidth = (UINT)(sizeof(TerrainScatterInstance) * terrainScatter.GetInstanceCount(layer));
+		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+		D3D11_SUBRESOURCE_DATA InitData;
+		ZeroMemory(&InitData, sizeof(InitData));
+		InitData.pSysMem = terrainScatter.GetInstances(layer);
+
+		hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pScatterInstanceBuffers[layer]);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(FoliageConstants);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &pFoliageBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	//Green grass darkening towards its roots and swaying, grey rocks that stay still
+	scatterConstants[SCATTER_LAYER_GRASS].FoliageColour = XMFLOAT4(0.35f, 0.55f, 0.18f, 1.0f);
+	scatterConstants[SCATTER_LAYER_GRASS].FoliageParams = XMFLOAT4(0.75f, 1.15f, 0.08f, 0.5f);
+	scatterConstants[SCATTER_LAYER_ROCKS].FoliageColour = XMFLOAT4(0.45f, 0.43f, 0.4f, 1.0f);
+	scatterConstants[SCATTER_LAYER_ROCKS].FoliageParams = XMFLOAT4(0.7f, 1.1f, 0.0f, 0.0f);
+
+	return InitScatterMeshes();
+}
+
+HRESULT Application::InitScatterMeshes()
+{
+	HRESULT hr;
+
+	std::vector<SimpleVertex> vertices;
+	std::vector<WORD> indices;
+
+	//Grass tuft, thin blades leaning out from the middle, each drawn from both sides
+	const UINT grassBlades = 7;
+	scatterMeshFirstIndex[SCATTER_LAYER_GRASS] = (UINT)indices.size();
+	scatterMeshBaseVertex[SCATTER_LAYER_GRASS] = (INT)vertices.size();
+	for (UINT i = 0; i < grassBlades; ++i)
+	{
+		float angle = 2.39996f * i;
+		float outX = cos(angle), outZ = sin(angle);
+		float baseRadius = 0.05f + 0.03f * (i % 3);
+		float height = 0.35f + 0.05f * (i % 4);
+		float halfWidth = 0.025f;
+
+		XMFLOAT3 base(outX * baseRadius, 0.0f, outZ * baseRadius);
+		XMFLOAT3 normal;
+		XMStoreFloat3(&normal, XMVector3Normalize(XMVectorSet(outX, 0.6f, outZ, 0.0f)));
+
+		WORD first = (WORD)vertices.size();
+		SimpleVertex blade[3] =
+		{
+			{ XMFLOAT3(base.x + outZ * halfWidth, 0.0f, base.z - outX * halfWidth), normal, XMFLOAT2(0.0f, 1.0f) },
+			{ XMFLOAT3(base.x - outZ * halfWidth, 0.0f, base.z + outX * halfWidth), normal, XMFLOAT2(1.0f, 1.0f) },
+			{ XMFLOAT3(base.x + outX * 0.12f, height, base.z + outZ * 0.12f), normal, XMFLOAT2(0.5f, 0.0f) },
+		};
+		vertices.insert(vertices.end(), blade, blade + 3);
+
+		WORD bladeIndices[6] = { first, (WORD)(first + 2), (WORD)(first + 1), (WORD)(first + 1), (WORD)(first + 2), first };
+		indices.insert(indices.end(), bladeIndices, bladeIndices + 6);
+	}
+	scatterMeshIndexCount[SCATTER_LAYER_GRASS] = (UINT)indices.size() - scatterMeshFirstIndex[SCATTER_LAYER_GRASS];
+
+	//Rock, an uneven double pyramid sitting partly below the ground
+	const UINT rockSides = 6;
+	const float rockRadii[rockSides] = { 1.0f, 0.8f, 0.95f, 0.75f, 0.9f, 0.85f };
+	scatterMeshFirstIndex[SCATTER_LAYER_ROCKS] = (UINT)indices.size();
+	scatterMeshBaseVertex[SCATTER_LAYER_ROCKS] = (INT)vertices.size();
+	size_t rockFirstVertex = vertices.size();
+	for (UINT i = 0; i < rockSides + 2; ++i)
+	{
+		SimpleVertex vertex;
+		if (i < rockSides)
+		{
+			float angle = XM_2PI * i / rockSides;
+			vertex.Pos = XMFLOAT3(cos(angle) * rockRadii[i], 0.2f, sin(angle) * rockRadii[i]);
+		}
+		else
+		{
+			vertex.Pos = i == rockSides ? XMFLOAT3(0.1f, 0.65f, -0.05f) : XMFLOAT3(0.0f, -0.45f, 0.0f);
+		}
+
+		XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&vertex.Pos), XMVectorSet(0.0f, 0.1f, 0.0f, 0.0f))));
+		vertex.TexC = XMFLOAT2(0.0f, 0.0f);
+		vertices.push_back(vertex);
+	}
+	for (UINT i = 0; i < rockSides; ++i)
+	{
+		WORD next = (WORD)((i + 1) % rockSides);
+		WORD rockIndices[6] = { (WORD)rockSides, next, (WORD)i, (WORD)(rockSides + 1), (WORD)i, next };
+		indices.insert(indices.end(), rockIndices, rockIndices + 6);
+	}
+	scatterMeshIndexCount[SCATTER_LAYER_ROCKS] = (UINT)indices.size() - scatterMeshFirstIndex[SCATTER_LAYER_ROCKS];
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(SimpleVertex) * vertices.size());
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = vertices.data();
+	hr = pd3dDevice->CreateBuffer(&bd, &InitData, &pScatterMeshVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = (UINT)(sizeof(WORD) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	InitData.pSysMem = indices.data();
+	return pd3dDevice->CreateBuffer(&bd, &InitData, &pScatterMeshIndexBuffer);
+}
+
+XMFLOAT3 Application::GetTerrainCameraPosition(const XMMATRIX& world)
+{
+	XMFLOAT3 eye = pCurrentCamera->GetPosition();
+	XMFLOAT3 camera;
+	XMStoreFloat3(&camera, XMVector3TransformCoord(XMLoadFloat3(&eye), XMMatrixInverse(nullptr, world)));
+	return camera;
+}
+
+void Application::CullSceneObjects(const XMMATRIX& view, const XMMATRIX& projection)
+{
+	sceneObjectOccluded.assign(SCENE_OBJECT_COUNT, 0);
+	if (!isHorizonCulling)
+		return;
+
+	//Object bounds go into terrain space, where the horizon is built
+	XMMATRIX terrainWorld = XMLoadFloat4x4(&terrain);
+	XMMATRIX toTerrain = XMMatrixInverse(nullptr, terrainWorld);
+	const BoundingBox* localBounds[SCENE_OBJECT_COUNT] = { &objSphere.Bounds, &pyramidBounds, &cubeBounds, &objPlane.Bounds, &objCar.Bounds };
+	const XMFLOAT4X4* worlds[SCENE_OBJECT_COUNT] = { &sphere, &pyramid, &cube, &hercules, &car };
+
+	sceneObjectBounds.resize(SCENE_OBJECT_COUNT);
+	for (int i = 0; i < SCENE_OBJECT_COUNT; ++i)
+	{
+		BoundingBox bounds;
+		localBounds[i]->Transform(bounds, XMLoadFloat4x4(worlds[i]) * toTerrain);
+		XMStoreFloat3((XMFLOAT3*)sceneObjectBounds[i].boundsMin, XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&bounds.Extents));
+		XMStoreFloat3((XMFLOAT3*)sceneObjectBounds[i].boundsMax, XMLoadFloat3(&bounds.Center) + XMLoadFloat3(&bounds.Extents));
+	}
+
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, terrainWorld * view * projection);
+	XMFLOAT3 camera = GetTerrainCameraPosition(terrainWorld);
+
+	terrainHorizon.Cull(&viewProjection._11, &camera.x, sceneObjectBounds.data(), sceneObjectBounds.size(), sceneObjectOccluded, &terrainHorizonStats);
+}
+
+bool Application::IsSceneObjectVisible(SceneObject object) const
+{
+	return !sceneObjectOccluded[object];
+}
+
+UINT Application::AddRenderShader(const RenderShader& shader)
+{
+	for (size_t i = 0; i < renderShaders.size(); ++i)
+	{
+		const RenderShader& added = renderShaders[i];
+		if (added.VertexShader == shader.VertexShader && added.PixelShader == shader.PixelShader && added.Layout == shader.Layout)
+			return (UINT)i;
+	}
+
+	renderShaders.push_back(shader);
+	return (UINT)renderShaders.size() - 1;
+}
+
+UINT Application::AddRenderMaterial(ID3D11ShaderResourceView* texture, ID3D11SamplerState* sampler, const MaterialConstants& constants)
+{
+	//Objects sharing a texture and constants share a material, and are drawn together
+	for (size_t i = 0; i < renderMaterials.size(); ++i)
+	{
+		const RenderMaterial& material = renderMaterials[i];
+		if (material.Texture == texture && material.Sampler == sampler && memcmp(&material.Values, &constants, sizeof(constants)) == 0)
+			return (UINT)i;
+	}
+
+	//The constants never change, so they are uploaded once here and only bound after
+	RenderMaterial material = { texture, sampler, nullptr, constants };
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = sizeof(MaterialConstants);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = &constants;
+	pd3dDevice->CreateBuffer(&bd, &InitData, &material.Constants);
+
+	renderMaterials.push_back(material);
+	return (UINT)renderMaterials.size() - 1;
+}
+
+void Application::BindRenderMaterial(UINT material)
+{
+	const RenderMaterial& bound = renderMaterials[material];
+	pImmediateContext->PSSetShaderResources(0, 1, &bound.Texture);
+	pImmediateContext->PSSetSamplers(0, 1, &bound.Sampler);
+	pImmediateContext->PSSetConstantBuffers(4, 1, &bound.Constants);
+}
+
+void Application::AddRenderObject(const RenderObject& object)
+{
+	renderObjects.push_back(object);
+}
+
+HRESULT Application::AddRenderInstances(const RenderObject& object, const RenderInstance* instances, UINT count)
+{
+	if (!count || !renderShaders[object.Shader].InstanceStride)
+		return E_INVALIDARG;
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(RenderInstance) * count;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = instances;
+
+	RenderObject instanced = object;
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &instanced.InstanceBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	instanced.InstanceCount = count;
+	AddRenderObject(instanced);
+	return S_OK;
+}
+
+void Application::InitRenderObjects()
+{
+	MaterialConstants sceneConstants;
+	sceneConstants.DiffuseMtrl = diffuseMaterial;
+	sceneConstants.AmbientMtrl = ambientMaterial;
+	sceneConstants.SpecularMtrl = specularMaterial;
+	sceneConstants.SpecularPower = specularPower;
+	sceneConstants.Padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	RenderShader scene = { pVertexShader, pPixelShader, pVertexLayout, 0 };
+	UINT sceneShader = AddRenderShader(scene);
+	UINT sphereMaterial = AddRenderMaterial(objSphere.AtlasRemapped ? pTextureAtlas : (pTextureSun ? pTextureSun : pTextureMud), pSamplerState, sceneConstants);
+	UINT pyramidMaterial = AddRenderMaterial(pyramidInAtlas ? pTextureAtlas : pTextureCrate, pSamplerState, sceneConstants);
+	UINT cubeMaterial = AddRenderMaterial(cubeInAtlas ? pTextureAtlas : pTextureCrate, pSamplerState, sceneConstants);
+	UINT herculesMaterial = AddRenderMaterial(pTextureHercules, pSamplerState, sceneConstants);
+	UINT carMaterial = AddRenderMaterial(objCar.AtlasRemapped ? pTextureAtlas : pTextureCrate, pSamplerState, sceneConstants);
+
+	//The terrain draws itself, but binds its material the same way
+	terrainMaterial = AddRenderMaterial(pTextureMud, pSamplerState, sceneConstants);
+	propMaterial = cubeMaterial;
+
+	RenderObject objects[] =
+	{
+		{ objSphere.VertexBuffer, objSphere.IndexBuffer, objSphere.IndexCount, RENDER_PASS_OPAQUE, sceneShader, sphereMaterial, &sphere, SCENE_OBJECT_SPHERE },
+		{ pPyramidVertexBuffer, pPyramidIndexBuffer, 18, RENDER_PASS_OPAQUE, sceneShader, pyramidMaterial, &pyramid, SCENE_OBJECT_PYRAMID },
+		{ pCubeVertexBuffer, pCubeIndexBuffer, 36, RENDER_PASS_OPAQUE, sceneShader, cubeMaterial, &cube, SCENE_OBJECT_CUBE },
+		{ objPlane.VertexBuffer, objPlane.IndexBuffer, objPlane.IndexCount, RENDER_PASS_OPAQUE, sceneShader, herculesMaterial, &hercules, SCENE_OBJECT_HERCULES },
+		{ objCar.VertexBuffer, objCar.IndexBuffer, objCar.IndexCount, RENDER_PASS_OPAQUE, sceneShader, carMaterial, &car, SCENE_OBJECT_CAR },
+	};
+
+	for (UINT i = 0; i < ARRAYSIZE(objects); ++i)
+		AddRenderObject(objects[i]);
+}
+
+HRESULT Application::InitRenderProps()
+{
+	if (!sceneInstancedShader.VertexShader)
+		return E_FAIL;
+
+	//A PROP_GRID x PROP_GRID field of small crates standing on the terrain, jittered, turned and tinted at random
+	std::vector<RenderInstance> instances;
+	instances.reserve(PROP_GRID * PROP_GRID);
+
+	UINT seed = 2024;
+	float spacing = 2.0f;
+	float scale = 0.3f;
+	for (UINT z = 0; z < PROP_GRID; ++z)
+	{
+		for (UINT x = 0; x < PROP_GRID; ++x)
+		{
+			float random[5];
+			for (UINT i = 0; i < ARRAYSIZE(random); ++i)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				random[i] = (seed >> 8) * (1.0f / 16777216.0f);
+			}
+
+			float px = ((float)x - 0.5f * (PROP_GRID - 1) + random[0] - 0.5f) * spacing;
+			float pz = ((float)z - 0.5f * (PROP_GRID - 1) + random[1] - 0.5f) * spacing;
+			float ground;
+			if (!terrainHeightField.GetHeightAt(px, pz, &ground))
+				continue;
+
+			//The cube mesh spans -1..1 in x and y and 0..2 in z, its bottom face is put on the ground
+			XMMATRIX transform = XMMatrixTranslation(0.0f, 1.0f, -1.0f) * XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(random[2] * XM_2PI) * XMMatrixTranslation(px, ground, pz);
+			XMFLOAT4X4 columns;
+			XMStoreFloat4x4(&columns, XMMatrixTranspose(transform));
+
+			RenderInstance instance;
+			memcpy(instance.World, &columns, sizeof(instance.World));
+			float brightness = 0.7f + 0.3f * random[3];
+			instance.Tint = XMFLOAT4(brightness, brightness * (0.9f + 0.1f * random[4]), brightness * 0.9f, 1.0f);
+			instances.push_back(instance);
+		}
+	}
+
+	if (instances.empty())
+		return E_FAIL;
+
+	//Placed in terrain space, so the terrain's world matrix moves them with it
+	UINT shader = AddRenderShader(sceneInstancedShader);
+	RenderObject props = { pCubeVertexBuffer, pCubeIndexBuffer, 36, RENDER_PASS_OPAQUE, shader, propMaterial, &terrain, SCENE_OBJECT_COUNT, nullptr, 0, &isPropsVisible };
+	return AddRenderInstances(props, instances.data(), (UINT)instances.size());
+}
+
+void Application::SubmitRenderObjects(const XMMATRIX& view)
+{
+	renderQueue.Clear();
+
+	for (size_t i = 0; i < renderObjects.size(); ++i)
+	{
+		const RenderObject& object = renderObjects[i];
+		if (object.Occluder != SCENE_OBJECT_COUNT && !IsSceneObjectVisible(object.Occluder))
+			continue;
+		if (object.Shown && !*object.Shown)
+			continue;
+
+		//View depth of the object's origin
+		XMVECTOR position = XMVector3TransformCoord(XMLoadFloat4x4(object.World).r[3], view);
+		renderQueue.Submit(MakeRenderKey(object.Pass, object.Shader, object.Material, XMVectorGetZ(position)), (uint32_t)i);
+	}
+}
+
+void Application::DrawRenderQueue()
+{
+	UINT strides[2] = { sizeof(SimpleVertex), sizeof(RenderInstance) };
+	UINT offsets[2] = { 0, 0 };
+	UINT boundShader = UINT_MAX;
+	UINT boundMaterial = UINT_MAX;
+	ID3D11Buffer* boundVertexBuffer = nullptr;
+	ID3D11Buffer* boundIndexBuffer = nullptr;
+	ID3D11Buffer* boundInstanceBuffer = nullptr;
+
+	ZeroMemory(&renderQueueCounts, sizeof(renderQueueCounts));
+
+	for (size_t i = 0; i < renderQueue.GetCount(); ++i)
+	{
+		const RenderObject& object = renderObjects[renderQueue.GetItem(i)];
+
+		if (object.Shader != boundShader)
+		{
+			const RenderShader& shader = renderShaders[object.Shader];
+			pImmediateContext->IASetInputLayout(shader.Layout);
+			pImmediateContext->VSSetShader(shader.VertexShader, nullptr, 0);
+			pImmediateContext->PSSetShader(shader.PixelShader, nullptr, 0);
+			boundShader = object.Shader;
+			++renderQueueCounts.ShaderChanges;
+		}
+
+		if (object.Material != boundMaterial)
+		{
+			BindRenderMaterial(object.Material);
+			boundMaterial = object.Material;
+			++renderQueueCounts.MaterialChanges;
+		}
+
+		//Slot 1 is only read by the instanced shaders, so it is left as it is for the others
+		if (object.VertexBuffer != boundVertexBuffer || object.IndexBuffer != boundIndexBuffer || (object.InstanceBuffer && object.InstanceBuffer != boundInstanceBuffer))
+		{
+			ID3D11Buffer* buffers[2] = { object.VertexBuffer, object.InstanceBuffer };
+			pImmediateContext->IASetVertexBuffers(0, object.InstanceBuffer ? 2 : 1, buffers, strides, offsets);
+			pImmediateContext->IASetIndexBuffer(object.IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+			boundVertexBuffer = object.VertexBuffer;
+			boundIndexBuffer = object.IndexBuffer;
+			if (object.InstanceBuffer)
+				boundInstanceBuffer = object.InstanceBuffer;
+			++renderQueueCounts.MeshChanges;
+		}
+
+		SetObjectConstants(XMLoadFloat4x4(object.World));
+		if (object.InstanceBuffer)
+			pImmediateContext->DrawIndexedInstanced(object.IndexCount, object.InstanceCount, 0, 0, 0);
+		else
+			pImmediateContext->DrawIndexed(object.IndexCount, 0, 0);
+		++renderQueueCounts.Draws;
+	}
+}
+
+void Application::SetObjectConstants(const XMMATRIX& world)
+{
+	ObjectConstants constants;
+	constants.mWorld = XMMatrixTranspose(world);
+	pObjectConstantRing->Upload(pImmediateContext, 5, &constants, sizeof(constants));
+	constantUploadBytes += sizeof(constants);
+}
+
+void Application::ReportFrameStats()
+{
+	//Once a second is enough to read and does not flood the debug output
+	DWORD now = GetTickCount();
+	if (lastStatsReport && now - lastStatsReport < 1000)
+		return;
+	lastStatsReport = now;
+
+	char report[256] = "DX11 Framework";
+	size_t length = strlen(report);
+
+	//Scene object draws, and how often the sorted queue had to change state between them
+	length += sprintf_s(report + length, sizeof(report) - length, " | %u draws, %u shader, %u material, %u mesh changes",
+		renderQueueCounts.Draws, renderQueueCounts.ShaderChanges, renderQueueCounts.MaterialChanges, renderQueueCounts.MeshChanges);
+
+	//Everything written to constant buffers this frame, ring slices and whole buffers alike
+	length += sprintf_s(report + length, sizeof(report) - length, " | %.1f KB constants", constantUploadBytes / 1024.0);
+
+	//Scatter instances drawn out of those placed, and the instanced draws they took
+	if (isScatterVisible)
+	{
+		const TerrainScatterSelectStats& grass = terrainScatterStats[SCATTER_LAYER_GRASS];
+		const TerrainScatterSelectStats& rocks = terrainScatterStats[SCATTER_LAYER_ROCKS];
+		length += sprintf_s(report + length, sizeof(report) - length, " | grass %zu/%zu in %zu draws, rocks %zu/%zu in %zu draws",
+			grass.instancesSelected, terrainScatter.GetInstanceCount(SCATTER_LAYER_GRASS), grass.rangeCount,
+			rocks.instancesSelected, terrainScatter.GetInstanceCount(SCATTER_LAYER_ROCKS), rocks.rangeCount);
+	}
+
+	SetWindowTextA(hWnd, report);
+	strcat_s(report, "\n");
+	OutputDebugStringA(report);
+}
+
+void Application::GetTerrainFrustumPlanes(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, float planes[6][4])
+{
+	//Frustum planes in terrain space from the columns of world * view * projection
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, XMMatrixTranspose(world * view * projection));
+	XMVECTOR row0 = XMLoadFloat4((XMFLOAT4*)m.m[0]);
+	XMVECTOR row1 = XMLoadFloat4((XMFLOAT4*)m.m[1]);
+	XMVECTOR row2 = XMLoadFloat4((XMFLOAT4*)m.m[2]);
+	XMVECTOR row3 = XMLoadFloat4((XMFLOAT4*)m.m[3]);
+
+	XMStoreFloat4((XMFLOAT4*)planes[0], row3 + row0);	//Left
+	XMStoreFloat4((XMFLOAT4*)planes[1], row3 - row0);	//Right
+	XMStoreFloat4((XMFLOAT4*)planes[2], row3 + row1);	//Bottom
+	XMStoreFloat4((XMFLOAT4*)planes[3], row3 - row1);	//Top
+	XMStoreFloat4((XMFLOAT4*)planes[4], row2);			//Near
+	XMStoreFloat4((XMFLOAT4*)planes[5], row3 - row2);	//Far
+}
+
+void Application::SelectTerrainNodes(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection)
+{
+	float planes[6][4];
+	GetTerrainFrustumPlanes(world, view, projection, planes);
+
+	XMFLOAT3 camera = GetTerrainCameraPosition(world);
+
+	terrainQuadtree.Select(&camera.x, planes, terrainSelection, &terrainSelectStats);
+	terrainConstants.CameraPos = XMFLOAT4(camera.x, camera.y, camera.z, 1.0f);
+}
+
+void Application::EditTerrain()
+{
+	//The terrain is only moved down, so the car's x and z are terrain space already
+	float forwardX = sin(rotationX);
+	float forwardZ = cos(rotationX);
+
+	//A pair of wheel tracks every quarter unit driven, so standing still digs nothing
+	float movedX = currentPosX - lastRutPosition.x;
+	float movedZ = currentPosZ - lastRutPosition.y;
+	if (movedX * movedX + movedZ * movedZ >= 0.25f * 0.25f)
+	{
+		for (int side = -1; side <= 1; side += 2)
+		{
+			TerrainBrush rut = { TERRAIN_BRUSH_RAISE, currentPosX + forwardZ * 0.35f * side, currentPosZ - forwardX * 0.35f * side, 0.35f, 0.3f, -0.03f, 0.0f };
+			terrainEditor.Apply(rut);
+		}
+		lastRutPosition = XMFLOAT2(currentPosX, currentPosZ);
+	}
+
+	//One crater per press, 8 units ahead of the car
+	bool craterKey = GetAsyncKeyState('C') != 0;
+	if (craterKey && !isCraterKeyDown)
+	{
+		TerrainBrush crater = { TERRAIN_BRUSH_CRATER, currentPosX + forwardX * 8.0f, currentPosZ + forwardZ * 8.0f, 5.0f, 0.0f, 2.5f, 0.0f };
+		terrainEditor.Apply(crater);
+	}
+	isCraterKeyDown = craterKey;
+}
+
+void Application::UpdateTerrainEdits()
+{
+	if (!terrainEditor.IsDirty())
+		return;
+
+	terrainEditor.TakeDirtyRects(terrainEditRects);
+
+	TerrainNormalDesc normalDesc = { 1.0f, 1.0f, 1.0f };
+	TerrainTileDesc tileDesc = { TERRAIN_TILE_QUADS, 1.0f, 1.0f, 1.0f };
+
+	ID3D11Resource* heightTexture = nullptr;
+	if (pTerrainHeights)
+		pTerrainHeights->GetResource(&heightTexture);
+
+	bool isHeightRangeExceeded = false;
+
+	for (size_t i = 0; i < terrainEditRects.size(); ++i)
+	{
+		const TerrainEditRect& rect = terrainEditRects[i];
+
+		//Normals come from the heights either side, so they change one sample further out
+		size_t x0 = rect.x0 ? rect.x0 - 1 : 0;
+		size_t z0 = rect.z0 ? rect.z0 - 1 : 0;
+		size_t x1 = min(rect.x1 + 1, (size_t)terrainWidth);
+		size_t z1 = min(rect.z1 + 1, (size_t)terrainHeight);
+
+		//Edits are small, one thread is quicker than starting more
+		UpdateTerrainNormals(terrainHeights.data(), terrainWidth, terrainHeight, normalDesc, x0, z0, x1, z1, terrainNormals.data(), nullptr, 1);
+		terrainHeightField.UpdateRegion(rect.x0, rect.z0, rect.x1, rect.z1);
+		terrainQuadtree.UpdateRegion(terrainHeights.data(), rect.x0, rect.z0, rect.x1, rect.z1);
+
+		//Grass and rocks put back on the ground, only the instances moved are uploaded
+		for (UINT layer = 0; layer < SCATTER_LAYER_COUNT; ++layer)
+		{
+			if (!pScatterInstanceBuffers[layer])
+				continue;
+
+			terrainScatter.UpdateRegion(layer, terrainHeightField, rect.x0, rect.z0, rect.x1, rect.z1, terrainScatterRanges);
+			const TerrainScatterInstance* instances = terrainScatter.GetInstances(layer);
+			for (size_t j = 0; j < terrainScatterRanges.size(); ++j)
+			{
+				const TerrainScatterRange& range = terrainScatterRanges[j];
+				D3D11_BOX box = { (UINT)(range.firstInstance * sizeof(TerrainScatterInstance)), 0, 0, (UINT)((range.firstInstance + range.instanceCount) * sizeof(TerrainScatterInstance)), 1, 1 };
+				pImmediateContext->UpdateSubresource(pScatterInstanceBuffers[layer], 0, &box, &instances[range.firstInstance], 0, 0);
+			}
+		}
+
+		//Tile rows holding the samples, copied over the same range of their vertex buffer
+		if (!UpdateTerrainTiles(terrainHeights.data(), terrainNormals.data(), terrainWidth, terrainHeight, tileDesc, x0, z0, x1, z1, terrainTiles, terrainEditVertices, terrainEditUpdates))
+			continue;
+
+		for (size_t j = 0; j < terrainEditUpdates.size(); ++j)
+		{
+			const TerrainTileUpdate& update = terrainEditUpdates[j];
+			size_t buffer = update.tile / TERRAIN_TILES_PER_BUFFER;
+			size_t bufferFirstVertex = terrainTiles[buffer * TERRAIN_TILES_PER_BUFFER].firstVertex;
+
+			D3D11_BOX box = { (UINT)((update.firstVertex - bufferFirstVertex) * sizeof(TerrainTileVertex)), 0, 0, (UINT)((update.firstVertex - bufferFirstVertex + update.vertexCount) * sizeof(TerrainTileVertex)), 1, 1 };
+			pImmediateContext->UpdateSubresource(terrainVertexBuffers[buffer], 0, &box, &terrainEditVertices[update.offset], 0, 0);
+		}
+
+		//The same rows of the height-only copy, while they stay inside the range it was quantised over
+		if (pTerrainHeightBuffer && !isHeightRangeExceeded)
+		{
+			const XMFLOAT4& heightParams = terrainConstants.HeightParams;
+			if (UpdateTerrainTileHeights(terrainEditVertices, heightParams.x, heightParams.y, terrainEditSamples))
+			{
+				for (size_t j = 0; j < terrainEditUpdates.size(); ++j)
+				{
+					const TerrainTileUpdate& update = terrainEditUpdates[j];
+					D3D11_BOX box = { (UINT)(update.firstVertex * sizeof(uint16_t)), 0, 0, (UINT)((update.firstVertex + update.vertexCount) * sizeof(uint16_t)), 1, 1 };
+					pImmediateContext->UpdateSubresource(pTerrainHeightBuffer, 0, &box, &terrainEditSamples[update.offset], 0, 0);
+				}
+			}
+			else
+			{
+				isHeightRangeExceeded = true;
+			}
+		}
+
+		//Heights the quadtree and the height-textured modes read
+		if (heightTexture)
+		{
+			D3D11_BOX box = { (UINT)rect.x0, (UINT)rect.z0, 0, (UINT)rect.x1, (UINT)rect.z1, 1 };
+			pImmediateContext->UpdateSubresource(heightTexture, 0, &box, &terrainHeights[rect.z0 * terrainWidth + rect.x0], terrainWidth * sizeof(float), 0);
+		}
+	}
+
+	if (heightTexture)
+		heightTexture->Release();
+
+	//Ruts or craters past the lowest or highest sample, every sample is quantised again over the new range
+	if (isHeightRangeExceeded)
+	{
+		float heightOffset, heightRange;
+		if (BuildTerrainTileHeights(terrainHeights.data(), terrainWidth, terrainHeight, tileDesc, terrainEditSamples, heightOffset, heightRange))
+		{
+			pImmediateContext->UpdateSubresource(pTerrainHeightBuffer, 0, nullptr, terrainEditSamples.data(), 0, 0);
+			terrainConstants.HeightParams = XMFLOAT4(heightOffset, heightRange, 0.0f, 0.0f);
+		}
+	}
+}
+
+void Application::DrawTerrain(const BoundingFrustum& frustum)
+{
+	switch (terrainMode)
+	{
+	case TERRAIN_MODE_QUADTREE:
+		DrawTerrainQuadtree();
+		break;
+	case TERRAIN_MODE_GEOMIPMAP:
+		DrawTerrainGeomipmap(frustum);
+		break;
+	case TERRAIN_MODE_RTIN:
+		DrawTerrainRtin(frustum);
+		break;
+	case TERRAIN_MODE_HEIGHTS:
+		DrawTerrainHeights(frustum);
+		break;
+	case TERRAIN_MODE_STREAMED:
+		DrawStreamedTerrain(frustum);
+		break;
+	default:
+		DrawTerrainTiles(frustum);
+		break;
+	}
+}
+
+void Application::DrawTerrainQuadtree()
+{
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+
+	pImmediateContext->IASetVertexBuffers(0, 1, &pTerrainPatchVertexBuffer, &stride, &offset);
+	pImmediateContext->IASetIndexBuffer(pTerrainPatchIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pImmediateContext->VSSetShader(pTerrainVertexShader, nullptr, 0);
+	pImmediateContext->VSSetShaderResources(3, 1, &pTerrainHeights);
+	pImmediateContext->VSSetConstantBuffers(2, 1, &pTerrainBuffer);
+
+	TerrainNodeConstants nodeConstants;
+	ZeroMemory(&nodeConstants, sizeof(nodeConstants));
+	for (size_t i = 0; i < terrainSelection.size(); ++i)
+	{
+		const TerrainNodeSelection& node = terrainSelection[i];
+		float samplesPerQuad = (float)(node.size / TERRAIN_PATCH_QUADS);
+
+		nodeConstants.NodeParams = XMFLOAT4((float)node.gridX, (float)node.gridZ, samplesPerQuad, (float)node.lod);
+		nodeConstants.MorphParams = XMFLOAT4(node.morphStart, node.morphEnd, (float)TERRAIN_PATCH_QUADS, 0.0f);
+		pTerrainNodeRing->Upload(pImmediateContext, 6, &nodeConstants, sizeof(nodeConstants));
+		constantUploadBytes += sizeof(nodeConstants);
+		pImmediateContext->DrawIndexed(terrainPatchIndexCount, 0, 0);
+	}
+
+	pImmediateContext->VSSetShader(pVertexShader, nullptr, 0);
+}
+
+void Application::SelectTerrainLods(const XMMATRIX& world, const XMMATRIX& projection)
+{
+	//Pixels covered by one unit of height error one unit in front of the camera
+	XMFLOAT4X4 p;
+	XMStoreFloat4x4(&p, projection);
+	float projectionScale = 0.5f * (float)_WindowHeight * p._22;
+
+	XMFLOAT3 camera = GetTerrainCameraPosition(world);
+	terrainGeomipmap.SelectLods(&camera.x, projectionScale, terrainPixelError, terrainPatchLods);
+}
+
+void Application::DrawTerrainGeomipmap(const BoundingFrustum& frustum)
+{
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	UINT tileVertexCount = (UINT)TerrainTileVertexCount(TERRAIN_TILE_QUADS);
+	size_t boundBuffer = terrainVertexBuffers.size();
+
+	pImmediateContext->IASetIndexBuffer(pTerrainLodIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+	for (size_t i = 0; i < terrainTiles.size(); ++i)
+	{
+		const TerrainTile& tile = terrainTiles[i];
+
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, XMLoadFloat3((const XMFLOAT3*)tile.boundsMin), XMLoadFloat3((const XMFLOAT3*)tile.boundsMax));
+		if (frustum.Contains(bounds) == DISJOINT)
+			continue;
+
+		size_t buffer = i / TERRAIN_TILES_PER_BUFFER;
+		if (buffer != boundBuffer)
+		{
+			pImmediateContext->IASetVertexBuffers(0, 1, &terrainVertexBuffers[buffer], &stride, &offset);
+			boundBuffer = buffer;
+		}
+
+		const TerrainPatchLod& patch = terrainPatchLods[i];
+		pImmediateContext->DrawIndexed(patch.indexCount, patch.firstIndex, (INT)((i % TERRAIN_TILES_PER_BUFFER) * tileVertexCount));
+	}
+}
+
+void Application::DrawTerrainRtin(const BoundingFrustum& frustum)
+{
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	UINT tileVertexCount = (UINT)TerrainTileVertexCount(TERRAIN_TILE_QUADS);
+	size_t boundBuffer = terrainVertexBuffers.size();
+
+	pImmediateContext->IASetIndexBuffer(pTerrainRtinIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+	for (size_t i = 0; i < terrainTiles.size(); ++i)
+	{
+		const TerrainTile& tile = terrainTiles[i];
+		const TerrainRtinRange& range = terrainRtinRanges[i];
+		if (!range.indexCount)
+			continue;
+
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, XMLoadFloat3((const XMFLOAT3*)tile.boundsMin), XMLoadFloat3((const XMFLOAT3*)tile.boundsMax));
+		if (frustum.Contains(bounds) == DISJOINT)
+			continue;
+
+		size_t buffer = i / TERRAIN_TILES_PER_BUFFER;
+		if (buffer != boundBuffer)
+		{
+			pImmediateContext->IASetVertexBuffers(0, 1, &terrainVertexBuffers[buffer], &stride, &offset);
+			boundBuffer = buffer;
+		}
+
+		pImmediateContext->DrawIndexed((UINT)range.indexCount, (UINT)range.firstIndex, (INT)((i % TERRAIN_TILES_PER_BUFFER) * tileVertexCount));
+	}
+}
+
+void Application::DrawTerrainHeights(const BoundingFrustum& frustum)
+{
+	UINT stride = sizeof(uint16_t);
+	UINT offset = 0;
+	UINT tileVertexCount = (UINT)TerrainTileVertexCount(TERRAIN_TILE_QUADS);
+
+	pImmediateContext->IASetInputLayout(pTerrainHeightLayout);
+	pImmediateContext->IASetVertexBuffers(0, 1, &pTerrainHeightBuffer, &stride, &offset);
+	pImmediateContext->IASetIndexBuffer(pgridIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pImmediateContext->IASetPrimitiveTopology(terrainTileTopology);
+	pImmediateContext->VSSetShader(pTerrainHeightVertexShader, nullptr, 0);
+	pImmediateContext->VSSetShaderResources(3, 1, &pTerrainHeights);
+	pImmediateContext->VSSetConstantBuffers(2, 1, &pTerrainBuffer);
+
+	//Tiles are full resolution, so one sample per quad and no morphing
+	TerrainNodeConstants tileConstants;
+	ZeroMemory(&tileConstants, sizeof(tileConstants));
+	tileConstants.MorphParams = XMFLOAT4(0.0f, 0.0f, (float)TERRAIN_TILE_QUADS, 0.0f);
+	for (size_t i = 0; i < terrainTiles.size(); ++i)
+	{
+		const TerrainTile& tile = terrainTiles[i];
+
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, XMLoadFloat3((const XMFLOAT3*)tile.boundsMin), XMLoadFloat3((const XMFLOAT3*)tile.boundsMax));
+		if (frustum.Contains(bounds) == DISJOINT)
+			continue;
+
+		tileConstants.NodeParams = XMFLOAT4((float)tile.gridX, (float)tile.gridZ, 1.0f, 0.0f);
+		pTerrainNodeRing->Upload(pImmediateContext, 6, &tileConstants, sizeof(tileConstants));
+		constantUploadBytes += sizeof(tileConstants);
+		pImmediateContext->DrawIndexed(terrainTileIndexCount, 0, (INT)(i * tileVertexCount));
+	}
+
+	pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	pImmediateContext->IASetInputLayout(pVertexLayout);
+	pImmediateContext->VSSetShader(pVertexShader, nullptr, 0);
+}
+
+void Application::DrawStreamedTerrain(const BoundingFrustum& frustum)
+{
+	pImmediateContext->VSSetShader(pTerrainStreamVertexShader, nullptr, 0);
+	constantUploadBytes += pStreamedTerrain->Draw(pImmediateContext, frustum, pTerrainBuffer, terrainConstants, pTerrainNodeRing);
+
+	pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	pImmediateContext->IASetInputLayout(pVertexLayout);
+	pImmediateContext->VSSetShader(pVertexShader, nullptr, 0);
+}
+
+void Application::DrawTerrainScatter(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection)
+{
+	if (!pScatterMeshVertexBuffer || !pScatterMeshIndexBuffer || !pFoliageBuffer)
+		return;
+
+	float planes[6][4];
+	GetTerrainFrustumPlanes(world, view, projection, planes);
+	XMFLOAT3 camera = GetTerrainCameraPosition(world);
+
+	UINT strides[2] = { sizeof(SimpleVertex), sizeof(TerrainScatterInstance) };
+	UINT offsets[2] = { 0, 0 };
+
+	pImmediateContext->IASetInputLayout(pFoliageLayout);
+	pImmediateContext->IASetIndexBuffer(pScatterMeshIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pImmediateContext->VSSetShader(pFoliageVertexShader, nullptr, 0);
+	pImmediateContext->PSSetShader(pFoliagePixelShader, nullptr, 0);
+	pImmediateContext->VSSetConstantBuffers(3, 1, &pFoliageBuffer);
+	pImmediateContext->PSSetConstantBuffers(3, 1, &pFoliageBuffer);
+
+	for (UINT layer = 0; layer < SCATTER_LAYER_COUNT; ++layer)
+	{
+		//Visible cells next to each other in a row come back as one range, drawn in one call
+		terrainScatter.Select(layer, &camera.x, planes, terrainScatterRanges, &terrainScatterStats[layer]);
+		if (!pScatterInstanceBuffers[layer] || terrainScatterRanges.empty())
+			continue;
+
+		ID3D11Buffer* buffers[2] = { pScatterMeshVertexBuffer, pScatterInstanceBuffers[layer] };
+		pImmediateContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+		pImmediateContext->UpdateSubresource(pFoliageBuffer, 0, nullptr, &scatterConstants[layer], 0, 0);
+		constantUploadBytes += sizeof(FoliageConstants);
+
+		for (size_t i = 0; i < terrainScatterRanges.size(); ++i)
+		{
+			const TerrainScatterRange& range = terrainScatterRanges[i];
+			pImmediateContext->DrawIndexedInstanced(scatterMeshIndexCount[layer], (UINT)range.instanceCount, scatterMeshFirstIndex[layer], scatterMeshBaseVertex[layer], (UINT)range.firstInstance);
+		}
+	}
+
+	pImmediateContext->IASetInputLayout(pVertexLayout);
+	pImmediateContext->VSSetShader(pVertexShader, nullptr, 0);
+	pImmediateContext->PSSetShader(pPixelShader, nullptr, 0);
 }
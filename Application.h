@@ -5,38 +5,158 @@
 #include <d3dcompiler.h>
 #include <directxmath.h>
 #include <directxcolors.h>
+#include <DirectXCollision.h>
 #include "resource.h"
 #include <time.h>
+#include <stdio.h>
 #include "DDSTextureLoader.h"
 #include "OBJLoader.h"
 #include "Structures.h"
 #include "Camera.h"
+#include "TextureCache.h"
+#include "TerrainVirtualTexture.h"
+#include "HeightmapLoader.h"
+#include "ProceduralTerrain.h"
+#include "TerrainTiles.h"
+#include "TerrainNormals.h"
+#include "TerrainQuadtree.h"
+#include "TerrainGeomipmap.h"
+#include "TerrainRtin.h"
+#include "TerrainHeightField.h"
+#include "TerrainHorizon.h"
+#include "StreamedTerrain.h"
+#include "TerrainCache.h"
+#include "TerrainEdit.h"
+#include "TerrainScatter.h"
+#include "RenderQueue.h"
+#include "ConstantRing.h"
 #include <vector>
+#include <string>
 #include <fstream>
 #include <iostream>
 
 using namespace DirectX;
 
-struct ConstantBuffer
+//Terrain tile indices, chosen at build time: 0 triangle list, 1 triangle strips cut by
+//primitive restart, 2 a single triangle strip with rows joined by degenerate triangles
+#ifndef TERRAIN_TILE_STRIPS
+#define TERRAIN_TILE_STRIPS 1
+#endif
+
+//Terrain heights, chosen at build time: 0 the heightmap file, 1 seeded procedural noise
+#ifndef TERRAIN_PROCEDURAL
+#define TERRAIN_PROCEDURAL 0
+#endif
+
+//Constants set once a frame, bound at b0
+struct FrameConstants
 {
-	XMMATRIX mWorld;
 	XMMATRIX mView;
 	XMMATRIX mProjection;
-	XMFLOAT4 DiffuseMtrl;
 
 	XMFLOAT4 DiffuseLight;
 	XMFLOAT3 LightVecw;
 	float gTime;
-	XMFLOAT4 AmbientMtrl;
 	XMFLOAT4 AmbientLight;
-
 	XMFLOAT4 SpecularLight;
-	XMFLOAT4 SpecularMtrl;
 	XMFLOAT3 eyePos;
-	
+	float Padding;
+};
+
+//Constants of a material, kept in an immutable buffer per material and bound at b4
+struct MaterialConstants
+{
+	XMFLOAT4 DiffuseMtrl;
+	XMFLOAT4 AmbientMtrl;
+	XMFLOAT4 SpecularMtrl;
 	float SpecularPower;
+	XMFLOAT3 Padding;
+};
+
+//Constants of a draw, written through the object ring and bound at b5
+struct ObjectConstants
+{
+	XMMATRIX mWorld;
+};
+
+//How the terrain is drawn, all modes share the heightmap read by CreateTerrain
+enum TerrainMode
+{
+	TERRAIN_MODE_TILES,
+	TERRAIN_MODE_QUADTREE,
+	TERRAIN_MODE_GEOMIPMAP,
+	TERRAIN_MODE_RTIN,
+	TERRAIN_MODE_HEIGHTS,
+	TERRAIN_MODE_STREAMED,
+};
+
+//Objects tested against the terrain horizon before they are drawn
+enum SceneObject
+{
+	SCENE_OBJECT_SPHERE,
+	SCENE_OBJECT_PYRAMID,
+	SCENE_OBJECT_CUBE,
+	SCENE_OBJECT_HERCULES,
+	SCENE_OBJECT_CAR,
+	SCENE_OBJECT_COUNT,
+};
+
+//What is scattered over the terrain, one instance buffer and one mesh each
+enum ScatterLayer
+{
+	SCATTER_LAYER_GRASS,
+	SCATTER_LAYER_ROCKS,
+	SCATTER_LAYER_COUNT,
+};
+
+//Shaders and input layout a render queue item is drawn with
+struct RenderShader
+{
+	ID3D11VertexShader* VertexShader;
+	ID3D11PixelShader* PixelShader;
+	ID3D11InputLayout* Layout;
+	UINT InstanceStride;		//0 unless the shaders read a per-instance stream from slot 1
+};
 
-	
+//One copy of an instanced render object, read by the INSTANCED shader variants
+struct RenderInstance
+{
+	XMFLOAT4 World[3];			//First three columns of the transform into the object's World
+	XMFLOAT4 Tint;				//Multiplies the texture colour
+};
+
+//Texture and sampler bound at t0 and s0, constants at b4
+struct RenderMaterial
+{
+	ID3D11ShaderResourceView* Texture;
+	ID3D11SamplerState* Sampler;
+	ID3D11Buffer* Constants;
+	MaterialConstants Values;
+};
+
+//Something drawn through the render queue, added once with AddRenderObject
+struct RenderObject
+{
+	ID3D11Buffer* VertexBuffer;
+	ID3D11Buffer* IndexBuffer;
+	UINT IndexCount;
+	UINT Pass;					//RENDER_PASS
+	UINT Shader;				//Index into renderShaders
+	UINT Material;				//Index into renderMaterials
+	const XMFLOAT4X4* World;	//Instanced objects place their instances within it
+	SceneObject Occluder;		//Tested against the terrain horizon, SCENE_OBJECT_COUNT if never hidden
+	ID3D11Buffer* InstanceBuffer;	//RenderInstances, nullptr unless added with AddRenderInstances
+	UINT InstanceCount;
+	const bool* Shown;			//nullptr if always drawn
+};
+
+//What the last frame's render queue bound and drew
+struct RenderQueueCounts
+{
+	UINT Draws;
+	UINT ShaderChanges;
+	UINT MaterialChanges;
+	UINT MeshChanges;
 };
 
 class Application
@@ -52,8 +172,18 @@ private:
 	ID3D11RenderTargetView* pRenderTargetView;
 	//Shaders
 	ID3D11VertexShader*     pVertexShader;
+	ID3D11VertexShader*     pTerrainVertexShader = nullptr;
+	ID3D11VertexShader*     pTerrainHeightVertexShader = nullptr;
+	ID3D11VertexShader*     pTerrainStreamVertexShader = nullptr;
 	ID3D11PixelShader*      pPixelShader;
+	ID3D11PixelShader*      pVirtualTexturePixelShader = nullptr;
+	ID3D11PixelShader*      pVirtualTextureFeedbackShader = nullptr;
+	ID3D11VertexShader*     pFoliageVertexShader = nullptr;
+	ID3D11PixelShader*      pFoliagePixelShader = nullptr;
 	ID3D11InputLayout*      pVertexLayout;
+	ID3D11InputLayout*      pTerrainHeightLayout = nullptr;
+	ID3D11InputLayout*      pFoliageLayout = nullptr;
+	RenderShader            sceneInstancedShader = {};	//VS and PS compiled with INSTANCED, nullptrs if that failed
 	//Buffers
 	ID3D11Buffer*           pCubeVertexBuffer;
 	ID3D11Buffer*           pCubeIndexBuffer;
@@ -61,11 +191,14 @@ private:
 	ID3D11Buffer*           pPyramidIndexBuffer;
 	ID3D11Buffer*           pPlaneVertexBuffer;
 	ID3D11Buffer*           pPlaneIndexBuffer;
-	ID3D11Buffer*           pgridVertexBuffer;
 	ID3D11Buffer*           pgridIndexBuffer;
-	ID3D11Buffer*           pConstantBuffer;
+	ID3D11Buffer*           pFrameBuffer;
+	//Per-draw constants, InitDevice fails when the ring cannot be set up
+	ConstantRing*           pObjectConstantRing = nullptr;
+	UINT                    constantUploadBytes = 0;	//Constant buffer bytes sent to the GPU in the last frame
 	// World Object
 	XMFLOAT4X4              sphere, pyramid, cube,hercules,car,terrain;
+	BoundingBox             cubeBounds, pyramidBounds;
 	//Lighting
 	XMFLOAT3                lightDirection;
 	XMFLOAT4                diffuseMaterial;
@@ -83,12 +216,22 @@ private:
 	ID3D11RasterizerState*  solidFrame;
 	//SamplerState
 	ID3D11SamplerState* pSamplerState = nullptr;
-	//Textures
+	//Textures (owned by pTextureCache, give them back with pTextureCache->Release)
+	TextureCache*           pTextureCache = nullptr;
 	ID3D11ShaderResourceView* pTextureCrate = nullptr;
 	ID3D11ShaderResourceView* pTextureHercules = nullptr;
 	ID3D11ShaderResourceView* pTextureSun = nullptr;
 	ID3D11ShaderResourceView* pTextureMud = nullptr;
 	ID3D11ShaderResourceView* pTextureSurface = nullptr;
+	//Texture Atlas (small textures share one binding)
+	ID3D11ShaderResourceView* pTextureAtlas = nullptr;
+	AtlasRegion             crateAtlasRegion;
+	AtlasRegion             mudAtlasRegion;
+	AtlasRegion             sunAtlasRegion;
+	bool                    cubeInAtlas;
+	bool                    pyramidInAtlas;
+	//Terrain Virtual Texture (nullptr when it could not be set up, the terrain then uses pTextureMud)
+	TerrainVirtualTexture*  pTerrainVirtualTexture = nullptr;
 	//Objects
 	MeshData                objPlane;
 	MeshData                objSphere;
@@ -111,35 +254,140 @@ private:
 	float currentPosX;
 	float rotationX;
 	XMMATRIX carMatrix;
-	// Terrain
-	UINT rows;
-	UINT columns;
-	int totalCells;
-	UINT totalFaces;
-	int totalVertices;
-	int depth;
-	int width;
-	// Width & Depth
-	float dx;
-	float dz;
-	//Texture Coords
-	float du;
-	float dv;
-	// Height map
-	XMFLOAT3* heightMap;
+	// Terrain (tiles share pgridIndexBuffer, each buffer holds up to TERRAIN_TILES_PER_BUFFER tiles)
+	static const UINT TERRAIN_TILE_QUADS = 64;
+	static const UINT TERRAIN_TILES_PER_BUFFER = 256;
+	std::vector<TerrainTile> terrainTiles;
+	std::vector<ID3D11Buffer*> terrainVertexBuffers;
+	UINT terrainTileIndexCount;
+	D3D11_PRIMITIVE_TOPOLOGY terrainTileTopology;
+	TerrainIndexStats terrainTileIndexStats;
+	// CDLOD Terrain (one patch mesh drawn per selected node, heights read in VS_Terrain)
+	static const UINT TERRAIN_PATCH_QUADS = 32;
+	TerrainQuadtree terrainQuadtree;
+	std::vector<TerrainNodeSelection> terrainSelection;
+	TerrainSelectStats terrainSelectStats;
+	TerrainConstants terrainConstants;
+	ID3D11Buffer* pTerrainPatchVertexBuffer = nullptr;
+	ID3D11Buffer* pTerrainPatchIndexBuffer = nullptr;
+	UINT terrainPatchIndexCount = 0;
+	ID3D11ShaderResourceView* pTerrainHeights = nullptr;
+	ID3D11Buffer* pTerrainBuffer = nullptr;
+	ConstantRing* pTerrainNodeRing = nullptr;	//Per node and tile constants, shared with the height-only and streamed terrain
+	// Geomipmapped Terrain (patches are the tiles, drawn from ranges of one shared LOD/stitch index buffer)
+	TerrainGeomipmap terrainGeomipmap;
+	std::vector<TerrainPatchLod> terrainPatchLods;
+	ID3D11Buffer* pTerrainLodIndexBuffer = nullptr;
+	float terrainPixelError = 2.0f;
+	// Adaptive Terrain (the tiles again, an RTIN triangulation within terrainRtinError of the heights for static distant terrain)
+	TerrainRtin terrainRtin;
+	std::vector<TerrainRtinRange> terrainRtinRanges;
+	TerrainRtinStats terrainRtinStats;
+	ID3D11Buffer* pTerrainRtinIndexBuffer = nullptr;
+	float terrainRtinError = 0.25f;
+	// Height-only Terrain (the tiles again, 2 bytes per vertex, position and UV rebuilt in VS_TerrainHeights)
+	ID3D11Buffer* pTerrainHeightBuffer = nullptr;
+	// Streamed Terrain (tiles of a terrain stream file loaded around the camera, nullptr if it could not be set up)
+	StreamedTerrain* pStreamedTerrain = nullptr;
+	TerrainMode terrainMode = TERRAIN_MODE_TILES;
+	// Height map (row 0 is the far, +Z edge)
+	std::vector<float> terrainHeights;
+	// Three floats per height sample, kept for edits to the terrain
+	std::vector<float> terrainNormals;
+	TerrainHeightField terrainHeightField;
+	// Horizon Culling (objects hidden behind hills are not drawn)
+	TerrainHorizon terrainHorizon;
+	TerrainHorizonStats terrainHorizonStats;
+	std::vector<TerrainHorizonBounds> sceneObjectBounds;
+	std::vector<uint8_t> sceneObjectOccluded;
+	bool isHorizonCulling = true;
+	// Terrain Editing (ruts behind the car, a crater ahead of it on C; only the rows and texels changed are uploaded)
+	TerrainEditor terrainEditor;
+	std::vector<TerrainEditRect> terrainEditRects;
+	std::vector<TerrainTileVertex> terrainEditVertices;
+	std::vector<TerrainTileUpdate> terrainEditUpdates;
+	std::vector<uint16_t> terrainEditSamples;
+	XMFLOAT2 lastRutPosition = XMFLOAT2(0.0f, 0.0f);
+	bool isCraterKeyDown = false;
+	// Terrain Scatter (grass and rocks, culled a cell at a time and drawn with one instanced draw per run of visible cells)
+	TerrainScatter terrainScatter;
+	TerrainScatterStats terrainScatterBuildStats;
+	TerrainScatterSelectStats terrainScatterStats[SCATTER_LAYER_COUNT];	//Last frame's, shown in the window title
+	std::vector<TerrainScatterRange> terrainScatterRanges;
+	ID3D11Buffer* pScatterInstanceBuffers[SCATTER_LAYER_COUNT] = {};
+	ID3D11Buffer* pScatterMeshVertexBuffer = nullptr;
+	ID3D11Buffer* pScatterMeshIndexBuffer = nullptr;
+	UINT scatterMeshFirstIndex[SCATTER_LAYER_COUNT];
+	UINT scatterMeshIndexCount[SCATTER_LAYER_COUNT];
+	INT scatterMeshBaseVertex[SCATTER_LAYER_COUNT];
+	FoliageConstants scatterConstants[SCATTER_LAYER_COUNT];
+	ID3D11Buffer* pFoliageBuffer = nullptr;
+	bool isScatterVisible = true;
+	// Render Queue (scene objects drawn in sort key order, state is bound only where neighbouring keys differ)
+	std::vector<RenderShader> renderShaders;
+	std::vector<RenderMaterial> renderMaterials;
+	std::vector<RenderObject> renderObjects;
+	RenderQueue renderQueue;
+	RenderQueueStats renderQueueStats;
+	RenderQueueCounts renderQueueCounts;
+	UINT terrainMaterial = 0;
+	// Instanced Props (ten thousand crates in one draw, shown with I and hidden with U)
+	static const UINT PROP_GRID = 100;
+	UINT propMaterial = 0;
+	bool isPropsVisible = false;
 	UINT terrainWidth;
 	UINT terrainHeight;
+	// Frame Stats (shown in the window title and the debug output once a second)
+	DWORD lastStatsReport = 0;
 private:
 	HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
 	HRESULT InitDevice();
 	void Cleanup();
-	HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
+	HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut, const D3D_SHADER_MACRO* pDefines = nullptr);
+	HRESULT CreateInstancedShader(LPCSTR vertexEntry, LPCSTR pixelEntry, const D3D11_INPUT_ELEMENT_DESC* layout, UINT elementCount, RenderShader& shader);
 	HRESULT InitShadersAndInputLayout();
+	HRESULT InitTextureAtlas();
+	HRESULT InitTerrainVirtualTexture();
 	HRESULT InitCubeVertexBuffer();
 	HRESULT InitCubeIndexBuffer();
 	HRESULT InitPyramidVertexBuffer();
 	HRESULT InitPyramidIndexBuffer();
 	HRESULT CreateTerrain(char* filename);
+	bool LoadTerrainCache(TerrainCache& cache, const char* fileName, const TerrainCacheKey& key, const TerrainHeightFieldDesc& heightFieldDesc, std::vector<uint16_t>& indices);
+	HRESULT InitTerrainQuadtree(const std::vector<float>& heights);
+	HRESULT InitTerrainGeomipmap(const std::vector<float>& heights);
+	HRESULT InitTerrainRtin(const std::vector<float>& heights);
+	HRESULT InitTerrainHeights(const std::vector<float>& heights);
+	HRESULT InitStreamedTerrain(const std::vector<float>& heights);
+	HRESULT InitTerrainScatter();
+	HRESULT InitScatterMeshes();
+	XMFLOAT3 GetTerrainCameraPosition(const XMMATRIX& world);
+	void GetTerrainFrustumPlanes(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, float planes[6][4]);
+	void SelectTerrainNodes(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
+	void SelectTerrainLods(const XMMATRIX& world, const XMMATRIX& projection);
+	void EditTerrain();
+	void UpdateTerrainEdits();
+	void DrawTerrain(const BoundingFrustum& frustum);
+	void DrawTerrainTiles(const BoundingFrustum& frustum);
+	void DrawTerrainQuadtree();
+	void DrawTerrainGeomipmap(const BoundingFrustum& frustum);
+	void DrawTerrainRtin(const BoundingFrustum& frustum);
+	void DrawTerrainHeights(const BoundingFrustum& frustum);
+	void DrawStreamedTerrain(const BoundingFrustum& frustum);
+	void DrawTerrainScatter(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
+	void CullSceneObjects(const XMMATRIX& view, const XMMATRIX& projection);
+	bool IsSceneObjectVisible(SceneObject object) const;
+	UINT AddRenderShader(const RenderShader& shader);
+	UINT AddRenderMaterial(ID3D11ShaderResourceView* texture, ID3D11SamplerState* sampler, const MaterialConstants& constants);
+	void BindRenderMaterial(UINT material);
+	void AddRenderObject(const RenderObject& object);
+	HRESULT AddRenderInstances(const RenderObject& object, const RenderInstance* instances, UINT count);
+	void InitRenderObjects();
+	HRESULT InitRenderProps();
+	void SubmitRenderObjects(const XMMATRIX& view);
+	void DrawRenderQueue();
+	void SetObjectConstants(const XMMATRIX& world);
+	void ReportFrameStats();
 
 	UINT _WindowHeight;
 	UINT _WindowWidth;
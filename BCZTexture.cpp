@@ -0,0 +1,816 @@
+//--------------------------------------------------------------------------------------
+// File: BCZTexture.cpp
+//
+// BCZ container encoding and transcoding.
+//
+// Layout: BCZ_HEADER, one BCZ_SLICE per slice, then the slice payloads. A payload is one
+// coded plane per block byte. Huffman codes are canonical, limited to 12 bits, and
+// written LSB first so the decoder resolves every symbol with a single 4096-entry table
+// lookup.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#include "BCZTexture.h"
+#include "MipGenerator.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+#pragma pack(push,1)
+
+const uint32_t BCZ_MAGIC = 0x315A4342; // "BCZ1"
+const uint32_t BCZ_VERSION = 1;
+const uint32_t BCZ_FLAGS_SRGB = 0x1;
+
+struct BCZ_HEADER
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    mipCount;
+    uint32_t    format;         // BC_FORMAT
+    uint32_t    flags;
+    uint32_t    sliceCount;
+};
+
+struct BCZ_SLICE
+{
+    uint32_t    level;
+    uint32_t    firstBlockRow;
+    uint32_t    blockRows;
+    uint32_t    dataOffset;     // from the start of the file
+    uint32_t    dataSize;
+};
+
+#pragma pack(pop)
+
+const size_t SLICE_BLOCK_ROWS = 16;
+const int HUFFMAN_MAX_BITS = 12;
+const size_t HUFFMAN_TABLE_BYTES = 128;    // 256 code lengths, 4 bits each
+
+enum PLANE_MODE
+{
+    PLANE_STORED   = 0,
+    PLANE_CONSTANT = 1,
+    PLANE_HUFFMAN  = 2,
+    PLANE_DELTA    = 3,     // byte minus the previous byte, then Huffman
+};
+
+//--------------------------------------------------------------------------------------
+// Mip level geometry shared by the encoder and decoder
+//--------------------------------------------------------------------------------------
+struct LevelInfo
+{
+    size_t blocksWide;
+    size_t blocksHigh;
+    size_t offset;          // into the tightly packed block chain
+};
+
+size_t ComputeLevels( size_t width, size_t height, size_t mipCount, BC_FORMAT format, std::vector<LevelInfo>& levels )
+{
+    size_t blockSize = BCBlockSize( format );
+    size_t offset = 0;
+    levels.resize( mipCount );
+    for (size_t i = 0; i < mipCount; ++i)
+    {
+        levels[i].blocksWide = std::max<size_t>( 1, ( width + 3 ) / 4 );
+        levels[i].blocksHigh = std::max<size_t>( 1, ( height + 3 ) / 4 );
+        levels[i].offset = offset;
+        offset += levels[i].blocksWide * levels[i].blocksHigh * blockSize;
+        width = std::max<size_t>( 1, width >> 1 );
+        height = std::max<size_t>( 1, height >> 1 );
+    }
+    return offset;
+}
+
+//--------------------------------------------------------------------------------------
+// Huffman code construction
+//--------------------------------------------------------------------------------------
+struct HuffmanCode
+{
+    uint8_t     lengths[256];
+    uint16_t    codes[256];     // bit reversed, ready for an LSB-first writer
+};
+
+// Lengths from a Huffman tree over freq. Symbols with zero frequency get length 0.
+// If the tree is deeper than HUFFMAN_MAX_BITS, frequencies are flattened and the tree is rebuilt.
+void BuildCodeLengths( const uint32_t freq[256], uint8_t lengths[256] )
+{
+    uint32_t f[256];
+    memcpy( f, freq, sizeof(f) );
+
+    for (;;)
+    {
+        struct Node
+        {
+            uint32_t weight;
+            int      left;
+            int      right;
+        };
+
+        Node nodes[511];
+        int count = 0;
+        std::vector<std::pair<uint32_t, int>> heap;
+        for (int s = 0; s < 256; ++s)
+        {
+            if (f[s])
+            {
+                nodes[count].weight = f[s];
+                nodes[count].left = -1;
+                nodes[count].right = s;
+                heap.push_back( std::make_pair( f[s], count ) );
+                ++count;
+            }
+        }
+
+        memset( lengths, 0, 256 );
+        if (heap.size() == 1)
+        {
+            lengths[ nodes[0].right ] = 1;
+            return;
+        }
+
+        auto greater = []( const std::pair<uint32_t, int>& a, const std::pair<uint32_t, int>& b ) { return a.first > b.first; };
+        std::make_heap( heap.begin(), heap.end(), greater );
+        while (heap.size() > 1)
+        {
+            std::pop_heap( heap.begin(), heap.end(), greater );
+            std::pair<uint32_t, int> a = heap.back();
+            heap.pop_back();
+            std::pop_heap( heap.begin(), heap.end(), greater );
+            std::pair<uint32_t, int> b = heap.back();
+            heap.pop_back();
+
+            nodes[count].weight = a.first + b.first;
+            nodes[count].left = a.second;
+            nodes[count].right = b.second;
+            heap.push_back( std::make_pair( nodes[count].weight, count ) );
+            std::push_heap( heap.begin(), heap.end(), greater );
+            ++count;
+        }
+
+        // Walk down from the root assigning depths
+        int depth[511];
+        int maxDepth = 0;
+        depth[count - 1] = 0;
+        for (int n = count - 1; n >= 0; --n)
+        {
+            if (nodes[n].left < 0)
+            {
+                int s = nodes[n].right;
+                lengths[s] = static_cast<uint8_t>( depth[n] );
+                maxDepth = std::max( maxDepth, depth[n] );
+            }
+            else
+            {
+                depth[ nodes[n].left ] = depth[n] + 1;
+                depth[ nodes[n].right ] = depth[n] + 1;
+            }
+        }
+
+        if (maxDepth <= HUFFMAN_MAX_BITS)
+        {
+            return;
+        }
+
+        for (int s = 0; s < 256; ++s)
+        {
+            if (f[s])
+            {
+                f[s] = std::max<uint32_t>( 1, f[s] >> 1 );
+            }
+        }
+    }
+}
+
+// Canonical codes from lengths (shortest first, then by symbol)
+void BuildCanonicalCodes( HuffmanCode& code )
+{
+    int lengthCount[HUFFMAN_MAX_BITS + 1] = {};
+    for (int s = 0; s < 256; ++s)
+    {
+        ++lengthCount[ code.lengths[s] ];
+    }
+    lengthCount[0] = 0;
+
+    int nextCode[HUFFMAN_MAX_BITS + 2] = {};
+    int c = 0;
+    for (int len = 1; len <= HUFFMAN_MAX_BITS; ++len)
+    {
+        c = ( c + lengthCount[len - 1] ) << 1;
+        nextCode[len] = c;
+    }
+
+    for (int s = 0; s < 256; ++s)
+    {
+        int len = code.lengths[s];
+        code.codes[s] = 0;
+        if (!len)
+        {
+            continue;
+        }
+
+        int value = nextCode[len]++;
+        int reversed = 0;
+        for (int i = 0; i < len; ++i)
+        {
+            reversed |= ( ( value >> i ) & 1 ) << ( len - 1 - i );
+        }
+        code.codes[s] = static_cast<uint16_t>( reversed );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Bit I/O
+//--------------------------------------------------------------------------------------
+class BitWriter
+{
+public:
+    explicit BitWriter( std::vector<uint8_t>& dest ) : out( dest ), bits( 0 ), count( 0 ) {}
+
+    void Put( uint32_t value, int length )
+    {
+        bits |= uint64_t( value ) << count;
+        count += length;
+        while (count >= 8)
+        {
+            out.push_back( static_cast<uint8_t>( bits ) );
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void Flush()
+    {
+        if (count > 0)
+        {
+            out.push_back( static_cast<uint8_t>( bits ) );
+        }
+        bits = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t bits;
+    int count;
+};
+
+class BitReader
+{
+public:
+    BitReader( const uint8_t* data, size_t size ) : ptr( data ), end( data + size ), bits( 0 ), count( 0 ), padBits( 0 ) {}
+
+    uint32_t Peek( int length )
+    {
+        if (count < length)
+        {
+            Refill();
+        }
+        return static_cast<uint32_t>( bits & ( ( uint64_t(1) << length ) - 1 ) );
+    }
+
+    void Skip( int length )
+    {
+        bits >>= length;
+        count -= length;
+    }
+
+    // True if no more bits were consumed than the stream holds
+    bool Valid() const { return count >= padBits; }
+
+private:
+    void Refill()
+    {
+        if (end - ptr >= 8)
+        {
+            uint64_t next;
+            memcpy( &next, ptr, sizeof(next) );
+            bits |= next << count;
+            size_t consumed = ( 63 - count ) >> 3;
+            ptr += consumed;
+            count += int( consumed * 8 );
+        }
+        else
+        {
+            // Past the end the stream reads as zeros; Valid() catches overruns
+            while (count <= 56)
+            {
+                uint64_t next = 0;
+                if (ptr < end)
+                {
+                    next = *ptr++;
+                }
+                else
+                {
+                    padBits += 8;
+                }
+                bits |= next << count;
+                count += 8;
+            }
+        }
+    }
+
+    const uint8_t* ptr;
+    const uint8_t* end;
+    uint64_t bits;
+    int count;
+    int padBits;
+};
+
+//--------------------------------------------------------------------------------------
+// Plane coding
+//--------------------------------------------------------------------------------------
+size_t HuffmanCost( const uint32_t freq[256], const uint8_t lengths[256] )
+{
+    size_t bits = 0;
+    for (int s = 0; s < 256; ++s)
+    {
+        bits += size_t( freq[s] ) * lengths[s];
+    }
+    return HUFFMAN_TABLE_BYTES + sizeof(uint32_t) + ( bits + 7 ) / 8;
+}
+
+void EncodePlane( const uint8_t* plane, size_t count, std::vector<uint8_t>& out )
+{
+    bool constant = true;
+    for (size_t i = 1; i < count && constant; ++i)
+    {
+        constant = ( plane[i] == plane[0] );
+    }
+    if (constant)
+    {
+        out.push_back( PLANE_CONSTANT );
+        out.push_back( plane[0] );
+        return;
+    }
+
+    std::vector<uint8_t> delta( count );
+    delta[0] = plane[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        delta[i] = static_cast<uint8_t>( plane[i] - plane[i - 1] );
+    }
+
+    uint32_t freqRaw[256] = {};
+    uint32_t freqDelta[256] = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        ++freqRaw[ plane[i] ];
+        ++freqDelta[ delta[i] ];
+    }
+
+    HuffmanCode raw;
+    HuffmanCode del;
+    BuildCodeLengths( freqRaw, raw.lengths );
+    BuildCodeLengths( freqDelta, del.lengths );
+    size_t rawCost = HuffmanCost( freqRaw, raw.lengths );
+    size_t deltaCost = HuffmanCost( freqDelta, del.lengths );
+
+    if (count <= std::min( rawCost, deltaCost ))
+    {
+        out.push_back( PLANE_STORED );
+        out.insert( out.end(), plane, plane + count );
+        return;
+    }
+
+    bool useDelta = deltaCost < rawCost;
+    HuffmanCode& code = useDelta ? del : raw;
+    const uint8_t* symbols = useDelta ? &delta[0] : plane;
+    BuildCanonicalCodes( code );
+
+    out.push_back( static_cast<uint8_t>( useDelta ? PLANE_DELTA : PLANE_HUFFMAN ) );
+    for (int s = 0; s < 256; s += 2)
+    {
+        out.push_back( static_cast<uint8_t>( code.lengths[s] | ( code.lengths[s + 1] << 4 ) ) );
+    }
+
+    size_t sizePos = out.size();
+    out.resize( out.size() + sizeof(uint32_t) );
+
+    size_t start = out.size();
+    BitWriter writer( out );
+    for (size_t i = 0; i < count; ++i)
+    {
+        writer.Put( code.codes[ symbols[i] ], code.lengths[ symbols[i] ] );
+    }
+    writer.Flush();
+
+    uint32_t byteCount = static_cast<uint32_t>( out.size() - start );
+    memcpy( &out[sizePos], &byteCount, sizeof(byteCount) );
+}
+
+// Decodes one plane into dest (count bytes, dest[i * stride]). Returns bytes read, 0 on error.
+size_t DecodePlane( const uint8_t* data, size_t size, size_t count, uint8_t* dest, size_t stride )
+{
+    if (size < 1)
+    {
+        return 0;
+    }
+
+    switch (data[0])
+    {
+    case PLANE_STORED:
+        if (size < 1 + count)
+        {
+            return 0;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i * stride] = data[1 + i];
+        }
+        return 1 + count;
+
+    case PLANE_CONSTANT:
+        if (size < 2)
+        {
+            return 0;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i * stride] = data[1];
+        }
+        return 2;
+
+    case PLANE_HUFFMAN:
+    case PLANE_DELTA:
+        break;
+
+    default:
+        return 0;
+    }
+
+    size_t headerSize = 1 + HUFFMAN_TABLE_BYTES + sizeof(uint32_t);
+    if (size < headerSize)
+    {
+        return 0;
+    }
+
+    uint8_t lengths[256];
+    for (int s = 0; s < 256; s += 2)
+    {
+        lengths[s] = data[1 + s / 2] & 0xF;
+        lengths[s + 1] = data[1 + s / 2] >> 4;
+    }
+
+    uint32_t byteCount;
+    memcpy( &byteCount, data + 1 + HUFFMAN_TABLE_BYTES, sizeof(byteCount) );
+    if (size - headerSize < byteCount)
+    {
+        return 0;
+    }
+
+    HuffmanCode code;
+    memcpy( code.lengths, lengths, sizeof(lengths) );
+    for (int s = 0; s < 256; ++s)
+    {
+        if (code.lengths[s] > HUFFMAN_MAX_BITS)
+        {
+            return 0;
+        }
+    }
+    BuildCanonicalCodes( code );
+
+    // Every HUFFMAN_MAX_BITS pattern maps to (symbol, length); unused patterns stay length 0
+    uint16_t table[1 << HUFFMAN_MAX_BITS];
+    memset( table, 0, sizeof(table) );
+    for (int s = 0; s < 256; ++s)
+    {
+        int len = code.lengths[s];
+        if (!len)
+        {
+            continue;
+        }
+        for (int fill = code.codes[s]; fill < ( 1 << HUFFMAN_MAX_BITS ); fill += ( 1 << len ))
+        {
+            table[fill] = static_cast<uint16_t>( ( s << 4 ) | len );
+        }
+    }
+
+    BitReader reader( data + headerSize, byteCount );
+    bool delta = ( data[0] == PLANE_DELTA );
+    uint8_t previous = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint16_t entry = table[ reader.Peek( HUFFMAN_MAX_BITS ) ];
+        int len = entry & 0xF;
+        if (!len)
+        {
+            return 0;
+        }
+        reader.Skip( len );
+
+        uint8_t value = static_cast<uint8_t>( entry >> 4 );
+        if (delta)
+        {
+            value = static_cast<uint8_t>( value + previous );
+            previous = value;
+        }
+        dest[i * stride] = value;
+    }
+
+    return reader.Valid() ? headerSize + byteCount : 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Reads and checks the header and slice table
+//--------------------------------------------------------------------------------------
+bool ReadBCZHeaders( const uint8_t* bczData, size_t bczDataSize,
+                     BCZ_HEADER& header, const BCZ_SLICE*& slices, std::vector<LevelInfo>& levels )
+{
+    if (!bczData || bczDataSize < sizeof(BCZ_HEADER))
+    {
+        return false;
+    }
+
+    memcpy( &header, bczData, sizeof(header) );
+    if (header.magic != BCZ_MAGIC || header.version != BCZ_VERSION
+        || !header.width || !header.height || header.format > BC_FORMAT_BC7
+        || !header.mipCount || header.mipCount > CountMips( header.width, header.height )
+        || !header.sliceCount)
+    {
+        return false;
+    }
+
+    size_t tableEnd = sizeof(BCZ_HEADER) + size_t( header.sliceCount ) * sizeof(BCZ_SLICE);
+    if (tableEnd > bczDataSize)
+    {
+        return false;
+    }
+
+    slices = reinterpret_cast<const BCZ_SLICE*>( bczData + sizeof(BCZ_HEADER) );
+    ComputeLevels( header.width, header.height, header.mipCount, BC_FORMAT( header.format ), levels );
+
+    // Slices must cover every block row of every level exactly once, in order
+    size_t level = 0;
+    size_t row = 0;
+    for (uint32_t i = 0; i < header.sliceCount; ++i)
+    {
+        const BCZ_SLICE& slice = slices[i];
+        if (slice.level != level || slice.firstBlockRow != row || !slice.blockRows
+            || row + slice.blockRows > levels[level].blocksHigh
+            || slice.dataOffset < tableEnd || slice.dataOffset > bczDataSize
+            || slice.dataSize > bczDataSize - slice.dataOffset)
+        {
+            return false;
+        }
+
+        row += slice.blockRows;
+        if (row == levels[level].blocksHigh)
+        {
+            ++level;
+            row = 0;
+        }
+    }
+
+    return level == header.mipCount;
+}
+
+};
+
+//--------------------------------------------------------------------------------------
+bool DirectX::EncodeBCZ( const uint8_t* blocks,
+                         size_t width,
+                         size_t height,
+                         size_t mipCount,
+                         BC_FORMAT format,
+                         bool srgb,
+                         std::vector<uint8_t>& bczData,
+                         unsigned int threadCount )
+{
+    bczData.clear();
+    if (!blocks || !width || !height || !mipCount || mipCount > CountMips( width, height ))
+    {
+        return false;
+    }
+
+    std::vector<LevelInfo> levels;
+    ComputeLevels( width, height, mipCount, format, levels );
+
+    std::vector<BCZ_SLICE> slices;
+    for (size_t level = 0; level < mipCount; ++level)
+    {
+        for (size_t row = 0; row < levels[level].blocksHigh; row += SLICE_BLOCK_ROWS)
+        {
+            BCZ_SLICE slice = {};
+            slice.level = static_cast<uint32_t>( level );
+            slice.firstBlockRow = static_cast<uint32_t>( row );
+            slice.blockRows = static_cast<uint32_t>( std::min( SLICE_BLOCK_ROWS, levels[level].blocksHigh - row ) );
+            slices.push_back( slice );
+        }
+    }
+
+    // Code every slice independently
+    size_t blockSize = BCBlockSize( format );
+    std::vector<std::vector<uint8_t>> payloads( slices.size() );
+    ParallelFor( slices.size(), threadCount, [&]( size_t index )
+    {
+        const BCZ_SLICE& slice = slices[index];
+        const LevelInfo& level = levels[ slice.level ];
+        size_t count = level.blocksWide * slice.blockRows;
+        const uint8_t* src = blocks + level.offset + slice.firstBlockRow * level.blocksWide * blockSize;
+
+        std::vector<uint8_t> plane( count );
+        for (size_t k = 0; k < blockSize; ++k)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                plane[i] = src[i * blockSize + k];
+            }
+            EncodePlane( &plane[0], count, payloads[index] );
+        }
+    } );
+
+    BCZ_HEADER header = {};
+    header.magic = BCZ_MAGIC;
+    header.version = BCZ_VERSION;
+    header.width = static_cast<uint32_t>( width );
+    header.height = static_cast<uint32_t>( height );
+    header.mipCount = static_cast<uint32_t>( mipCount );
+    header.format = static_cast<uint32_t>( format );
+    header.flags = srgb ? BCZ_FLAGS_SRGB : 0;
+    header.sliceCount = static_cast<uint32_t>( slices.size() );
+
+    size_t offset = sizeof(BCZ_HEADER) + slices.size() * sizeof(BCZ_SLICE);
+    for (size_t i = 0; i < slices.size(); ++i)
+    {
+        slices[i].dataOffset = static_cast<uint32_t>( offset );
+        slices[i].dataSize = static_cast<uint32_t>( payloads[i].size() );
+        offset += payloads[i].size();
+    }
+
+    bczData.reserve( offset );
+    bczData.insert( bczData.end(), reinterpret_cast<const uint8_t*>( &header ), reinterpret_cast<const uint8_t*>( &header ) + sizeof(header) );
+    bczData.insert( bczData.end(), reinterpret_cast<const uint8_t*>( &slices[0] ), reinterpret_cast<const uint8_t*>( &slices[0] ) + slices.size() * sizeof(BCZ_SLICE) );
+    for (size_t i = 0; i < payloads.size(); ++i)
+    {
+        bczData.insert( bczData.end(), payloads[i].begin(), payloads[i].end() );
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::SaveBCZTextureToFile( const char* fileName,
+                                    const uint8_t* rgba,
+                                    size_t width,
+                                    size_t height,
+                                    size_t rowPitch,
+                                    BC_FORMAT format,
+                                    bool srgb,
+                                    bool generateMips,
+                                    BCEncodeStats* stats,
+                                    unsigned int threadCount )
+{
+    if (!fileName)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> blocks;
+    size_t mipCount = 0;
+    if (!CompressMipChain( rgba, width, height, rowPitch, format, srgb, generateMips, blocks, mipCount, stats, threadCount ))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> bczData;
+    if (!EncodeBCZ( &blocks[0], width, height, mipCount, format, srgb, bczData, threadCount ))
+    {
+        return false;
+    }
+
+    std::ofstream outFile( fileName, std::ios::out | std::ios::binary );
+    if (!outFile.good())
+    {
+        return false;
+    }
+
+    outFile.write( (const char*)&bczData[0], bczData.size() );
+    outFile.close();
+
+    return outFile.good();
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::GetBCZTextureInfo( const uint8_t* bczData, size_t bczDataSize, BCZTextureInfo& info )
+{
+    BCZ_HEADER header;
+    const BCZ_SLICE* slices = nullptr;
+    std::vector<LevelInfo> levels;
+    if (!ReadBCZHeaders( bczData, bczDataSize, header, slices, levels ))
+    {
+        return false;
+    }
+
+    info.width = header.width;
+    info.height = header.height;
+    info.mipCount = header.mipCount;
+    info.format = BC_FORMAT( header.format );
+    info.srgb = ( header.flags & BCZ_FLAGS_SRGB ) != 0;
+    info.blockBytes = ComputeLevels( header.width, header.height, header.mipCount, info.format, levels );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::TranscodeBCZToDDS( const uint8_t* bczData,
+                                 size_t bczDataSize,
+                                 BC_FORMAT targetFormat,
+                                 std::vector<uint8_t>& ddsData,
+                                 BCZTranscodeStats* stats,
+                                 unsigned int threadCount )
+{
+    ddsData.clear();
+
+    BCZ_HEADER header;
+    const BCZ_SLICE* slices = nullptr;
+    std::vector<LevelInfo> levels;
+    if (!ReadBCZHeaders( bczData, bczDataSize, header, slices, levels ))
+    {
+        return false;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    BC_FORMAT format = BC_FORMAT( header.format );
+    bool srgb = ( header.flags & BCZ_FLAGS_SRGB ) != 0;
+    size_t blockSize = BCBlockSize( format );
+    size_t blockBytes = ComputeLevels( header.width, header.height, header.mipCount, format, levels );
+
+    // Entropy decode straight into the stored block layout, one slice per job
+    std::vector<uint8_t> blocks( blockBytes );
+    std::atomic<bool> failed( false );
+    ParallelFor( header.sliceCount, threadCount, [&]( size_t index )
+    {
+        const BCZ_SLICE& slice = slices[index];
+        const LevelInfo& level = levels[ slice.level ];
+        size_t count = level.blocksWide * slice.blockRows;
+        uint8_t* dest = &blocks[ level.offset + slice.firstBlockRow * level.blocksWide * blockSize ];
+
+        const uint8_t* data = bczData + slice.dataOffset;
+        size_t remaining = slice.dataSize;
+        for (size_t k = 0; k < blockSize; ++k)
+        {
+            size_t used = DecodePlane( data, remaining, count, dest + k, blockSize );
+            if (!used)
+            {
+                failed = true;
+                return;
+            }
+            data += used;
+            remaining -= used;
+        }
+    } );
+
+    if (failed)
+    {
+        return false;
+    }
+
+    // Re-encode for devices that cannot sample the stored format
+    if (targetFormat != format)
+    {
+        std::vector<LevelInfo> targetLevels;
+        std::vector<uint8_t> converted( ComputeLevels( header.width, header.height, header.mipCount, targetFormat, targetLevels ) );
+        std::vector<uint8_t> rgba;
+        size_t w = header.width;
+        size_t h = header.height;
+        for (size_t i = 0; i < header.mipCount; ++i)
+        {
+            rgba.resize( w * h * 4 );
+            if (!DecompressSurface( &blocks[ levels[i].offset ], w, h, format, &rgba[0] )
+                || !CompressSurface( &rgba[0], w, h, w * 4, targetFormat, &converted[ targetLevels[i].offset ], threadCount ))
+            {
+                return false;
+            }
+            w = std::max<size_t>( 1, w >> 1 );
+            h = std::max<size_t>( 1, h >> 1 );
+        }
+        blocks.swap( converted );
+    }
+
+    AppendBCDDSHeaders( ddsData, header.width, header.height, header.mipCount, targetFormat, srgb );
+    ddsData.insert( ddsData.end(), blocks.begin(), blocks.end() );
+
+    if (stats)
+    {
+        double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+        stats->compressedBytes = bczDataSize;
+        stats->blockBytes = blocks.size();
+        stats->seconds = seconds;
+        stats->megabytesPerSecond = ( seconds > 0.0 ) ? double( blocks.size() ) / seconds / 1e6 : 0.0;
+    }
+
+    return true;
+}
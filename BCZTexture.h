@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// File: BCZTexture.h
+//
+// BCZ: supercompressed BC textures.
+//
+// A BCZ file holds the same BC1 / BC3 / BC7 blocks a DDS file would, with an entropy
+// layer on top. Each mip level is cut into slices of block rows; within a slice byte k
+// of every block forms its own plane, and every plane is Huffman coded (optionally after
+// delta coding) with its own table. Endpoint bytes compress well that way, index bytes
+// much less so.
+//
+// Transcoding undoes the entropy layer on worker threads, one slice per job, and
+// produces an in-memory DDS file for DDSTextureLoader. If the device cannot sample the
+// stored format (BC7 below feature level 11) the blocks are re-encoded to the target
+// format. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef BCZTEXTURE_H
+#define BCZTEXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "BlockCompressor.h"
+
+namespace DirectX
+{
+    struct BCZTextureInfo
+    {
+        size_t      width;
+        size_t      height;
+        size_t      mipCount;
+        BC_FORMAT   format;         // format of the stored blocks
+        bool        srgb;
+        size_t      blockBytes;     // size of all blocks once the entropy layer is removed
+    };
+
+    struct BCZTranscodeStats
+    {
+        size_t      compressedBytes;
+        size_t      blockBytes;
+        double      seconds;            // wall clock, entropy decode plus any re-encode
+        double      megabytesPerSecond; // block bytes produced per second
+    };
+
+    // Entropy codes a tightly packed BC mip chain (level 0 first, as CompressMipChain
+    // produces). Slices are coded in parallel; threadCount of 0 uses every hardware thread.
+    bool EncodeBCZ( const uint8_t* blocks,
+                    size_t width,
+                    size_t height,
+                    size_t mipCount,
+                    BC_FORMAT format,
+                    bool srgb,
+                    std::vector<uint8_t>& bczData,
+                    unsigned int threadCount = 0 );
+
+    // Compresses an RGBA8 image (optionally with a generated mip chain) and writes a BCZ file
+    bool SaveBCZTextureToFile( const char* fileName,
+                               const uint8_t* rgba,
+                               size_t width,
+                               size_t height,
+                               size_t rowPitch,
+                               BC_FORMAT format,
+                               bool srgb,
+                               bool generateMips,
+                               BCEncodeStats* stats = nullptr,
+                               unsigned int threadCount = 0 );
+
+    // Validates the headers and slice table of a BCZ file in memory
+    bool GetBCZTextureInfo( const uint8_t* bczData, size_t bczDataSize, BCZTextureInfo& info );
+
+    // Decodes a BCZ file to a DDS file in memory holding targetFormat blocks.
+    // stats is optional.
+    bool TranscodeBCZToDDS( const uint8_t* bczData,
+                            size_t bczDataSize,
+                            BC_FORMAT targetFormat,
+                            std::vector<uint8_t>& ddsData,
+                            BCZTranscodeStats* stats = nullptr,
+                            unsigned int threadCount = 0 );
+}
+
+#endif // BCZTEXTURE_H
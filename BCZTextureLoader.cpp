@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// File: BCZTextureLoader.cpp
+//
+// Functions for loading a BCZ (supercompressed BC) texture and creating a Direct3D 11
+// runtime resource for it.
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <vector>
+
+#include "BCZTextureLoader.h"
+#include "BCZTexture.h"
+#include "DDSTextureLoader.h"
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Picks the block format to transcode to: the stored one if the device can sample it
+//--------------------------------------------------------------------------------------
+static BC_FORMAT GetTargetFormat( _In_ ID3D11Device* d3dDevice, _In_ const BCZTextureInfo& info )
+{
+    if ( info.format != BC_FORMAT_BC7 )
+    {
+        return info.format;
+    }
+
+    UINT fmtSupport = 0;
+    HRESULT hr = d3dDevice->CheckFormatSupport( info.srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM, &fmtSupport );
+    if ( SUCCEEDED(hr) && ( fmtSupport & D3D11_FORMAT_SUPPORT_TEXTURE2D ) )
+    {
+        return BC_FORMAT_BC7;
+    }
+
+    return BC_FORMAT_BC3;
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::CreateBCZTextureFromMemory( ID3D11Device* d3dDevice,
+                                             const uint8_t* bczData,
+                                             size_t bczDataSize,
+                                             ID3D11Resource** texture,
+                                             ID3D11ShaderResourceView** textureView,
+                                             unsigned int threadCount )
+{
+    if ( texture )
+    {
+        *texture = nullptr;
+    }
+    if ( textureView )
+    {
+        *textureView = nullptr;
+    }
+
+    if ( !d3dDevice || !bczData || (!texture && !textureView) )
+    {
+        return E_INVALIDARG;
+    }
+
+    BCZTextureInfo info;
+    if ( !GetBCZTextureInfo( bczData, bczDataSize, info ) )
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    std::vector<uint8_t> ddsData;
+    if ( !TranscodeBCZToDDS( bczData, bczDataSize, GetTargetFormat( d3dDevice, info ), ddsData, nullptr, threadCount ) )
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    return CreateDDSTextureFromMemory( d3dDevice, ddsData.data(), ddsData.size(), texture, textureView );
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::CreateBCZTextureFromFile( ID3D11Device* d3dDevice,
+                                           const wchar_t* fileName,
+                                           ID3D11Resource** texture,
+                                           ID3D11ShaderResourceView** textureView,
+                                           unsigned int threadCount )
+{
+    if ( !fileName )
+    {
+        return E_INVALIDARG;
+    }
+
+    std::ifstream inFile( fileName, std::ios::in | std::ios::binary | std::ios::ate );
+    if ( !inFile.good() )
+    {
+        return HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND );
+    }
+
+    std::vector<uint8_t> bczData( static_cast<size_t>( inFile.tellg() ) );
+    inFile.seekg( 0 );
+    inFile.read( reinterpret_cast<char*>( bczData.data() ), bczData.size() );
+    if ( !inFile.good() || bczData.empty() )
+    {
+        return E_FAIL;
+    }
+
+    return CreateBCZTextureFromMemory( d3dDevice, bczData.data(), bczData.size(), texture, textureView, threadCount );
+}
@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// File: BCZTextureLoader.h
+//
+// Functions for loading a BCZ (supercompressed BC) texture and creating a Direct3D 11
+// runtime resource for it.
+//
+// The entropy layer is removed on worker threads and the resulting DDS image goes
+// through DDSTextureLoader. BC7 data is transcoded to BC3 on devices that cannot sample
+// BC7 (feature level 10.1 and below).
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11_1.h>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+namespace DirectX
+{
+    HRESULT CreateBCZTextureFromMemory( _In_ ID3D11Device* d3dDevice,
+                                        _In_reads_bytes_(bczDataSize) const uint8_t* bczData,
+                                        _In_ size_t bczDataSize,
+                                        _Outptr_opt_ ID3D11Resource** texture,
+                                        _Outptr_opt_ ID3D11ShaderResourceView** textureView,
+                                        _In_ unsigned int threadCount = 0
+                                      );
+
+    HRESULT CreateBCZTextureFromFile( _In_ ID3D11Device* d3dDevice,
+                                      _In_z_ const wchar_t* fileName,
+                                      _Outptr_opt_ ID3D11Resource** texture,
+                                      _Outptr_opt_ ID3D11ShaderResourceView** textureView,
+                                      _In_ unsigned int threadCount = 0
+                                    );
+}
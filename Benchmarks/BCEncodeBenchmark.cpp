@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// File: BCEncodeBenchmark.cpp
+//
+// BC1/BC3/BC7 encode throughput and quality for the sample textures.
+//
+// Each image is encoded with its full mip chain, on one thread and on every hardware
+// thread. MPix/s counts the pixels of all levels; PSNR is of the top level, RGB only for
+// BC1, as BCEncodeStats reports it.
+//--------------------------------------------------------------------------------------
+
+#include "BenchmarkCommon.h"
+#include "BlockCompressor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 3;
+
+};
+
+
+int main()
+{
+    std::vector<uint8_t> crate;
+    size_t crateWidth, crateHeight;
+    if ( !Benchmark::LoadSampleImage( "Crate_COLOR.dds", crate, crateWidth, crateHeight ) )
+        return 1;
+
+    std::vector<uint8_t> mud;
+    size_t mudWidth, mudHeight;
+    if ( !Benchmark::LoadSampleImage( "Mud_COLOR.dds", mud, mudWidth, mudHeight ) )
+        return 1;
+
+    std::vector<uint8_t> crate2k;
+    Benchmark::TileImage( crate, crateWidth, crateHeight, 2048, 2048, crate2k );
+
+    const struct
+    {
+        const char*             name;
+        const uint8_t*          rgba;
+        size_t                  width;
+        size_t                  height;
+    } images[] =
+    {
+        { "crate 2048",  crate2k.data(), 2048, 2048 },
+        { "mud",         mud.data(), mudWidth, mudHeight },
+    };
+    const char* formatNames[] = { "BC1", "BC3", "BC7" };
+
+    printf( "BC encode with mips, best of %d runs\n", RUNS );
+    printf( "%-12s %-11s %-6s %12s %12s %10s\n", "image", "size", "format", "MPix/s 1T", "MPix/s all", "PSNR dB" );
+
+    for ( const auto& image : images )
+    {
+        for ( int format = BC_FORMAT_BC1; format <= BC_FORMAT_BC7; ++format )
+        {
+            double megapixelsPerSecond[2];
+            BCEncodeStats stats = {};
+            for ( int threads = 0; threads < 2; ++threads )
+            {
+                std::vector<uint8_t> blocks;
+                size_t mipCount;
+                bool ok = true;
+                double seconds = Benchmark::BestSeconds( RUNS, [&]()
+                {
+                    ok = CompressMipChain( image.rgba, image.width, image.height, image.width * 4,
+                                           static_cast<BC_FORMAT>( format ), false, true, blocks, mipCount,
+                                           &stats, threads == 0 ? 1 : 0 ) && ok;
+                } );
+                if ( !ok )
+                {
+                    fprintf( stderr, "CompressMipChain failed for %s %s\n", image.name, formatNames[format] );
+                    return 1;
+                }
+                megapixelsPerSecond[threads] = double( stats.pixels ) / seconds * 1e-6;
+            }
+
+            char size[32];
+            snprintf( size, sizeof(size), "%zux%zu", image.width, image.height );
+            printf( "%-12s %-11s %-6s %12.1f %12.1f %10.2f\n", image.name, size, formatNames[format],
+                    megapixelsPerSecond[0], megapixelsPerSecond[1], stats.psnr );
+        }
+    }
+
+    return 0;
+}
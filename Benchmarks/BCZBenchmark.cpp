@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// File: BCZBenchmark.cpp
+//
+// BCZ compression ratio and transcode throughput for the sample textures.
+//
+// Each image is block compressed with its full mip chain, entropy coded to BCZ and then
+// transcoded back to a DDS file in memory, on one thread and on every hardware thread.
+// Ratio is the BCZ size over the raw block size; MB/s counts the block bytes produced.
+// BC7 files are also transcoded to BC3, the path taken on devices without BC7.
+//--------------------------------------------------------------------------------------
+
+#include "BenchmarkCommon.h"
+#include "BCZTexture.h"
+#include "DDSParser.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 3;
+
+bool Transcode( const std::vector<uint8_t>& bcz, BC_FORMAT target, unsigned int threadCount, double& megabytesPerSecond )
+{
+    std::vector<uint8_t> dds;
+    BCZTranscodeStats stats = {};
+    bool ok = true;
+    double seconds = Benchmark::BestSeconds( RUNS, [&]()
+    {
+        ok = TranscodeBCZToDDS( bcz.data(), bcz.size(), target, dds, &stats, threadCount ) && ok;
+    } );
+    megabytesPerSecond = double( stats.blockBytes ) / seconds * 1e-6;
+    return ok;
+}
+
+};
+
+
+int main()
+{
+    std::vector<uint8_t> crate;
+    size_t crateWidth, crateHeight;
+    if ( !Benchmark::LoadSampleImage( "Crate_COLOR.dds", crate, crateWidth, crateHeight ) )
+        return 1;
+
+    std::vector<uint8_t> mud;
+    size_t mudWidth, mudHeight;
+    if ( !Benchmark::LoadSampleImage( "Mud_COLOR.dds", mud, mudWidth, mudHeight ) )
+        return 1;
+
+    std::vector<uint8_t> crate2k;
+    Benchmark::TileImage( crate, crateWidth, crateHeight, 2048, 2048, crate2k );
+
+    const struct
+    {
+        const char*             name;
+        const uint8_t*          rgba;
+        size_t                  width;
+        size_t                  height;
+    } images[] =
+    {
+        { "crate 2048",  crate2k.data(), 2048, 2048 },
+        { "mud",         mud.data(), mudWidth, mudHeight },
+    };
+    const char* formatNames[] = { "BC1", "BC3", "BC7" };
+
+    printf( "BCZ transcode to DDS, best of %d runs\n", RUNS );
+    printf( "%-12s %-6s %12s %8s %10s %10s %14s\n", "image", "format", "block bytes", "ratio", "MB/s 1T", "MB/s all", "to BC3 MB/s" );
+
+    for ( const auto& image : images )
+    {
+        for ( int format = BC_FORMAT_BC1; format <= BC_FORMAT_BC7; ++format )
+        {
+            std::vector<uint8_t> blocks;
+            size_t mipCount;
+            std::vector<uint8_t> bcz;
+            if ( !CompressMipChain( image.rgba, image.width, image.height, image.width * 4,
+                                    static_cast<BC_FORMAT>( format ), false, true, blocks, mipCount ) ||
+                 !EncodeBCZ( blocks.data(), image.width, image.height, mipCount,
+                             static_cast<BC_FORMAT>( format ), false, bcz ) )
+            {
+                fprintf( stderr, "Encoding %s %s failed\n", image.name, formatNames[format] );
+                return 1;
+            }
+
+            // The transcoded blocks have to be the ones that were encoded
+            std::vector<uint8_t> dds;
+            DDSTextureInfo info;
+            if ( !TranscodeBCZToDDS( bcz.data(), bcz.size(), static_cast<BC_FORMAT>( format ), dds ) ||
+                 ParseDDS( dds.data(), dds.size(), info ) != DDS_PARSE_OK ||
+                 info.dataSize != blocks.size() ||
+                 memcmp( dds.data() + info.dataOffset, blocks.data(), blocks.size() ) != 0 )
+            {
+                fprintf( stderr, "Round trip of %s %s failed\n", image.name, formatNames[format] );
+                return 1;
+            }
+
+            double single, all, toBC3 = 0.0;
+            bool ok = Transcode( bcz, static_cast<BC_FORMAT>( format ), 1, single ) &&
+                      Transcode( bcz, static_cast<BC_FORMAT>( format ), 0, all );
+            if ( format == BC_FORMAT_BC7 )
+                ok = Transcode( bcz, BC_FORMAT_BC3, 0, toBC3 ) && ok;
+            if ( !ok )
+            {
+                fprintf( stderr, "Transcoding %s %s failed\n", image.name, formatNames[format] );
+                return 1;
+            }
+
+            char bc3[32] = "-";
+            if ( format == BC_FORMAT_BC7 )
+                snprintf( bc3, sizeof(bc3), "%.1f", toBC3 );
+            printf( "%-12s %-6s %12zu %8.3f %10.0f %10.0f %14s\n", image.name, formatNames[format], blocks.size(),
+                    double( bcz.size() ) / double( blocks.size() ), single, all, bc3 );
+        }
+    }
+
+    return 0;
+}
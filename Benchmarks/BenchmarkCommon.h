@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkCommon.h
+//
+// Helpers shared by the benchmark drivers: timing, reading the repo's sample files and
+// building test images and height grids.
+//
+// Every figure is the best of several runs, which is the least disturbed by other work
+// on the machine. FRAMEWORK_DATA_DIR is set by the build to the directory holding the
+// sample files.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef BENCHMARKCOMMON_H
+#define BENCHMARKCOMMON_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "HeightmapLoader.h"
+#include "ProceduralTerrain.h"
+#include "TextureAtlas.h"
+
+#ifndef FRAMEWORK_DATA_DIR
+#define FRAMEWORK_DATA_DIR "."
+#endif
+
+namespace Benchmark
+{
+    // Shortest wall clock time of runs calls to work, in seconds
+    template<typename Work>
+    double BestSeconds( int runs, Work work )
+    {
+        double best = 1e30;
+        for ( int run = 0; run < runs; ++run )
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            work();
+            double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+            best = std::min( best, seconds );
+        }
+        return best;
+    }
+
+    inline std::string DataPath( const char* fileName )
+    {
+        return std::string( FRAMEWORK_DATA_DIR ) + "/" + fileName;
+    }
+
+    inline bool ReadDataFile( const char* fileName, std::vector<uint8_t>& data )
+    {
+        std::string path = DataPath( fileName );
+        FILE* file = fopen( path.c_str(), "rb" );
+        if ( !file )
+        {
+            fprintf( stderr, "Cannot open %s\n", path.c_str() );
+            return false;
+        }
+
+        fseek( file, 0, SEEK_END );
+        long size = ftell( file );
+        fseek( file, 0, SEEK_SET );
+
+        data.resize( size > 0 ? size_t( size ) : 0 );
+        bool ok = size > 0 && fread( data.data(), 1, data.size(), file ) == data.size();
+        fclose( file );
+        return ok;
+    }
+
+    // Decodes the top level of one of the sample DDS textures to RGBA8
+    inline bool LoadSampleImage( const char* fileName, std::vector<uint8_t>& rgba, size_t& width, size_t& height )
+    {
+        std::vector<uint8_t> dds;
+        if ( !ReadDataFile( fileName, dds ) )
+            return false;
+
+        if ( !DirectX::DecodeAtlasImageFromDDS( dds.data(), dds.size(), rgba, width, height ) )
+        {
+            fprintf( stderr, "Cannot decode %s\n", fileName );
+            return false;
+        }
+        return true;
+    }
+
+    // Repeats an RGBA8 image to fill width x height, so results do not depend on the
+    // size the sample happens to have
+    inline void TileImage( const std::vector<uint8_t>& source, size_t sourceWidth, size_t sourceHeight,
+                           size_t width, size_t height, std::vector<uint8_t>& dest )
+    {
+        dest.resize( width * height * 4 );
+        for ( size_t y = 0; y < height; ++y )
+        {
+            for ( size_t x = 0; x < width; ++x )
+            {
+                memcpy( &dest[( y * width + x ) * 4], &source[( ( y % sourceHeight ) * sourceWidth + x % sourceWidth ) * 4], 4 );
+            }
+        }
+    }
+
+    // Heightmap.bmp as the application loads it, 225x225 samples from 0 to 25.5
+    inline bool LoadSampleHeights( std::vector<float>& heights, size_t& width, size_t& depth )
+    {
+        DirectX::HeightmapLoadDesc desc = { DirectX::HEIGHTMAP_UNKNOWN, 0, 0, false, 25.5f, 0.0f };
+        DirectX::HeightmapInfo info;
+        std::string path = DataPath( "Heightmap.bmp" );
+        if ( !DirectX::LoadHeightmap( path.c_str(), desc, heights, &info ) )
+        {
+            fprintf( stderr, "Cannot load %s\n", path.c_str() );
+            return false;
+        }
+        width = info.width;
+        depth = info.depth;
+        return true;
+    }
+
+    // Rolling fBm hills, for grids larger than the sample heightmap
+    inline void MakeTerrainHeights( size_t size, std::vector<float>& heights,
+                                    DirectX::PROCEDURAL_NOISE noise = DirectX::PROCEDURAL_FBM )
+    {
+        DirectX::ProceduralTerrainDesc desc = { noise, 1234, 8, 1.0f / 256.0f, 2.0f, 0.5f, 32.0f, 80.0f, 0.0f };
+        DirectX::GenerateProceduralHeights( desc, 0, 0, size, size, heights );
+    }
+}
+
+#endif // BENCHMARKCOMMON_H
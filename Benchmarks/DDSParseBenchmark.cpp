@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: DDSParseBenchmark.cpp
+//
+// DDS header validation and subresource layout throughput.
+//
+// Each iteration runs ParseDDS and BuildDDSLayout on a file already in memory, which is
+// all DDSTextureLoader does before creating the texture. Headers/s is iterations per
+// second; GB/s is the file bytes those iterations describe, to compare with how fast the
+// file can be read in the first place.
+//--------------------------------------------------------------------------------------
+
+#include "BenchmarkCommon.h"
+#include "BlockCompressor.h"
+#include "DDSParser.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 5;
+const size_t ITERATIONS = 200000;
+
+};
+
+
+int main()
+{
+    struct Sample
+    {
+        std::string             name;
+        std::vector<uint8_t>    data;
+    };
+    std::vector<Sample> samples;
+
+    const char* files[] = { "Crate_COLOR.dds", "Mud_COLOR.dds", "Surface_COLOR.dds" };
+    for ( const char* file : files )
+    {
+        Sample sample;
+        sample.name = file;
+        if ( !Benchmark::ReadDataFile( file, sample.data ) )
+            return 1;
+        samples.push_back( sample );
+    }
+
+    // A DX10-header file with a full chain, which has the most subresources to lay out
+    {
+        Sample sample;
+        sample.name = "BC7 sRGB 4096 (DX10)";
+        size_t mipCount = 13;
+        AppendBCDDSHeaders( sample.data, 4096, 4096, mipCount, BC_FORMAT_BC7, true );
+        size_t headerSize = sample.data.size();
+        size_t dataSize = 0;
+        for ( size_t level = 0; level < mipCount; ++level )
+        {
+            size_t size = std::max<size_t>( 4096 >> level, 1 );
+            dataSize += ComputeBCSurfaceSize( size, size, BC_FORMAT_BC7 );
+        }
+        sample.data.resize( headerSize + dataSize );
+        samples.push_back( sample );
+    }
+
+    printf( "ParseDDS + BuildDDSLayout, %zu iterations, best of %d runs\n", ITERATIONS, RUNS );
+    printf( "%-22s %10s %6s %14s %12s\n", "file", "bytes", "subres", "headers/s", "GB/s" );
+
+    for ( const auto& sample : samples )
+    {
+        DDSTextureInfo info;
+        std::vector<DDSSubresource> layout;
+        bool ok = true;
+        double seconds = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            for ( size_t i = 0; i < ITERATIONS; ++i )
+            {
+                ok = ParseDDS( sample.data.data(), sample.data.size(), info ) == DDS_PARSE_OK &&
+                     BuildDDSLayout( info, layout ) == DDS_PARSE_OK && ok;
+            }
+        } );
+        if ( !ok )
+        {
+            fprintf( stderr, "Parsing %s failed\n", sample.name.c_str() );
+            return 1;
+        }
+
+        double headersPerSecond = double( ITERATIONS ) / seconds;
+        printf( "%-22s %10zu %6zu %14.0f %12.1f\n", sample.name.c_str(), sample.data.size(), layout.size(),
+                headersPerSecond, headersPerSecond * double( sample.data.size() ) * 1e-9 );
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// File: MipBenchmark.cpp
+//
+// Mip chain generation throughput for every MipGenerator format and filter.
+//
+// The source is Crate_COLOR.dds repeated to 2048x2048 and converted to each format.
+// MPix/s counts level 0 pixels, so a full chain's extra third is included in the time.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "BenchmarkCommon.h"
+#include "MipGenerator.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const size_t IMAGE_SIZE = 2048;
+const int RUNS = 5;
+
+// Values in [0,1] only
+uint16_t UNormToHalf( float value )
+{
+    if ( value < 6.103515625e-5f )
+        return static_cast<uint16_t>( value * 16777216.0f + 0.5f );
+
+    int exponent;
+    float mantissa = frexpf( value, &exponent );
+    unsigned int bits = static_cast<unsigned int>( exponent + 14 ) << 10;
+    bits += static_cast<unsigned int>( ( mantissa * 2.0f - 1.0f ) * 1024.0f + 0.5f );
+    return static_cast<uint16_t>( bits );
+}
+
+// Converts RGBA8 to a tightly packed image in format
+void ConvertImage( const std::vector<uint8_t>& rgba, MIPGEN_FORMAT format, std::vector<uint8_t>& dest )
+{
+    size_t pixels = rgba.size() / 4;
+    dest.resize( pixels * MipGenBytesPerPixel( format ) );
+
+    switch ( format )
+    {
+    case MIPGEN_FORMAT_R16G16B16A16_FLOAT:
+        {
+            uint16_t* halves = reinterpret_cast<uint16_t*>( dest.data() );
+            for ( size_t i = 0; i < pixels * 4; ++i )
+                halves[i] = UNormToHalf( rgba[i] / 255.0f );
+        }
+        break;
+
+    case MIPGEN_FORMAT_R16_UNORM:
+        {
+            uint16_t* values = reinterpret_cast<uint16_t*>( dest.data() );
+            for ( size_t i = 0; i < pixels; ++i )
+                values[i] = static_cast<uint16_t>( ( rgba[i * 4] * 77 + rgba[i * 4 + 1] * 150 + rgba[i * 4 + 2] * 29 ) );
+        }
+        break;
+
+    default:
+        dest = rgba;
+        break;
+    }
+}
+
+};
+
+
+int main()
+{
+    std::vector<uint8_t> sample;
+    size_t sampleWidth, sampleHeight;
+    if ( !Benchmark::LoadSampleImage( "Crate_COLOR.dds", sample, sampleWidth, sampleHeight ) )
+        return 1;
+
+    std::vector<uint8_t> image;
+    Benchmark::TileImage( sample, sampleWidth, sampleHeight, IMAGE_SIZE, IMAGE_SIZE, image );
+
+    const struct
+    {
+        MIPGEN_FORMAT   format;
+        const char*     name;
+    } formats[] =
+    {
+        { MIPGEN_FORMAT_R8G8B8A8_UNORM,         "R8G8B8A8_UNORM" },
+        { MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB,    "R8G8B8A8_UNORM_SRGB" },
+        { MIPGEN_FORMAT_R16G16B16A16_FLOAT,     "R16G16B16A16_FLOAT" },
+        { MIPGEN_FORMAT_R16_UNORM,              "R16_UNORM" },
+    };
+    const char* filterNames[] = { "box", "kaiser" };
+
+    size_t mipCount = CountMips( IMAGE_SIZE, IMAGE_SIZE );
+    printf( "Mip chain of %zux%zu (%zu levels), best of %d runs\n", IMAGE_SIZE, IMAGE_SIZE, mipCount, RUNS );
+    printf( "%-22s %-8s %10s %10s\n", "format", "filter", "ms", "MPix/s" );
+
+    for ( const auto& entry : formats )
+    {
+        std::vector<uint8_t> source;
+        ConvertImage( image, entry.format, source );
+        std::vector<uint8_t> chain( ComputeMipChainSize( IMAGE_SIZE, IMAGE_SIZE, entry.format, mipCount ) );
+        size_t rowPitch = IMAGE_SIZE * MipGenBytesPerPixel( entry.format );
+
+        for ( int filter = MIPGEN_FILTER_BOX; filter <= MIPGEN_FILTER_KAISER; ++filter )
+        {
+            bool ok = true;
+            double seconds = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                ok = GenerateMipChain( source.data(), IMAGE_SIZE, IMAGE_SIZE, rowPitch, entry.format,
+                                       static_cast<MIPGEN_FILTER>( filter ), mipCount, chain.data() ) && ok;
+            } );
+            if ( !ok )
+            {
+                fprintf( stderr, "GenerateMipChain failed for %s\n", entry.name );
+                return 1;
+            }
+
+            printf( "%-22s %-8s %10.2f %10.1f\n", entry.name, filterNames[filter], seconds * 1e3,
+                    double( IMAGE_SIZE * IMAGE_SIZE ) / seconds * 1e-6 );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------------------
+// File: ProceduralTerrainBenchmark.cpp
+//
+// Procedural height generation throughput for every noise type.
+//
+// A 2048x2048 grid of 8-octave noise is generated on one thread and on every hardware
+// thread, and the same number of scattered points is evaluated one at a time with
+// ProceduralHeight and in a batch with ProceduralHeights.
+//--------------------------------------------------------------------------------------
+
+#include "BenchmarkCommon.h"
+#include "ProceduralTerrain.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 3;
+const size_t GRID_SIZE = 2048;
+const size_t POINT_COUNT = 1 << 20;
+
+};
+
+
+int main()
+{
+    const struct
+    {
+        PROCEDURAL_NOISE    noise;
+        const char*         name;
+    } noises[] =
+    {
+        { PROCEDURAL_FBM,       "fBm" },
+        { PROCEDURAL_RIDGED,    "ridged" },
+        { PROCEDURAL_WARPED,    "warped" },
+    };
+
+    // Scattered points over the same area as the grid
+    std::vector<float> x( POINT_COUNT ), z( POINT_COUNT ), heights( POINT_COUNT );
+    uint32_t state = 99;
+    for ( size_t i = 0; i < POINT_COUNT; ++i )
+    {
+        state = state * 1664525u + 1013904223u;
+        x[i] = float( state >> 8 ) * ( float( GRID_SIZE ) / 16777216.0f );
+        state = state * 1664525u + 1013904223u;
+        z[i] = float( state >> 8 ) * ( float( GRID_SIZE ) / 16777216.0f );
+    }
+
+    printf( "%zux%zu grid and %zu points of 8-octave noise, best of %d runs, M samples/s\n", GRID_SIZE, GRID_SIZE, POINT_COUNT, RUNS );
+    printf( "%-8s %10s %10s %10s %10s\n", "noise", "grid 1T", "grid all", "point", "points" );
+
+    for ( const auto& entry : noises )
+    {
+        ProceduralTerrainDesc desc = { entry.noise, 1337, 8, 1.0f / 256.0f, 2.0f, 0.5f, 32.0f, 80.0f, 0.0f };
+
+        std::vector<float> grid;
+        double gridSeconds[2];
+        for ( int threads = 0; threads < 2; ++threads )
+        {
+            bool ok = true;
+            gridSeconds[threads] = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                ok = GenerateProceduralHeights( desc, 0, 0, GRID_SIZE, GRID_SIZE, grid, nullptr, threads == 0 ? 1 : 0 ) && ok;
+            } );
+            if ( !ok )
+            {
+                fprintf( stderr, "GenerateProceduralHeights failed for %s\n", entry.name );
+                return 1;
+            }
+        }
+
+        double pointSeconds = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            for ( size_t i = 0; i < POINT_COUNT; ++i )
+                heights[i] = ProceduralHeight( desc, x[i], z[i] );
+        } );
+
+        // Both have to give the heights the grid has
+        std::vector<float> single( heights );
+        double batchSeconds = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            ProceduralHeights( desc, x.data(), z.data(), POINT_COUNT, heights.data() );
+        } );
+        if ( single != heights || ProceduralHeight( desc, 17.0f, 5.0f ) != grid[5 * GRID_SIZE + 17] )
+        {
+            fprintf( stderr, "Point and grid heights of %s differ\n", entry.name );
+            return 1;
+        }
+
+        double samples = double( GRID_SIZE * GRID_SIZE );
+        printf( "%-8s %10.1f %10.1f %10.1f %10.1f\n", entry.name, samples / gridSeconds[0] * 1e-6,
+                samples / gridSeconds[1] * 1e-6, POINT_COUNT / pointSeconds * 1e-6, POINT_COUNT / batchSeconds * 1e-6 );
+    }
+
+    return 0;
+}
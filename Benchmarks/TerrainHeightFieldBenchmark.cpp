@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightFieldBenchmark.cpp
+//
+// TerrainHeightField build and query timings.
+//
+// The min-max pyramid is built over Heightmap.bmp and a 4097x4097 fBm grid, on one
+// thread and on every hardware thread. Queries run on one thread at random points over
+// the grid: single and batched heights, normals, and rays cast both steeply down and
+// nearly level, which have to walk much further through the pyramid.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "BenchmarkCommon.h"
+#include "TerrainHeightField.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 3;
+const size_t POINT_QUERIES = 1 << 20;
+const size_t RAY_QUERIES = 1 << 16;
+
+// Repeatable values in [0, 1)
+class Random
+{
+public:
+    explicit Random( uint32_t seed ) : state( seed ) {}
+
+    float Next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return float( state >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+private:
+    uint32_t state;
+};
+
+};
+
+
+int main()
+{
+    struct Grid
+    {
+        const char*         name;
+        std::vector<float>  heights;
+        size_t              width;
+        size_t              depth;
+    };
+    std::vector<Grid> grids( 2 );
+
+    grids[0].name = "Heightmap.bmp";
+    if ( !Benchmark::LoadSampleHeights( grids[0].heights, grids[0].width, grids[0].depth ) )
+        return 1;
+
+    grids[1].name = "fBm 4097";
+    grids[1].width = grids[1].depth = 4097;
+    Benchmark::MakeTerrainHeights( 4097, grids[1].heights );
+
+    TerrainHeightFieldDesc desc = { 1.0f, 1.0f, 1.0f };
+
+    printf( "TerrainHeightField, best of %d runs; builds in ms, queries in millions per second on one thread\n", RUNS );
+    printf( "%-14s %9s %9s %9s %9s %9s %9s %9s\n", "grid", "build 1T", "build all", "height", "heights", "normal", "ray down", "ray level" );
+
+    for ( const Grid& grid : grids )
+    {
+        TerrainHeightField field;
+        double build[2];
+        for ( int threads = 0; threads < 2; ++threads )
+        {
+            bool ok = true;
+            build[threads] = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                ok = field.Build( grid.heights.data(), grid.width, grid.depth, desc, threads == 0 ? 1 : 0 ) && ok;
+            } );
+            if ( !ok )
+            {
+                fprintf( stderr, "Build failed for %s\n", grid.name );
+                return 1;
+            }
+        }
+
+        // Terrain space, centred on the origin with row 0 at +Z
+        float sizeX = float( grid.width - 1 ) * desc.spacingX;
+        float sizeZ = float( grid.depth - 1 ) * desc.spacingZ;
+        float peak = *std::max_element( grid.heights.begin(), grid.heights.end() ) * desc.heightScale;
+
+        std::vector<float> x( POINT_QUERIES ), z( POINT_QUERIES ), heights( POINT_QUERIES );
+        Random random( 7 );
+        for ( size_t i = 0; i < POINT_QUERIES; ++i )
+        {
+            x[i] = ( random.Next() - 0.5f ) * sizeX;
+            z[i] = ( random.Next() - 0.5f ) * sizeZ;
+        }
+
+        // The sums keep the compiler from dropping the queries
+        float sum = 0.0f;
+        double height = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            for ( size_t i = 0; i < POINT_QUERIES; ++i )
+            {
+                float h;
+                if ( field.GetHeightAt( x[i], z[i], &h ) )
+                    sum += h;
+            }
+        } );
+        double batch = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            field.GetHeightsAt( x.data(), z.data(), POINT_QUERIES, heights.data() );
+            sum += heights[POINT_QUERIES / 2];
+        } );
+        double normal = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            for ( size_t i = 0; i < POINT_QUERIES; ++i )
+            {
+                float n[3];
+                if ( field.GetNormalAt( x[i], z[i], n ) )
+                    sum += n[1];
+            }
+        } );
+
+        size_t hits[2] = { 0, 0 };
+        double rays[2];
+        for ( int level = 0; level < 2; ++level )
+        {
+            // Level rays start just above the peaks, so they still meet the ground on small grids
+            float start = peak + ( level ? 5.0f : 50.0f );
+            rays[level] = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                Random rayRandom( 11 );
+                hits[level] = 0;
+                for ( size_t i = 0; i < RAY_QUERIES; ++i )
+                {
+                    float origin[3] = { ( rayRandom.Next() - 0.5f ) * sizeX, start, ( rayRandom.Next() - 0.5f ) * sizeZ };
+                    float direction[3];
+                    if ( level )
+                    {
+                        float angle = rayRandom.Next() * 6.2831853f;
+                        direction[0] = cosf( angle );
+                        direction[1] = -0.15f;
+                        direction[2] = sinf( angle );
+                    }
+                    else
+                    {
+                        direction[0] = rayRandom.Next() - 0.5f;
+                        direction[1] = -1.0f;
+                        direction[2] = rayRandom.Next() - 0.5f;
+                    }
+
+                    TerrainRayHit hit;
+                    hits[level] += field.Raycast( origin, direction, sizeX + sizeZ, &hit );
+                }
+            } );
+        }
+
+        printf( "%-14s %9.2f %9.2f %9.1f %9.1f %9.1f %9.2f %9.2f\n", grid.name, build[0] * 1e3, build[1] * 1e3,
+                POINT_QUERIES / height * 1e-6, POINT_QUERIES / batch * 1e-6, POINT_QUERIES / normal * 1e-6,
+                RAY_QUERIES / rays[0] * 1e-6, RAY_QUERIES / rays[1] * 1e-6 );
+        printf( "%-14s rays hit: %zu down, %zu level (checksum %g)\n", "", hits[0], hits[1], double( sum ) );
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainNormalsBenchmark.cpp
+//
+// Terrain normal generation throughput.
+//
+// ComputeTerrainNormals runs on Heightmap.bmp and on fBm grids up to 4097x4097, on one
+// thread and on every hardware thread, next to a plain clamped central-difference loop
+// as the baseline it replaced. The largest difference from that loop is printed too.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "BenchmarkCommon.h"
+#include "TerrainNormals.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 5;
+
+void NaiveNormals( const std::vector<float>& heights, size_t width, size_t depth,
+                   const TerrainNormalDesc& desc, std::vector<float>& normals )
+{
+    normals.resize( width * depth * 3 );
+    for ( size_t z = 0; z < depth; ++z )
+    {
+        for ( size_t x = 0; x < width; ++x )
+        {
+            size_t left = x ? x - 1 : 0;
+            size_t right = std::min( x + 1, width - 1 );
+            size_t up = z ? z - 1 : 0;
+            size_t down = std::min( z + 1, depth - 1 );
+
+            float slopeX = ( heights[z * width + left] - heights[z * width + right] ) * desc.heightScale / ( float( right - left ) * desc.spacingX );
+            float slopeZ = ( heights[down * width + x] - heights[up * width + x] ) * desc.heightScale / ( float( down - up ) * desc.spacingZ );
+            float length = sqrtf( slopeX * slopeX + 1.0f + slopeZ * slopeZ );
+
+            float* normal = &normals[( z * width + x ) * 3];
+            normal[0] = slopeX / length;
+            normal[1] = 1.0f / length;
+            normal[2] = slopeZ / length;
+        }
+    }
+}
+
+};
+
+
+int main()
+{
+    struct Grid
+    {
+        const char*         name;
+        std::vector<float>  heights;
+        size_t              width;
+        size_t              depth;
+    };
+    std::vector<Grid> grids( 3 );
+
+    grids[0].name = "Heightmap.bmp";
+    if ( !Benchmark::LoadSampleHeights( grids[0].heights, grids[0].width, grids[0].depth ) )
+        return 1;
+
+    grids[1].name = "fBm 1025";
+    grids[1].width = grids[1].depth = 1025;
+    Benchmark::MakeTerrainHeights( 1025, grids[1].heights );
+
+    grids[2].name = "fBm 4097";
+    grids[2].width = grids[2].depth = 4097;
+    Benchmark::MakeTerrainHeights( 4097, grids[2].heights );
+
+    TerrainNormalDesc desc = { 1.0f, 1.0f, 1.0f };
+
+    printf( "ComputeTerrainNormals, best of %d runs\n", RUNS );
+    printf( "%-14s %-11s %14s %14s %14s %10s\n", "grid", "size", "Mverts/s 1T", "Mverts/s all", "naive Mverts/s", "max diff" );
+
+    for ( const Grid& grid : grids )
+    {
+        size_t vertices = grid.width * grid.depth;
+        std::vector<float> normals( vertices * 3 );
+        double seconds[2];
+        for ( int threads = 0; threads < 2; ++threads )
+        {
+            bool ok = true;
+            seconds[threads] = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                ok = ComputeTerrainNormals( grid.heights.data(), grid.width, grid.depth, desc, normals.data(),
+                                            nullptr, threads == 0 ? 1 : 0 ) && ok;
+            } );
+            if ( !ok )
+            {
+                fprintf( stderr, "ComputeTerrainNormals failed for %s\n", grid.name );
+                return 1;
+            }
+        }
+
+        std::vector<float> reference;
+        double naiveSeconds = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            NaiveNormals( grid.heights, grid.width, grid.depth, desc, reference );
+        } );
+
+        float largest = 0.0f;
+        for ( size_t i = 0; i < normals.size(); ++i )
+            largest = std::max( largest, fabsf( normals[i] - reference[i] ) );
+
+        char size[32];
+        snprintf( size, sizeof(size), "%zux%zu", grid.width, grid.depth );
+        printf( "%-14s %-11s %14.0f %14.0f %14.0f %10.2g\n", grid.name, size,
+                double( vertices ) / seconds[0] * 1e-6, double( vertices ) / seconds[1] * 1e-6,
+                double( vertices ) / naiveSeconds * 1e-6, largest );
+    }
+
+    return 0;
+}
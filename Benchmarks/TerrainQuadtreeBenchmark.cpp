@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtreeBenchmark.cpp
+//
+// CDLOD node selection cost and node counts per frame as the height grid grows.
+//
+// The quadtree is built over 1025x1025 and 4097x4097 fBm grids with the patch size and
+// ranges the application uses, and Select runs along the same camera path over both: a
+// loop a few units above the ground, looking ahead. Nodes selected are what the frame
+// draws, so their triangle count should grow with the extra distance the larger grid
+// puts in view, covered by coarse nodes, and not with its sixteen times as many samples.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "BenchmarkCommon.h"
+#include "TerrainQuadtree.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 5;
+const int FRAMES = 256;
+const size_t PATCH_QUADS = 32;
+const float PATH_RADIUS = 400.0f;
+
+// Left-handed look-at and perspective, [x y z 1] * M with rows stored first
+void LookAtPerspective( const float eye[3], const float at[3], float matrix[16] )
+{
+    const float fovY = 0.7854f;
+    const float aspect = 16.0f / 9.0f;
+    const float zNear = 0.1f;
+    const float zFar = 5000.0f;
+
+    float forward[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+    float length = sqrtf( forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2] );
+    for ( int i = 0; i < 3; ++i )
+        forward[i] /= length;
+
+    float right[3] = { forward[2], 0.0f, -forward[0] };
+    length = sqrtf( right[0] * right[0] + right[2] * right[2] );
+    right[0] /= length;
+    right[2] /= length;
+
+    float up[3] = { forward[1] * right[2] - forward[2] * right[1],
+                    forward[2] * right[0] - forward[0] * right[2],
+                    forward[0] * right[1] - forward[1] * right[0] };
+
+    float view[16] =
+    {
+        right[0], up[0], forward[0], 0.0f,
+        right[1], up[1], forward[1], 0.0f,
+        right[2], up[2], forward[2], 0.0f,
+        -( right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2] ),
+        -( up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2] ),
+        -( forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2] ),
+        1.0f,
+    };
+
+    float scaleY = 1.0f / tanf( fovY * 0.5f );
+    float q = zFar / ( zFar - zNear );
+    float projection[16] =
+    {
+        scaleY / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, scaleY, 0.0f, 0.0f,
+        0.0f, 0.0f, q, 1.0f,
+        0.0f, 0.0f, -zNear * q, 0.0f,
+    };
+
+    for ( int row = 0; row < 4; ++row )
+    {
+        for ( int column = 0; column < 4; ++column )
+        {
+            float sum = 0.0f;
+            for ( int k = 0; k < 4; ++k )
+                sum += view[row * 4 + k] * projection[k * 4 + column];
+            matrix[row * 4 + column] = sum;
+        }
+    }
+}
+
+// Frustum planes from the columns of the matrix, in the order the application uses
+void GetFrustumPlanes( const float m[16], float planes[6][4] )
+{
+    for ( int k = 0; k < 4; ++k )
+    {
+        planes[0][k] = m[k * 4 + 3] + m[k * 4 + 0];     // left
+        planes[1][k] = m[k * 4 + 3] - m[k * 4 + 0];     // right
+        planes[2][k] = m[k * 4 + 3] + m[k * 4 + 1];     // bottom
+        planes[3][k] = m[k * 4 + 3] - m[k * 4 + 1];     // top
+        planes[4][k] = m[k * 4 + 2];                    // near
+        planes[5][k] = m[k * 4 + 3] - m[k * 4 + 2];     // far
+    }
+}
+
+struct Frame
+{
+    float   camera[3];
+    float   planes[6][4];
+};
+
+};
+
+
+int main()
+{
+    const size_t sizes[] = { 1025, 4097 };
+
+    printf( "TerrainQuadtree::Select over %d frames of a %.0f unit loop, %zu quad patches, best of %d runs\n",
+            FRAMES, double( PATH_RADIUS ), PATCH_QUADS, RUNS );
+    printf( "%-10s %5s %10s %10s %10s %12s %12s\n", "grid", "lods", "selected", "max sel", "visited", "triangles", "us/frame" );
+
+    for ( size_t size : sizes )
+    {
+        std::vector<float> heights;
+        Benchmark::MakeTerrainHeights( size, heights );
+
+        // Enough levels for the top one to cover the whole grid in a node or two
+        size_t lodCount = 1;
+        while ( ( PATCH_QUADS << ( lodCount - 1 ) ) < size - 1 && lodCount < 16 )
+            lodCount++;
+
+        TerrainQuadtreeDesc desc = { PATCH_QUADS, lodCount, 1.0f, 1.0f, 1.0f, PATCH_QUADS * 3.0f, 0.7f };
+        TerrainQuadtree quadtree;
+        if ( !quadtree.Build( heights.data(), size, size, desc ) )
+        {
+            fprintf( stderr, "Build failed for %zu\n", size );
+            return 1;
+        }
+
+        // Same path in terrain units on both grids, 5 units above the ground looking ahead
+        float origin = 0.5f * float( size - 1 );
+        std::vector<Frame> frames( FRAMES );
+        for ( int i = 0; i < FRAMES; ++i )
+        {
+            float angle = float( i ) / float( FRAMES ) * 6.2831853f;
+            float eye[3] = { PATH_RADIUS * cosf( angle ), 0.0f, PATH_RADIUS * sinf( angle ) };
+            size_t column = size_t( eye[0] + origin );
+            size_t row = size_t( origin - eye[2] );
+            eye[1] = heights[row * size + column] + 5.0f;
+
+            float at[3] = { PATH_RADIUS * cosf( angle + 0.05f ), eye[1] - 2.0f, PATH_RADIUS * sinf( angle + 0.05f ) };
+            float matrix[16];
+            LookAtPerspective( eye, at, matrix );
+
+            memcpy( frames[i].camera, eye, sizeof( eye ) );
+            GetFrustumPlanes( matrix, frames[i].planes );
+        }
+
+        std::vector<TerrainNodeSelection> selection;
+        size_t selected = 0;
+        size_t visited = 0;
+        size_t mostSelected = 0;
+        double seconds = Benchmark::BestSeconds( RUNS, [&]()
+        {
+            selected = visited = mostSelected = 0;
+            for ( const Frame& frame : frames )
+            {
+                TerrainSelectStats stats;
+                quadtree.Select( frame.camera, frame.planes, selection, &stats );
+                selected += stats.nodesSelected;
+                visited += stats.nodesVisited;
+                mostSelected = std::max( mostSelected, stats.nodesSelected );
+            }
+        } );
+
+        char name[32];
+        snprintf( name, sizeof(name), "%zux%zu", size, size );
+        double perFrame = double( selected ) / FRAMES;
+        printf( "%-10s %5zu %10.1f %10zu %10.1f %12.0f %12.2f\n", name, lodCount, perFrame, mostSelected,
+                double( visited ) / FRAMES, perFrame * PATCH_QUADS * PATCH_QUADS * 2, seconds * 1e6 / FRAMES );
+    }
+
+    return 0;
+}
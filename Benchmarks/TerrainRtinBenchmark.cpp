@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainRtinBenchmark.cpp
+//
+// TerrainRtin error pass and meshing timings, and how many triangles each error keeps.
+//
+// The midpoint errors are computed over Heightmap.bmp and over ridged and fBm grids, on
+// one thread and on every hardware thread, with the 64-quad tiles the application uses.
+// Meshes are then built for a range of maximum errors, and each one's triangle count is
+// given as a share of the full grid's.
+//--------------------------------------------------------------------------------------
+
+#include "BenchmarkCommon.h"
+#include "TerrainRtin.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int RUNS = 3;
+const size_t TILE_QUADS = 64;
+const float MAX_ERRORS[] = { 0.0f, 0.05f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f };
+
+};
+
+
+int main()
+{
+    struct Grid
+    {
+        const char*         name;
+        std::vector<float>  heights;
+        size_t              width;
+        size_t              depth;
+    };
+    std::vector<Grid> grids( 3 );
+
+    grids[0].name = "Heightmap.bmp";
+    if ( !Benchmark::LoadSampleHeights( grids[0].heights, grids[0].width, grids[0].depth ) )
+        return 1;
+
+    grids[1].name = "ridged 1025";
+    grids[1].width = grids[1].depth = 1025;
+    Benchmark::MakeTerrainHeights( 1025, grids[1].heights, PROCEDURAL_RIDGED );
+
+    grids[2].name = "fBm 4097";
+    grids[2].width = grids[2].depth = 4097;
+    Benchmark::MakeTerrainHeights( 4097, grids[2].heights );
+
+    TerrainRtinDesc desc = { TILE_QUADS, 1.0f };
+
+    printf( "TerrainRtin with %zu quad tiles, best of %d runs\n", TILE_QUADS, RUNS );
+
+    for ( const Grid& grid : grids )
+    {
+        TerrainRtin rtin;
+        double build[2];
+        for ( int threads = 0; threads < 2; ++threads )
+        {
+            bool ok = true;
+            build[threads] = Benchmark::BestSeconds( RUNS, [&]()
+            {
+                ok = rtin.Build( grid.heights.data(), grid.width, grid.depth, desc, threads == 0 ? 1 : 0 ) && ok;
+            } );
+            if ( !ok )
+            {
+                fprintf( stderr, "Build failed for %s\n", grid.name );
+                return 1;
+            }
+        }
+
+        auto range = std::minmax_element( grid.heights.begin(), grid.heights.end() );
+        printf( "\n%s %zux%zu, heights span %.1f; errors in %.2f ms on 1 thread, %.2f ms on all\n", grid.name,
+                grid.width, grid.depth, double( *range.second - *range.first ), build[0] * 1e3, build[1] * 1e3 );
+        printf( "%10s %12s %10s %10s %10s\n", "maxError", "triangles", "of grid", "mesh 1T", "mesh all" );
+
+        for ( float maxError : MAX_ERRORS )
+        {
+            std::vector<uint16_t> indices;
+            std::vector<TerrainRtinRange> ranges;
+            TerrainRtinStats stats = {};
+            double mesh[2];
+            for ( int threads = 0; threads < 2; ++threads )
+            {
+                bool ok = true;
+                mesh[threads] = Benchmark::BestSeconds( RUNS, [&]()
+                {
+                    ok = rtin.BuildIndices( maxError, indices, ranges, &stats, threads == 0 ? 1 : 0 ) && ok;
+                } );
+                if ( !ok )
+                {
+                    fprintf( stderr, "BuildIndices failed for %s at %g\n", grid.name, maxError );
+                    return 1;
+                }
+            }
+
+            printf( "%10.2f %12zu %9.2f%% %8.2fms %8.2fms\n", maxError, stats.triangleCount,
+                    100.0 * double( stats.triangleCount ) / double( stats.gridTriangleCount ), mesh[0] * 1e3, mesh[1] * 1e3 );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,1002 @@
+//--------------------------------------------------------------------------------------
+// File: BlockCompressor.cpp
+//
+// BC1 / BC3 / BC7 block compression for the asset pipeline.
+//
+// Endpoints come from the principal axis of the block (power iteration on the colour
+// covariance), are quantized, and then refined once by least squares against the chosen
+// indices. Projection and index search work on four pixels at a time with SSE; block
+// rows are shared out across threads with an atomic counter.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "ParallelFor.h"
+#include "DDS.h"
+#include "DDSParser.h"
+#include "MipGenerator.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BC_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+//--------------------------------------------------------------------------------------
+// Four-wide float helpers
+//--------------------------------------------------------------------------------------
+#ifdef BC_USE_SSE
+
+typedef __m128 Float4;
+
+inline Float4 Load4( const float* p )               { return _mm_loadu_ps( p ); }
+inline Float4 Splat4( float v )                     { return _mm_set1_ps( v ); }
+inline Float4 Add4( Float4 a, Float4 b )            { return _mm_add_ps( a, b ); }
+inline Float4 Sub4( Float4 a, Float4 b )            { return _mm_sub_ps( a, b ); }
+inline Float4 Mul4( Float4 a, Float4 b )            { return _mm_mul_ps( a, b ); }
+inline Float4 Min4( Float4 a, Float4 b )            { return _mm_min_ps( a, b ); }
+inline Float4 Max4( Float4 a, Float4 b )            { return _mm_max_ps( a, b ); }
+inline Float4 Less4( Float4 a, Float4 b )           { return _mm_cmplt_ps( a, b ); }
+inline Float4 Select4( Float4 a, Float4 b, Float4 mask ) { return _mm_or_ps( _mm_andnot_ps( mask, a ), _mm_and_ps( mask, b ) ); }
+inline void   Store4( float* p, Float4 v )          { _mm_storeu_ps( p, v ); }
+
+#else
+
+struct Float4 { float v[4]; };
+
+inline Float4 Load4( const float* p )               { Float4 r; memcpy( r.v, p, sizeof(r.v) ); return r; }
+inline Float4 Splat4( float s )                     { Float4 r = { { s, s, s, s } }; return r; }
+inline Float4 Add4( Float4 a, Float4 b )            { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+inline Float4 Sub4( Float4 a, Float4 b )            { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+inline Float4 Mul4( Float4 a, Float4 b )            { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+inline Float4 Min4( Float4 a, Float4 b )            { for (int i = 0; i < 4; ++i) a.v[i] = std::min( a.v[i], b.v[i] ); return a; }
+inline Float4 Max4( Float4 a, Float4 b )            { for (int i = 0; i < 4; ++i) a.v[i] = std::max( a.v[i], b.v[i] ); return a; }
+inline Float4 Less4( Float4 a, Float4 b )           { for (int i = 0; i < 4; ++i) a.v[i] = ( a.v[i] < b.v[i] ) ? 1.0f : 0.0f; return a; }
+inline Float4 Select4( Float4 a, Float4 b, Float4 mask ) { for (int i = 0; i < 4; ++i) a.v[i] = mask.v[i] ? b.v[i] : a.v[i]; return a; }
+inline void   Store4( float* p, Float4 v )          { memcpy( p, v.v, sizeof(v.v) ); }
+
+#endif
+
+inline float HorizontalMin( Float4 v ) { float t[4]; Store4( t, v ); return std::min( std::min( t[0], t[1] ), std::min( t[2], t[3] ) ); }
+inline float HorizontalMax( Float4 v ) { float t[4]; Store4( t, v ); return std::max( std::max( t[0], t[1] ), std::max( t[2], t[3] ) ); }
+inline float HorizontalSum( Float4 v ) { float t[4]; Store4( t, v ); return ( t[0] + t[1] ) + ( t[2] + t[3] ); }
+
+//--------------------------------------------------------------------------------------
+// A 4x4 block in structure-of-arrays form, values 0..255
+//--------------------------------------------------------------------------------------
+struct BlockPixels
+{
+    float c[4][16]; // r, g, b, a
+};
+
+void LoadBlock( const uint8_t* rgba, size_t width, size_t height, size_t rowPitch,
+                size_t bx, size_t by, BlockPixels& block )
+{
+    for (size_t y = 0; y < 4; ++y)
+    {
+        size_t sy = std::min( by * 4 + y, height - 1 );
+        const uint8_t* row = rgba + sy * rowPitch;
+        for (size_t x = 0; x < 4; ++x)
+        {
+            size_t sx = std::min( bx * 4 + x, width - 1 );
+            for (size_t ch = 0; ch < 4; ++ch)
+            {
+                block.c[ch][y * 4 + x] = row[sx * 4 + ch];
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Principal axis of the first 'channels' channels, by power iteration on the covariance
+//--------------------------------------------------------------------------------------
+void ComputePrincipalAxis( const BlockPixels& block, int channels, float mean[4], float axis[4] )
+{
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        mean[ch] = 0.0f;
+        axis[ch] = 0.0f;
+    }
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        Float4 sum = Splat4( 0.0f );
+        for (int i = 0; i < 16; i += 4)
+        {
+            sum = Add4( sum, Load4( &block.c[ch][i] ) );
+        }
+        mean[ch] = HorizontalSum( sum ) / 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for (int a = 0; a < channels; ++a)
+    {
+        Float4 ma = Splat4( mean[a] );
+        for (int b = a; b < channels; ++b)
+        {
+            Float4 mb = Splat4( mean[b] );
+            Float4 sum = Splat4( 0.0f );
+            for (int i = 0; i < 16; i += 4)
+            {
+                sum = Add4( sum, Mul4( Sub4( Load4( &block.c[a][i] ), ma ), Sub4( Load4( &block.c[b][i] ), mb ) ) );
+            }
+            cov[a][b] = cov[b][a] = HorizontalSum( sum );
+        }
+    }
+
+    // Start from the diagonal of the bounding box, which is never orthogonal to the major axis in practice
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        Float4 lo = Load4( &block.c[ch][0] );
+        Float4 hi = lo;
+        for (int i = 4; i < 16; i += 4)
+        {
+            lo = Min4( lo, Load4( &block.c[ch][i] ) );
+            hi = Max4( hi, Load4( &block.c[ch][i] ) );
+        }
+        axis[ch] = HorizontalMax( hi ) - HorizontalMin( lo );
+    }
+
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+            {
+                next[a] += cov[a][b] * axis[b];
+            }
+        }
+
+        float length = 0.0f;
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            length += next[ch] * next[ch];
+        }
+        if (length < 1e-12f)
+        {
+            break;
+        }
+
+        length = 1.0f / sqrtf( length );
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            axis[ch] = next[ch] * length;
+        }
+    }
+
+    float length = 0.0f;
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        length += axis[ch] * axis[ch];
+    }
+    if (length > 1e-12f)
+    {
+        length = 1.0f / sqrtf( length );
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            axis[ch] *= length;
+        }
+    }
+}
+
+// Projects the block onto the axis and returns the endpoints at the extremes
+void ComputeAxisEndpoints( const BlockPixels& block, int channels, const float mean[4], const float axis[4],
+                           float e0[4], float e1[4] )
+{
+    Float4 tmin = Splat4( 1e30f );
+    Float4 tmax = Splat4( -1e30f );
+    for (int i = 0; i < 16; i += 4)
+    {
+        Float4 t = Splat4( 0.0f );
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            t = Add4( t, Mul4( Sub4( Load4( &block.c[ch][i] ), Splat4( mean[ch] ) ), Splat4( axis[ch] ) ) );
+        }
+        tmin = Min4( tmin, t );
+        tmax = Max4( tmax, t );
+    }
+
+    float lo = HorizontalMin( tmin );
+    float hi = HorizontalMax( tmax );
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        e0[ch] = std::min( 255.0f, std::max( 0.0f, mean[ch] + axis[ch] * hi ) );
+        e1[ch] = std::min( 255.0f, std::max( 0.0f, mean[ch] + axis[ch] * lo ) );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Nearest palette entry for every pixel; returns the summed squared error
+//--------------------------------------------------------------------------------------
+float FindIndices( const BlockPixels& block, int firstChannel, int channels,
+                   const float palette[][4], int paletteCount, uint8_t indices[16] )
+{
+    float total = 0.0f;
+    for (int i = 0; i < 16; i += 4)
+    {
+        Float4 px[4];
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            px[ch] = Load4( &block.c[firstChannel + ch][i] );
+        }
+
+        Float4 best = Splat4( 1e30f );
+        Float4 bestIndex = Splat4( 0.0f );
+        for (int p = 0; p < paletteCount; ++p)
+        {
+            Float4 dist = Splat4( 0.0f );
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                Float4 d = Sub4( px[ch], Splat4( palette[p][firstChannel + ch] ) );
+                dist = Add4( dist, Mul4( d, d ) );
+            }
+            Float4 closer = Less4( dist, best );
+            best = Select4( best, dist, closer );
+            bestIndex = Select4( bestIndex, Splat4( float(p) ), closer );
+        }
+
+        float idx[4];
+        Store4( idx, bestIndex );
+        for (int j = 0; j < 4; ++j)
+        {
+            indices[i + j] = static_cast<uint8_t>( idx[j] );
+        }
+        total += HorizontalSum( best );
+    }
+    return total;
+}
+
+//--------------------------------------------------------------------------------------
+// Least-squares endpoints for fixed indices. weight[i] is the fraction of e1 for index i.
+//--------------------------------------------------------------------------------------
+bool SolveEndpoints( const BlockPixels& block, int channels, const uint8_t indices[16],
+                     const float* weight, float e0[4], float e1[4] )
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        float b = weight[ indices[i] ];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            ax[ch] += a * block.c[ch][i];
+            bx[ch] += b * block.c[ch][i];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf( det ) < 1e-6f)
+    {
+        return false;
+    }
+
+    float inv = 1.0f / det;
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        e0[ch] = std::min( 255.0f, std::max( 0.0f, ( bb * ax[ch] - ab * bx[ch] ) * inv ) );
+        e1[ch] = std::min( 255.0f, std::max( 0.0f, ( aa * bx[ch] - ab * ax[ch] ) * inv ) );
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// BC1 colour block
+//--------------------------------------------------------------------------------------
+inline uint16_t Quantize565( const float c[4] )
+{
+    uint16_t r = static_cast<uint16_t>( c[0] * ( 31.0f / 255.0f ) + 0.5f );
+    uint16_t g = static_cast<uint16_t>( c[1] * ( 63.0f / 255.0f ) + 0.5f );
+    uint16_t b = static_cast<uint16_t>( c[2] * ( 31.0f / 255.0f ) + 0.5f );
+    return static_cast<uint16_t>( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+inline void Expand565( uint16_t v, float c[4] )
+{
+    uint32_t r = ( v >> 11 ) & 31;
+    uint32_t g = ( v >> 5 ) & 63;
+    uint32_t b = v & 31;
+    c[0] = float( ( r << 3 ) | ( r >> 2 ) );
+    c[1] = float( ( g << 2 ) | ( g >> 4 ) );
+    c[2] = float( ( b << 3 ) | ( b >> 2 ) );
+    c[3] = 255.0f;
+}
+
+// Palette in index order for four-colour mode
+void BuildBC1Palette( uint16_t c0, uint16_t c1, float palette[4][4] )
+{
+    Expand565( c0, palette[0] );
+    Expand565( c1, palette[1] );
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        palette[2][ch] = ( 2.0f * palette[0][ch] + palette[1][ch] ) / 3.0f;
+        palette[3][ch] = ( palette[0][ch] + 2.0f * palette[1][ch] ) / 3.0f;
+    }
+}
+
+float TryBC1Endpoints( const BlockPixels& block, const float e0[4], const float e1[4],
+                       uint16_t& c0, uint16_t& c1, uint8_t indices[16] )
+{
+    c0 = Quantize565( e0 );
+    c1 = Quantize565( e1 );
+    if (c0 < c1)
+    {
+        std::swap( c0, c1 );
+    }
+
+    float palette[4][4];
+    BuildBC1Palette( c0, c1, palette );
+    return FindIndices( block, 0, 3, palette, ( c0 == c1 ) ? 1 : 4, indices );
+}
+
+void EncodeBC1Block( const BlockPixels& block, uint8_t* out )
+{
+    static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    float mean[4], axis[4], e0[4], e1[4];
+    ComputePrincipalAxis( block, 3, mean, axis );
+    ComputeAxisEndpoints( block, 3, mean, axis, e0, e1 );
+
+    uint16_t c0, c1;
+    uint8_t indices[16];
+    float error = TryBC1Endpoints( block, e0, e1, c0, c1, indices );
+
+    // One least-squares refinement against the chosen indices
+    if (c0 != c1 && SolveEndpoints( block, 3, indices, weights, e0, e1 ))
+    {
+        uint16_t r0, r1;
+        uint8_t refined[16];
+        float refinedError = TryBC1Endpoints( block, e0, e1, r0, r1, refined );
+        if (refinedError < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            memcpy( indices, refined, sizeof(indices) );
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        bits |= uint32_t( indices[i] & 3 ) << ( i * 2 );
+    }
+
+    out[0] = uint8_t( c0 & 0xff );
+    out[1] = uint8_t( c0 >> 8 );
+    out[2] = uint8_t( c1 & 0xff );
+    out[3] = uint8_t( c1 >> 8 );
+    memcpy( out + 4, &bits, sizeof(bits) );
+}
+
+void DecodeBC1Block( const uint8_t* in, uint8_t rgba[16][4], bool allowPunchThrough )
+{
+    uint16_t c0 = uint16_t( in[0] | ( in[1] << 8 ) );
+    uint16_t c1 = uint16_t( in[2] | ( in[3] << 8 ) );
+    uint32_t bits;
+    memcpy( &bits, in + 4, sizeof(bits) );
+
+    float palette[4][4];
+    Expand565( c0, palette[0] );
+    Expand565( c1, palette[1] );
+    if (c0 > c1 || !allowPunchThrough)
+    {
+        BuildBC1Palette( c0, c1, palette );
+    }
+    else
+    {
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            palette[2][ch] = ( palette[0][ch] + palette[1][ch] ) * 0.5f;
+            palette[3][ch] = 0.0f;
+        }
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const float* p = palette[ ( bits >> ( i * 2 ) ) & 3 ];
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            rgba[i][ch] = static_cast<uint8_t>( p[ch] + 0.5f );
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// BC3 alpha block (eight interpolated values)
+//--------------------------------------------------------------------------------------
+void BuildAlphaPalette( uint8_t a0, uint8_t a1, float palette[8][4] )
+{
+    memset( palette, 0, sizeof(float) * 8 * 4 );
+    palette[0][3] = a0;
+    palette[1][3] = a1;
+    if (a0 > a1)
+    {
+        for (int k = 2; k < 8; ++k)
+        {
+            palette[k][3] = float( ( ( 8 - k ) * a0 + ( k - 1 ) * a1 ) / 7 );
+        }
+    }
+    else
+    {
+        for (int k = 2; k < 6; ++k)
+        {
+            palette[k][3] = float( ( ( 6 - k ) * a0 + ( k - 1 ) * a1 ) / 5 );
+        }
+        palette[6][3] = 0.0f;
+        palette[7][3] = 255.0f;
+    }
+}
+
+void EncodeAlphaBlock( const BlockPixels& block, uint8_t* out )
+{
+    Float4 lo = Load4( &block.c[3][0] );
+    Float4 hi = lo;
+    for (int i = 4; i < 16; i += 4)
+    {
+        lo = Min4( lo, Load4( &block.c[3][i] ) );
+        hi = Max4( hi, Load4( &block.c[3][i] ) );
+    }
+
+    uint8_t a0 = static_cast<uint8_t>( HorizontalMax( hi ) );
+    uint8_t a1 = static_cast<uint8_t>( HorizontalMin( lo ) );
+
+    uint8_t indices[16] = {};
+    if (a0 != a1)
+    {
+        float palette[8][4];
+        BuildAlphaPalette( a0, a1, palette );
+        FindIndices( block, 3, 1, palette, 8, indices );
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        bits |= uint64_t( indices[i] & 7 ) << ( i * 3 );
+    }
+    for (int i = 0; i < 6; ++i)
+    {
+        out[2 + i] = uint8_t( bits >> ( i * 8 ) );
+    }
+}
+
+void DecodeAlphaBlock( const uint8_t* in, uint8_t rgba[16][4] )
+{
+    float palette[8][4];
+    BuildAlphaPalette( in[0], in[1], palette );
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        bits |= uint64_t( in[2 + i] ) << ( i * 8 );
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        rgba[i][3] = static_cast<uint8_t>( palette[ ( bits >> ( i * 3 ) ) & 7 ][3] );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// BC7 mode 6
+//--------------------------------------------------------------------------------------
+const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+const float BC7_WEIGHT_FRACTIONS4[16] =
+{
+    0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+    34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+};
+
+struct BitWriter
+{
+    uint8_t* data;
+    size_t   position;
+
+    void Write( uint32_t value, size_t bits )
+    {
+        for (size_t i = 0; i < bits; ++i, ++position)
+        {
+            if (value & ( 1u << i ))
+            {
+                data[ position >> 3 ] |= uint8_t( 1u << ( position & 7 ) );
+            }
+        }
+    }
+};
+
+struct BitReader
+{
+    const uint8_t* data;
+    size_t         position;
+
+    uint32_t Read( size_t bits )
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < bits; ++i, ++position)
+        {
+            value |= uint32_t( ( data[ position >> 3 ] >> ( position & 7 ) ) & 1 ) << i;
+        }
+        return value;
+    }
+};
+
+// 7-bit endpoint plus shared p-bit giving the closest 8-bit reconstruction
+void QuantizeBC7Endpoint( const float e[4], uint8_t q[4], uint8_t& pbit )
+{
+    float bestError = 1e30f;
+    for (uint8_t p = 0; p < 2; ++p)
+    {
+        uint8_t candidate[4];
+        float error = 0.0f;
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            int v = int( ( e[ch] - p ) * 0.5f + 0.5f );
+            v = std::min( 127, std::max( 0, v ) );
+            candidate[ch] = uint8_t( v );
+            float d = float( ( v << 1 ) | p ) - e[ch];
+            error += d * d;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            pbit = p;
+            memcpy( q, candidate, 4 );
+        }
+    }
+}
+
+void BuildBC7Palette( const uint8_t q0[4], uint8_t p0, const uint8_t q1[4], uint8_t p1, float palette[16][4] )
+{
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        int a = ( q0[ch] << 1 ) | p0;
+        int b = ( q1[ch] << 1 ) | p1;
+        for (int i = 0; i < 16; ++i)
+        {
+            palette[i][ch] = float( ( ( 64 - BC7_WEIGHTS4[i] ) * a + BC7_WEIGHTS4[i] * b + 32 ) >> 6 );
+        }
+    }
+}
+
+float TryBC7Endpoints( const BlockPixels& block, const float e0[4], const float e1[4],
+                       uint8_t q0[4], uint8_t& p0, uint8_t q1[4], uint8_t& p1, uint8_t indices[16] )
+{
+    QuantizeBC7Endpoint( e0, q0, p0 );
+    QuantizeBC7Endpoint( e1, q1, p1 );
+
+    float palette[16][4];
+    BuildBC7Palette( q0, p0, q1, p1, palette );
+    return FindIndices( block, 0, 4, palette, 16, indices );
+}
+
+void EncodeBC7Block( const BlockPixels& block, uint8_t* out )
+{
+    float mean[4], axis[4], e0[4], e1[4];
+    ComputePrincipalAxis( block, 4, mean, axis );
+    ComputeAxisEndpoints( block, 4, mean, axis, e0, e1 );
+
+    uint8_t q0[4], q1[4], p0 = 0, p1 = 0;
+    uint8_t indices[16];
+    float error = TryBC7Endpoints( block, e0, e1, q0, p0, q1, p1, indices );
+
+    if (SolveEndpoints( block, 4, indices, BC7_WEIGHT_FRACTIONS4, e0, e1 ))
+    {
+        uint8_t r0[4], r1[4], rp0 = 0, rp1 = 0;
+        uint8_t refined[16];
+        float refinedError = TryBC7Endpoints( block, e0, e1, r0, rp0, r1, rp1, refined );
+        if (refinedError < error)
+        {
+            memcpy( q0, r0, 4 );
+            memcpy( q1, r1, 4 );
+            p0 = rp0;
+            p1 = rp1;
+            memcpy( indices, refined, sizeof(indices) );
+        }
+    }
+
+    // The anchor (pixel 0) index is stored with its top bit implied zero
+    if (indices[0] & 8)
+    {
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            std::swap( q0[ch], q1[ch] );
+        }
+        std::swap( p0, p1 );
+        for (int i = 0; i < 16; ++i)
+        {
+            indices[i] = uint8_t( 15 - indices[i] );
+        }
+    }
+
+    memset( out, 0, 16 );
+    BitWriter writer = { out, 0 };
+    writer.Write( 1u << 6, 7 );
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        writer.Write( q0[ch], 7 );
+        writer.Write( q1[ch], 7 );
+    }
+    writer.Write( p0, 1 );
+    writer.Write( p1, 1 );
+    writer.Write( indices[0], 3 );
+    for (int i = 1; i < 16; ++i)
+    {
+        writer.Write( indices[i], 4 );
+    }
+    assert( writer.position == 128 );
+}
+
+bool DecodeBC7Block( const uint8_t* in, uint8_t rgba[16][4] )
+{
+    if (( in[0] & 0x7f ) != 0x40)
+    {
+        return false;
+    }
+
+    BitReader reader = { in, 7 };
+    uint8_t q0[4], q1[4];
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        q0[ch] = uint8_t( reader.Read( 7 ) );
+        q1[ch] = uint8_t( reader.Read( 7 ) );
+    }
+    uint8_t p0 = uint8_t( reader.Read( 1 ) );
+    uint8_t p1 = uint8_t( reader.Read( 1 ) );
+
+    float palette[16][4];
+    BuildBC7Palette( q0, p0, q1, p1, palette );
+
+    for (int i = 0; i < 16; ++i)
+    {
+        uint32_t index = reader.Read( i == 0 ? 3 : 4 );
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            rgba[i][ch] = static_cast<uint8_t>( palette[index][ch] );
+        }
+    }
+    return true;
+}
+
+void EncodeBlockRow( const uint8_t* rgba, size_t width, size_t height, size_t rowPitch,
+                     BC_FORMAT format, size_t by, uint8_t* dest )
+{
+    size_t blocksWide = std::max<size_t>( 1, ( width + 3 ) / 4 );
+    size_t blockSize = BCBlockSize( format );
+    BlockPixels block;
+
+    for (size_t bx = 0; bx < blocksWide; ++bx)
+    {
+        LoadBlock( rgba, width, height, rowPitch, bx, by, block );
+        uint8_t* out = dest + ( by * blocksWide + bx ) * blockSize;
+
+        switch (format)
+        {
+        case BC_FORMAT_BC1:
+            EncodeBC1Block( block, out );
+            break;
+
+        case BC_FORMAT_BC3:
+            EncodeAlphaBlock( block, out );
+            EncodeBC1Block( block, out + 8 );
+            break;
+
+        case BC_FORMAT_BC7:
+            EncodeBC7Block( block, out );
+            break;
+        }
+    }
+}
+
+};
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::BCBlockSize( BC_FORMAT format )
+{
+    return ( format == BC_FORMAT_BC1 ) ? 8 : 16;
+}
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::ComputeBCSurfaceSize( size_t width, size_t height, BC_FORMAT format )
+{
+    size_t blocksWide = std::max<size_t>( 1, ( width + 3 ) / 4 );
+    size_t blocksHigh = std::max<size_t>( 1, ( height + 3 ) / 4 );
+    return blocksWide * blocksHigh * BCBlockSize( format );
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::CompressSurface( const uint8_t* rgba,
+                               size_t width,
+                               size_t height,
+                               size_t rowPitch,
+                               BC_FORMAT format,
+                               uint8_t* dest,
+                               unsigned int threadCount )
+{
+    if (!rgba || !dest || !width || !height || rowPitch < width * 4)
+    {
+        return false;
+    }
+
+    size_t blocksHigh = std::max<size_t>( 1, ( height + 3 ) / 4 );
+    ParallelFor( blocksHigh, threadCount, [&]( size_t by )
+    {
+        EncodeBlockRow( rgba, width, height, rowPitch, format, by, dest );
+    } );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::DecompressSurface( const uint8_t* blocks,
+                                 size_t width,
+                                 size_t height,
+                                 BC_FORMAT format,
+                                 uint8_t* rgba )
+{
+    if (!blocks || !rgba || !width || !height)
+    {
+        return false;
+    }
+
+    size_t blocksWide = std::max<size_t>( 1, ( width + 3 ) / 4 );
+    size_t blocksHigh = std::max<size_t>( 1, ( height + 3 ) / 4 );
+    size_t blockSize = BCBlockSize( format );
+
+    for (size_t by = 0; by < blocksHigh; ++by)
+    {
+        for (size_t bx = 0; bx < blocksWide; ++bx)
+        {
+            const uint8_t* in = blocks + ( by * blocksWide + bx ) * blockSize;
+            uint8_t decoded[16][4];
+
+            switch (format)
+            {
+            case BC_FORMAT_BC1:
+                DecodeBC1Block( in, decoded, true );
+                break;
+
+            case BC_FORMAT_BC3:
+                DecodeBC1Block( in + 8, decoded, false );
+                DecodeAlphaBlock( in, decoded );
+                break;
+
+            case BC_FORMAT_BC7:
+                if (!DecodeBC7Block( in, decoded ))
+                {
+                    return false;
+                }
+                break;
+            }
+
+            for (size_t y = 0; y < 4 && by * 4 + y < height; ++y)
+            {
+                for (size_t x = 0; x < 4 && bx * 4 + x < width; ++x)
+                {
+                    memcpy( rgba + ( ( by * 4 + y ) * width + bx * 4 + x ) * 4, decoded[y * 4 + x], 4 );
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+double DirectX::ComputePSNR( const uint8_t* a, const uint8_t* b, size_t width, size_t height, bool ignoreAlpha )
+{
+    double sum = 0.0;
+    size_t channels = ignoreAlpha ? 3 : 4;
+    size_t count = width * height * channels;
+    for (size_t i = 0; i < width * height; ++i)
+    {
+        for (size_t ch = 0; ch < channels; ++ch)
+        {
+            double d = double( a[i * 4 + ch] ) - double( b[i * 4 + ch] );
+            sum += d * d;
+        }
+    }
+
+    if (sum == 0.0)
+    {
+        return 99.0;
+    }
+
+    double mse = sum / double( count );
+    return 10.0 * log10( 255.0 * 255.0 / mse );
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::CompressMipChain( const uint8_t* rgba,
+                                size_t width,
+                                size_t height,
+                                size_t rowPitch,
+                                BC_FORMAT format,
+                                bool srgb,
+                                bool generateMips,
+                                std::vector<uint8_t>& blocks,
+                                size_t& mipCount,
+                                BCEncodeStats* stats,
+                                unsigned int threadCount )
+{
+    if (!rgba || !width || !height || rowPitch < width * 4)
+    {
+        return false;
+    }
+
+    // Source levels, tightly packed
+    mipCount = generateMips ? CountMips( width, height ) : 1;
+    MIPGEN_FORMAT mipFormat = srgb ? MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB : MIPGEN_FORMAT_R8G8B8A8_UNORM;
+    std::vector<uint8_t> levels( ComputeMipChainSize( width, height, mipFormat, mipCount ) );
+    if (!GenerateMipChain( rgba, width, height, rowPitch, mipFormat, MIPGEN_FILTER_KAISER, mipCount, &levels[0] ))
+    {
+        return false;
+    }
+
+    struct Level
+    {
+        size_t width;
+        size_t height;
+        size_t sourceOffset;
+        size_t destOffset;
+    };
+
+    struct Job
+    {
+        size_t level;
+        size_t blockRow;
+    };
+
+    std::vector<Level> levelInfo;
+    std::vector<Job> jobs;
+    size_t sourceOffset = 0;
+    size_t destOffset = 0;
+    size_t totalPixels = 0;
+    for (size_t i = 0, w = width, h = height; i < mipCount; ++i)
+    {
+        Level level = { w, h, sourceOffset, destOffset };
+        levelInfo.push_back( level );
+
+        size_t blocksHigh = std::max<size_t>( 1, ( h + 3 ) / 4 );
+        for (size_t by = 0; by < blocksHigh; ++by)
+        {
+            Job job = { i, by };
+            jobs.push_back( job );
+        }
+
+        totalPixels += w * h;
+        sourceOffset += w * h * 4;
+        destOffset += ComputeBCSurfaceSize( w, h, format );
+        w = std::max<size_t>( 1, w >> 1 );
+        h = std::max<size_t>( 1, h >> 1 );
+    }
+
+    blocks.resize( destOffset );
+
+    auto start = std::chrono::high_resolution_clock::now();
+    ParallelFor( jobs.size(), threadCount, [&]( size_t index )
+    {
+        const Level& level = levelInfo[ jobs[index].level ];
+        EncodeBlockRow( &levels[ level.sourceOffset ], level.width, level.height, level.width * 4,
+                        format, jobs[index].blockRow, &blocks[ level.destOffset ] );
+    } );
+    double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+    if (stats)
+    {
+        stats->pixels = totalPixels;
+        stats->seconds = seconds;
+        stats->megapixelsPerSecond = ( seconds > 0.0 ) ? double( totalPixels ) / seconds / 1e6 : 0.0;
+
+        std::vector<uint8_t> decoded( width * height * 4 );
+        stats->psnr = DecompressSurface( &blocks[0], width, height, format, &decoded[0] )
+                      ? ComputePSNR( &levels[0], &decoded[0], width, height, format == BC_FORMAT_BC1 )
+                      : 0.0;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+void DirectX::AppendBCDDSHeaders( std::vector<uint8_t>& dest,
+                                  size_t width,
+                                  size_t height,
+                                  size_t mipCount,
+                                  BC_FORMAT format,
+                                  bool srgb )
+{
+    DDS_HEADER header;
+    memset( &header, 0, sizeof(header) );
+    header.size = sizeof(DDS_HEADER);
+    header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_LINEARSIZE | ( mipCount > 1 ? DDS_HEADER_FLAGS_MIPMAP : 0 );
+    header.height = static_cast<uint32_t>( height );
+    header.width = static_cast<uint32_t>( width );
+    header.pitchOrLinearSize = static_cast<uint32_t>( ComputeBCSurfaceSize( width, height, format ) );
+    header.mipMapCount = static_cast<uint32_t>( mipCount );
+    header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+    header.ddspf.flags = DDS_FOURCC;
+    header.caps = DDS_SURFACE_FLAGS_TEXTURE | ( mipCount > 1 ? DDS_SURFACE_FLAGS_MIPMAP : 0 );
+
+    // Legacy FourCCs have no sRGB variant, so sRGB and BC7 use the DX10 extension
+    bool useDX10 = srgb || format == BC_FORMAT_BC7;
+    DDS_HEADER_DXT10 ext;
+    memset( &ext, 0, sizeof(ext) );
+    if (useDX10)
+    {
+        header.ddspf.fourCC = MAKEFOURCC( 'D', 'X', '1', '0' );
+        ext.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        ext.arraySize = 1;
+        switch (format)
+        {
+        case BC_FORMAT_BC1: ext.dxgiFormat = srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM; break;
+        case BC_FORMAT_BC3: ext.dxgiFormat = srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM; break;
+        case BC_FORMAT_BC7: ext.dxgiFormat = srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM; break;
+        }
+    }
+    else
+    {
+        header.ddspf.fourCC = ( format == BC_FORMAT_BC1 ) ? MAKEFOURCC( 'D', 'X', 'T', '1' ) : MAKEFOURCC( 'D', 'X', 'T', '5' );
+    }
+
+    const uint8_t* magic = reinterpret_cast<const uint8_t*>( &DDS_MAGIC );
+    dest.insert( dest.end(), magic, magic + sizeof(uint32_t) );
+    dest.insert( dest.end(), reinterpret_cast<const uint8_t*>( &header ), reinterpret_cast<const uint8_t*>( &header ) + sizeof(header) );
+    if (useDX10)
+    {
+        dest.insert( dest.end(), reinterpret_cast<const uint8_t*>( &ext ), reinterpret_cast<const uint8_t*>( &ext ) + sizeof(ext) );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::SaveBCTextureToDDSFile( const char* fileName,
+                                      const uint8_t* rgba,
+                                      size_t width,
+                                      size_t height,
+                                      size_t rowPitch,
+                                      BC_FORMAT format,
+                                      bool srgb,
+                                      bool generateMips,
+                                      BCEncodeStats* stats,
+                                      unsigned int threadCount )
+{
+    if (!fileName)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> compressed;
+    size_t mipCount = 0;
+    if (!CompressMipChain( rgba, width, height, rowPitch, format, srgb, generateMips, compressed, mipCount, stats, threadCount ))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> headers;
+    AppendBCDDSHeaders( headers, width, height, mipCount, format, srgb );
+
+    std::ofstream outFile( fileName, std::ios::out | std::ios::binary );
+    if (!outFile.good())
+    {
+        return false;
+    }
+
+    outFile.write( (const char*)&headers[0], headers.size() );
+    outFile.write( (const char*)&compressed[0], compressed.size() );
+    outFile.close();
+
+    return outFile.good();
+}
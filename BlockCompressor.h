@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// File: BlockCompressor.h
+//
+// BC1 / BC3 / BC7 block compression for the asset pipeline.
+//
+// Encodes RGBA8 images into 4x4 blocks on all hardware threads and writes DDS files
+// that DDSTextureLoader reads directly. Has no Direct3D dependency.
+//
+// BC7 output uses mode 6 (single subset, RGBA 7.7.7.7 endpoints with p-bits and 4-bit
+// indices) for every block. That is a valid BC7 stream; the multi-subset modes would buy
+// a little more quality on blocks with several distinct colours at a much higher cost.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef BLOCKCOMPRESSOR_H
+#define BLOCKCOMPRESSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    enum BC_FORMAT
+    {
+        BC_FORMAT_BC1 = 0,  // RGB, 1-bit alpha unused (opaque), 8 bytes per block
+        BC_FORMAT_BC3 = 1,  // RGB + interpolated alpha, 16 bytes per block
+        BC_FORMAT_BC7 = 2,  // RGBA, 16 bytes per block
+    };
+
+    struct BCEncodeStats
+    {
+        size_t pixels;              // source pixels encoded, all mips
+        double seconds;             // wall clock encode time
+        double megapixelsPerSecond;
+        double psnr;                // PSNR of the top level in dB, RGB only for BC1 (0 if not measured)
+    };
+
+    // Bytes per 4x4 block
+    size_t BCBlockSize( BC_FORMAT format );
+
+    // Size of one compressed surface
+    size_t ComputeBCSurfaceSize( size_t width, size_t height, BC_FORMAT format );
+
+    // Compresses a single RGBA8 surface. threadCount of 0 uses every hardware thread.
+    // dest must hold ComputeBCSurfaceSize bytes.
+    bool CompressSurface( const uint8_t* rgba,
+                          size_t width,
+                          size_t height,
+                          size_t rowPitch,
+                          BC_FORMAT format,
+                          uint8_t* dest,
+                          unsigned int threadCount = 0 );
+
+    // Decodes blocks produced by CompressSurface back to tightly packed RGBA8
+    // (BC7 decoding only covers mode 6, which is all the encoder emits).
+    bool DecompressSurface( const uint8_t* blocks,
+                            size_t width,
+                            size_t height,
+                            BC_FORMAT format,
+                            uint8_t* rgba );
+
+    // PSNR between two tightly packed RGBA8 images (RGB only if ignoreAlpha)
+    double ComputePSNR( const uint8_t* a, const uint8_t* b, size_t width, size_t height, bool ignoreAlpha = false );
+
+    // Compresses an RGBA8 image and (optionally) its generated mip chain into tightly packed
+    // blocks, level 0 first. All levels are encoded in parallel. stats is optional.
+    bool CompressMipChain( const uint8_t* rgba,
+                           size_t width,
+                           size_t height,
+                           size_t rowPitch,
+                           BC_FORMAT format,
+                           bool srgb,
+                           bool generateMips,
+                           std::vector<uint8_t>& blocks,
+                           size_t& mipCount,
+                           BCEncodeStats* stats = nullptr,
+                           unsigned int threadCount = 0 );
+
+    // Appends the DDS magic and headers describing a 2D BC texture to dest
+    void AppendBCDDSHeaders( std::vector<uint8_t>& dest,
+                             size_t width,
+                             size_t height,
+                             size_t mipCount,
+                             BC_FORMAT format,
+                             bool srgb );
+
+    // Compresses an RGBA8 image (optionally with a generated mip chain) and writes a DDS file.
+    // All levels are encoded in parallel. stats is optional.
+    bool SaveBCTextureToDDSFile( const char* fileName,
+                                 const uint8_t* rgba,
+                                 size_t width,
+                                 size_t height,
+                                 size_t rowPitch,
+                                 BC_FORMAT format,
+                                 bool srgb,
+                                 bool generateMips,
+                                 BCEncodeStats* stats = nullptr,
+                                 unsigned int threadCount = 0 );
+}
+
+#endif // BLOCKCOMPRESSOR_H
@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// File: ConstantRing.cpp
+//
+// Per-draw constants in slices of one dynamic constant buffer, bound by offset where the
+// device allows it.
+//--------------------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "ConstantRing.h"
+
+using namespace DirectX;
+
+
+//-------------------------------------------------------------------------------------
+ConstantRing::ConstantRing() :
+    buffer( nullptr ),
+    context1( nullptr ),
+    sliceBytes( 0 ),
+    sliceCount( 0 ),
+    nextSlice( 0 )
+{
+}
+
+
+//-------------------------------------------------------------------------------------
+ConstantRing::~ConstantRing()
+{
+    if ( context1 ) context1->Release();
+    if ( buffer ) buffer->Release();
+}
+
+
+//-------------------------------------------------------------------------------------
+HRESULT ConstantRing::Initialise( ID3D11Device* device, ID3D11DeviceContext* context, UINT sliceBytes, UINT sliceCount )
+{
+    if ( !sliceBytes || !sliceCount )
+        return E_INVALIDARG;
+
+    this->sliceBytes = ( sliceBytes + SLICE_ALIGNMENT - 1 ) / SLICE_ALIGNMENT * SLICE_ALIGNMENT;
+
+    // Offsets need the 11.1 context, and the driver has to allow both them and no-overwrite
+    // maps of constant buffers
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+    ZeroMemory( &options, sizeof(options) );
+    if ( SUCCEEDED( device->CheckFeatureSupport( D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options) ) ) &&
+         options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer )
+    {
+        context->QueryInterface( __uuidof(ID3D11DeviceContext1), (void**)&context1 );
+    }
+
+    this->sliceCount = context1 ? sliceCount : 1;
+    nextSlice = this->sliceCount;
+
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory( &bd, sizeof(bd) );
+    bd.Usage = D3D11_USAGE_DYNAMIC;
+    bd.ByteWidth = this->sliceBytes * this->sliceCount;
+    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    return device->CreateBuffer( &bd, nullptr, &buffer );
+}
+
+
+//-------------------------------------------------------------------------------------
+HRESULT ConstantRing::Upload( ID3D11DeviceContext* context, UINT slot, const void* data, UINT size )
+{
+    if ( !buffer || size > sliceBytes )
+        return E_INVALIDARG;
+
+    // Starting over from the front discards what the GPU may still be reading, earlier draws
+    // keep the old copy
+    D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if ( nextSlice == sliceCount )
+    {
+        mapType = D3D11_MAP_WRITE_DISCARD;
+        nextSlice = 0;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = context->Map( buffer, 0, mapType, 0, &mapped );
+    if ( FAILED(hr) )
+        return hr;
+
+    UINT offset = nextSlice * sliceBytes;
+    memcpy( (BYTE*)mapped.pData + offset, data, size );
+    context->Unmap( buffer, 0 );
+    ++nextSlice;
+
+    if ( context1 )
+    {
+        UINT firstConstant = offset / 16;
+        UINT constantCount = sliceBytes / 16;
+
+        // Some runtimes ignore a new offset for the buffer already in the slot, so the slot is
+        // emptied first
+        ID3D11Buffer* none = nullptr;
+        context1->VSSetConstantBuffers( slot, 1, &none );
+        context1->VSSetConstantBuffers1( slot, 1, &buffer, &firstConstant, &constantCount );
+    }
+    else
+    {
+        context->VSSetConstantBuffers( slot, 1, &buffer );
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// File: ConstantRing.h
+//
+// Constants that change with every draw, written into slices of one large dynamic
+// constant buffer.
+//
+// Each upload maps the buffer with D3D11_MAP_WRITE_NO_OVERWRITE, fills the next free
+// slice and binds only that slice with VSSetConstantBuffers1, so draws already recorded
+// keep reading theirs; once the buffer is full it is mapped with DISCARD and filling
+// starts again from the front. Without constant buffer offsets (before Direct3D 11.1) the
+// ring is a single slice mapped with DISCARD for every upload.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef CONSTANTRING_H
+#define CONSTANTRING_H
+
+#include <windows.h>
+#include <d3d11_1.h>
+
+namespace DirectX
+{
+    class ConstantRing
+    {
+    public:
+        ConstantRing();
+        ~ConstantRing();
+
+        // sliceBytes is the most a single upload writes and is rounded up to 256; sliceCount
+        // is how many uploads fit before the ring wraps
+        HRESULT Initialise( ID3D11Device* device, ID3D11DeviceContext* context, UINT sliceBytes, UINT sliceCount );
+
+        // Copies size bytes into a fresh slice and binds it to the vertex shader at slot
+        HRESULT Upload( ID3D11DeviceContext* context, UINT slot, const void* data, UINT size );
+
+        bool IsOffsetBinding() const { return context1 != nullptr; }
+
+    private:
+        // Bound ranges start and end on multiples of 16 constants
+        static const UINT SLICE_ALIGNMENT = 256;
+
+        ID3D11Buffer*           buffer;
+        ID3D11DeviceContext1*   context1;   // nullptr when ranges of a buffer cannot be bound
+        UINT                    sliceBytes;
+        UINT                    sliceCount;
+        UINT                    nextSlice;
+    };
+}
+
+#endif // CONSTANTRING_H
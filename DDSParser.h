@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// File: DDSParser.h
+//
+// Platform-neutral DDS container parsing.
+//
+// Validates a DDS file held in memory and describes it: resource dimension, format,
+// size, mip and array counts, and a table with the location and pitch of every
+// subresource. DDSTextureLoader creates its Direct3D 11 resources from this description.
+// Asset tools and Linux build servers can use the same code without Direct3D.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DDSPARSER_H
+#define DDSPARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "DDSFormats.h"
+
+namespace DirectX
+{
+    enum DDS_ALPHA_MODE
+    {
+        DDS_ALPHA_MODE_UNKNOWN       = 0,
+        DDS_ALPHA_MODE_STRAIGHT      = 1,
+        DDS_ALPHA_MODE_PREMULTIPLIED = 2,
+        DDS_ALPHA_MODE_OPAQUE        = 3,
+        DDS_ALPHA_MODE_CUSTOM        = 4,
+    };
+
+    enum DDS_PARSE_RESULT
+    {
+        DDS_PARSE_OK             = 0,
+        DDS_PARSE_INVALID_HEADER = 1,   // not a DDS file, or truncated headers
+        DDS_PARSE_INVALID_DATA   = 2,   // header fields are inconsistent
+        DDS_PARSE_NOT_SUPPORTED  = 3,   // valid DDS, but a format or size Direct3D 11 cannot create
+        DDS_PARSE_END_OF_FILE    = 4,   // pixel data is shorter than the header describes
+    };
+
+    // Same values as D3D11_RESOURCE_DIMENSION
+    enum DDS_DIMENSION
+    {
+        DDS_DIMENSION_UNKNOWN   = 0,
+        DDS_DIMENSION_TEXTURE1D = 2,
+        DDS_DIMENSION_TEXTURE2D = 3,
+        DDS_DIMENSION_TEXTURE3D = 4,
+    };
+
+    struct DDSTextureInfo
+    {
+        DDS_DIMENSION   dimension;
+        DXGI_FORMAT     format;
+        size_t          width;
+        size_t          height;
+        size_t          depth;
+        size_t          mipCount;
+        size_t          arraySize;      // already multiplied by 6 for cube maps
+        bool            isCubeMap;
+        DDS_ALPHA_MODE  alphaMode;
+        size_t          dataOffset;     // start of the pixel data within the file
+        size_t          dataSize;
+    };
+
+    struct DDSSubresource
+    {
+        size_t          offset;         // relative to DDSTextureInfo::dataOffset
+        size_t          rowPitch;
+        size_t          slicePitch;
+        size_t          width;
+        size_t          height;
+        size_t          depth;
+    };
+
+    size_t BitsPerPixel( DXGI_FORMAT fmt );
+
+    void GetSurfaceInfo( size_t width,
+                         size_t height,
+                         DXGI_FORMAT fmt,
+                         size_t* outNumBytes,
+                         size_t* outRowBytes,
+                         size_t* outNumRows );
+
+    DXGI_FORMAT MakeSRGB( DXGI_FORMAT format );
+
+    // Validates the headers of a DDS file in memory and fills in info
+    DDS_PARSE_RESULT ParseDDS( const uint8_t* ddsData, size_t ddsDataSize, DDSTextureInfo& info );
+
+    // One entry per subresource, in Direct3D order (array item major, then mip level).
+    // Fails with DDS_PARSE_END_OF_FILE if the data is too short for the layout.
+    DDS_PARSE_RESULT BuildDDSLayout( const DDSTextureInfo& info, std::vector<DDSSubresource>& layout );
+}
+
+#endif // DDSPARSER_H
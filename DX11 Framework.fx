@@ -5,31 +5,77 @@
 //--------------------------------------------------------------------------------------
 
 Texture2D txDiffuse : register(t0);
+Texture2D txPhysicalPages : register(t1);
+Texture2D<uint4> txPageTable : register(t2);
+Texture2D<float> txHeight : register(t3);
+Buffer<float> txTileHeights : register(t4);
 SamplerState samLinear : register(s0);
     
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
 //--------------------------------------------------------------------------------------
-cbuffer ConstantBuffer : register( b0 )
+cbuffer FrameBuffer : register( b0 )
 {
-	matrix World;
 	matrix View;
 	matrix Projection;
-    float4 DiffuseMtrl;
     
     float4 DiffuseLight;
     float3 LightVecW;
     float gTime;
-    float4 AmbientMtrl;
     float4 AmbientLight;
-    
-    float4 SpecularMtrl;
     float4 SpecularLight;
     float3 EyePosW;
-    
+}
+
+cbuffer MaterialBuffer : register( b4 )
+{
+    float4 DiffuseMtrl;
+    float4 AmbientMtrl;
+    float4 SpecularMtrl;
     float  SpecularPower;
-    
- 
+}
+
+// A slice of the object ring, written for every draw, see ConstantRing.h
+cbuffer ObjectBuffer : register( b5 )
+{
+	matrix World;
+}
+
+//--------------------------------------------------------------------------------------
+// Virtual texture (terrain), see TerrainVirtualTexture.h
+//--------------------------------------------------------------------------------------
+cbuffer VirtualTextureBuffer : register( b1 )
+{
+    float4 VTParams;    // pages across mip 0, page size, border, coarsest mip
+    float4 VTPhysical;  // 1 / physical width, 1 / physical height, page size with borders, feedback mip bias
+}
+
+//--------------------------------------------------------------------------------------
+// Terrain, see TerrainQuadtree.h and TerrainTiles.h
+//--------------------------------------------------------------------------------------
+cbuffer TerrainBuffer : register( b2 )
+{
+    float4 TerrainGrid; // origin x, origin z, spacing x, spacing z
+    float4 TerrainSize; // last sample column, last sample row, 1 / last column, 1 / last row
+    float4 CameraPos;   // terrain space
+    float4 HeightParams; // height-only stream: height offset, height range, unused, unused
+}
+
+// Terrain node or tile, a slice of the terrain node ring written for every draw, see ConstantRing.h
+cbuffer TerrainNodeBuffer : register( b6 )
+{
+    float4 NodeParams;  // first grid x, first grid z, grid samples per patch quad, lod
+    float4 MorphParams; // morph start, morph end, patch quads, unused
+    float4 StitchParams; // streamed tiles: samples between the coarser neighbour's vertices on the top, right, bottom, left edges
+}
+
+//--------------------------------------------------------------------------------------
+// Foliage layer (grass, rocks), see TerrainScatter.h
+//--------------------------------------------------------------------------------------
+cbuffer FoliageBuffer : register( b3 )
+{
+    float4 FoliageColour; // base colour, alpha unused
+    float4 FoliageParams; // brightness at tint 0, brightness at tint 1, sway per unit of mesh height, root darkening
 }
 //--------------------------------------------------------------------------------------
 struct VS_INPUT
@@ -39,12 +85,28 @@ struct VS_INPUT
 };
 
 
+//--------------------------------------------------------------------------------------
+// Instancing: VS and PS compiled again with INSTANCED defined read a transform and a tint
+// for each instance from a stream in slot 1, the transform placing it within World
+//--------------------------------------------------------------------------------------
+#ifdef INSTANCED
+#define INSTANCE_INPUT , float4 InstanceWorld0 : WORLD0, float4 InstanceWorld1 : WORLD1, float4 InstanceWorld2 : WORLD2, float4 InstanceTint : TINT
+// The stream holds the first three columns of the instance transform
+#define OBJECT_WORLD mul(transpose(float4x4(InstanceWorld0, InstanceWorld1, InstanceWorld2, float4(0.0f, 0.0f, 0.0f, 1.0f))), World)
+#else
+#define INSTANCE_INPUT
+#define OBJECT_WORLD World
+#endif
+
 struct VS_OUTPUT
 {
     float4 Pos : SV_POSITION;
     float3 Norm : NORMAL;
     float3 PosW : POSITION;
     float2 Tex : TEXCOORD;
+#ifdef INSTANCED
+    float4 Tint : TINT;
+#endif
     
    
 };
@@ -52,12 +114,13 @@ struct VS_OUTPUT
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
-VS_OUTPUT VS(float4 Pos : POSITION, float3 NormalL : NORMAL, float2 Tex : TEXCOORD)
+VS_OUTPUT VS(float4 Pos : POSITION, float3 NormalL : NORMAL, float2 Tex : TEXCOORD INSTANCE_INPUT)
 {
 
 	VS_OUTPUT output = (VS_OUTPUT) 0;
+	float4x4 world = OBJECT_WORLD;
 
-	output.Pos = mul(Pos, World);
+	output.Pos = mul(Pos, world);
     output.PosW = normalize(EyePosW - output.Pos.xyz);
 	output.Pos = mul(output.Pos, View);
 	output.Pos = mul(output.Pos, Projection);
@@ -65,20 +128,166 @@ VS_OUTPUT VS(float4 Pos : POSITION, float3 NormalL : NORMAL, float2 Tex : TEXCOO
     // Convert from local space to world space
     // W component of vector is 0 as vectors cannot be translated
 
-	float3 normalW = mul(float4(NormalL, 0.0f), World).xyz;
+	float3 normalW = mul(float4(NormalL, 0.0f), world).xyz;
 	normalW = normalize(normalW);
     output.Norm = normalW;
 
     // Texture Shader
     
     output.Tex = Tex;
+
+#ifdef INSTANCED
+    output.Tint = InstanceTint;
+#endif
     
 	return output;
 }
+//--------------------------------------------------------------------------------------
+// Terrain Vertex Shader (CDLOD)
+//--------------------------------------------------------------------------------------
+float TerrainHeight(float2 grid)
+{
+    // Bilinear between the four samples around grid, clamped to the heightmap
+    grid = clamp(grid, 0.0f, TerrainSize.xy);
+    int2 base = min((int2)grid, (int2)TerrainSize.xy - 1);
+    float2 f = grid - base;
+    
+    float h00 = txHeight.Load(int3(base, 0));
+    float h10 = txHeight.Load(int3(base + int2(1, 0), 0));
+    float h01 = txHeight.Load(int3(base + int2(0, 1), 0));
+    float h11 = txHeight.Load(int3(base + int2(1, 1), 0));
+    
+    return lerp(lerp(h00, h10, f.x), lerp(h01, h11, f.x), f.y);
+}
+
+float3 TerrainPosition(float2 grid)
+{
+    grid = clamp(grid, 0.0f, TerrainSize.xy);
+    return float3(TerrainGrid.x + grid.x * TerrainGrid.z, TerrainHeight(grid), TerrainGrid.y - grid.y * TerrainGrid.w);
+}
+
+float3 TerrainNormal(float2 grid, float step)
+{
+    // Slope over step samples either side (grid z runs towards -Z)
+    float hl = TerrainHeight(grid - float2(step, 0.0f));
+    float hr = TerrainHeight(grid + float2(step, 0.0f));
+    float hu = TerrainHeight(grid - float2(0.0f, step));
+    float hd = TerrainHeight(grid + float2(0.0f, step));
+    return normalize(float3((hl - hr) / (2.0f * step * TerrainGrid.z), 1.0f, (hd - hu) / (2.0f * step * TerrainGrid.w)));
+}
+
+VS_OUTPUT VS_Terrain(float4 Pos : POSITION, float3 NormalL : NORMAL, float2 Tex : TEXCOORD)
+{
+    VS_OUTPUT output = (VS_OUTPUT) 0;
+    
+    // Pos.xz is the vertex within the patch, 0 to patch quads
+    float2 patch = Pos.xz;
+    float3 local = TerrainPosition(NodeParams.xy + patch * NodeParams.z);
+    
+    // Odd vertices slide onto the next coarser grid as they near the end of the node's range
+    float morph = saturate((distance(local, CameraPos.xyz) - MorphParams.x) / max(MorphParams.y - MorphParams.x, 0.0001f));
+    patch -= frac(patch * 0.5f) * 2.0f * morph;
+    
+    float2 grid = NodeParams.xy + patch * NodeParams.z;
+    local = TerrainPosition(grid);
+    
+    // Normal from the slope at this level's sample spacing
+    float3 normalL = TerrainNormal(grid, NodeParams.z);
+    
+    output.Pos = mul(float4(local, 1.0f), World);
+    output.PosW = normalize(EyePosW - output.Pos.xyz);
+    output.Pos = mul(output.Pos, View);
+    output.Pos = mul(output.Pos, Projection);
+    
+    output.Norm = normalize(mul(float4(normalL, 0.0f), World).xyz);
+    output.Tex = grid * TerrainSize.zw;
+    
+    return output;
+}
+
+//--------------------------------------------------------------------------------------
+// Terrain Vertex Shader (height-only tiles)
+//--------------------------------------------------------------------------------------
+VS_OUTPUT VS_TerrainHeights(float Height : HEIGHT, uint VertexId : SV_VertexID)
+{
+    VS_OUTPUT output = (VS_OUTPUT) 0;
+    
+    // Vertex within the tile; the modulo drops the base vertex whether or not it is included
+    uint stride = (uint)MorphParams.z + 1;
+    uint vertex = VertexId % (stride * stride);
+    
+    // Edge tiles repeat the last sample row and column
+    float2 grid = min(NodeParams.xy + float2(vertex % stride, vertex / stride), TerrainSize.xy);
+    float3 local = float3(TerrainGrid.x + grid.x * TerrainGrid.z, HeightParams.x + Height * HeightParams.y, TerrainGrid.y - grid.y * TerrainGrid.w);
+    
+    output.Pos = mul(float4(local, 1.0f), World);
+    output.PosW = normalize(EyePosW - output.Pos.xyz);
+    output.Pos = mul(output.Pos, View);
+    output.Pos = mul(output.Pos, Projection);
+    
+    output.Norm = normalize(mul(float4(TerrainNormal(grid, 1.0f), 0.0f), World).xyz);
+    output.Tex = grid * TerrainSize.zw;
+    
+    return output;
+}
+
+// Streamed tiles are (patch quads + 3) samples a side, a one sample border around the drawn ones
+float StreamHeight(int2 sample)
+{
+    int stride = (int)MorphParams.z + 3;
+    return HeightParams.x + txTileHeights.Load((sample.y + 1) * stride + sample.x + 1) * HeightParams.y;
+}
+
+VS_OUTPUT VS_TerrainStream(uint VertexId : SV_VertexID)
+{
+    VS_OUTPUT output = (VS_OUTPUT) 0;
+    
+    int quads = (int)MorphParams.z;
+    int2 sample = int2(VertexId % (quads + 1), VertexId / (quads + 1));
+    float height = StreamHeight(sample);
+    
+    // Edge vertices next to a coarser tile are moved onto that tile's edge
+    if (sample.y == 0 || sample.y == quads)
+    {
+        int step = (int)(sample.y == 0 ? StitchParams.x : StitchParams.z);
+        int first = sample.x / step * step;
+        if (first != sample.x)
+            height = lerp(StreamHeight(int2(first, sample.y)), StreamHeight(int2(first + step, sample.y)), (float)(sample.x - first) / step);
+    }
+    else if (sample.x == 0 || sample.x == quads)
+    {
+        int step = (int)(sample.x == 0 ? StitchParams.w : StitchParams.y);
+        int first = sample.y / step * step;
+        if (first != sample.y)
+            height = lerp(StreamHeight(int2(sample.x, first)), StreamHeight(int2(sample.x, first + step)), (float)(sample.y - first) / step);
+    }
+    
+    // Tiles past the far edges repeat the last sample row and column
+    float2 grid = min(NodeParams.xy + sample * NodeParams.z, TerrainSize.xy);
+    float3 local = float3(TerrainGrid.x + grid.x * TerrainGrid.z, height, TerrainGrid.y - grid.y * TerrainGrid.w);
+    
+    output.Pos = mul(float4(local, 1.0f), World);
+    output.PosW = normalize(EyePosW - output.Pos.xyz);
+    output.Pos = mul(output.Pos, View);
+    output.Pos = mul(output.Pos, Projection);
+    
+    // Slope from the neighbouring samples, the border supplies them on the tile edges
+    float hl = StreamHeight(sample - int2(1, 0));
+    float hr = StreamHeight(sample + int2(1, 0));
+    float hu = StreamHeight(sample - int2(0, 1));
+    float hd = StreamHeight(sample + int2(0, 1));
+    float3 normalL = normalize(float3((hl - hr) / (2.0f * NodeParams.z * TerrainGrid.z), 1.0f, (hd - hu) / (2.0f * NodeParams.z * TerrainGrid.w)));
+    
+    output.Norm = normalize(mul(float4(normalL, 0.0f), World).xyz);
+    output.Tex = grid * TerrainSize.zw;
+    
+    return output;
+}
+
 //--------------------------------------------------------------------------------------
 // Pixel Shader
 //--------------------------------------------------------------------------------------
-float4 PS( VS_OUTPUT input ) : SV_Target
+float4 Shade( VS_OUTPUT input, float4 textureColour )
 {
     float4 f = (0.0f, 0.0f, 0.0f, 1.0f);
     
@@ -90,9 +299,6 @@ float4 PS( VS_OUTPUT input ) : SV_Target
     float3 ambient = AmbientMtrl * AmbientLight;
     float3 diffuse = DiffuseMtrl * AmbientLight;
     
-    float4 textureColour = { 1, 1, 1, 1 };
-    textureColour = txDiffuse.Sample(samLinear, input.Tex);
-    
     f.rbg = textureColour.rbg * (diffuse + ambient + specular);
     f.a = textureColour.a;
     
@@ -100,5 +306,107 @@ float4 PS( VS_OUTPUT input ) : SV_Target
     
 }
 
+float4 PS( VS_OUTPUT input ) : SV_Target
+{
+    float4 textureColour = { 1, 1, 1, 1 };
+    textureColour = txDiffuse.Sample(samLinear, input.Tex);
+#ifdef INSTANCED
+    textureColour *= input.Tint;
+#endif
+    
+    return Shade(input, textureColour);
+}
+
+//--------------------------------------------------------------------------------------
+// Virtual texture pixel shaders
+//--------------------------------------------------------------------------------------
+float VirtualMip(float2 uv, float bias)
+{
+    // Mip from the screen space footprint in virtual texels
+    float2 texel = uv * VTParams.x * VTParams.y;
+    float2 dx = ddx(texel);
+    float2 dy = ddy(texel);
+    float footprint = max(dot(dx, dx), dot(dy, dy));
+    
+    return clamp(0.5f * log2(max(footprint, 1e-8f)) + bias, 0.0f, VTParams.w);
+}
+
+float4 PS_VirtualTexture( VS_OUTPUT input ) : SV_Target
+{
+    float2 uv = clamp(input.Tex, 0.0f, 0.99999f);
+    float mip = floor(VirtualMip(uv, 0.0f));
+    
+    // The page table entry points at the finest resident page covering this one
+    int2 page = int2(uv * (VTParams.x / exp2(mip)));
+    uint4 entry = txPageTable.Load(int3(page, (int)mip));
+    
+    float mappedPages = VTParams.x / exp2((float)entry.z);
+    float2 local = frac(uv * mappedPages);
+    float2 physical = (entry.xy * VTPhysical.z + VTParams.z + local * VTParams.y) * VTPhysical.xy;
+    
+    return Shade(input, txPhysicalPages.SampleLevel(samLinear, physical, 0));
+}
+
+uint PS_VirtualTextureFeedback( VS_OUTPUT input ) : SV_Target
+{
+    // Same packing as MakePageId in VirtualTexture.h
+    float2 uv = clamp(input.Tex, 0.0f, 0.99999f);
+    uint mip = (uint)floor(VirtualMip(uv, VTPhysical.w));
+    uint2 page = (uint2)(uv * (VTParams.x / exp2((float)mip)));
+    
+    return page.x | (page.y << 12) | (mip << 24);
+}
+
+//--------------------------------------------------------------------------------------
+// Foliage (instanced terrain scatter)
+//--------------------------------------------------------------------------------------
+struct VS_FOLIAGE_OUTPUT
+{
+    float4 Pos : SV_POSITION;
+    float3 Norm : NORMAL;
+    float3 PosW : POSITION;
+    float2 Tex : TEXCOORD;
+    float Tint : TINT;
+};
 
+VS_FOLIAGE_OUTPUT VS_Foliage(float4 Pos : POSITION, float3 NormalL : NORMAL, float2 Tex : TEXCOORD,
+                             float4 InstancePos : INSTANCE0, float2 InstanceParams : INSTANCE1)
+{
+    VS_FOLIAGE_OUTPUT output = (VS_FOLIAGE_OUTPUT) 0;
+    
+    // InstancePos is the terrain space position and scale, InstanceParams the rotation about y and tint
+    float s, c;
+    sincos(InstanceParams.x, s, c);
+    float3 local = Pos.xyz * InstancePos.w;
+    local = float3(c * local.x + s * local.z, local.y, c * local.z - s * local.x);
+    
+    // Tops sway with the wind, out of step from one instance to the next
+    float phase = gTime * 2.0f + InstancePos.x * 0.37f + InstancePos.z * 0.23f;
+    local.xz += FoliageParams.z * Pos.y * InstancePos.w * float2(sin(phase), cos(phase * 0.7f));
+    
+    float3 normalL = float3(c * NormalL.x + s * NormalL.z, NormalL.y, c * NormalL.z - s * NormalL.x);
+    
+    output.Pos = mul(float4(local + InstancePos.xyz, 1.0f), World);
+    output.PosW = normalize(EyePosW - output.Pos.xyz);
+    output.Pos = mul(output.Pos, View);
+    output.Pos = mul(output.Pos, Projection);
+    
+    output.Norm = normalize(mul(float4(normalL, 0.0f), World).xyz);
+    output.Tex = Tex;
+    output.Tint = lerp(FoliageParams.x, FoliageParams.y, InstanceParams.y);
+    
+    return output;
+}
 
+float4 PS_Foliage( VS_FOLIAGE_OUTPUT input ) : SV_Target
+{
+    VS_OUTPUT shaded;
+    shaded.Pos = input.Pos;
+    shaded.Norm = input.Norm;
+    shaded.PosW = input.PosW;
+    shaded.Tex = input.Tex;
+    
+    // Tex.y runs from 0 at the mesh's top to 1 at its root
+    float brightness = input.Tint * (1.0f - FoliageParams.w * input.Tex.y);
+    return Shade(shaded, float4(FoliageColour.rgb * brightness, 1.0f));
+}
@@ -0,0 +1,371 @@
+//--------------------------------------------------------------------------------------
+// File: HeightmapLoader.cpp
+//
+// Memory mapped RAW16, PGM and BMP heightmap loading.
+//--------------------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "HeightmapLoader.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HEIGHTMAP_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+inline uint32_t Read16( const uint8_t* p ) { return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ); }
+inline uint32_t Read32( const uint8_t* p ) { return Read16( p ) | ( Read16( p + 2 ) << 16 ); }
+
+//-------------------------------------------------------------------------------------
+// Where the samples are and how to read them
+//-------------------------------------------------------------------------------------
+struct SourceLayout
+{
+    size_t          width;
+    size_t          depth;
+    const uint8_t*  firstRow;       // image row that becomes grid row 0
+    ptrdiff_t       rowPitch;       // bytes to the next grid row, negative for bottom-up BMPs
+    unsigned int    bytesPerSample; // 1, 2 (16-bit), 3 or 4 (first byte used)
+    bool            bigEndian;      // 16-bit only
+    unsigned int    maxValue;
+    const uint8_t*  palette;        // 8-bit BMPs, 4 bytes per entry
+    size_t          paletteSize;
+    unsigned int    bitsPerSample;
+};
+
+//-------------------------------------------------------------------------------------
+bool ParseRaw16( const uint8_t* data, size_t dataSize, const HeightmapLoadDesc& desc, SourceLayout& layout )
+{
+    size_t width = desc.rawWidth;
+    size_t depth = desc.rawDepth;
+    if ( !width || !depth )
+    {
+        size_t samples = dataSize / 2;
+        width = depth = size_t( sqrt( double( samples ) ) + 0.5 );
+    }
+
+    if ( width < 2 || depth < 2 || width * depth * 2 != dataSize )
+        return false;
+
+    layout.width = width;
+    layout.depth = depth;
+    layout.firstRow = data;
+    layout.rowPitch = ptrdiff_t( width * 2 );
+    layout.bytesPerSample = 2;
+    layout.bigEndian = desc.rawBigEndian;
+    layout.maxValue = 65535;
+    layout.bitsPerSample = 16;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+// P5 header: magic, width, height and maximum value separated by whitespace or comments,
+// then a single whitespace character before the samples
+//-------------------------------------------------------------------------------------
+bool ParsePGM( const uint8_t* data, size_t dataSize, SourceLayout& layout )
+{
+    if ( dataSize < 2 || data[0] != 'P' || data[1] != '5' )
+        return false;
+
+    size_t pos = 2;
+    size_t values[3];
+    for ( size_t v = 0; v < 3; ++v )
+    {
+        for ( ;; )
+        {
+            if ( pos >= dataSize )
+                return false;
+            if ( data[pos] == '#' )
+            {
+                while ( pos < dataSize && data[pos] != '\n' )
+                    ++pos;
+            }
+            else if ( isspace( data[pos] ) )
+                ++pos;
+            else
+                break;
+        }
+
+        if ( !isdigit( data[pos] ) )
+            return false;
+
+        size_t value = 0;
+        while ( pos < dataSize && isdigit( data[pos] ) && value < 1000000 )
+            value = value * 10 + size_t( data[pos++] - '0' );
+        values[v] = value;
+    }
+
+    if ( pos >= dataSize || !isspace( data[pos] ) )
+        return false;
+    ++pos;
+
+    size_t width = values[0], depth = values[1], maxValue = values[2];
+    if ( width < 2 || depth < 2 || !maxValue || maxValue > 65535 )
+        return false;
+
+    unsigned int bytes = maxValue < 256 ? 1 : 2;
+    if ( ( dataSize - pos ) / bytes / width < depth )
+        return false;
+
+    layout.width = width;
+    layout.depth = depth;
+    layout.firstRow = data + pos;
+    layout.rowPitch = ptrdiff_t( width * bytes );
+    layout.bytesPerSample = bytes;
+    layout.bigEndian = true;
+    layout.maxValue = static_cast<unsigned int>( maxValue );
+    layout.bitsPerSample = bytes * 8;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool ParseBMP( const uint8_t* data, size_t dataSize, SourceLayout& layout )
+{
+    const size_t FILE_HEADER_SIZE = 14;
+    if ( dataSize < FILE_HEADER_SIZE + 40 || data[0] != 'B' || data[1] != 'M' )
+        return false;
+
+    const uint8_t* info = data + FILE_HEADER_SIZE;
+    size_t offBits = Read32( data + 10 );
+    size_t infoSize = Read32( info );
+    int32_t width = int32_t( Read32( info + 4 ) );
+    int32_t height = int32_t( Read32( info + 8 ) );
+    unsigned int bitCount = Read16( info + 14 );
+    uint32_t compression = Read32( info + 16 );
+    size_t colorsUsed = Read32( info + 32 );
+
+    // BI_RGB only
+    if ( compression != 0 || infoSize < 40 || width < 2 || height == 0 )
+        return false;
+
+    if ( bitCount != 8 && bitCount != 24 && bitCount != 32 )
+        return false;
+
+    size_t depth = size_t( height < 0 ? -int64_t( height ) : height );
+    if ( depth < 2 )
+        return false;
+
+    // Rows are padded to a multiple of four bytes
+    size_t stride = ( ( size_t( width ) * bitCount + 31 ) / 32 ) * 4;
+    if ( offBits > dataSize || ( dataSize - offBits ) / stride < depth )
+        return false;
+
+    layout.palette = nullptr;
+    layout.paletteSize = 0;
+    if ( bitCount == 8 )
+    {
+        size_t entries = colorsUsed ? std::min<size_t>( colorsUsed, 256 ) : 256;
+        size_t paletteOffset = FILE_HEADER_SIZE + infoSize;
+        if ( paletteOffset + entries * 4 > offBits )
+            return false;
+        layout.palette = data + paletteOffset;
+        layout.paletteSize = entries;
+    }
+
+    const uint8_t* pixels = data + offBits;
+    layout.width = size_t( width );
+    layout.depth = depth;
+    if ( height > 0 )
+    {
+        // Bottom-up: the last stored row is the top of the image
+        layout.firstRow = pixels + ( depth - 1 ) * stride;
+        layout.rowPitch = -ptrdiff_t( stride );
+    }
+    else
+    {
+        layout.firstRow = pixels;
+        layout.rowPitch = ptrdiff_t( stride );
+    }
+    layout.bytesPerSample = bitCount / 8;
+    layout.bigEndian = false;
+    layout.maxValue = 255;
+    layout.bitsPerSample = 8;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+// 16-bit samples, eight at a time
+//-------------------------------------------------------------------------------------
+void ConvertRow16( const uint8_t* src, size_t count, bool bigEndian, float scale, float offset, float* dest )
+{
+    size_t x = 0;
+
+#ifdef HEIGHTMAP_USE_SSE
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 s = _mm_set1_ps( scale );
+    const __m128 o = _mm_set1_ps( offset );
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + x * 2 ) );
+        if ( bigEndian )
+            v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+
+        __m128 lo = _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) );
+        __m128 hi = _mm_cvtepi32_ps( _mm_unpackhi_epi16( v, zero ) );
+        _mm_storeu_ps( dest + x, _mm_add_ps( _mm_mul_ps( lo, s ), o ) );
+        _mm_storeu_ps( dest + x + 4, _mm_add_ps( _mm_mul_ps( hi, s ), o ) );
+    }
+#endif
+
+    for ( ; x < count; ++x )
+    {
+        const uint8_t* p = src + x * 2;
+        uint32_t value = bigEndian ? ( uint32_t( p[0] ) << 8 ) | p[1] : ( uint32_t( p[1] ) << 8 ) | p[0];
+        dest[x] = float( value ) * scale + offset;
+    }
+}
+
+//-------------------------------------------------------------------------------------
+// 32-bit pixels, low byte of each, four at a time
+//-------------------------------------------------------------------------------------
+void ConvertRow32( const uint8_t* src, size_t count, float scale, float offset, float* dest )
+{
+    size_t x = 0;
+
+#ifdef HEIGHTMAP_USE_SSE
+    const __m128i mask = _mm_set1_epi32( 0xFF );
+    const __m128 s = _mm_set1_ps( scale );
+    const __m128 o = _mm_set1_ps( offset );
+    for ( ; x + 4 <= count; x += 4 )
+    {
+        __m128i v = _mm_and_si128( _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + x * 4 ) ), mask );
+        _mm_storeu_ps( dest + x, _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( v ), s ), o ) );
+    }
+#endif
+
+    for ( ; x < count; ++x )
+        dest[x] = float( src[x * 4] ) * scale + offset;
+}
+
+//-------------------------------------------------------------------------------------
+bool ConvertSamples( const SourceLayout& layout,
+                     const HeightmapLoadDesc& desc,
+                     std::vector<float>& heights,
+                     HeightmapInfo* info,
+                     unsigned int threadCount )
+{
+    size_t width = layout.width;
+    heights.resize( width * layout.depth );
+
+    float scale = desc.heightScale / float( layout.maxValue );
+    float offset = desc.heightOffset;
+
+    // Every 8-bit value (or palette index) maps through one table
+    float table[256];
+    if ( layout.bytesPerSample != 2 && layout.bytesPerSample != 4 )
+    {
+        for ( unsigned int v = 0; v < 256; ++v )
+        {
+            unsigned int value = v;
+            if ( layout.palette )
+                value = ( v < layout.paletteSize ) ? layout.palette[v * 4] : 0;
+            table[v] = float( value ) * scale + offset;
+        }
+    }
+
+    ParallelFor( layout.depth, threadCount, [&]( size_t z )
+    {
+        const uint8_t* src = layout.firstRow + ptrdiff_t( z ) * layout.rowPitch;
+        float* dest = &heights[z * width];
+
+        switch ( layout.bytesPerSample )
+        {
+        case 2:
+            ConvertRow16( src, width, layout.bigEndian, scale, offset, dest );
+            break;
+
+        case 4:
+            ConvertRow32( src, width, scale, offset, dest );
+            break;
+
+        default:
+            for ( size_t x = 0; x < width; ++x )
+                dest[x] = table[src[x * layout.bytesPerSample]];
+            break;
+        }
+    } );
+
+    if ( info )
+    {
+        info->width = width;
+        info->depth = layout.depth;
+        info->bitsPerSample = layout.bitsPerSample;
+    }
+
+    return true;
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::LoadHeightmapFromMemory( const uint8_t* data,
+                                       size_t dataSize,
+                                       const HeightmapLoadDesc& desc,
+                                       std::vector<float>& heights,
+                                       HeightmapInfo* info,
+                                       unsigned int threadCount )
+{
+    if ( !data || !dataSize )
+        return false;
+
+    HEIGHTMAP_FORMAT format = desc.format;
+    if ( format == HEIGHTMAP_UNKNOWN )
+    {
+        if ( dataSize >= 2 && data[0] == 'B' && data[1] == 'M' )
+            format = HEIGHTMAP_BMP;
+        else if ( dataSize >= 2 && data[0] == 'P' && data[1] == '5' )
+            format = HEIGHTMAP_PGM;
+        else
+            format = HEIGHTMAP_RAW16;
+    }
+
+    SourceLayout layout;
+    memset( &layout, 0, sizeof( layout ) );
+
+    bool parsed = false;
+    switch ( format )
+    {
+    case HEIGHTMAP_RAW16:   parsed = ParseRaw16( data, dataSize, desc, layout ); break;
+    case HEIGHTMAP_PGM:     parsed = ParsePGM( data, dataSize, layout ); break;
+    case HEIGHTMAP_BMP:     parsed = ParseBMP( data, dataSize, layout ); break;
+    default:                break;
+    }
+
+    if ( !parsed )
+        return false;
+
+    if ( info )
+        info->format = format;
+
+    return ConvertSamples( layout, desc, heights, info, threadCount );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::LoadHeightmap( const char* fileName,
+                             const HeightmapLoadDesc& desc,
+                             std::vector<float>& heights,
+                             HeightmapInfo* info,
+                             unsigned int threadCount )
+{
+    if ( !fileName )
+        return false;
+
+    MappedFile file;
+    if ( !file.Open( fileName ) )
+        return false;
+
+    return LoadHeightmapFromMemory( file.data, file.size, desc, heights, info, threadCount );
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// File: HeightmapLoader.h
+//
+// Reads heightmap images into a float height grid.
+//
+// Files are memory mapped rather than copied into a buffer first, and samples are
+// converted to floats row by row across worker threads, eight at a time with SSE when
+// available. Supported sources:
+//
+//  RAW16  headerless 16-bit samples, little endian unless told otherwise; the size is
+//         given or, for square maps, worked out from the file size
+//  PGM    binary (P5) greymaps, 8-bit or 16-bit (big endian, as the format defines)
+//  BMP    uncompressed 8-bit (through the palette), 24-bit and 32-bit, bottom-up or
+//         top-down, with rows padded to 4 bytes; the first colour channel is the height
+//
+// Grid row 0 is the top row of the image, the far (+Z) edge as BuildTerrainTiles lays it
+// out. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef HEIGHTMAPLOADER_H
+#define HEIGHTMAPLOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    enum HEIGHTMAP_FORMAT
+    {
+        HEIGHTMAP_UNKNOWN = 0,  // BMP or PGM by their signature, otherwise RAW16
+        HEIGHTMAP_RAW16,
+        HEIGHTMAP_PGM,
+        HEIGHTMAP_BMP,
+    };
+
+    struct HeightmapLoadDesc
+    {
+        HEIGHTMAP_FORMAT    format;
+        size_t              rawWidth;       // RAW16 only, 0 for a square map
+        size_t              rawDepth;
+        bool                rawBigEndian;   // RAW16 only
+        float               heightScale;    // height of the largest sample value
+        float               heightOffset;   // height of sample value 0
+    };
+
+    struct HeightmapInfo
+    {
+        size_t              width;
+        size_t              depth;
+        HEIGHTMAP_FORMAT    format;
+        unsigned int        bitsPerSample;  // precision of the source, 8 or 16
+    };
+
+    // Fills heights with width x depth floats, offset + sample / maximum sample * scale.
+    // threadCount of 0 uses every hardware thread.
+    bool LoadHeightmap( const char* fileName,
+                        const HeightmapLoadDesc& desc,
+                        std::vector<float>& heights,
+                        HeightmapInfo* info = nullptr,
+                        unsigned int threadCount = 0 );
+
+    // The same from a file already in memory
+    bool LoadHeightmapFromMemory( const uint8_t* data,
+                                  size_t dataSize,
+                                  const HeightmapLoadDesc& desc,
+                                  std::vector<float>& heights,
+                                  HeightmapInfo* info = nullptr,
+                                  unsigned int threadCount = 0 );
+}
+
+#endif // HEIGHTMAPLOADER_H
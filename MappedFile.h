@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// Read-only memory mapped view of a whole file, shared by the asset pipeline modules.
+//
+// Pages are read on first touch and the OS can drop them again under memory pressure,
+// so large inputs cost no heap copy. Include it from .cpp files only: on Windows it
+// brings in windows.h with NOMINMAX defined.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DirectX
+{
+    class MappedFile
+    {
+    public:
+        MappedFile() : data( nullptr ), size( 0 )
+#ifdef _WIN32
+            , file( INVALID_HANDLE_VALUE ), mapping( nullptr )
+#endif
+        {
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if ( data )
+                UnmapViewOfFile( data );
+            if ( mapping )
+                CloseHandle( mapping );
+            if ( file != INVALID_HANDLE_VALUE )
+                CloseHandle( file );
+#else
+            if ( data )
+                munmap( const_cast<uint8_t*>( data ), size );
+#endif
+        }
+
+        bool Open( const char* fileName )
+        {
+#ifdef _WIN32
+            file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+            if ( file == INVALID_HANDLE_VALUE )
+                return false;
+
+            LARGE_INTEGER fileSize;
+            if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart <= 0 )
+                return false;
+
+            mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+            if ( !mapping )
+                return false;
+
+            data = static_cast<const uint8_t*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+            size = size_t( fileSize.QuadPart );
+#else
+            int fd = open( fileName, O_RDONLY );
+            if ( fd < 0 )
+                return false;
+
+            struct stat st;
+            if ( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+            {
+                close( fd );
+                return false;
+            }
+
+            void* view = mmap( nullptr, size_t( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+            close( fd );
+            if ( view == MAP_FAILED )
+                return false;
+
+            madvise( view, size_t( st.st_size ), MADV_SEQUENTIAL );
+            data = static_cast<const uint8_t*>( view );
+            size = size_t( st.st_size );
+#endif
+            return data != nullptr;
+        }
+
+        const uint8_t*  data;
+        size_t          size;
+
+    private:
+        MappedFile( const MappedFile& );
+        MappedFile& operator=( const MappedFile& );
+
+#ifdef _WIN32
+        HANDLE          file;
+        HANDLE          mapping;
+#endif
+    };
+}
+
+#endif // MAPPEDFILE_H
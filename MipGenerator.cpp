@@ -0,0 +1,715 @@
+//--------------------------------------------------------------------------------------
+// File: MipGenerator.cpp
+//
+// CPU mip-chain generation for textures that are shipped without mipmaps.
+//
+// Every level is expanded to linear float4 pixels, filtered with SSE (two pixels per
+// instruction where the CPU has AVX), and packed back to the storage format. Levels are filtered
+// from the float copy of the previous level, not from the quantized output, so there
+// is no precision drift down the chain.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "MipGenerator.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MIPGEN_USE_SSE
+#include <emmintrin.h>
+#include <immintrin.h>
+// The AVX and F16C paths are compiled whatever the build's baseline is and only taken
+// when the CPU and OS report support, so an /arch:SSE2 build still uses them.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MIPGEN_TARGET(isa)
+#else
+#include <cpuid.h>
+#define MIPGEN_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+
+//--------------------------------------------------------------------------------------
+// Colour space conversion
+//--------------------------------------------------------------------------------------
+const size_t SRGB_ENCODE_TABLE_SIZE = 65536;
+
+struct SRGBTables
+{
+    float   decode[256];
+    uint8_t encode[SRGB_ENCODE_TABLE_SIZE];
+
+    SRGBTables()
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            float c = float(i) / 255.0f;
+            decode[i] = (c <= 0.04045f) ? c / 12.92f : powf( (c + 0.055f) / 1.055f, 2.4f );
+        }
+
+        for (size_t i = 0; i < SRGB_ENCODE_TABLE_SIZE; ++i)
+        {
+            float l = float(i) / float(SRGB_ENCODE_TABLE_SIZE - 1);
+            float s = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf( l, 1.0f / 2.4f ) - 0.055f;
+            encode[i] = static_cast<uint8_t>( std::min( 255.0f, std::max( 0.0f, s * 255.0f + 0.5f ) ) );
+        }
+    }
+};
+
+const SRGBTables& GetSRGBTables()
+{
+    static const SRGBTables tables;
+    return tables;
+}
+
+inline uint8_t EncodeSRGB( const SRGBTables& t, float l )
+{
+    l = std::min( 1.0f, std::max( 0.0f, l ) );
+    return t.encode[ static_cast<size_t>( l * float(SRGB_ENCODE_TABLE_SIZE - 1) + 0.5f ) ];
+}
+
+inline uint8_t EncodeUNorm8( float v )
+{
+    v = std::min( 1.0f, std::max( 0.0f, v ) );
+    return static_cast<uint8_t>( v * 255.0f + 0.5f );
+}
+
+//--------------------------------------------------------------------------------------
+// Half precision conversion (IEEE 754 binary16)
+//--------------------------------------------------------------------------------------
+inline float HalfToFloat( uint16_t h )
+{
+    uint32_t sign = uint32_t( h & 0x8000 ) << 16;
+    uint32_t exponent = ( h >> 10 ) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Denormal: renormalize
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            mantissa &= 0x3ff;
+            bits = sign | ( exponent << 23 ) | ( mantissa << 13 );
+        }
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | ( mantissa << 13 );
+    }
+    else
+    {
+        bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+    }
+
+    float f;
+    memcpy( &f, &bits, sizeof(f) );
+    return f;
+}
+
+inline uint16_t FloatToHalf( float f )
+{
+    uint32_t bits;
+    memcpy( &bits, &f, sizeof(bits) );
+
+    uint16_t sign = static_cast<uint16_t>( ( bits >> 16 ) & 0x8000 );
+    uint32_t absBits = bits & 0x7fffffff;
+
+    if (absBits >= 0x7f800000)
+    {
+        // Inf or NaN
+        return sign | 0x7c00 | ( ( absBits > 0x7f800000 ) ? 0x200 : 0 );
+    }
+    if (absBits >= 0x477ff000)
+    {
+        // Overflows to infinity
+        return sign | 0x7c00;
+    }
+    if (absBits < 0x38800000)
+    {
+        // Denormal or zero
+        if (absBits < 0x33000000)
+        {
+            return sign;
+        }
+        uint32_t exponent = absBits >> 23;
+        uint32_t mantissa = ( absBits & 0x7fffff ) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t result = mantissa >> shift;
+        uint32_t rem = mantissa & ( ( 1u << shift ) - 1 );
+        uint32_t halfway = 1u << ( shift - 1 );
+        if (rem > halfway || ( rem == halfway && ( result & 1 ) ))
+        {
+            ++result;
+        }
+        return sign | static_cast<uint16_t>( result );
+    }
+
+    // Round to nearest even
+    absBits += 0xc8000000 + 0xfff + ( ( absBits >> 13 ) & 1 );
+    return sign | static_cast<uint16_t>( absBits >> 13 );
+}
+
+//--------------------------------------------------------------------------------------
+// Float4 pixel helpers
+//--------------------------------------------------------------------------------------
+#ifdef MIPGEN_USE_SSE
+
+typedef __m128 Pixel;
+
+inline Pixel PixelLoad( const float* p )              { return _mm_loadu_ps( p ); }
+inline void  PixelStore( float* p, Pixel v )          { _mm_storeu_ps( p, v ); }
+inline Pixel PixelZero()                              { return _mm_setzero_ps(); }
+inline Pixel PixelAdd( Pixel a, Pixel b )             { return _mm_add_ps( a, b ); }
+inline Pixel PixelScale( Pixel a, float s )           { return _mm_mul_ps( a, _mm_set1_ps( s ) ); }
+inline Pixel PixelMulAdd( Pixel acc, Pixel a, float s ) { return _mm_add_ps( acc, _mm_mul_ps( a, _mm_set1_ps( s ) ) ); }
+
+#else
+
+struct Pixel { float v[4]; };
+
+inline Pixel PixelLoad( const float* p )              { Pixel r; memcpy( r.v, p, sizeof(r.v) ); return r; }
+inline void  PixelStore( float* p, Pixel v )          { memcpy( p, v.v, sizeof(v.v) ); }
+inline Pixel PixelZero()                              { Pixel r = { { 0, 0, 0, 0 } }; return r; }
+inline Pixel PixelAdd( Pixel a, Pixel b )             { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+inline Pixel PixelScale( Pixel a, float s )           { for (int i = 0; i < 4; ++i) a.v[i] *= s; return a; }
+inline Pixel PixelMulAdd( Pixel acc, Pixel a, float s ) { for (int i = 0; i < 4; ++i) acc.v[i] += a.v[i] * s; return acc; }
+
+#endif
+
+//--------------------------------------------------------------------------------------
+// Run time instruction set selection
+//--------------------------------------------------------------------------------------
+#ifdef MIPGEN_USE_SSE
+
+struct CPUFeatures
+{
+    bool    avx;
+    bool    f16c;
+
+    CPUFeatures() : avx( false ), f16c( false )
+    {
+        unsigned int regs[4] = { 0, 0, 0, 0 };
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid( info, 1 );
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>( info[i] );
+#else
+        if ( !__get_cpuid( 1, &regs[0], &regs[1], &regs[2], &regs[3] ) )
+            return;
+#endif
+        const unsigned int ecx = regs[2];
+        const bool osxsave = ( ecx & ( 1u << 27 ) ) != 0;
+        if ( !osxsave )
+            return;
+
+        // Both need the OS to save the YMM registers on a context switch
+#if defined(_MSC_VER)
+        unsigned long long xcr0 = _xgetbv( 0 );
+#else
+        unsigned int xcr0Low, xcr0High;
+        __asm__ ( "xgetbv" : "=a"( xcr0Low ), "=d"( xcr0High ) : "c"( 0 ) );
+        unsigned long long xcr0 = ( static_cast<unsigned long long>( xcr0High ) << 32 ) | xcr0Low;
+#endif
+        if ( ( xcr0 & 6 ) != 6 )
+            return;
+
+        avx = ( ecx & ( 1u << 28 ) ) != 0;
+        f16c = avx && ( ecx & ( 1u << 29 ) ) != 0;
+    }
+};
+
+const CPUFeatures& GetCPUFeatures()
+{
+    static const CPUFeatures features;
+    return features;
+}
+
+// Each kernel returns how many pixels it handled; the caller finishes the rest
+MIPGEN_TARGET("f16c")
+size_t LoadHalvesF16C( const uint16_t* halves, size_t width, float* out )
+{
+    size_t x = 0;
+    for (; x + 2 <= width; x += 2)
+    {
+        __m128i h = _mm_loadu_si128( reinterpret_cast<const __m128i*>( halves + x * 4 ) );
+        _mm_storeu_ps( out + x * 4, _mm_cvtph_ps( h ) );
+        _mm_storeu_ps( out + x * 4 + 4, _mm_cvtph_ps( _mm_srli_si128( h, 8 ) ) );
+    }
+    return x;
+}
+
+MIPGEN_TARGET("f16c")
+size_t StoreHalvesF16C( const float* source, size_t count, uint16_t* halves )
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i lo = _mm_cvtps_ph( _mm_loadu_ps( source + i * 4 ), 0 );
+        __m128i hi = _mm_cvtps_ph( _mm_loadu_ps( source + i * 4 + 4 ), 0 );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( halves + i * 4 ), _mm_unpacklo_epi64( lo, hi ) );
+    }
+    return i;
+}
+
+// Two destination pixels per iteration while all four source columns are in range
+MIPGEN_TARGET("avx")
+size_t BoxDownsampleRowAVX( const float* row0, const float* row1, size_t width, float* out, size_t dwidth )
+{
+    const __m256 quarter = _mm256_set1_ps( 0.25f );
+    size_t x = 0;
+    for (; x + 2 <= dwidth && x * 2 + 4 <= width; x += 2)
+    {
+        __m256 a0 = _mm256_loadu_ps( row0 + x * 8 );
+        __m256 b0 = _mm256_loadu_ps( row0 + x * 8 + 8 );
+        __m256 a1 = _mm256_loadu_ps( row1 + x * 8 );
+        __m256 b1 = _mm256_loadu_ps( row1 + x * 8 + 8 );
+
+        __m256 even = _mm256_add_ps( _mm256_permute2f128_ps( a0, b0, 0x20 ), _mm256_permute2f128_ps( a1, b1, 0x20 ) );
+        __m256 odd = _mm256_add_ps( _mm256_permute2f128_ps( a0, b0, 0x31 ), _mm256_permute2f128_ps( a1, b1, 0x31 ) );
+        _mm256_storeu_ps( out + x * 4, _mm256_mul_ps( _mm256_add_ps( even, odd ), quarter ) );
+    }
+    return x;
+}
+
+#endif
+
+//--------------------------------------------------------------------------------------
+// Format expansion to linear float4
+//--------------------------------------------------------------------------------------
+void LoadLevel( const uint8_t* source, size_t width, size_t height, size_t rowPitch,
+                MIPGEN_FORMAT format, float* dest )
+{
+    const SRGBTables& srgb = GetSRGBTables();
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        const uint8_t* row = source + y * rowPitch;
+        float* out = dest + y * width * 4;
+
+        switch (format)
+        {
+        case MIPGEN_FORMAT_R8G8B8A8_UNORM:
+            for (size_t x = 0; x < width; ++x)
+            {
+                out[x * 4 + 0] = row[x * 4 + 0] * (1.0f / 255.0f);
+                out[x * 4 + 1] = row[x * 4 + 1] * (1.0f / 255.0f);
+                out[x * 4 + 2] = row[x * 4 + 2] * (1.0f / 255.0f);
+                out[x * 4 + 3] = row[x * 4 + 3] * (1.0f / 255.0f);
+            }
+            break;
+
+        case MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB:
+            for (size_t x = 0; x < width; ++x)
+            {
+                out[x * 4 + 0] = srgb.decode[ row[x * 4 + 0] ];
+                out[x * 4 + 1] = srgb.decode[ row[x * 4 + 1] ];
+                out[x * 4 + 2] = srgb.decode[ row[x * 4 + 2] ];
+                out[x * 4 + 3] = row[x * 4 + 3] * (1.0f / 255.0f);
+            }
+            break;
+
+        case MIPGEN_FORMAT_R16G16B16A16_FLOAT:
+            {
+                const uint16_t* halves = reinterpret_cast<const uint16_t*>( row );
+                size_t x = 0;
+#ifdef MIPGEN_USE_SSE
+                if ( GetCPUFeatures().f16c )
+                    x = LoadHalvesF16C( halves, width, out );
+#endif
+                for (; x < width; ++x)
+                {
+                    for (size_t c = 0; c < 4; ++c)
+                    {
+                        out[x * 4 + c] = HalfToFloat( halves[x * 4 + c] );
+                    }
+                }
+            }
+            break;
+
+        case MIPGEN_FORMAT_R16_UNORM:
+            {
+                const uint16_t* values = reinterpret_cast<const uint16_t*>( row );
+                for (size_t x = 0; x < width; ++x)
+                {
+                    out[x * 4 + 0] = values[x] * (1.0f / 65535.0f);
+                    out[x * 4 + 1] = 0.0f;
+                    out[x * 4 + 2] = 0.0f;
+                    out[x * 4 + 3] = 1.0f;
+                }
+            }
+            break;
+
+        default:
+            assert( false );
+            break;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Packs linear float4 back to the storage format (tight pitch)
+//--------------------------------------------------------------------------------------
+void StoreLevel( const float* source, size_t width, size_t height, MIPGEN_FORMAT format, uint8_t* dest )
+{
+    const SRGBTables& srgb = GetSRGBTables();
+    size_t count = width * height;
+
+    switch (format)
+    {
+    case MIPGEN_FORMAT_R8G8B8A8_UNORM:
+        {
+            size_t i = 0;
+#ifdef MIPGEN_USE_SSE
+            const __m128 scale = _mm_set1_ps( 255.0f );
+            const __m128 zero = _mm_setzero_ps();
+            for (; i + 4 <= count; i += 4)
+            {
+                // cvtps rounds to nearest; saturating packs clamp to [0,255]
+                __m128i p0 = _mm_cvtps_epi32( _mm_mul_ps( _mm_max_ps( zero, _mm_loadu_ps( source + i * 4 + 0 ) ), scale ) );
+                __m128i p1 = _mm_cvtps_epi32( _mm_mul_ps( _mm_max_ps( zero, _mm_loadu_ps( source + i * 4 + 4 ) ), scale ) );
+                __m128i p2 = _mm_cvtps_epi32( _mm_mul_ps( _mm_max_ps( zero, _mm_loadu_ps( source + i * 4 + 8 ) ), scale ) );
+                __m128i p3 = _mm_cvtps_epi32( _mm_mul_ps( _mm_max_ps( zero, _mm_loadu_ps( source + i * 4 + 12 ) ), scale ) );
+                __m128i packed = _mm_packus_epi16( _mm_packs_epi32( p0, p1 ), _mm_packs_epi32( p2, p3 ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( dest + i * 4 ), packed );
+            }
+#endif
+            for (; i < count; ++i)
+            {
+                for (size_t c = 0; c < 4; ++c)
+                {
+                    dest[i * 4 + c] = EncodeUNorm8( source[i * 4 + c] );
+                }
+            }
+        }
+        break;
+
+    case MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB:
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i * 4 + 0] = EncodeSRGB( srgb, source[i * 4 + 0] );
+            dest[i * 4 + 1] = EncodeSRGB( srgb, source[i * 4 + 1] );
+            dest[i * 4 + 2] = EncodeSRGB( srgb, source[i * 4 + 2] );
+            dest[i * 4 + 3] = EncodeUNorm8( source[i * 4 + 3] );
+        }
+        break;
+
+    case MIPGEN_FORMAT_R16G16B16A16_FLOAT:
+        {
+            uint16_t* halves = reinterpret_cast<uint16_t*>( dest );
+            size_t i = 0;
+#ifdef MIPGEN_USE_SSE
+            if ( GetCPUFeatures().f16c )
+                i = StoreHalvesF16C( source, count, halves );
+#endif
+            for (; i < count; ++i)
+            {
+                for (size_t c = 0; c < 4; ++c)
+                {
+                    halves[i * 4 + c] = FloatToHalf( source[i * 4 + c] );
+                }
+            }
+        }
+        break;
+
+    case MIPGEN_FORMAT_R16_UNORM:
+        {
+            uint16_t* values = reinterpret_cast<uint16_t*>( dest );
+            for (size_t i = 0; i < count; ++i)
+            {
+                float v = std::min( 1.0f, std::max( 0.0f, source[i * 4] ) );
+                values[i] = static_cast<uint16_t>( v * 65535.0f + 0.5f );
+            }
+        }
+        break;
+
+    default:
+        assert( false );
+        break;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// 2x2 box filter
+//--------------------------------------------------------------------------------------
+void BoxDownsample( const float* source, size_t width, size_t height,
+                    float* dest, size_t dwidth, size_t dheight )
+{
+    for (size_t y = 0; y < dheight; ++y)
+    {
+        const float* row0 = source + std::min( y * 2, height - 1 ) * width * 4;
+        const float* row1 = source + std::min( y * 2 + 1, height - 1 ) * width * 4;
+        float* out = dest + y * dwidth * 4;
+
+        size_t x = 0;
+#ifdef MIPGEN_USE_SSE
+        if ( GetCPUFeatures().avx )
+            x = BoxDownsampleRowAVX( row0, row1, width, out, dwidth );
+#endif
+        for (; x < dwidth; ++x)
+        {
+            size_t x0 = std::min( x * 2, width - 1 );
+            size_t x1 = std::min( x * 2 + 1, width - 1 );
+
+            Pixel sum = PixelAdd( PixelAdd( PixelLoad( row0 + x0 * 4 ), PixelLoad( row0 + x1 * 4 ) ),
+                                  PixelAdd( PixelLoad( row1 + x0 * 4 ), PixelLoad( row1 + x1 * 4 ) ) );
+            PixelStore( out + x * 4, PixelScale( sum, 0.25f ) );
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Separable Kaiser-windowed sinc, 6 taps per axis for a 2:1 reduction
+//--------------------------------------------------------------------------------------
+const int KAISER_TAPS = 6;
+const float KAISER_ALPHA = 4.0f;
+const float KAISER_WIDTH = 3.0f; // filter half-width in source pixels
+
+float BesselI0( float x )
+{
+    // Power series, converges quickly for the alphas we use
+    float sum = 1.0f;
+    float term = 1.0f;
+    float halfX = x * 0.5f;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= ( halfX / float(k) ) * ( halfX / float(k) );
+        sum += term;
+        if (term < sum * 1e-7f)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+struct KaiserWeights
+{
+    float w[KAISER_TAPS];
+
+    KaiserWeights()
+    {
+        // Destination pixel x covers source [2x, 2x+2); taps are source pixels 2x-2 .. 2x+3
+        const float pi = 3.14159265358979f;
+        float total = 0.0f;
+        for (int i = 0; i < KAISER_TAPS; ++i)
+        {
+            float d = ( float(i - 2) + 0.5f ) - 1.0f;   // distance from the destination centre, source px
+            float t = d * 0.5f;                         // in destination px
+            float sinc = ( t == 0.0f ) ? 1.0f : sinf( pi * t ) / ( pi * t );
+            float r = d / KAISER_WIDTH;
+            float window = ( fabsf( r ) >= 1.0f ) ? 0.0f : BesselI0( KAISER_ALPHA * sqrtf( 1.0f - r * r ) ) / BesselI0( KAISER_ALPHA );
+            w[i] = sinc * window;
+            total += w[i];
+        }
+        for (int i = 0; i < KAISER_TAPS; ++i)
+        {
+            w[i] /= total;
+        }
+    }
+};
+
+const KaiserWeights& GetKaiserWeights()
+{
+    static const KaiserWeights weights;
+    return weights;
+}
+
+void KaiserDownsample( const float* source, size_t width, size_t height,
+                       float* dest, size_t dwidth, size_t dheight,
+                       std::vector<float>& scratch )
+{
+    const KaiserWeights& k = GetKaiserWeights();
+
+    // Horizontal pass: width x height -> dwidth x height
+    scratch.resize( dwidth * height * 4 );
+    for (size_t y = 0; y < height; ++y)
+    {
+        const float* row = source + y * width * 4;
+        float* out = &scratch[ y * dwidth * 4 ];
+
+        if (width == 1)
+        {
+            memcpy( out, row, sizeof(float) * 4 );
+            continue;
+        }
+
+        for (size_t x = 0; x < dwidth; ++x)
+        {
+            Pixel acc = PixelZero();
+            ptrdiff_t base = ptrdiff_t( x * 2 ) - 2;
+            for (int t = 0; t < KAISER_TAPS; ++t)
+            {
+                ptrdiff_t sx = std::min<ptrdiff_t>( std::max<ptrdiff_t>( base + t, 0 ), ptrdiff_t( width ) - 1 );
+                acc = PixelMulAdd( acc, PixelLoad( row + sx * 4 ), k.w[t] );
+            }
+            PixelStore( out + x * 4, acc );
+        }
+    }
+
+    // Vertical pass: dwidth x height -> dwidth x dheight
+    for (size_t y = 0; y < dheight; ++y)
+    {
+        float* out = dest + y * dwidth * 4;
+
+        if (height == 1)
+        {
+            memcpy( out, &scratch[0], sizeof(float) * 4 * dwidth );
+            continue;
+        }
+
+        const float* rows[KAISER_TAPS];
+        ptrdiff_t base = ptrdiff_t( y * 2 ) - 2;
+        for (int t = 0; t < KAISER_TAPS; ++t)
+        {
+            ptrdiff_t sy = std::min<ptrdiff_t>( std::max<ptrdiff_t>( base + t, 0 ), ptrdiff_t( height ) - 1 );
+            rows[t] = &scratch[ sy * dwidth * 4 ];
+        }
+
+        for (size_t x = 0; x < dwidth; ++x)
+        {
+            Pixel acc = PixelZero();
+            for (int t = 0; t < KAISER_TAPS; ++t)
+            {
+                acc = PixelMulAdd( acc, PixelLoad( rows[t] + x * 4 ), k.w[t] );
+            }
+            PixelStore( out + x * 4, acc );
+        }
+    }
+}
+
+};
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::CountMips( size_t width, size_t height )
+{
+    size_t mipCount = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max<size_t>( 1, width >> 1 );
+        height = std::max<size_t>( 1, height >> 1 );
+        ++mipCount;
+    }
+    return mipCount;
+}
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::MipGenBytesPerPixel( MIPGEN_FORMAT format )
+{
+    switch (format)
+    {
+    case MIPGEN_FORMAT_R8G8B8A8_UNORM:
+    case MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB:
+        return 4;
+
+    case MIPGEN_FORMAT_R16G16B16A16_FLOAT:
+        return 8;
+
+    case MIPGEN_FORMAT_R16_UNORM:
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::ComputeMipChainSize( size_t width, size_t height, MIPGEN_FORMAT format, size_t mipCount )
+{
+    size_t bpp = MipGenBytesPerPixel( format );
+    size_t total = 0;
+    for (size_t level = 0; level < mipCount; ++level)
+    {
+        total += width * height * bpp;
+        width = std::max<size_t>( 1, width >> 1 );
+        height = std::max<size_t>( 1, height >> 1 );
+    }
+    return total;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::GenerateMipChain( const uint8_t* source,
+                                size_t width,
+                                size_t height,
+                                size_t rowPitch,
+                                MIPGEN_FORMAT format,
+                                MIPGEN_FILTER filter,
+                                size_t mipCount,
+                                uint8_t* dest )
+{
+    size_t bpp = MipGenBytesPerPixel( format );
+    if (!source || !dest || !bpp || !width || !height || !mipCount)
+    {
+        return false;
+    }
+
+    if (rowPitch < width * bpp || mipCount > CountMips( width, height ))
+    {
+        return false;
+    }
+
+    // Level 0 is a straight copy
+    for (size_t y = 0; y < height; ++y)
+    {
+        memcpy( dest + y * width * bpp, source + y * rowPitch, width * bpp );
+    }
+
+    if (mipCount == 1)
+    {
+        return true;
+    }
+
+    std::vector<float> current( width * height * 4 );
+    std::vector<float> next;
+    std::vector<float> scratch;
+    LoadLevel( source, width, height, rowPitch, format, &current[0] );
+
+    uint8_t* out = dest + width * height * bpp;
+    size_t w = width;
+    size_t h = height;
+
+    for (size_t level = 1; level < mipCount; ++level)
+    {
+        size_t dw = std::max<size_t>( 1, w >> 1 );
+        size_t dh = std::max<size_t>( 1, h >> 1 );
+
+        next.resize( dw * dh * 4 );
+        if (filter == MIPGEN_FILTER_KAISER)
+        {
+            KaiserDownsample( &current[0], w, h, &next[0], dw, dh, scratch );
+        }
+        else
+        {
+            BoxDownsample( &current[0], w, h, &next[0], dw, dh );
+        }
+
+        StoreLevel( &next[0], dw, dh, format, out );
+        out += dw * dh * bpp;
+
+        current.swap( next );
+        w = dw;
+        h = dh;
+    }
+
+    return true;
+}
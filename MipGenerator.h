@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// File: MipGenerator.h
+//
+// CPU mip-chain generation for textures that are shipped without mipmaps.
+//
+// Used by DDSTextureLoader when GenerateMips is not available (no device context, or
+// the format is not renderable) and by offline tools. Has no Direct3D dependency so it
+// builds and benchmarks on any platform with an SSE2 compiler; AVX and F16C are used when
+// the CPU has them.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace DirectX
+{
+    enum MIPGEN_FORMAT
+    {
+        MIPGEN_FORMAT_UNKNOWN            = 0,
+        MIPGEN_FORMAT_R8G8B8A8_UNORM     = 1,   // also used for B8G8R8A8 (filters are channel-order agnostic)
+        MIPGEN_FORMAT_R8G8B8A8_UNORM_SRGB = 2,
+        MIPGEN_FORMAT_R16G16B16A16_FLOAT = 3,
+        MIPGEN_FORMAT_R16_UNORM          = 4,
+    };
+
+    enum MIPGEN_FILTER
+    {
+        MIPGEN_FILTER_BOX    = 0,   // 2x2 average
+        MIPGEN_FILTER_KAISER = 1,   // 6-tap separable Kaiser-windowed sinc
+    };
+
+    // Number of levels in a full chain down to 1x1
+    size_t CountMips( size_t width, size_t height );
+
+    // Bytes per pixel for a mipgen format (0 if unknown)
+    size_t MipGenBytesPerPixel( MIPGEN_FORMAT format );
+
+    // Bytes needed to hold mipCount tightly packed levels, level 0 included
+    size_t ComputeMipChainSize( size_t width, size_t height, MIPGEN_FORMAT format, size_t mipCount );
+
+    // Builds mipCount tightly packed levels into dest (which must hold ComputeMipChainSize bytes).
+    // Level 0 is copied from source (rowPitch may include padding); levels 1..mipCount-1 are
+    // filtered from the previous level. sRGB data is filtered in linear space.
+    // Returns false on bad arguments.
+    bool GenerateMipChain( const uint8_t* source,
+                           size_t width,
+                           size_t height,
+                           size_t rowPitch,
+                           MIPGEN_FORMAT format,
+                           MIPGEN_FILTER filter,
+                           size_t mipCount,
+                           uint8_t* dest );
+}
+
+#endif // MIPGENERATOR_H
@@ -62,10 +62,21 @@ void OBJLoader::CreateIndices(const std::vector<XMFLOAT3>& inVertices,
 	}
 }
 
+bool OBJLoader::RemapToAtlas(SimpleVertex* vertices, unsigned int numVertices, const AtlasRegion* atlasRegion)
+{
+	if (!atlasRegion)
+	{
+		return false;
+	}
+
+	//Leaves the coordinates alone if the mesh tiles its texture, the atlas can't wrap
+	return RemapAtlasTexCoords(*atlasRegion, &vertices[0].TexC.x, numVertices, sizeof(SimpleVertex));
+}
+
 //WARNING: This code makes a big assumption -- that your models have texture coordinates AND normals which they should have anyway (else you can't do texturing and lighting!)
 //If your .obj file has no lines beginning with "vt" or "vn", then you'll need to change the Export settings in your modelling software so that it exports the texture coordinates 
 //and normals. If you still have no "vt" lines, you'll need to do some texture unwrapping, also known as UV unwrapping.
-MeshData OBJLoader::Load(char* filename, ID3D11Device* _pd3dDevice, bool invertTexCoords)
+MeshData OBJLoader::Load(char* filename, ID3D11Device* _pd3dDevice, bool invertTexCoords, const AtlasRegion* atlasRegion)
 {
 	std::string binaryFilename = filename;
 	binaryFilename.append("Binary");
@@ -203,6 +214,25 @@ MeshData OBJLoader::Load(char* filename, ID3D11Device* _pd3dDevice, bool invertT
 				finalVerts[i].TexC = meshTexCoords[i];
 			}
 
+			unsigned short* indicesArray = new unsigned short[meshIndices.size()];
+			unsigned int numMeshIndices = meshIndices.size();
+			for(unsigned int i = 0; i < numMeshIndices; ++i)
+			{
+				indicesArray[i] = meshIndices[i];
+			}
+
+			//Output data into binary file, the next time you run this function, the binary file will exist and will load that instead which is much quicker than parsing into vectors
+			std::ofstream outbin(binaryFilename.c_str(), std::ios::out | std::ios::binary);
+			outbin.write((char*)&numMeshVertices, sizeof(unsigned int));
+			outbin.write((char*)&numMeshIndices, sizeof(unsigned int));
+			outbin.write((char*)finalVerts, sizeof(SimpleVertex) * numMeshVertices);
+			outbin.write((char*)indicesArray, sizeof(unsigned short) * numMeshIndices);
+			outbin.close();
+
+			//The binary file keeps the original texture coordinates so it stays valid if the atlas layout changes
+			meshData.AtlasRemapped = RemapToAtlas(finalVerts, numMeshVertices, atlasRegion);
+			BoundingBox::CreateFromPoints(meshData.Bounds, numMeshVertices, &finalVerts[0].Pos, sizeof(SimpleVertex));
+
 			//Put data into vertex and index buffers, then pass the relevant data to the MeshData object.
 			//The rest of the code will hopefully look familiar to you, as it's similar to whats in your InitVertexBuffer and InitIndexBuffer methods
 			ID3D11Buffer* vertexBuffer;
@@ -224,21 +254,6 @@ MeshData OBJLoader::Load(char* filename, ID3D11Device* _pd3dDevice, bool invertT
 			meshData.VBOffset = 0;
 			meshData.VBStride = sizeof(SimpleVertex);
 
-			unsigned short* indicesArray = new unsigned short[meshIndices.size()];
-			unsigned int numMeshIndices = meshIndices.size();
-			for(unsigned int i = 0; i < numMeshIndices; ++i)
-			{
-				indicesArray[i] = meshIndices[i];
-			}
-
-			//Output data into binary file, the next time you run this function, the binary file will exist and will load that instead which is much quicker than parsing into vectors
-			std::ofstream outbin(binaryFilename.c_str(), std::ios::out | std::ios::binary);
-			outbin.write((char*)&numMeshVertices, sizeof(unsigned int));
-			outbin.write((char*)&numMeshIndices, sizeof(unsigned int));
-			outbin.write((char*)finalVerts, sizeof(SimpleVertex) * numMeshVertices);
-			outbin.write((char*)indicesArray, sizeof(unsigned short) * numMeshIndices);
-			outbin.close();
-
 			ID3D11Buffer* indexBuffer;
 
 			ZeroMemory(&bd, sizeof(bd));
@@ -277,6 +292,9 @@ MeshData OBJLoader::Load(char* filename, ID3D11Device* _pd3dDevice, bool invertT
 		binaryInFile.read((char*)finalVerts, sizeof(SimpleVertex) * numVertices);
 		binaryInFile.read((char*)indices, sizeof(unsigned short) * numIndices);
 
+		meshData.AtlasRemapped = RemapToAtlas(finalVerts, numVertices, atlasRegion);
+		BoundingBox::CreateFromPoints(meshData.Bounds, numVertices, &finalVerts[0].Pos, sizeof(SimpleVertex));
+
 		//Put data into vertex and index buffers, then pass the relevant data to the MeshData object.
 		//The rest of the code will hopefully look familiar to you, as it's similar to whats in your InitVertexBuffer and InitIndexBuffer methods
 		ID3D11Buffer* vertexBuffer;
@@ -2,10 +2,12 @@
 #include <windows.h>
 #include <d3d11_1.h>
 #include <directxmath.h>
+#include <DirectXCollision.h>
 #include <fstream>		//For loading in an external file
 #include <vector>		//For storing the XMFLOAT3/2 variables
 #include <map>			//For fast searching when re-creating the index buffer
 #include "Structures.h"
+#include "TextureAtlas.h"
 
 using namespace DirectX;
 
@@ -16,17 +18,23 @@ struct MeshData
 	UINT VBStride;
 	UINT VBOffset;
 	UINT IndexCount;
+	bool AtlasRemapped;	//TexC points into the atlas region passed to Load
+	BoundingBox Bounds;	//Object space, around every vertex
 };
 
 namespace OBJLoader
 {
 	//The only method you'll need to call
-	MeshData Load(char* filename, ID3D11Device* _pd3dDevice, bool invertTexCoords = true);
+	//If atlasRegion is given, texture coordinates are moved into that region of the atlas
+	MeshData Load(char* filename, ID3D11Device* _pd3dDevice, bool invertTexCoords = true, const AtlasRegion* atlasRegion = nullptr);
 
 	//Helper methods for the above method
 	//Searhes to see if a similar vertex already exists in the buffer -- if true, we re-use that index
 	bool FindSimilarVertex(const SimpleVertex& vertex, std::map<SimpleVertex, unsigned short>& vertToIndexMap, unsigned short& index);
 
+	//Rewrites TexC into the atlas region, returns false (and changes nothing) if that is not possible
+	bool RemapToAtlas(SimpleVertex* vertices, unsigned int numVertices, const AtlasRegion* atlasRegion);
+
 	//Re-creates a single index buffer from the 3 given in the OBJ file
 	void CreateIndices(const std::vector<XMFLOAT3>& inVertices, const std::vector<XMFLOAT2>& inTexCoords, const std::vector<XMFLOAT3>& inNormals, std::vector<unsigned short>& outIndices, std::vector<XMFLOAT3>& outVertices, std::vector<XMFLOAT2>& outTexCoords, std::vector<XMFLOAT3>& outNormals);
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: ParallelFor.h
+//
+// Thread pool-free parallel loop shared by the asset pipeline modules.
+//
+// Spawns threadCount - 1 std::threads (0 means every hardware thread), and the calling
+// thread works too. Items are handed out one at a time from an atomic counter, so
+// uneven items balance out without any scheduling up front.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace DirectX
+{
+    // Calls func( item ) for every item in [0, count). Returns when all items are done.
+    template<typename Func>
+    void ParallelFor( size_t count, unsigned int threadCount, Func func )
+    {
+        if (!count)
+        {
+            return;
+        }
+
+        if (!threadCount)
+        {
+            threadCount = std::max( 1u, std::thread::hardware_concurrency() );
+        }
+        threadCount = static_cast<unsigned int>( std::min<size_t>( threadCount, count ) );
+
+        std::atomic<size_t> next( 0 );
+        auto worker = [&]()
+        {
+            for (size_t item = next++; item < count; item = next++)
+            {
+                func( item );
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; ++i)
+        {
+            threads.push_back( std::thread( worker ) );
+        }
+        worker();
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+}
+
+#endif // PARALLELFOR_H
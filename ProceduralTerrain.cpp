@@ -0,0 +1,421 @@
+//--------------------------------------------------------------------------------------
+// File: ProceduralTerrain.cpp
+//
+// Gradient noise heights, row parallel with an SSE2 inner loop.
+//
+// The noise is 2D gradient noise with a quintic fade and diagonal gradients picked by
+// an integer hash of the lattice point and the seed, so no permutation table is needed
+// and the SSE2 path can hash four points at once. Both paths do the same operations in
+// the same order and so produce identical heights.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "ProceduralTerrain.h"
+#include "ParallelFor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PROCEDURAL_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+const unsigned int MAX_OCTAVES = 16;
+
+// Octaves, and the two warp lookups, each get their own lattice
+const uint32_t OCTAVE_SEED_STEP = 0x9E3779B9;
+const uint32_t WARP_SEED_X = 0x68BC21EB;
+const uint32_t WARP_SEED_Z = 0x02E5BE93;
+
+// The warp lookups are taken this far from the point so they are not correlated with it
+const float WARP_OFFSET_X[2] = { 5.2f, 1.3f };
+const float WARP_OFFSET_Z[2] = { 1.7f, 9.2f };
+
+// Settings worked out once per call
+struct NoiseParams
+{
+    unsigned int    octaves;
+    unsigned int    warpOctaves;
+    float           inverseNorm;        // 1 / sum of the octave amplitudes
+    float           warpInverseNorm;
+    float           warp;               // warp strength in noise units
+};
+
+float InverseNorm( unsigned int octaves, float gain )
+{
+    float norm = 0.0f, amplitude = 1.0f;
+    for ( unsigned int octave = 0; octave < octaves; ++octave )
+    {
+        norm += amplitude;
+        amplitude *= gain;
+    }
+    return ( norm > 0.0f ) ? 1.0f / norm : 1.0f;
+}
+
+NoiseParams MakeParams( const ProceduralTerrainDesc& desc )
+{
+    NoiseParams params;
+    params.octaves = std::max( 1u, std::min( desc.octaves, MAX_OCTAVES ) );
+    params.warpOctaves = std::max( 1u, params.octaves / 2 );
+    params.inverseNorm = InverseNorm( params.octaves, desc.gain );
+    params.warpInverseNorm = InverseNorm( params.warpOctaves, desc.gain );
+    params.warp = desc.warpStrength * desc.frequency;
+    return params;
+}
+
+//-------------------------------------------------------------------------------------
+// Scalar path
+//-------------------------------------------------------------------------------------
+inline uint32_t Hash( int32_t ix, int32_t iz, uint32_t seed )
+{
+    uint32_t h = seed ^ ( uint32_t( ix ) * 0x27D4EB2Du ) ^ ( uint32_t( iz ) * 0x165667B1u );
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+inline float Gradient( uint32_t h, float x, float z )
+{
+    return ( ( h & 1 ) ? -x : x ) + ( ( h & 2 ) ? -z : z );
+}
+
+inline float Fade( float t )
+{
+    return t * t * t * ( t * ( t * 6.0f - 15.0f ) + 10.0f );
+}
+
+inline int32_t Floor( float x )
+{
+    int32_t i = int32_t( x );
+    return ( float( i ) > x ) ? i - 1 : i;
+}
+
+float Noise( float x, float z, uint32_t seed )
+{
+    int32_t ix = Floor( x );
+    int32_t iz = Floor( z );
+    float fx = x - float( ix );
+    float fz = z - float( iz );
+    float u = Fade( fx );
+    float v = Fade( fz );
+
+    float n00 = Gradient( Hash( ix, iz, seed ), fx, fz );
+    float n10 = Gradient( Hash( ix + 1, iz, seed ), fx - 1.0f, fz );
+    float n01 = Gradient( Hash( ix, iz + 1, seed ), fx, fz - 1.0f );
+    float n11 = Gradient( Hash( ix + 1, iz + 1, seed ), fx - 1.0f, fz - 1.0f );
+
+    float a = n00 + ( n10 - n00 ) * u;
+    float b = n01 + ( n11 - n01 ) * u;
+    return a + ( b - a ) * v;
+}
+
+// Roughly [-1, 1]
+float Fbm( float x, float z, uint32_t seed, unsigned int octaves, float inverseNorm, const ProceduralTerrainDesc& desc )
+{
+    float sum = 0.0f, amplitude = 1.0f;
+    for ( unsigned int octave = 0; octave < octaves; ++octave )
+    {
+        sum += Noise( x, z, seed + octave * OCTAVE_SEED_STEP ) * amplitude;
+        x *= desc.lacunarity;
+        z *= desc.lacunarity;
+        amplitude *= desc.gain;
+    }
+    return sum * inverseNorm;
+}
+
+// [0, 1]
+float Ridged( float x, float z, uint32_t seed, unsigned int octaves, float inverseNorm, const ProceduralTerrainDesc& desc )
+{
+    float sum = 0.0f, amplitude = 1.0f;
+    for ( unsigned int octave = 0; octave < octaves; ++octave )
+    {
+        float ridge = 1.0f - fabsf( Noise( x, z, seed + octave * OCTAVE_SEED_STEP ) );
+        sum += ridge * ridge * amplitude;
+        x *= desc.lacunarity;
+        z *= desc.lacunarity;
+        amplitude *= desc.gain;
+    }
+    return sum * inverseNorm;
+}
+
+float Evaluate( const ProceduralTerrainDesc& desc, const NoiseParams& params, float x, float z )
+{
+    float px = x * desc.frequency;
+    float pz = z * desc.frequency;
+    float value;
+
+    switch ( desc.noise )
+    {
+    case PROCEDURAL_RIDGED:
+        value = Ridged( px, pz, desc.seed, params.octaves, params.inverseNorm, desc );
+        break;
+
+    case PROCEDURAL_WARPED:
+        {
+            float qx = Fbm( px + WARP_OFFSET_X[0], pz + WARP_OFFSET_X[1], desc.seed ^ WARP_SEED_X, params.warpOctaves, params.warpInverseNorm, desc );
+            float qz = Fbm( px + WARP_OFFSET_Z[0], pz + WARP_OFFSET_Z[1], desc.seed ^ WARP_SEED_Z, params.warpOctaves, params.warpInverseNorm, desc );
+            value = 0.5f + 0.5f * Fbm( px + params.warp * qx, pz + params.warp * qz, desc.seed, params.octaves, params.inverseNorm, desc );
+        }
+        break;
+
+    default:
+        value = 0.5f + 0.5f * Fbm( px, pz, desc.seed, params.octaves, params.inverseNorm, desc );
+        break;
+    }
+
+    return desc.heightOffset + value * desc.heightScale;
+}
+
+#ifdef PROCEDURAL_USE_SSE
+//-------------------------------------------------------------------------------------
+// SSE2 path, four points per call; the same operations as the scalar path
+//-------------------------------------------------------------------------------------
+
+// Low 32 bits of a 32 x 32 multiply (SSE4.1 has this as one instruction)
+inline __m128i MulLo32( __m128i a, __m128i b )
+{
+    __m128i even = _mm_mul_epu32( a, b );
+    __m128i odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+    return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+                               _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+}
+
+inline __m128i Hash4( __m128i ix, __m128i iz, __m128i seed )
+{
+    __m128i h = _mm_xor_si128( seed, _mm_xor_si128( MulLo32( ix, _mm_set1_epi32( 0x27D4EB2D ) ),
+                                                    MulLo32( iz, _mm_set1_epi32( 0x165667B1 ) ) ) );
+    h = _mm_xor_si128( h, _mm_srli_epi32( h, 15 ) );
+    h = MulLo32( h, _mm_set1_epi32( 0x2C1B3C6D ) );
+    return _mm_xor_si128( h, _mm_srli_epi32( h, 12 ) );
+}
+
+// Hash bits 0 and 1 become the sign bits of x and z
+inline __m128 Gradient4( __m128i h, __m128 x, __m128 z )
+{
+    __m128 signX = _mm_castsi128_ps( _mm_slli_epi32( h, 31 ) );
+    __m128 signZ = _mm_castsi128_ps( _mm_slli_epi32( _mm_srli_epi32( h, 1 ), 31 ) );
+    return _mm_add_ps( _mm_xor_ps( x, signX ), _mm_xor_ps( z, signZ ) );
+}
+
+inline __m128 Fade4( __m128 t )
+{
+    __m128 inner = _mm_add_ps( _mm_mul_ps( t, _mm_sub_ps( _mm_mul_ps( t, _mm_set1_ps( 6.0f ) ), _mm_set1_ps( 15.0f ) ) ), _mm_set1_ps( 10.0f ) );
+    return _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( t, t ), t ), inner );
+}
+
+inline __m128i Floor4( __m128 x )
+{
+    __m128i i = _mm_cvttps_epi32( x );
+    __m128i over = _mm_castps_si128( _mm_cmpgt_ps( _mm_cvtepi32_ps( i ), x ) );
+    return _mm_add_epi32( i, over );
+}
+
+__m128 Noise4( __m128 x, __m128 z, __m128i seed )
+{
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128i oneI = _mm_set1_epi32( 1 );
+
+    __m128i ix = Floor4( x );
+    __m128i iz = Floor4( z );
+    __m128 fx = _mm_sub_ps( x, _mm_cvtepi32_ps( ix ) );
+    __m128 fz = _mm_sub_ps( z, _mm_cvtepi32_ps( iz ) );
+    __m128 u = Fade4( fx );
+    __m128 v = Fade4( fz );
+
+    __m128i ix1 = _mm_add_epi32( ix, oneI );
+    __m128i iz1 = _mm_add_epi32( iz, oneI );
+    __m128 fx1 = _mm_sub_ps( fx, one );
+    __m128 fz1 = _mm_sub_ps( fz, one );
+
+    __m128 n00 = Gradient4( Hash4( ix, iz, seed ), fx, fz );
+    __m128 n10 = Gradient4( Hash4( ix1, iz, seed ), fx1, fz );
+    __m128 n01 = Gradient4( Hash4( ix, iz1, seed ), fx, fz1 );
+    __m128 n11 = Gradient4( Hash4( ix1, iz1, seed ), fx1, fz1 );
+
+    __m128 a = _mm_add_ps( n00, _mm_mul_ps( _mm_sub_ps( n10, n00 ), u ) );
+    __m128 b = _mm_add_ps( n01, _mm_mul_ps( _mm_sub_ps( n11, n01 ), u ) );
+    return _mm_add_ps( a, _mm_mul_ps( _mm_sub_ps( b, a ), v ) );
+}
+
+__m128 Fbm4( __m128 x, __m128 z, uint32_t seed, unsigned int octaves, float inverseNorm, const ProceduralTerrainDesc& desc )
+{
+    const __m128 lacunarity = _mm_set1_ps( desc.lacunarity );
+    __m128 sum = _mm_setzero_ps();
+    float amplitude = 1.0f;
+    for ( unsigned int octave = 0; octave < octaves; ++octave )
+    {
+        __m128 n = Noise4( x, z, _mm_set1_epi32( int( seed + octave * OCTAVE_SEED_STEP ) ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( n, _mm_set1_ps( amplitude ) ) );
+        x = _mm_mul_ps( x, lacunarity );
+        z = _mm_mul_ps( z, lacunarity );
+        amplitude *= desc.gain;
+    }
+    return _mm_mul_ps( sum, _mm_set1_ps( inverseNorm ) );
+}
+
+__m128 Ridged4( __m128 x, __m128 z, uint32_t seed, unsigned int octaves, float inverseNorm, const ProceduralTerrainDesc& desc )
+{
+    const __m128 lacunarity = _mm_set1_ps( desc.lacunarity );
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 signMask = _mm_set1_ps( -0.0f );
+    __m128 sum = _mm_setzero_ps();
+    float amplitude = 1.0f;
+    for ( unsigned int octave = 0; octave < octaves; ++octave )
+    {
+        __m128 n = Noise4( x, z, _mm_set1_epi32( int( seed + octave * OCTAVE_SEED_STEP ) ) );
+        __m128 ridge = _mm_sub_ps( one, _mm_andnot_ps( signMask, n ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( _mm_mul_ps( ridge, ridge ), _mm_set1_ps( amplitude ) ) );
+        x = _mm_mul_ps( x, lacunarity );
+        z = _mm_mul_ps( z, lacunarity );
+        amplitude *= desc.gain;
+    }
+    return _mm_mul_ps( sum, _mm_set1_ps( inverseNorm ) );
+}
+
+__m128 Evaluate4( const ProceduralTerrainDesc& desc, const NoiseParams& params, __m128 x, __m128 z )
+{
+    const __m128 half = _mm_set1_ps( 0.5f );
+    __m128 px = _mm_mul_ps( x, _mm_set1_ps( desc.frequency ) );
+    __m128 pz = _mm_mul_ps( z, _mm_set1_ps( desc.frequency ) );
+    __m128 value;
+
+    switch ( desc.noise )
+    {
+    case PROCEDURAL_RIDGED:
+        value = Ridged4( px, pz, desc.seed, params.octaves, params.inverseNorm, desc );
+        break;
+
+    case PROCEDURAL_WARPED:
+        {
+            __m128 qx = Fbm4( _mm_add_ps( px, _mm_set1_ps( WARP_OFFSET_X[0] ) ), _mm_add_ps( pz, _mm_set1_ps( WARP_OFFSET_X[1] ) ),
+                              desc.seed ^ WARP_SEED_X, params.warpOctaves, params.warpInverseNorm, desc );
+            __m128 qz = Fbm4( _mm_add_ps( px, _mm_set1_ps( WARP_OFFSET_Z[0] ) ), _mm_add_ps( pz, _mm_set1_ps( WARP_OFFSET_Z[1] ) ),
+                              desc.seed ^ WARP_SEED_Z, params.warpOctaves, params.warpInverseNorm, desc );
+            __m128 warp = _mm_set1_ps( params.warp );
+            __m128 n = Fbm4( _mm_add_ps( px, _mm_mul_ps( warp, qx ) ), _mm_add_ps( pz, _mm_mul_ps( warp, qz ) ),
+                             desc.seed, params.octaves, params.inverseNorm, desc );
+            value = _mm_add_ps( half, _mm_mul_ps( half, n ) );
+        }
+        break;
+
+    default:
+        value = _mm_add_ps( half, _mm_mul_ps( half, Fbm4( px, pz, desc.seed, params.octaves, params.inverseNorm, desc ) ) );
+        break;
+    }
+
+    return _mm_add_ps( _mm_set1_ps( desc.heightOffset ), _mm_mul_ps( value, _mm_set1_ps( desc.heightScale ) ) );
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+void EvaluateMany( const ProceduralTerrainDesc& desc, const NoiseParams& params, const float* x, const float* z, size_t count, float* heights )
+{
+    size_t i = 0;
+
+#ifdef PROCEDURAL_USE_SSE
+    for ( ; i + 4 <= count; i += 4 )
+        _mm_storeu_ps( heights + i, Evaluate4( desc, params, _mm_loadu_ps( x + i ), _mm_loadu_ps( z + i ) ) );
+#endif
+
+    for ( ; i < count; ++i )
+        heights[i] = Evaluate( desc, params, x[i], z[i] );
+}
+
+void EvaluateRow( const ProceduralTerrainDesc& desc, const NoiseParams& params, ptrdiff_t gridX, ptrdiff_t gridZ, size_t width, float* heights )
+{
+    float z = float( gridZ );
+    size_t i = 0;
+
+#ifdef PROCEDURAL_USE_SSE
+    const __m128 zs = _mm_set1_ps( z );
+    const __m128 steps = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+    for ( ; i + 4 <= width; i += 4 )
+    {
+        // Exact while sample coordinates stay below 2^24
+        __m128 xs = _mm_add_ps( _mm_set1_ps( float( gridX + ptrdiff_t( i ) ) ), steps );
+        _mm_storeu_ps( heights + i, Evaluate4( desc, params, xs, zs ) );
+    }
+#endif
+
+    for ( ; i < width; ++i )
+        heights[i] = Evaluate( desc, params, float( gridX + ptrdiff_t( i ) ), z );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+float DirectX::ProceduralHeight( const ProceduralTerrainDesc& desc, float x, float z )
+{
+    return Evaluate( desc, MakeParams( desc ), x, z );
+}
+
+
+//-------------------------------------------------------------------------------------
+void DirectX::ProceduralHeights( const ProceduralTerrainDesc& desc,
+                                 const float* x,
+                                 const float* z,
+                                 size_t count,
+                                 float* heights )
+{
+    if ( !x || !z || !heights )
+        return;
+
+    EvaluateMany( desc, MakeParams( desc ), x, z, count, heights );
+}
+
+
+//-------------------------------------------------------------------------------------
+void DirectX::ProceduralRow( const ProceduralTerrainDesc& desc,
+                             ptrdiff_t gridX,
+                             ptrdiff_t gridZ,
+                             size_t width,
+                             float* heights )
+{
+    if ( !heights )
+        return;
+
+    EvaluateRow( desc, MakeParams( desc ), gridX, gridZ, width, heights );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::GenerateProceduralHeights( const ProceduralTerrainDesc& desc,
+                                         ptrdiff_t gridX,
+                                         ptrdiff_t gridZ,
+                                         size_t width,
+                                         size_t depth,
+                                         std::vector<float>& heights,
+                                         ProceduralTerrainStats* stats,
+                                         unsigned int threadCount )
+{
+    if ( !width || !depth || desc.frequency <= 0.0f )
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    heights.resize( width * depth );
+    NoiseParams params = MakeParams( desc );
+
+    ParallelFor( depth, threadCount, [&]( size_t row )
+    {
+        EvaluateRow( desc, params, gridX, gridZ + ptrdiff_t( row ), width, &heights[row * width] );
+    } );
+
+    if ( stats )
+    {
+        double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+        stats->samples = width * depth;
+        stats->seconds = seconds;
+        stats->megaSamplesPerSecond = ( seconds > 0.0 ) ? double( stats->samples ) / seconds / 1e6 : 0.0;
+    }
+
+    return true;
+}
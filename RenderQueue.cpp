@@ -0,0 +1,158 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.cpp
+//
+// Sort key packing and the radix sort of the render queue.
+//
+// A non-negative float's bits compare as an unsigned integer in the same order as the
+// float, so the depth is stored as its raw bits and reversed by complementing them.
+//--------------------------------------------------------------------------------------
+
+#include <string.h>
+#include <chrono>
+
+#include "RenderQueue.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const unsigned int PASS_SHIFT = 64 - RENDER_KEY_PASS_BITS;
+
+// Opaque keys: pass, shader, material, depth
+const unsigned int OPAQUE_SHADER_SHIFT = PASS_SHIFT - RENDER_KEY_SHADER_BITS;
+const unsigned int OPAQUE_MATERIAL_SHIFT = OPAQUE_SHADER_SHIFT - RENDER_KEY_MATERIAL_BITS;
+
+// Transparent keys: pass, reversed depth, shader, material
+const unsigned int TRANSPARENT_DEPTH_SHIFT = PASS_SHIFT - RENDER_KEY_DEPTH_BITS;
+const unsigned int TRANSPARENT_SHADER_SHIFT = TRANSPARENT_DEPTH_SHIFT - RENDER_KEY_SHADER_BITS;
+const unsigned int TRANSPARENT_MATERIAL_SHIFT = TRANSPARENT_SHADER_SHIFT - RENDER_KEY_MATERIAL_BITS;
+
+const unsigned int RADIX_BITS = 8;
+const size_t RADIX_BUCKETS = size_t( 1 ) << RADIX_BITS;
+const size_t RADIX_PASSES = 64 / RADIX_BITS;
+
+inline uint64_t Field( uint64_t key, unsigned int shift, unsigned int bits )
+{
+    return ( key >> shift ) & ( ( uint64_t( 1 ) << bits ) - 1 );
+}
+
+inline uint64_t Place( uint32_t value, unsigned int shift, unsigned int bits )
+{
+    return ( uint64_t( value ) & ( ( uint64_t( 1 ) << bits ) - 1 ) ) << shift;
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+uint64_t DirectX::MakeRenderKey( uint32_t pass, uint32_t shader, uint32_t material, float depth )
+{
+    // Also turns NaN into 0
+    float clamped = depth > 0.0f ? depth : 0.0f;
+    uint32_t depthBits;
+    memcpy( &depthBits, &clamped, sizeof(depthBits) );
+
+    uint64_t key = Place( pass, PASS_SHIFT, RENDER_KEY_PASS_BITS );
+    if ( pass == RENDER_PASS_TRANSPARENT )
+    {
+        key |= Place( ~depthBits, TRANSPARENT_DEPTH_SHIFT, RENDER_KEY_DEPTH_BITS );
+        key |= Place( shader, TRANSPARENT_SHADER_SHIFT, RENDER_KEY_SHADER_BITS );
+        key |= Place( material, TRANSPARENT_MATERIAL_SHIFT, RENDER_KEY_MATERIAL_BITS );
+    }
+    else
+    {
+        key |= Place( shader, OPAQUE_SHADER_SHIFT, RENDER_KEY_SHADER_BITS );
+        key |= Place( material, OPAQUE_MATERIAL_SHIFT, RENDER_KEY_MATERIAL_BITS );
+        key |= depthBits;
+    }
+    return key;
+}
+
+
+//-------------------------------------------------------------------------------------
+uint32_t DirectX::GetRenderKeyPass( uint64_t key )
+{
+    return uint32_t( Field( key, PASS_SHIFT, RENDER_KEY_PASS_BITS ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+uint32_t DirectX::GetRenderKeyShader( uint64_t key )
+{
+    unsigned int shift = GetRenderKeyPass( key ) == RENDER_PASS_TRANSPARENT ? TRANSPARENT_SHADER_SHIFT : OPAQUE_SHADER_SHIFT;
+    return uint32_t( Field( key, shift, RENDER_KEY_SHADER_BITS ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+uint32_t DirectX::GetRenderKeyMaterial( uint64_t key )
+{
+    unsigned int shift = GetRenderKeyPass( key ) == RENDER_PASS_TRANSPARENT ? TRANSPARENT_MATERIAL_SHIFT : OPAQUE_MATERIAL_SHIFT;
+    return uint32_t( Field( key, shift, RENDER_KEY_MATERIAL_BITS ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+void RenderQueue::Submit( uint64_t key, uint32_t item )
+{
+    Entry entry = { key, item };
+    entries.push_back( entry );
+}
+
+
+//-------------------------------------------------------------------------------------
+void RenderQueue::Sort( RenderQueueStats* stats )
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    size_t count = entries.size();
+    size_t sortPasses = 0;
+
+    if ( count > 1 )
+    {
+        // Every byte's histogram in one read of the keys
+        size_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+        memset( histograms, 0, sizeof(histograms) );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            uint64_t key = entries[i].key;
+            for ( size_t pass = 0; pass < RADIX_PASSES; ++pass )
+                ++histograms[pass][( key >> ( pass * RADIX_BITS ) ) & ( RADIX_BUCKETS - 1 )];
+        }
+
+        scratch.resize( count );
+        for ( size_t pass = 0; pass < RADIX_PASSES; ++pass )
+        {
+            // A byte all keys share would leave the order as it is
+            size_t* histogram = histograms[pass];
+            size_t shift = pass * RADIX_BITS;
+            if ( histogram[( entries[0].key >> shift ) & ( RADIX_BUCKETS - 1 )] == count )
+                continue;
+
+            size_t offsets[RADIX_BUCKETS];
+            size_t offset = 0;
+            for ( size_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket )
+            {
+                offsets[bucket] = offset;
+                offset += histogram[bucket];
+            }
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+                const Entry& entry = entries[i];
+                scratch[offsets[( entry.key >> shift ) & ( RADIX_BUCKETS - 1 )]++] = entry;
+            }
+
+            entries.swap( scratch );
+            ++sortPasses;
+        }
+    }
+
+    if ( stats )
+    {
+        stats->itemCount = count;
+        stats->sortPasses = sortPasses;
+        stats->seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+}
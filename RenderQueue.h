@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.h
+//
+// Draw items ordered by a 64-bit sort key, rebuilt every frame.
+//
+// Each item is submitted as a key and the caller's index for it. The key packs, from the
+// most significant bits down, the pass, the shader, the material and the view depth, so
+// sorting groups items that share state and the caller only has to bind what changed
+// between neighbours. Opaque items go front to back within a material, to let the depth
+// test reject hidden pixels early. Transparent items have to be blended back to front, so
+// their depth is placed above the shader and material and reversed. Keys are sorted with
+// a least significant digit radix sort, a byte at a time, which skips the bytes every key
+// shares. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    enum RENDER_PASS
+    {
+        RENDER_PASS_OPAQUE = 0,         // front to back
+        RENDER_PASS_TRANSPARENT,        // back to front
+    };
+
+    // Widths of the key fields; ids at or above 1 << bits are truncated
+    const unsigned int RENDER_KEY_PASS_BITS = 4;
+    const unsigned int RENDER_KEY_SHADER_BITS = 12;
+    const unsigned int RENDER_KEY_MATERIAL_BITS = 16;
+    const unsigned int RENDER_KEY_DEPTH_BITS = 32;
+
+    struct RenderQueueStats
+    {
+        size_t      itemCount;
+        size_t      sortPasses;         // bytes of the key the radix sort had to move items for
+        double      seconds;
+    };
+
+    // depth is the distance along the view direction, negative depths count as 0
+    uint64_t MakeRenderKey( uint32_t pass, uint32_t shader, uint32_t material, float depth );
+
+    uint32_t GetRenderKeyPass( uint64_t key );
+    uint32_t GetRenderKeyShader( uint64_t key );
+    uint32_t GetRenderKeyMaterial( uint64_t key );
+
+    class RenderQueue
+    {
+    public:
+        // Empties the queue, keeping its memory for the next frame
+        void Clear() { entries.clear(); }
+
+        void Submit( uint64_t key, uint32_t item );
+
+        // Orders the items by key; items with equal keys keep the order they were
+        // submitted in. stats is optional.
+        void Sort( RenderQueueStats* stats = nullptr );
+
+        size_t GetCount() const { return entries.size(); }
+        uint64_t GetKey( size_t i ) const { return entries[i].key; }
+        uint32_t GetItem( size_t i ) const { return entries[i].item; }
+
+    private:
+        struct Entry
+        {
+            uint64_t    key;
+            uint32_t    item;
+        };
+
+        std::vector<Entry>  entries;
+        std::vector<Entry>  scratch;
+    };
+}
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,205 @@
+#include "StreamedTerrain.h"
+#include "TerrainTiles.h"
+
+StreamedTerrain::StreamedTerrain()
+{
+	_device = nullptr;
+	_cache = nullptr;
+	_indexBuffer = nullptr;
+	_indexCount = 0;
+	_lodDistance = 2.0f;
+}
+
+StreamedTerrain::~StreamedTerrain()
+{
+	//Stop the loaders before anything they fill goes away
+	_streamer.Close();
+	delete _cache;
+
+	for (size_t i = 0; i < _tileViews.size(); ++i)
+	{
+		if (_tileViews[i]) _tileViews[i]->Release();
+		if (_tileBuffers[i]) _tileBuffers[i]->Release();
+	}
+	if (_indexBuffer) _indexBuffer->Release();
+}
+
+HRESULT StreamedTerrain::Initialise(ID3D11Device* device, ID3D11DeviceContext* context, const char* fileName, size_t budgetBytes, float lodDistance)
+{
+	if (!_streamer.Open(fileName))
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+	_device = device;
+	_lodDistance = lodDistance;
+
+	const TerrainStreamLayout& layout = _streamer.GetLayout();
+
+	//Every tile is drawn with the same strips, heights are looked up by vertex id
+	std::vector<uint16_t> indices;
+	if (!BuildTerrainTileStripIndices(layout.tileQuads, TERRAIN_STRIP_RESTART, indices))
+		return E_FAIL;
+	_indexCount = (UINT)indices.size();
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(uint16_t) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = indices.data();
+
+	HRESULT hr = device->CreateBuffer(&bd, &initData, &_indexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	//Room for the coarsest tile and at least a few levels below it, whatever the budget
+	size_t slotCount = max(budgetBytes / layout.tileBytes, (size_t)64);
+	_cache = new TerrainStreamCache(layout, slotCount);
+	_tileBuffers.assign(slotCount, nullptr);
+	_tileViews.assign(slotCount, nullptr);
+
+	//The coarsest mip is a single tile that stays resident, so the whole terrain always has something to draw
+	TerrainStreamer::LoadedTile root;
+	if (!_streamer.ReadTile(MakeTerrainTileId(layout.mipCount - 1, 0, 0), root))
+		return E_FAIL;
+
+	return UploadTile(context, root, true);
+}
+
+HRESULT StreamedTerrain::UploadTile(ID3D11DeviceContext* context, const TerrainStreamer::LoadedTile& tile, bool locked)
+{
+	size_t slot;
+	if (!_cache->MapTile(tile.tileId, tile.minY, tile.maxY, locked, slot))
+		return E_FAIL;
+
+	if (_tileBuffers[slot])
+	{
+		context->UpdateSubresource(_tileBuffers[slot], 0, nullptr, tile.samples.data(), 0, 0);
+		return S_OK;
+	}
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = (UINT)(sizeof(uint16_t) * tile.samples.size());
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = tile.samples.data();
+
+	HRESULT hr = _device->CreateBuffer(&bd, &initData, &_tileBuffers[slot]);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	ZeroMemory(&viewDesc, sizeof(viewDesc));
+	viewDesc.Format = DXGI_FORMAT_R16_UNORM;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = (UINT)tile.samples.size();
+
+	return _device->CreateShaderResourceView(_tileBuffers[slot], &viewDesc, &_tileViews[slot]);
+}
+
+void StreamedTerrain::Update(ID3D11DeviceContext* context, const XMFLOAT3& camera)
+{
+	if (!_cache)
+		return;
+
+	_streamer.TakeCompleted(_loaded);
+	for (size_t i = 0; i < _loaded.size(); ++i)
+	{
+		_arrived.push_back(std::move(_loaded[i]));
+	}
+
+	for (size_t uploads = 0; uploads < MAX_UPLOADS_PER_FRAME && !_arrived.empty(); ++uploads)
+	{
+		UploadTile(context, _arrived.front(), false);
+		_arrived.pop_front();
+	}
+
+	_cache->Select(camera.x, camera.y, camera.z, _lodDistance, _draw, _requests);
+
+	//Tiles read but not uploaded yet are not asked for again
+	size_t kept = 0;
+	for (size_t i = 0; i < _requests.size() && kept < MAX_PENDING; ++i)
+	{
+		bool arrived = false;
+		for (size_t j = 0; j < _arrived.size() && !arrived; ++j)
+			arrived = _arrived[j].tileId == _requests[i];
+
+		if (!arrived)
+			_requests[kept++] = _requests[i];
+	}
+	_requests.resize(kept);
+
+	//Replaces whatever older frames queued and has not been read yet
+	_streamer.Request(_requests);
+
+	_cache->EndFrame();
+}
+
+UINT StreamedTerrain::Draw(ID3D11DeviceContext* context, const BoundingFrustum& frustum, ID3D11Buffer* terrainBuffer, const TerrainConstants& constants, ConstantRing* nodeRing)
+{
+	if (!_cache)
+		return 0;
+
+	const TerrainStreamLayout& layout = _cache->GetLayout();
+	float lastColumn = (float)(layout.width - 1);
+	float lastRow = (float)(layout.depth - 1);
+
+	TerrainConstants streamConstants = constants;
+	streamConstants.TerrainGrid = XMFLOAT4(-0.5f * lastColumn * layout.spacingX, 0.5f * lastRow * layout.spacingZ, layout.spacingX, layout.spacingZ);
+	streamConstants.TerrainSize = XMFLOAT4(lastColumn, lastRow, 1.0f / lastColumn, 1.0f / lastRow);
+	streamConstants.HeightParams = XMFLOAT4(layout.heightOffset, layout.heightRange, 0.0f, 0.0f);
+	context->UpdateSubresource(terrainBuffer, 0, nullptr, &streamConstants, 0, 0);
+	UINT uploadBytes = sizeof(streamConstants);
+
+	TerrainNodeConstants tileConstants;
+	ZeroMemory(&tileConstants, sizeof(tileConstants));
+	tileConstants.MorphParams = XMFLOAT4(0.0f, 0.0f, (float)layout.tileQuads, 0.0f);
+
+	//Neighbours more than tileQuads times coarser cannot line up with the tile's vertices anyway
+	size_t maxStitch = 0;
+	while (((size_t)2 << maxStitch) <= layout.tileQuads)
+		++maxStitch;
+
+	context->IASetInputLayout(nullptr);
+	context->IASetIndexBuffer(_indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	context->VSSetConstantBuffers(2, 1, &terrainBuffer);
+
+	for (size_t i = 0; i < _draw.size(); ++i)
+	{
+		const TerrainStreamDrawTile& tile = _draw[i];
+
+		float boundsMin[3], boundsMax[3];
+		if (!_tileViews[tile.slot] || !_cache->GetTileBounds(tile.tileId, boundsMin, boundsMax))
+			continue;
+
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, XMLoadFloat3((const XMFLOAT3*)boundsMin), XMLoadFloat3((const XMFLOAT3*)boundsMax));
+		if (frustum.Contains(bounds) == DISJOINT)
+			continue;
+
+		size_t mip = TerrainTileIdMip(tile.tileId);
+		size_t span = layout.tileQuads << mip;
+		float stitch[4];
+		for (int edge = 0; edge < 4; ++edge)
+			stitch[edge] = (float)((size_t)1 << min(tile.coarserNeighbour[edge], maxStitch));
+
+		tileConstants.NodeParams = XMFLOAT4((float)(TerrainTileIdX(tile.tileId) * span), (float)(TerrainTileIdZ(tile.tileId) * span), (float)((size_t)1 << mip), (float)mip);
+		tileConstants.StitchParams = XMFLOAT4(stitch[0], stitch[1], stitch[2], stitch[3]);
+		nodeRing->Upload(context, 6, &tileConstants, sizeof(tileConstants));
+		uploadBytes += sizeof(tileConstants);
+		context->VSSetShaderResources(4, 1, &_tileViews[tile.slot]);
+		context->DrawIndexed(_indexCount, 0, 0);
+	}
+
+	ID3D11ShaderResourceView* nullView = nullptr;
+	context->VSSetShaderResources(4, 1, &nullView);
+	return uploadBytes;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <windows.h>
+#include <d3d11_1.h>
+#include <DirectXCollision.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "Structures.h"
+#include "ConstantRing.h"
+#include "TerrainStream.h"
+
+using namespace DirectX;
+
+//GPU side of the out-of-core terrain. Tiles of a terrain stream file are read by TerrainStreamer's
+//worker threads, TerrainStreamCache decides which are resident (LRU, within a memory budget) and
+//which to draw, and each resident tile lives in a buffer of 16-bit heights read by VS_TerrainStream.
+//The coarsest mip is loaded up front and never evicted, so there is always something to draw;
+//finer tiles replace it as they arrive.
+//Each frame: Update with the camera in terrain space, then Draw.
+class StreamedTerrain
+{
+private:
+	//Uploads are spread over frames so a burst of arrivals cannot stall one
+	static const size_t MAX_UPLOADS_PER_FRAME = 8;
+	static const size_t MAX_PENDING = 32;
+
+	ID3D11Device* _device;
+	TerrainStreamer _streamer;
+	TerrainStreamCache* _cache;
+
+	//One buffer per cache slot, created the first time a tile lands in the slot and reused after
+	std::vector<ID3D11Buffer*> _tileBuffers;
+	std::vector<ID3D11ShaderResourceView*> _tileViews;
+	ID3D11Buffer* _indexBuffer;
+	UINT _indexCount;
+	float _lodDistance;
+
+	std::vector<TerrainStreamer::LoadedTile> _loaded;
+	std::deque<TerrainStreamer::LoadedTile> _arrived;
+	std::vector<TerrainStreamDrawTile> _draw;
+	std::vector<uint32_t> _requests;
+
+	HRESULT UploadTile(ID3D11DeviceContext* context, const TerrainStreamer::LoadedTile& tile, bool locked);
+
+public:
+	StreamedTerrain();
+	~StreamedTerrain();
+
+	//Opens a file written by BuildTerrainStreamFile. budgetBytes bounds the resident tile heights;
+	//lodDistance is how many tile widths away a tile is split.
+	HRESULT Initialise(ID3D11Device* device, ID3D11DeviceContext* context, const char* fileName, size_t budgetBytes, float lodDistance);
+
+	void Update(ID3D11DeviceContext* context, const XMFLOAT3& camera);
+
+	//Draws the selected tiles with VS_TerrainStream. The stream's grid and height range go into the
+	//b2 terrain buffer once, each tile's placement and stitching into a slice of nodeRing at b6; the
+	//caller sets the shader, pixel state and the other constant buffers. Returns the constant bytes
+	//uploaded.
+	UINT Draw(ID3D11DeviceContext* context, const BoundingFrustum& frustum, ID3D11Buffer* terrainBuffer, const TerrainConstants& constants, ConstantRing* nodeRing);
+
+	const TerrainStreamLayout& GetLayout() const { return _streamer.GetLayout(); }
+	TerrainStreamStats GetStats() const { return _cache ? _cache->GetStats() : TerrainStreamStats(); }
+};
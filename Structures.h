@@ -19,3 +19,27 @@ struct SimpleVertex
 		return memcmp((void*)this, (void*)&other, sizeof(SimpleVertex)) > 0;
 	};
 };
+
+//Per terrain constants for the terrain vertex shaders, bound at b2 and uploaded once a frame
+struct TerrainConstants
+{
+	XMFLOAT4 TerrainGrid;	//Origin x, origin z, spacing x, spacing z
+	XMFLOAT4 TerrainSize;	//Last sample column, last sample row, 1 / last column, 1 / last row
+	XMFLOAT4 CameraPos;		//Terrain space
+	XMFLOAT4 HeightParams;	//Height-only stream: height offset, height range, unused, unused
+};
+
+//Per node or tile constants for the terrain vertex shaders, a slice of a ConstantRing bound at b6
+struct TerrainNodeConstants
+{
+	XMFLOAT4 NodeParams;	//First grid x, first grid z, grid samples per patch quad, lod
+	XMFLOAT4 MorphParams;	//Morph start, morph end, patch quads, unused
+	XMFLOAT4 StitchParams;	//Streamed tiles: samples between the coarser neighbour's vertices on the top, right, bottom, left edges
+};
+
+//Per layer constants for the foliage shaders, bound at b3
+struct FoliageConstants
+{
+	XMFLOAT4 FoliageColour;	//Base colour, alpha unused
+	XMFLOAT4 FoliageParams;	//Brightness at tint 0, brightness at tint 1, sway per unit of mesh height, root darkening
+};
@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainCache.cpp
+//
+// Terrain build cache files and content hashing.
+//
+// Layout: TBC_HEADER, then the sections in TERRAIN_CACHE_SECTION order, each starting on
+// a SECTION_ALIGNMENT boundary. The header records the total file size, so a file cut
+// short by a full disk is refused even though rename makes that unlikely.
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+
+#include "TerrainCache.h"
+#include "MappedFile.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+#pragma pack(push,1)
+
+const uint32_t TBC_MAGIC = 0x31434254; // "TBC1"
+
+struct TBC_SECTION
+{
+    uint64_t    offset;
+    uint64_t    bytes;
+};
+
+struct TBC_HEADER
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    sourceHash;
+    uint64_t    buildHash;
+    uint64_t    width;
+    uint64_t    depth;
+    uint64_t    fileSize;
+    TBC_SECTION sections[TERRAIN_CACHE_SECTION_COUNT];
+};
+
+#pragma pack(pop)
+
+// Sections start on cache lines, which also keeps every element type aligned
+const uint64_t SECTION_ALIGNMENT = 64;
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotateLeft( uint64_t value, int bits )
+{
+    return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+inline uint64_t Read64( const uint8_t* p )
+{
+    uint64_t value;
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+inline uint64_t Round( uint64_t lane, uint64_t input )
+{
+    lane += input * PRIME2;
+    lane = RotateLeft( lane, 31 );
+    return lane * PRIME1;
+}
+
+inline uint64_t MergeRound( uint64_t hash, uint64_t lane )
+{
+    hash ^= Round( 0, lane );
+    return hash * PRIME1 + PRIME4;
+}
+
+inline uint64_t AlignUp( uint64_t value )
+{
+    return ( value + SECTION_ALIGNMENT - 1 ) & ~( SECTION_ALIGNMENT - 1 );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+uint64_t DirectX::HashTerrainBytes( const void* data, size_t size, uint64_t seed )
+{
+    const uint8_t* p = static_cast<const uint8_t*>( data );
+    const uint8_t* end = p + size;
+    uint64_t hash;
+
+    if ( size >= 32 )
+    {
+        // Four independent lanes keep the multiplies in flight
+        uint64_t lane0 = seed + PRIME1 + PRIME2;
+        uint64_t lane1 = seed + PRIME2;
+        uint64_t lane2 = seed;
+        uint64_t lane3 = seed - PRIME1;
+        for ( ; p + 32 <= end; p += 32 )
+        {
+            lane0 = Round( lane0, Read64( p ) );
+            lane1 = Round( lane1, Read64( p + 8 ) );
+            lane2 = Round( lane2, Read64( p + 16 ) );
+            lane3 = Round( lane3, Read64( p + 24 ) );
+        }
+
+        hash = RotateLeft( lane0, 1 ) + RotateLeft( lane1, 7 ) + RotateLeft( lane2, 12 ) + RotateLeft( lane3, 18 );
+        hash = MergeRound( hash, lane0 );
+        hash = MergeRound( hash, lane1 );
+        hash = MergeRound( hash, lane2 );
+        hash = MergeRound( hash, lane3 );
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash += uint64_t( size );
+
+    for ( ; p + 8 <= end; p += 8 )
+        hash = RotateLeft( hash ^ Round( 0, Read64( p ) ), 27 ) * PRIME1 + PRIME4;
+    for ( ; p < end; ++p )
+        hash = RotateLeft( hash ^ ( uint64_t( *p ) * PRIME5 ), 11 ) * PRIME1;
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::HashTerrainFile( const char* fileName, uint64_t* hash )
+{
+    if ( !fileName || !hash )
+        return false;
+
+    MappedFile file;
+    if ( !file.Open( fileName ) )
+        return false;
+
+    *hash = HashTerrainBytes( file.data, file.size );
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::WriteTerrainCache( const char* fileName,
+                                 const TerrainCacheKey& key,
+                                 size_t width,
+                                 size_t depth,
+                                 const TerrainCacheSection* sections )
+{
+    if ( !fileName || !sections )
+        return false;
+
+    TBC_HEADER header;
+    memset( &header, 0, sizeof( header ) );
+    header.magic = TBC_MAGIC;
+    header.version = TERRAIN_CACHE_VERSION;
+    header.sourceHash = key.sourceHash;
+    header.buildHash = key.buildHash;
+    header.width = width;
+    header.depth = depth;
+
+    uint64_t offset = AlignUp( sizeof( header ) );
+    for ( size_t i = 0; i < TERRAIN_CACHE_SECTION_COUNT; ++i )
+    {
+        if ( sections[i].bytes && !sections[i].data )
+            return false;
+
+        header.sections[i].offset = offset;
+        header.sections[i].bytes = sections[i].bytes;
+        offset = AlignUp( offset + sections[i].bytes );
+    }
+    header.fileSize = offset;
+
+    // Written aside and renamed into place, so readers only ever see a whole file
+    std::string temporaryName = std::string( fileName ) + ".tmp";
+    {
+        std::ofstream file( temporaryName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+        if ( !file )
+            return false;
+
+        static const char padding[SECTION_ALIGNMENT] = {};
+        file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+        uint64_t written = sizeof( header );
+        for ( size_t i = 0; i < TERRAIN_CACHE_SECTION_COUNT; ++i )
+        {
+            file.write( padding, std::streamsize( header.sections[i].offset - written ) );
+            file.write( static_cast<const char*>( sections[i].data ), std::streamsize( sections[i].bytes ) );
+            written = header.sections[i].offset + sections[i].bytes;
+        }
+        file.write( padding, std::streamsize( header.fileSize - written ) );
+
+        if ( !file.good() )
+        {
+            file.close();
+            remove( temporaryName.c_str() );
+            return false;
+        }
+    }
+
+    // rename does not replace an existing file everywhere
+    remove( fileName );
+    if ( rename( temporaryName.c_str(), fileName ) != 0 )
+    {
+        remove( temporaryName.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+TerrainCache::TerrainCache() :
+    file( nullptr ),
+    width( 0 ),
+    depth( 0 )
+{
+    memset( sections, 0, sizeof( sections ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+TerrainCache::~TerrainCache()
+{
+    Close();
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainCache::Open( const char* fileName, const TerrainCacheKey& key )
+{
+    Close();
+    if ( !fileName )
+        return false;
+
+    MappedFile* mapped = new MappedFile;
+    if ( !mapped->Open( fileName ) || mapped->size < sizeof( TBC_HEADER ) )
+    {
+        delete mapped;
+        return false;
+    }
+
+    TBC_HEADER header;
+    memcpy( &header, mapped->data, sizeof( header ) );
+
+    bool valid = header.magic == TBC_MAGIC
+              && header.version == TERRAIN_CACHE_VERSION
+              && header.sourceHash == key.sourceHash
+              && header.buildHash == key.buildHash
+              && header.fileSize == mapped->size;
+
+    for ( size_t i = 0; i < TERRAIN_CACHE_SECTION_COUNT && valid; ++i )
+    {
+        const TBC_SECTION& section = header.sections[i];
+        valid = section.offset % SECTION_ALIGNMENT == 0
+             && section.offset >= sizeof( header )
+             && section.offset <= header.fileSize
+             && section.bytes <= header.fileSize - section.offset;
+
+        sections[i].data = mapped->data + section.offset;
+        sections[i].bytes = size_t( section.bytes );
+    }
+
+    if ( !valid )
+    {
+        delete mapped;
+        memset( sections, 0, sizeof( sections ) );
+        return false;
+    }
+
+    file = mapped;
+    width = size_t( header.width );
+    depth = size_t( header.depth );
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainCache::Close()
+{
+    delete file;
+    file = nullptr;
+    width = 0;
+    depth = 0;
+    memset( sections, 0, sizeof( sections ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+const void* TerrainCache::GetSection( TERRAIN_CACHE_SECTION section, size_t* bytes ) const
+{
+    if ( !file || size_t( section ) >= TERRAIN_CACHE_SECTION_COUNT )
+    {
+        if ( bytes )
+            *bytes = 0;
+        return nullptr;
+    }
+
+    if ( bytes )
+        *bytes = sections[section].bytes;
+    return sections[section].data;
+}
@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainCache.h
+//
+// Versioned binary cache of a terrain build, so later starts skip the build.
+//
+// A cache file holds the heights, normals, tile vertices, tiles, tile indices and min-max
+// pyramid built from one heightmap, each in its own aligned section, under a key made of
+// a hash of the heightmap's contents and a hash of every build parameter. Opening maps
+// the file rather than reading it, so sections are used in place and only the pages
+// actually touched are read. A cache from another version, for another key, or cut
+// short is refused and the caller rebuilds; files are written under a temporary name
+// and renamed, so a crash mid-write never leaves a cache that looks valid. Bump
+// TERRAIN_CACHE_VERSION whenever the build itself changes. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINCACHE_H
+#define TERRAINCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace DirectX
+{
+    const uint32_t TERRAIN_CACHE_VERSION = 1;
+
+    enum TERRAIN_CACHE_SECTION
+    {
+        TERRAIN_CACHE_HEIGHTS = 0,      // float per sample
+        TERRAIN_CACHE_NORMALS,          // three floats per sample
+        TERRAIN_CACHE_TILE_VERTICES,    // TerrainTileVertex
+        TERRAIN_CACHE_TILES,            // TerrainTile
+        TERRAIN_CACHE_INDICES,          // uint16_t, shared by every tile
+        TERRAIN_CACHE_PYRAMID,          // TerrainHeightField::GetPyramid
+        TERRAIN_CACHE_SECTION_COUNT,
+    };
+
+    struct TerrainCacheKey
+    {
+        uint64_t    sourceHash;         // the heightmap's contents
+        uint64_t    buildHash;          // everything else the build depends on
+    };
+
+    struct TerrainCacheSection
+    {
+        const void* data;
+        size_t      bytes;
+    };
+
+    // 64-bit hash of a block of bytes, four lanes at a time in the style of xxHash64.
+    // Pass an earlier result as the seed to hash several blocks as one.
+    uint64_t HashTerrainBytes( const void* data, size_t size, uint64_t seed = 0 );
+
+    // The same over a whole file, memory mapped
+    bool HashTerrainFile( const char* fileName, uint64_t* hash );
+
+    // Writes a cache holding sections[TERRAIN_CACHE_SECTION_COUNT] for a width x depth grid
+    bool WriteTerrainCache( const char* fileName,
+                            const TerrainCacheKey& key,
+                            size_t width,
+                            size_t depth,
+                            const TerrainCacheSection* sections );
+
+    class MappedFile;
+
+    class TerrainCache
+    {
+    public:
+        TerrainCache();
+        ~TerrainCache();
+
+        // Maps the cache; false, with nothing open, unless it was written by this version
+        // for the same key and is complete
+        bool Open( const char* fileName, const TerrainCacheKey& key );
+        void Close();
+
+        bool IsOpen() const { return file != nullptr; }
+        size_t GetWidth() const { return width; }
+        size_t GetDepth() const { return depth; }
+
+        // Valid until Close; bytes is optional
+        const void* GetSection( TERRAIN_CACHE_SECTION section, size_t* bytes = nullptr ) const;
+
+    private:
+        TerrainCache( const TerrainCache& );
+        TerrainCache& operator=( const TerrainCache& );
+
+        MappedFile*         file;
+        size_t              width;
+        size_t              depth;
+        TerrainCacheSection sections[TERRAIN_CACHE_SECTION_COUNT];
+    };
+}
+
+#endif // TERRAINCACHE_H
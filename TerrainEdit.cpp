@@ -0,0 +1,220 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainEdit.cpp
+//
+// Terrain height brushes and changed-area tracking.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "TerrainEdit.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+// Crater shape in units of its depth: a parabolic bowl up to a rim at CRATER_RIM_RADIUS of
+// the radius, then a smooth fall from the rim to the untouched ground at the radius
+const float CRATER_RIM_RADIUS = 0.8f;
+const float CRATER_RIM_HEIGHT = 0.25f;
+
+inline float CraterProfile( float u )
+{
+    if ( u < CRATER_RIM_RADIUS )
+    {
+        float s = u / CRATER_RIM_RADIUS;
+        return -1.0f + ( 1.0f + CRATER_RIM_HEIGHT ) * s * s;
+    }
+
+    float s = ( u - CRATER_RIM_RADIUS ) / ( 1.0f - CRATER_RIM_RADIUS );
+    return CRATER_RIM_HEIGHT * ( 1.0f - s * s * ( 3.0f - 2.0f * s ) );
+}
+
+// 1 out to hardness of the radius, smoothstep down to 0 at the radius
+inline float Falloff( float u, float hardness )
+{
+    if ( u <= hardness )
+        return 1.0f;
+    if ( u >= 1.0f )
+        return 0.0f;
+
+    float t = ( u - hardness ) / ( 1.0f - hardness );
+    return 1.0f - t * t * ( 3.0f - 2.0f * t );
+}
+
+inline size_t RectArea( const TerrainEditRect& rect )
+{
+    return ( rect.x1 - rect.x0 ) * ( rect.z1 - rect.z0 );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainEditor::TerrainEditor() :
+    heights( nullptr ),
+    width( 0 ),
+    depth( 0 ),
+    originX( 0.0f ),
+    originZ( 0.0f )
+{
+    desc.spacingX = 1.0f;
+    desc.spacingZ = 1.0f;
+    desc.heightScale = 1.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainEditor::Attach( float* heights, size_t width, size_t depth, const TerrainEditDesc& desc )
+{
+    dirty.clear();
+    this->heights = nullptr;
+
+    if ( !heights || width < 2 || depth < 2 )
+        return false;
+
+    if ( desc.spacingX <= 0.0f || desc.spacingZ <= 0.0f || desc.heightScale == 0.0f )
+        return false;
+
+    this->heights = heights;
+    this->width = width;
+    this->depth = depth;
+    this->desc = desc;
+    originX = -0.5f * float( width - 1 ) * desc.spacingX;
+    originZ = 0.5f * float( depth - 1 ) * desc.spacingZ;
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainEditor::Apply( const TerrainBrush& brush, TerrainEditRect* rect )
+{
+    if ( !heights || !( brush.radius > 0.0f ) )
+        return false;
+
+    // Samples under the brush's bounding square
+    float gx = ( brush.centerX - originX ) / desc.spacingX;
+    float gz = ( originZ - brush.centerZ ) / desc.spacingZ;
+    float rx = brush.radius / desc.spacingX;
+    float rz = brush.radius / desc.spacingZ;
+
+    float firstX = std::max( ceilf( gx - rx ), 0.0f );
+    float firstZ = std::max( ceilf( gz - rz ), 0.0f );
+    float lastX = std::min( floorf( gx + rx ), float( width - 1 ) );
+    float lastZ = std::min( floorf( gz + rz ), float( depth - 1 ) );
+    if ( !( firstX <= lastX && firstZ <= lastZ ) )
+        return false;
+
+    TerrainEditRect changed = { size_t( firstX ), size_t( firstZ ), size_t( lastX ) + 1, size_t( lastZ ) + 1 };
+
+    // Smoothing reads the heights as they were before this brush, one sample around too
+    size_t copyX0 = changed.x0 ? changed.x0 - 1 : 0;
+    size_t copyZ0 = changed.z0 ? changed.z0 - 1 : 0;
+    size_t copyX1 = std::min( changed.x1 + 1, width );
+    size_t copyZ1 = std::min( changed.z1 + 1, depth );
+    size_t copyWidth = copyX1 - copyX0;
+    if ( brush.operation == TERRAIN_BRUSH_SMOOTH )
+    {
+        scratch.resize( copyWidth * ( copyZ1 - copyZ0 ) );
+        for ( size_t z = copyZ0; z < copyZ1; ++z )
+        {
+            std::copy( heights + z * width + copyX0, heights + z * width + copyX1, &scratch[( z - copyZ0 ) * copyWidth] );
+        }
+    }
+
+    float hardness = std::min( std::max( brush.hardness, 0.0f ), 0.999f );
+    float amount = std::min( std::max( brush.strength, 0.0f ), 1.0f );
+    float offset = brush.strength / desc.heightScale;
+    float target = brush.targetHeight / desc.heightScale;
+    float inverseRadius = 1.0f / brush.radius;
+
+    for ( size_t z = changed.z0; z < changed.z1; ++z )
+    {
+        float dz = ( float( z ) - gz ) * desc.spacingZ;
+        float* row = heights + z * width;
+
+        for ( size_t x = changed.x0; x < changed.x1; ++x )
+        {
+            float dx = ( float( x ) - gx ) * desc.spacingX;
+            float u = sqrtf( dx * dx + dz * dz ) * inverseRadius;
+            if ( u >= 1.0f )
+                continue;
+
+            switch ( brush.operation )
+            {
+            case TERRAIN_BRUSH_RAISE:
+                row[x] += offset * Falloff( u, hardness );
+                break;
+
+            case TERRAIN_BRUSH_FLATTEN:
+                row[x] += ( target - row[x] ) * amount * Falloff( u, hardness );
+                break;
+
+            case TERRAIN_BRUSH_SMOOTH:
+            {
+                // 3x3 average, the edges of the grid repeat
+                float sum = 0.0f;
+                for ( int j = -1; j <= 1; ++j )
+                {
+                    size_t sz = std::min( std::max( ptrdiff_t( z ) + j, ptrdiff_t( 0 ) ), ptrdiff_t( depth - 1 ) );
+                    const float* source = &scratch[( sz - copyZ0 ) * copyWidth];
+                    for ( int i = -1; i <= 1; ++i )
+                    {
+                        size_t sx = std::min( std::max( ptrdiff_t( x ) + i, ptrdiff_t( 0 ) ), ptrdiff_t( width - 1 ) );
+                        sum += source[sx - copyX0];
+                    }
+                }
+                row[x] += ( sum / 9.0f - row[x] ) * amount * Falloff( u, hardness );
+                break;
+            }
+
+            case TERRAIN_BRUSH_CRATER:
+                row[x] += offset * CraterProfile( u );
+                break;
+            }
+        }
+    }
+
+    AddDirtyRect( changed );
+    if ( rect )
+        *rect = changed;
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainEditor::TakeDirtyRects( std::vector<TerrainEditRect>& rects )
+{
+    rects.swap( dirty );
+    dirty.clear();
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainEditor::AddDirtyRect( const TerrainEditRect& rect )
+{
+    // Folds in every rectangle whose union with this one costs no more than the two did
+    // apart; the union can reach further rectangles, so the search starts over after each
+    TerrainEditRect merged = rect;
+    for ( size_t i = 0; i < dirty.size(); )
+    {
+        const TerrainEditRect& other = dirty[i];
+        TerrainEditRect both = { std::min( merged.x0, other.x0 ), std::min( merged.z0, other.z0 ),
+                                 std::max( merged.x1, other.x1 ), std::max( merged.z1, other.z1 ) };
+
+        if ( RectArea( both ) <= RectArea( merged ) + RectArea( other ) )
+        {
+            merged = both;
+            dirty.erase( dirty.begin() + i );
+            i = 0;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    dirty.push_back( merged );
+}
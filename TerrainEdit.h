@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainEdit.h
+//
+// Brush edits to a terrain height grid at run time, with the changed areas tracked.
+//
+// Brushes are circles in terrain space whose effect falls off smoothly from a fully
+// affected inner part to nothing at their radius. Every edit only visits the samples under
+// its brush and records their rectangle; rectangles that overlap are merged when that does
+// not make them cover more samples than they did apart. The owner takes the rectangles
+// once a frame and brings normals, bounds and vertex buffers up to date over just those,
+// so the cost of an edit follows its area and not the size of the terrain. Has no
+// Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINEDIT_H
+#define TERRAINEDIT_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace DirectX
+{
+    enum TERRAIN_BRUSH
+    {
+        TERRAIN_BRUSH_RAISE = 0,        // adds strength world units, negative digs
+        TERRAIN_BRUSH_FLATTEN,          // moves heights strength (0..1) of the way to targetHeight
+        TERRAIN_BRUSH_SMOOTH,           // moves heights strength (0..1) of the way to their 3x3 average
+        TERRAIN_BRUSH_CRATER,           // a bowl strength world units deep with a raised rim
+    };
+
+    struct TerrainEditDesc
+    {
+        float       spacingX;           // world units between height samples
+        float       spacingZ;
+        float       heightScale;        // applied to the height samples
+    };
+
+    struct TerrainBrush
+    {
+        TERRAIN_BRUSH   operation;
+        float           centerX;        // terrain space
+        float           centerZ;
+        float           radius;         // world units
+        float           hardness;       // fraction of the radius at full strength, 0..1
+        float           strength;
+        float           targetHeight;   // TERRAIN_BRUSH_FLATTEN only
+    };
+
+    // Samples [x0, x1) x [z0, z1)
+    struct TerrainEditRect
+    {
+        size_t      x0;
+        size_t      z0;
+        size_t      x1;
+        size_t      z1;
+    };
+
+    class TerrainEditor
+    {
+    public:
+        TerrainEditor();
+
+        // heights is a width x depth grid laid out in terrain space as BuildTerrainTiles lays
+        // it out. It is edited in place, not copied, so it must outlive the editor.
+        bool Attach( float* heights, size_t width, size_t depth, const TerrainEditDesc& desc );
+
+        // Applies a brush; false if it misses the grid. rect is optional and gets the samples
+        // the brush covered.
+        bool Apply( const TerrainBrush& brush, TerrainEditRect* rect = nullptr );
+
+        bool IsDirty() const { return !dirty.empty(); }
+
+        // Hands over the rectangles changed since the last call and starts afresh
+        void TakeDirtyRects( std::vector<TerrainEditRect>& rects );
+
+    private:
+        void AddDirtyRect( const TerrainEditRect& rect );
+
+        float*                          heights;
+        size_t                          width;
+        size_t                          depth;
+        TerrainEditDesc                 desc;
+        float                           originX;
+        float                           originZ;
+        std::vector<TerrainEditRect>    dirty;
+        std::vector<float>              scratch;
+    };
+}
+
+#endif // TERRAINEDIT_H
@@ -0,0 +1,280 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainGeomipmap.cpp
+//
+// Geomipmap patch errors, shared LOD/stitch index lists and per-camera LOD selection.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "TerrainGeomipmap.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+// Largest power of two patch whose (n + 1)^2 vertices fit 16-bit indices
+const size_t MAX_PATCH_QUADS = 128;
+
+//-------------------------------------------------------------------------------------
+// Height of the level with the given step under full-resolution sample (i, j) of a patch,
+// using the same diagonal as the index lists (top right to bottom left of each cell)
+//-------------------------------------------------------------------------------------
+float CoarseHeight( const float* patch, size_t stride, size_t step, size_t i, size_t j )
+{
+    size_t cellQuads = stride - 1;
+    size_t i0 = std::min( i / step * step, cellQuads - step );
+    size_t j0 = std::min( j / step * step, cellQuads - step );
+    float u = float( j - j0 ) / float( step );
+    float v = float( i - i0 ) / float( step );
+
+    float a = patch[i0 * stride + j0];
+    float b = patch[i0 * stride + j0 + step];
+    float c = patch[( i0 + step ) * stride + j0];
+    float d = patch[( i0 + step ) * stride + j0 + step];
+
+    if ( u + v <= 1.0f )
+        return a + ( b - a ) * u + ( c - a ) * v;
+
+    return d + ( c - d ) * ( 1.0f - u ) + ( b - d ) * ( 1.0f - v );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainGeomipmap::TerrainGeomipmap()
+    : lodCount( 0 ),
+      patchesX( 0 ),
+      patchesZ( 0 )
+{
+    memset( &desc, 0, sizeof( desc ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainGeomipmap::Build( const float* heights,
+                              size_t width,
+                              size_t depth,
+                              const TerrainGeomipmapDesc& desc,
+                              unsigned int threadCount )
+{
+    if ( !heights || width < 2 || depth < 2 )
+        return false;
+
+    size_t quads = desc.patchQuads;
+    if ( !quads || quads > MAX_PATCH_QUADS || ( quads & ( quads - 1 ) ) != 0 )
+        return false;
+
+    this->desc = desc;
+    lodCount = 1;
+    while ( ( size_t( 1 ) << lodCount ) <= quads )
+        ++lodCount;
+
+    // Same split as BuildTerrainTiles
+    patchesX = ( width - 2 ) / quads + 1;
+    patchesZ = ( depth - 2 ) / quads + 1;
+
+    size_t patchCount = patchesX * patchesZ;
+    errors.assign( patchCount * lodCount, 0.0f );
+    boundsMin.assign( patchCount * 3, 0.0f );
+    boundsMax.assign( patchCount * 3, 0.0f );
+
+    float originX = -0.5f * float( width - 1 ) * desc.spacingX;
+    float originZ = 0.5f * float( depth - 1 ) * desc.spacingZ;
+    size_t stride = quads + 1;
+
+    ParallelFor( patchCount, threadCount, [&]( size_t p )
+    {
+        size_t gridX = ( p % patchesX ) * quads;
+        size_t gridZ = ( p / patchesX ) * quads;
+
+        // Scaled patch samples; rows and columns past the grid repeat the last one like the tiles
+        std::vector<float> patch( stride * stride );
+        for ( size_t i = 0; i < stride; ++i )
+        {
+            const float* row = heights + std::min( gridZ + i, depth - 1 ) * width;
+            for ( size_t j = 0; j < stride; ++j )
+                patch[i * stride + j] = row[std::min( gridX + j, width - 1 )] * desc.heightScale;
+        }
+
+        float* patchErrors = &errors[p * lodCount];
+        for ( size_t lod = 1; lod < lodCount; ++lod )
+        {
+            size_t step = size_t( 1 ) << lod;
+            float error = 0.0f;
+            for ( size_t i = 0; i < stride; ++i )
+            {
+                for ( size_t j = 0; j < stride; ++j )
+                    error = std::max( error, fabsf( patch[i * stride + j] - CoarseHeight( patch.data(), stride, step, i, j ) ) );
+            }
+
+            // Coarser levels never report less error than finer ones
+            patchErrors[lod] = std::max( error, patchErrors[lod - 1] );
+        }
+
+        auto range = std::minmax_element( patch.begin(), patch.end() );
+        size_t lastColumn = std::min( gridX + quads, width - 1 );
+        size_t lastRow = std::min( gridZ + quads, depth - 1 );
+        boundsMin[p * 3 + 0] = originX + float( gridX ) * desc.spacingX;
+        boundsMin[p * 3 + 1] = *range.first;
+        boundsMin[p * 3 + 2] = originZ - float( lastRow ) * desc.spacingZ;
+        boundsMax[p * 3 + 0] = originX + float( lastColumn ) * desc.spacingX;
+        boundsMax[p * 3 + 1] = *range.second;
+        boundsMax[p * 3 + 2] = originZ - float( gridZ ) * desc.spacingZ;
+    } );
+
+    BuildIndices();
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Every level and stitch combination, one after the other. A stitched edge moves each of
+// its odd vertices onto an even neighbour, which turns the triangles touching that edge in
+// each pair of cells into a fan matching the coarser neighbour; triangles that collapse
+// are dropped. Top and left edges snap towards the first vertex and bottom and right edges
+// towards the last, so with the cells' diagonal no triangle is left spanning another
+// triangle's vertex in the corners where two stitched edges meet.
+//-------------------------------------------------------------------------------------
+void TerrainGeomipmap::BuildIndices()
+{
+    size_t quads = desc.patchQuads;
+    size_t stride = quads + 1;
+
+    indices.clear();
+    ranges.resize( lodCount * TERRAIN_STITCH_COMBINATIONS );
+
+    for ( size_t lod = 0; lod < lodCount; ++lod )
+    {
+        size_t step = size_t( 1 ) << lod;
+
+        for ( uint32_t stitch = 0; stitch < TERRAIN_STITCH_COMBINATIONS; ++stitch )
+        {
+            auto vertex = [&]( size_t i, size_t j ) -> uint16_t
+            {
+                bool oddColumn = ( ( j / step ) & 1 ) != 0;
+                bool oddRow = ( ( i / step ) & 1 ) != 0;
+
+                if ( oddColumn && i == 0 && ( stitch & TERRAIN_STITCH_TOP ) )
+                    j -= step;
+                if ( oddColumn && i == quads && ( stitch & TERRAIN_STITCH_BOTTOM ) )
+                    j += step;
+                if ( oddRow && j == 0 && ( stitch & TERRAIN_STITCH_LEFT ) )
+                    i -= step;
+                if ( oddRow && j == quads && ( stitch & TERRAIN_STITCH_RIGHT ) )
+                    i += step;
+
+                return uint16_t( i * stride + j );
+            };
+
+            auto triangle = [&]( uint16_t a, uint16_t b, uint16_t c )
+            {
+                if ( a == b || b == c || a == c )
+                    return;
+
+                indices.push_back( a );
+                indices.push_back( b );
+                indices.push_back( c );
+            };
+
+            IndexRange& range = ranges[lod * TERRAIN_STITCH_COMBINATIONS + stitch];
+            range.first = uint32_t( indices.size() );
+
+            for ( size_t i = 0; i < quads; i += step )
+            {
+                for ( size_t j = 0; j < quads; j += step )
+                {
+                    uint16_t a = vertex( i, j );
+                    uint16_t b = vertex( i, j + step );
+                    uint16_t c = vertex( i + step, j );
+                    uint16_t d = vertex( i + step, j + step );
+
+                    triangle( a, b, c );
+                    triangle( c, b, d );
+                }
+            }
+
+            range.count = uint32_t( indices.size() ) - range.first;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainGeomipmap::SelectLods( const float cameraPosition[3],
+                                   float projectionScale,
+                                   float pixelThreshold,
+                                   std::vector<TerrainPatchLod>& patches ) const
+{
+    size_t patchCount = patchesX * patchesZ;
+    patches.resize( patchCount );
+
+    // Coarsest level whose error, projected from the nearest point of the patch, is in budget
+    for ( size_t p = 0; p < patchCount; ++p )
+    {
+        float distanceSq = 0.0f;
+        for ( size_t axis = 0; axis < 3; ++axis )
+        {
+            float c = cameraPosition[axis];
+            float outside = std::max( std::max( boundsMin[p * 3 + axis] - c, c - boundsMax[p * 3 + axis] ), 0.0f );
+            distanceSq += outside * outside;
+        }
+
+        float allowed = pixelThreshold * sqrtf( distanceSq ) / projectionScale;
+        const float* patchErrors = &errors[p * lodCount];
+
+        uint32_t lod = 0;
+        while ( lod + 1 < lodCount && patchErrors[lod + 1] <= allowed )
+            ++lod;
+
+        patches[p].lod = lod;
+    }
+
+    // Neighbours may differ by one level at most, so only refine until that holds
+    bool changed = true;
+    while ( changed )
+    {
+        changed = false;
+        for ( size_t z = 0; z < patchesZ; ++z )
+        {
+            for ( size_t x = 0; x < patchesX; ++x )
+            {
+                uint32_t& lod = patches[z * patchesX + x].lod;
+                uint32_t limit = lod;
+                if ( z > 0 )            limit = std::min( limit, patches[( z - 1 ) * patchesX + x].lod + 1 );
+                if ( z + 1 < patchesZ ) limit = std::min( limit, patches[( z + 1 ) * patchesX + x].lod + 1 );
+                if ( x > 0 )            limit = std::min( limit, patches[z * patchesX + x - 1].lod + 1 );
+                if ( x + 1 < patchesX ) limit = std::min( limit, patches[z * patchesX + x + 1].lod + 1 );
+
+                if ( limit < lod )
+                {
+                    lod = limit;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for ( size_t z = 0; z < patchesZ; ++z )
+    {
+        for ( size_t x = 0; x < patchesX; ++x )
+        {
+            TerrainPatchLod& patch = patches[z * patchesX + x];
+            uint32_t stitch = 0;
+            if ( z > 0 && patches[( z - 1 ) * patchesX + x].lod > patch.lod )            stitch |= TERRAIN_STITCH_TOP;
+            if ( z + 1 < patchesZ && patches[( z + 1 ) * patchesX + x].lod > patch.lod ) stitch |= TERRAIN_STITCH_BOTTOM;
+            if ( x > 0 && patches[z * patchesX + x - 1].lod > patch.lod )                stitch |= TERRAIN_STITCH_LEFT;
+            if ( x + 1 < patchesX && patches[z * patchesX + x + 1].lod > patch.lod )     stitch |= TERRAIN_STITCH_RIGHT;
+
+            const IndexRange& range = ranges[patch.lod * TERRAIN_STITCH_COMBINATIONS + stitch];
+            patch.stitch = stitch;
+            patch.firstIndex = range.first;
+            patch.indexCount = range.count;
+        }
+    }
+}
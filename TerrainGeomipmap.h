@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainGeomipmap.h
+//
+// Geomipmapping over the fixed-size patches of BuildTerrainTiles.
+//
+// Every patch keeps its full-resolution vertices; a LOD level only changes which of them
+// the indices reach (every 2^lod-th sample). A single shared index list holds one range
+// per LOD level and edge-stitch combination, where the stitched edges of a patch snap
+// their odd vertices onto the grid of a coarser neighbour so no cracks open between
+// levels. Per frame each patch picks the coarsest level whose geometric error projects
+// to no more than a pixel threshold, and neighbouring patches are then pulled to within
+// one level of each other. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINGEOMIPMAP_H
+#define TERRAINGEOMIPMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    // Patch edges that meet a coarser neighbour, in grid terms (row 0 is the +Z edge)
+    enum TERRAIN_STITCH_FLAGS
+    {
+        TERRAIN_STITCH_TOP      = 0x1,  // row 0
+        TERRAIN_STITCH_RIGHT    = 0x2,  // last column
+        TERRAIN_STITCH_BOTTOM   = 0x4,  // last row
+        TERRAIN_STITCH_LEFT     = 0x8,  // column 0
+        TERRAIN_STITCH_COMBINATIONS = 16,
+    };
+
+    struct TerrainGeomipmapDesc
+    {
+        size_t      patchQuads;         // power of two, at most 128 so a patch fits 16-bit indices
+        float       spacingX;           // world units between height samples
+        float       spacingZ;
+        float       heightScale;        // applied to the height samples
+    };
+
+    struct TerrainPatchLod
+    {
+        uint32_t    lod;                // 0 is full resolution
+        uint32_t    stitch;             // TERRAIN_STITCH_FLAGS
+        uint32_t    firstIndex;         // range of the shared index list to draw
+        uint32_t    indexCount;
+    };
+
+    class TerrainGeomipmap
+    {
+    public:
+        TerrainGeomipmap();
+
+        // heights is a width x depth grid split into patches exactly as BuildTerrainTiles
+        // splits it into tiles, so patch i is drawn from tile i's vertices. The geometric
+        // error of every patch at every level is measured in parallel.
+        bool Build( const float* heights,
+                    size_t width,
+                    size_t depth,
+                    const TerrainGeomipmapDesc& desc,
+                    unsigned int threadCount = 0 );
+
+        // Chooses a level for every patch (culled ones included, so their neighbours still
+        // stitch correctly). cameraPosition is in terrain space. projectionScale converts
+        // an error at unit distance to pixels: viewport height * 0.5 * projection._22.
+        void SelectLods( const float cameraPosition[3],
+                         float projectionScale,
+                         float pixelThreshold,
+                         std::vector<TerrainPatchLod>& patches ) const;
+
+        // Triangle list indices for every level and stitch combination, relative to the
+        // first vertex of a patch
+        const std::vector<uint16_t>& GetIndices() const { return indices; }
+
+        size_t GetLodCount() const { return lodCount; }
+        size_t GetPatchCountX() const { return patchesX; }
+        size_t GetPatchCountZ() const { return patchesZ; }
+
+        // Largest height difference between the full-resolution patch and the patch at lod
+        float GetPatchError( size_t patch, size_t lod ) const { return errors[patch * lodCount + lod]; }
+
+    private:
+        struct IndexRange
+        {
+            uint32_t    first;
+            uint32_t    count;
+        };
+
+        void BuildIndices();
+
+        TerrainGeomipmapDesc    desc;
+        size_t                  lodCount;
+        size_t                  patchesX;
+        size_t                  patchesZ;
+        std::vector<float>      errors;         // lodCount per patch, non-decreasing with lod
+        std::vector<float>      boundsMin;      // 3 per patch, terrain space
+        std::vector<float>      boundsMax;
+        std::vector<uint16_t>   indices;
+        std::vector<IndexRange> ranges;         // TERRAIN_STITCH_COMBINATIONS per level
+    };
+}
+
+#endif // TERRAINGEOMIPMAP_H
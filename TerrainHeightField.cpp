@@ -0,0 +1,525 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightField.cpp
+//
+// Terrain height queries and min-max pyramid ray casting.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "TerrainHeightField.h"
+#include "ParallelFor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HEIGHTFIELD_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+// Deep enough for a depth-first walk of any pyramid whose levels fit size_t
+const size_t MAX_TRAVERSAL_STACK = 4 * 64;
+
+struct TraversalNode
+{
+    size_t  level;
+    size_t  x;
+    size_t  z;
+};
+
+//-------------------------------------------------------------------------------------
+// Slab test of a ray (in grid space) against a box, clipped to [tMin, tMax]
+//-------------------------------------------------------------------------------------
+bool RayHitsBox( const float origin[3], const float inverse[3], const float boxMin[3], const float boxMax[3], float tMin, float tMax )
+{
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        float t0 = ( boxMin[axis] - origin[axis] ) * inverse[axis];
+        float t1 = ( boxMax[axis] - origin[axis] ) * inverse[axis];
+        if ( t0 > t1 )
+            std::swap( t0, t1 );
+
+        // NaN from 0 * inf (ray in the slab's plane) leaves the interval alone
+        if ( t0 > tMin )
+            tMin = t0;
+        if ( t1 < tMax )
+            tMax = t1;
+        if ( tMin > tMax )
+            return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Two-sided Moller-Trumbore
+//-------------------------------------------------------------------------------------
+bool RayHitsTriangle( const float origin[3], const float direction[3], const float* a, const float* b, const float* c, float& t )
+{
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    float p[3] = { direction[1] * e2[2] - direction[2] * e2[1],
+                   direction[2] * e2[0] - direction[0] * e2[2],
+                   direction[0] * e2[1] - direction[1] * e2[0] };
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if ( fabsf( det ) < 1e-12f )
+        return false;
+
+    float inverseDet = 1.0f / det;
+    float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+    float u = ( s[0] * p[0] + s[1] * p[1] + s[2] * p[2] ) * inverseDet;
+    if ( u < 0.0f || u > 1.0f )
+        return false;
+
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1],
+                   s[2] * e1[0] - s[0] * e1[2],
+                   s[0] * e1[1] - s[1] * e1[0] };
+    float v = ( direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2] ) * inverseDet;
+    if ( v < 0.0f || u + v > 1.0f )
+        return false;
+
+    t = ( e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2] ) * inverseDet;
+    return t >= 0.0f;
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainHeightField::TerrainHeightField()
+    : heights( nullptr ),
+      width( 0 ),
+      depth( 0 ),
+      originX( 0.0f ),
+      originZ( 0.0f )
+{
+    memset( &desc, 0, sizeof( desc ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::Build( const float* heights,
+                                size_t width,
+                                size_t depth,
+                                const TerrainHeightFieldDesc& desc,
+                                unsigned int threadCount )
+{
+    if ( !Allocate( heights, width, depth, desc ) )
+        return false;
+
+    // The cell level is most of the work, so its rows are spread over threads
+    ParallelFor( depth - 1, threadCount, [&]( size_t z )
+    {
+        BuildLevel( 0, 0, z, width - 1, z + 1 );
+    } );
+
+    for ( size_t level = 1; level < levels.size(); ++level )
+        BuildLevel( level, 0, 0, levels[level].nodesX, levels[level].nodesZ );
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::BuildFromPyramid( const float* heights,
+                                           size_t width,
+                                           size_t depth,
+                                           const TerrainHeightFieldDesc& desc,
+                                           const float* pyramid,
+                                           size_t pyramidSize )
+{
+    if ( !pyramid || !Allocate( heights, width, depth, desc ) || pyramidSize != GetPyramidSize() )
+    {
+        levels.clear();
+        this->heights = nullptr;
+        return false;
+    }
+
+    for ( size_t level = 0; level < levels.size(); ++level )
+    {
+        size_t count = levels[level].minY.size();
+        memcpy( levels[level].minY.data(), pyramid, count * sizeof( float ) );
+        memcpy( levels[level].maxY.data(), pyramid + count, count * sizeof( float ) );
+        pyramid += 2 * count;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+size_t TerrainHeightField::GetPyramidSize() const
+{
+    size_t size = 0;
+    for ( size_t level = 0; level < levels.size(); ++level )
+        size += 2 * levels[level].minY.size();
+
+    return size;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainHeightField::GetPyramid( float* pyramid ) const
+{
+    for ( size_t level = 0; level < levels.size(); ++level )
+    {
+        size_t count = levels[level].minY.size();
+        memcpy( pyramid, levels[level].minY.data(), count * sizeof( float ) );
+        memcpy( pyramid + count, levels[level].maxY.data(), count * sizeof( float ) );
+        pyramid += 2 * count;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+// Takes the grid and sizes the pyramid: one node per cell, then halved until a single
+// node covers everything
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::Allocate( const float* heights, size_t width, size_t depth, const TerrainHeightFieldDesc& desc )
+{
+    if ( !heights || width < 2 || depth < 2 || desc.spacingX <= 0.0f || desc.spacingZ <= 0.0f )
+        return false;
+
+    this->heights = heights;
+    this->width = width;
+    this->depth = depth;
+    this->desc = desc;
+    originX = -0.5f * float( width - 1 ) * desc.spacingX;
+    originZ = 0.5f * float( depth - 1 ) * desc.spacingZ;
+
+    levels.clear();
+    size_t nodesX = width - 1;
+    size_t nodesZ = depth - 1;
+    for ( ;; )
+    {
+        Level level;
+        level.nodesX = nodesX;
+        level.nodesZ = nodesZ;
+        level.minY.resize( nodesX * nodesZ );
+        level.maxY.resize( nodesX * nodesZ );
+        levels.push_back( level );
+
+        if ( nodesX == 1 && nodesZ == 1 )
+            break;
+        nodesX = ( nodesX + 1 ) / 2;
+        nodesZ = ( nodesZ + 1 ) / 2;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Nodes [x0, x1) x [z0, z1) of a level from the cells or the level below
+//-------------------------------------------------------------------------------------
+void TerrainHeightField::BuildLevel( size_t level, size_t x0, size_t z0, size_t x1, size_t z1 )
+{
+    Level& target = levels[level];
+
+    for ( size_t z = z0; z < z1; ++z )
+    {
+        for ( size_t x = x0; x < x1; ++x )
+        {
+            float lo, hi;
+            if ( level == 0 )
+            {
+                const float* row = heights + z * width + x;
+                float a = row[0], b = row[1], c = row[width], d = row[width + 1];
+                lo = std::min( std::min( a, b ), std::min( c, d ) ) * desc.heightScale;
+                hi = std::max( std::max( a, b ), std::max( c, d ) ) * desc.heightScale;
+                if ( lo > hi )
+                    std::swap( lo, hi );
+            }
+            else
+            {
+                const Level& source = levels[level - 1];
+                size_t cx = 2 * x, cz = 2 * z;
+                lo = source.minY[cz * source.nodesX + cx];
+                hi = source.maxY[cz * source.nodesX + cx];
+                for ( size_t sz = cz; sz < std::min( cz + 2, source.nodesZ ); ++sz )
+                {
+                    for ( size_t sx = cx; sx < std::min( cx + 2, source.nodesX ); ++sx )
+                    {
+                        lo = std::min( lo, source.minY[sz * source.nodesX + sx] );
+                        hi = std::max( hi, source.maxY[sz * source.nodesX + sx] );
+                    }
+                }
+            }
+
+            target.minY[z * target.nodesX + x] = lo;
+            target.maxY[z * target.nodesX + x] = hi;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainHeightField::UpdateRegion( size_t x0, size_t z0, size_t x1, size_t z1 )
+{
+    if ( !heights )
+        return;
+
+    // Cells that use any of the samples
+    size_t cx0 = x0 ? x0 - 1 : 0;
+    size_t cz0 = z0 ? z0 - 1 : 0;
+    size_t cx1 = std::min( x1, width - 1 );
+    size_t cz1 = std::min( z1, depth - 1 );
+    if ( cx0 >= cx1 || cz0 >= cz1 )
+        return;
+
+    for ( size_t level = 0; level < levels.size(); ++level )
+    {
+        BuildLevel( level, cx0, cz0, cx1, cz1 );
+
+        // The parents of those nodes
+        cx0 /= 2;
+        cz0 /= 2;
+        cx1 = ( cx1 + 1 ) / 2;
+        cz1 = ( cz1 + 1 ) / 2;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::GetHeightAt( float x, float z, float* height ) const
+{
+    float gx = ( x - originX ) / desc.spacingX;
+    float gz = ( originZ - z ) / desc.spacingZ;
+    if ( !heights || !( gx >= 0.0f && gz >= 0.0f && gx <= float( width - 1 ) && gz <= float( depth - 1 ) ) )
+        return false;
+
+    size_t i = std::min( size_t( gx ), width - 2 );
+    size_t j = std::min( size_t( gz ), depth - 2 );
+    float fx = gx - float( i );
+    float fz = gz - float( j );
+
+    const float* row = heights + j * width + i;
+    float top = row[0] + ( row[1] - row[0] ) * fx;
+    float bottom = row[width] + ( row[width + 1] - row[width] ) * fx;
+
+    if ( height )
+        *height = ( top + ( bottom - top ) * fz ) * desc.heightScale;
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::GetNormalAt( float x, float z, float normal[3] ) const
+{
+    float gx = ( x - originX ) / desc.spacingX;
+    float gz = ( originZ - z ) / desc.spacingZ;
+    if ( !heights || !( gx >= 0.0f && gz >= 0.0f && gx <= float( width - 1 ) && gz <= float( depth - 1 ) ) )
+        return false;
+
+    size_t i = std::min( size_t( gx ), width - 2 );
+    size_t j = std::min( size_t( gz ), depth - 2 );
+    float fx = gx - float( i );
+    float fz = gz - float( j );
+
+    const float* row = heights + j * width + i;
+    float h00 = row[0], h10 = row[1], h01 = row[width], h11 = row[width + 1];
+
+    // Slopes of the bilinear patch; grid z runs towards -Z
+    float slopeX = ( ( h10 - h00 ) + ( ( h11 - h01 ) - ( h10 - h00 ) ) * fz ) * desc.heightScale / desc.spacingX;
+    float slopeZ = -( ( h01 - h00 ) + ( ( h11 - h10 ) - ( h01 - h00 ) ) * fx ) * desc.heightScale / desc.spacingZ;
+
+    float length = sqrtf( slopeX * slopeX + 1.0f + slopeZ * slopeZ );
+    normal[0] = -slopeX / length;
+    normal[1] = 1.0f / length;
+    normal[2] = -slopeZ / length;
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainHeightField::GetHeightsAt( const float* x,
+                                       const float* z,
+                                       size_t count,
+                                       float* out,
+                                       float outsideHeight ) const
+{
+    if ( !heights )
+    {
+        std::fill( out, out + count, outsideHeight );
+        return;
+    }
+
+    size_t k = 0;
+
+#ifdef HEIGHTFIELD_USE_SSE
+    const __m128 ox = _mm_set1_ps( originX );
+    const __m128 oz = _mm_set1_ps( originZ );
+    const __m128 inverseX = _mm_set1_ps( 1.0f / desc.spacingX );
+    const __m128 inverseZ = _mm_set1_ps( 1.0f / desc.spacingZ );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lastX = _mm_set1_ps( float( width - 1 ) );
+    const __m128 lastZ = _mm_set1_ps( float( depth - 1 ) );
+    const __m128i lastCellX = _mm_set1_epi32( int( width - 2 ) );
+    const __m128i lastCellZ = _mm_set1_epi32( int( depth - 2 ) );
+    const __m128 scale = _mm_set1_ps( desc.heightScale );
+    const __m128 outside = _mm_set1_ps( outsideHeight );
+
+    for ( ; k + 4 <= count; k += 4 )
+    {
+        __m128 gx = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( x + k ), ox ), inverseX );
+        __m128 gz = _mm_mul_ps( _mm_sub_ps( oz, _mm_loadu_ps( z + k ) ), inverseZ );
+        __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( gx, zero ), _mm_cmple_ps( gx, lastX ) ),
+                                    _mm_and_ps( _mm_cmpge_ps( gz, zero ), _mm_cmple_ps( gz, lastZ ) ) );
+
+        // Outside points are pulled onto cell 0 so the loads below stay in the grid
+        gx = _mm_and_ps( gx, inside );
+        gz = _mm_and_ps( gz, inside );
+        __m128i ix = _mm_cvttps_epi32( gx );
+        __m128i iz = _mm_cvttps_epi32( gz );
+        __m128i overX = _mm_cmpgt_epi32( ix, lastCellX );
+        __m128i overZ = _mm_cmpgt_epi32( iz, lastCellZ );
+        ix = _mm_or_si128( _mm_and_si128( overX, lastCellX ), _mm_andnot_si128( overX, ix ) );
+        iz = _mm_or_si128( _mm_and_si128( overZ, lastCellZ ), _mm_andnot_si128( overZ, iz ) );
+        __m128 fx = _mm_sub_ps( gx, _mm_cvtepi32_ps( ix ) );
+        __m128 fz = _mm_sub_ps( gz, _mm_cvtepi32_ps( iz ) );
+
+        int cellX[4], cellZ[4];
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( cellX ), ix );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( cellZ ), iz );
+
+        float h00[4], h10[4], h01[4], h11[4];
+        for ( int lane = 0; lane < 4; ++lane )
+        {
+            const float* row = heights + size_t( cellZ[lane] ) * width + size_t( cellX[lane] );
+            h00[lane] = row[0];
+            h10[lane] = row[1];
+            h01[lane] = row[width];
+            h11[lane] = row[width + 1];
+        }
+
+        __m128 a = _mm_loadu_ps( h00 ), b = _mm_loadu_ps( h10 );
+        __m128 c = _mm_loadu_ps( h01 ), d = _mm_loadu_ps( h11 );
+        __m128 top = _mm_add_ps( a, _mm_mul_ps( _mm_sub_ps( b, a ), fx ) );
+        __m128 bottom = _mm_add_ps( c, _mm_mul_ps( _mm_sub_ps( d, c ), fx ) );
+        __m128 h = _mm_mul_ps( _mm_add_ps( top, _mm_mul_ps( _mm_sub_ps( bottom, top ), fz ) ), scale );
+
+        _mm_storeu_ps( out + k, _mm_or_ps( _mm_and_ps( inside, h ), _mm_andnot_ps( inside, outside ) ) );
+    }
+#endif
+
+    for ( ; k < count; ++k )
+    {
+        if ( !GetHeightAt( x[k], z[k], out + k ) )
+            out[k] = outsideHeight;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+// The cell's two triangles, top right to bottom left diagonal like the tile indices
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::IntersectCell( size_t cellX, size_t cellZ, const float origin[3], const float direction[3], float& t ) const
+{
+    float x0 = originX + float( cellX ) * desc.spacingX;
+    float x1 = x0 + desc.spacingX;
+    float z0 = originZ - float( cellZ ) * desc.spacingZ;
+    float z1 = z0 - desc.spacingZ;
+
+    const float* row = heights + cellZ * width + cellX;
+    float a[3] = { x0, row[0] * desc.heightScale, z0 };
+    float b[3] = { x1, row[1] * desc.heightScale, z0 };
+    float c[3] = { x0, row[width] * desc.heightScale, z1 };
+    float d[3] = { x1, row[width + 1] * desc.heightScale, z1 };
+
+    float t0 = 0.0f, t1 = 0.0f;
+    bool hit0 = RayHitsTriangle( origin, direction, a, b, c, t0 );
+    bool hit1 = RayHitsTriangle( origin, direction, c, b, d, t1 );
+    if ( !hit0 && !hit1 )
+        return false;
+
+    t = hit0 ? ( hit1 ? std::min( t0, t1 ) : t0 ) : t1;
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHeightField::Raycast( const float origin[3],
+                                  const float direction[3],
+                                  float maxDistance,
+                                  TerrainRayHit* hit ) const
+{
+    if ( !heights || levels.empty() || maxDistance < 0.0f )
+        return false;
+
+    // Box tests run in grid space: x and z in cells, y as is
+    float gridOrigin[3] = { ( origin[0] - originX ) / desc.spacingX, origin[1], ( originZ - origin[2] ) / desc.spacingZ };
+    float gridDirection[3] = { direction[0] / desc.spacingX, direction[1], -direction[2] / desc.spacingZ };
+    float inverse[3];
+    for ( int axis = 0; axis < 3; ++axis )
+        inverse[axis] = ( gridDirection[axis] != 0.0f ) ? 1.0f / gridDirection[axis] : ( gridDirection[axis] >= 0.0f ? INFINITY : -INFINITY );
+
+    // Children nearer the origin along the ray are visited first
+    size_t firstX = gridDirection[0] >= 0.0f ? 0 : 1;
+    size_t firstZ = gridDirection[2] >= 0.0f ? 0 : 1;
+
+    float best = maxDistance;
+    bool found = false;
+    size_t foundX = 0, foundZ = 0;
+
+    TraversalNode stack[MAX_TRAVERSAL_STACK];
+    size_t top = 0;
+    TraversalNode root = { levels.size() - 1, 0, 0 };
+    stack[top++] = root;
+
+    while ( top )
+    {
+        TraversalNode node = stack[--top];
+        const Level& level = levels[node.level];
+        size_t span = size_t( 1 ) << node.level;
+
+        float boxMin[3] = { float( node.x * span ), level.minY[node.z * level.nodesX + node.x], float( node.z * span ) };
+        float boxMax[3] = { float( std::min( ( node.x + 1 ) * span, width - 1 ) ),
+                            level.maxY[node.z * level.nodesX + node.x],
+                            float( std::min( ( node.z + 1 ) * span, depth - 1 ) ) };
+
+        if ( !RayHitsBox( gridOrigin, inverse, boxMin, boxMax, 0.0f, best ) )
+            continue;
+
+        if ( node.level == 0 )
+        {
+            float t;
+            if ( IntersectCell( node.x, node.z, origin, direction, t ) && t <= best )
+            {
+                best = t;
+                found = true;
+                foundX = node.x;
+                foundZ = node.z;
+            }
+            continue;
+        }
+
+        // Pushed far to near so the near child is popped first
+        const Level& children = levels[node.level - 1];
+        for ( int k = 3; k >= 0; --k )
+        {
+            size_t cx = 2 * node.x + ( ( k & 1 ) ^ firstX );
+            size_t cz = 2 * node.z + ( ( k >> 1 ) ^ firstZ );
+            if ( cx < children.nodesX && cz < children.nodesZ && top < MAX_TRAVERSAL_STACK )
+            {
+                TraversalNode child = { node.level - 1, cx, cz };
+                stack[top++] = child;
+            }
+        }
+    }
+
+    if ( found && hit )
+    {
+        hit->distance = best;
+        for ( int axis = 0; axis < 3; ++axis )
+            hit->position[axis] = origin[axis] + direction[axis] * best;
+        hit->gridX = foundX;
+        hit->gridZ = foundZ;
+    }
+
+    return found;
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightField.h
+//
+// Height, normal and ray queries against a terrain height grid.
+//
+// Heights and normals are bilinear in the grid cell under the point. Rays are traced down
+// a min-max pyramid over the cells: each level keeps the lowest and highest height under
+// every 2x2 block of the level below, so whole blocks the ray passes above or below are
+// skipped, and only the cells it may touch are tested against their two triangles (the
+// same split the tile indices use). Batched height queries run four points at a time with
+// SSE when available. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINHEIGHTFIELD_H
+#define TERRAINHEIGHTFIELD_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace DirectX
+{
+    struct TerrainHeightFieldDesc
+    {
+        float       spacingX;           // world units between height samples
+        float       spacingZ;
+        float       heightScale;        // applied to the height samples
+    };
+
+    struct TerrainRayHit
+    {
+        float       distance;           // along the ray, in units of the direction's length
+        float       position[3];
+        size_t      gridX;              // cell hit
+        size_t      gridZ;
+    };
+
+    class TerrainHeightField
+    {
+    public:
+        TerrainHeightField();
+
+        // heights is a width x depth grid laid out in terrain space as BuildTerrainTiles lays
+        // it out. The grid is referenced, not copied, so it must outlive the height field;
+        // after changing it call UpdateRegion.
+        bool Build( const float* heights,
+                    size_t width,
+                    size_t depth,
+                    const TerrainHeightFieldDesc& desc,
+                    unsigned int threadCount = 0 );
+
+        // The same with the pyramid taken from GetPyramid of an earlier build over the same
+        // grid instead of computed; false if pyramidSize does not match the grid
+        bool BuildFromPyramid( const float* heights,
+                               size_t width,
+                               size_t depth,
+                               const TerrainHeightFieldDesc& desc,
+                               const float* pyramid,
+                               size_t pyramidSize );
+
+        // Every level's minimum then maximum heights, finest level first, GetPyramidSize floats
+        size_t GetPyramidSize() const;
+        void GetPyramid( float* pyramid ) const;
+
+        // Rebuilds the pyramid over samples [x0, x1) x [z0, z1)
+        void UpdateRegion( size_t x0, size_t z0, size_t x1, size_t z1 );
+
+        // Terrain space queries; false outside the grid
+        bool GetHeightAt( float x, float z, float* height ) const;
+        bool GetNormalAt( float x, float z, float normal[3] ) const;
+
+        // heights[i] for (x[i], z[i]); points outside the grid get outsideHeight
+        void GetHeightsAt( const float* x,
+                           const float* z,
+                           size_t count,
+                           float* heights,
+                           float outsideHeight = 0.0f ) const;
+
+        // Nearest hit of origin + t * direction for t in [0, maxDistance]
+        bool Raycast( const float origin[3],
+                      const float direction[3],
+                      float maxDistance,
+                      TerrainRayHit* hit ) const;
+
+        size_t GetWidth() const { return width; }
+        size_t GetDepth() const { return depth; }
+        const TerrainHeightFieldDesc& GetDesc() const { return desc; }
+
+        // The min-max pyramid. Node (x, z) of a level covers cells [x << level, (x + 1) << level)
+        // along each axis, clipped to the grid; the last level is a single node.
+        size_t GetLevelCount() const { return levels.size(); }
+        size_t GetNodeCountX( size_t level ) const { return levels[level].nodesX; }
+        size_t GetNodeCountZ( size_t level ) const { return levels[level].nodesZ; }
+        float GetNodeMinY( size_t level, size_t x, size_t z ) const { return levels[level].minY[z * levels[level].nodesX + x]; }
+        float GetNodeMaxY( size_t level, size_t x, size_t z ) const { return levels[level].maxY[z * levels[level].nodesX + x]; }
+
+    private:
+        struct Level
+        {
+            size_t              nodesX;
+            size_t              nodesZ;
+            std::vector<float>  minY;
+            std::vector<float>  maxY;
+        };
+
+        bool Allocate( const float* heights, size_t width, size_t depth, const TerrainHeightFieldDesc& desc );
+        void BuildLevel( size_t level, size_t x0, size_t z0, size_t x1, size_t z1 );
+        bool IntersectCell( size_t cellX, size_t cellZ, const float origin[3], const float direction[3], float& t ) const;
+
+        const float*            heights;
+        size_t                  width;
+        size_t                  depth;
+        TerrainHeightFieldDesc  desc;
+        float                   originX;
+        float                   originZ;
+        std::vector<Level>      levels;     // level 0 is one node per cell
+    };
+}
+
+#endif // TERRAINHEIGHTFIELD_H
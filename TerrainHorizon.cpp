@@ -0,0 +1,505 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHorizon.cpp
+//
+// Front-to-back horizon culling against the min-max blocks of a terrain height field.
+//
+// A block box is clipped to the near plane and projected, and the convex hull of its
+// corners gives, for every column it fully spans, the lowest and highest screen y it
+// covers over the whole column: the top of a convex outline is concave and the bottom
+// convex, so both are found at the column edges. A block only raises a column if it
+// reaches down to what the column already has covered, so the covered part of every
+// column stays one interval from the bottom of the screen.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "TerrainHorizon.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+// Kept off both ends of every covered interval so rounding never claims an uncovered pixel
+const float COLUMN_EPSILON = 1e-4f;
+
+// Eight box corners, a corner and its clipped neighbours on the near plane
+const size_t MAX_OUTLINE_POINTS = 8 + 12;
+
+// Blocks are merged into their parents while the parent spans fewer columns than this
+const float MIN_BLOCK_COLUMNS = 4.0f;
+
+// Deep enough for a depth-first walk of any pyramid whose levels fit size_t
+const size_t MAX_TRAVERSAL_STACK = 4 * 64;
+
+struct TraversalNode
+{
+    size_t  level;
+    size_t  x;
+    size_t  z;
+};
+
+struct ScreenPoint
+{
+    float   x;
+    float   y;
+};
+
+//-------------------------------------------------------------------------------------
+// [x y z 1] * M for the corners of a box, corner i taking boxMax on axis a when bit a is set
+//-------------------------------------------------------------------------------------
+void TransformCorners( const float m[16], const float boxMin[3], const float boxMax[3], float clip[8][4] )
+{
+    for ( size_t i = 0; i < 8; ++i )
+    {
+        float x = ( i & 1 ) ? boxMax[0] : boxMin[0];
+        float y = ( i & 2 ) ? boxMax[1] : boxMin[1];
+        float z = ( i & 4 ) ? boxMax[2] : boxMin[2];
+        for ( size_t c = 0; c < 4; ++c )
+            clip[i][c] = x * m[c] + y * m[4 + c] + z * m[8 + c] + m[12 + c];
+    }
+}
+
+//-------------------------------------------------------------------------------------
+// Screen outline of the part of a box in front of the near plane (z >= 0 in clip space)
+//-------------------------------------------------------------------------------------
+size_t ClipAndProject( const float clip[8][4], ScreenPoint* points )
+{
+    size_t count = 0;
+    for ( size_t i = 0; i < 8; ++i )
+    {
+        if ( clip[i][2] >= 0.0f && clip[i][3] > 0.0f )
+        {
+            points[count].x = clip[i][0] / clip[i][3];
+            points[count].y = clip[i][1] / clip[i][3];
+            ++count;
+        }
+    }
+
+    // Edges join corners that differ in one bit
+    for ( size_t i = 0; i < 8; ++i )
+    {
+        for ( size_t bit = 1; bit < 8; bit <<= 1 )
+        {
+            if ( i & bit )
+                continue;
+
+            const float* a = clip[i];
+            const float* b = clip[i | bit];
+            if ( ( a[2] >= 0.0f ) == ( b[2] >= 0.0f ) )
+                continue;
+
+            float t = a[2] / ( a[2] - b[2] );
+            float w = a[3] + t * ( b[3] - a[3] );
+            if ( w <= 0.0f )
+                continue;
+
+            points[count].x = ( a[0] + t * ( b[0] - a[0] ) ) / w;
+            points[count].y = ( a[1] + t * ( b[1] - a[1] ) ) / w;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+float Cross( const ScreenPoint& o, const ScreenPoint& a, const ScreenPoint& b )
+{
+    return ( a.x - o.x ) * ( b.y - o.y ) - ( a.y - o.y ) * ( b.x - o.x );
+}
+
+//-------------------------------------------------------------------------------------
+// Lower and upper convex hull chains, both from the leftmost to the rightmost point
+//-------------------------------------------------------------------------------------
+void BuildHullChains( ScreenPoint* points, size_t count, ScreenPoint* lower, size_t& lowerCount, ScreenPoint* upper, size_t& upperCount )
+{
+    std::sort( points, points + count, []( const ScreenPoint& a, const ScreenPoint& b )
+    {
+        return a.x < b.x || ( a.x == b.x && a.y < b.y );
+    } );
+
+    lowerCount = 0;
+    upperCount = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        while ( lowerCount >= 2 && Cross( lower[lowerCount - 2], lower[lowerCount - 1], points[i] ) <= 0.0f )
+            --lowerCount;
+        lower[lowerCount++] = points[i];
+
+        while ( upperCount >= 2 && Cross( upper[upperCount - 2], upper[upperCount - 1], points[i] ) >= 0.0f )
+            --upperCount;
+        upper[upperCount++] = points[i];
+    }
+}
+
+//-------------------------------------------------------------------------------------
+// y of a hull chain at x, for x rising from call to call. A vertical end of the chain
+// gives its lower point for the lower chain and its upper point for the upper chain.
+//-------------------------------------------------------------------------------------
+float EvaluateChain( const ScreenPoint* chain, size_t count, float x, size_t& segment, bool upper )
+{
+    while ( segment + 2 < count && chain[segment + 1].x <= x )
+        ++segment;
+
+    const ScreenPoint& a = chain[segment];
+    const ScreenPoint& b = chain[segment + 1];
+    float dx = b.x - a.x;
+    if ( dx <= 0.0f )
+        return upper ? std::max( a.y, b.y ) : std::min( a.y, b.y );
+
+    float t = std::min( std::max( ( x - a.x ) / dx, 0.0f ), 1.0f );
+    return a.y + t * ( b.y - a.y );
+}
+
+float DistanceToBox( const float point[3], const float boxMin[3], const float boxMax[3] )
+{
+    float squared = 0.0f;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        float d = std::max( std::max( boxMin[axis] - point[axis], point[axis] - boxMax[axis] ), 0.0f );
+        squared += d * d;
+    }
+
+    return sqrtf( squared );
+}
+
+float FarthestCornerDistance( const float point[3], const float boxMin[3], const float boxMax[3] )
+{
+    float squared = 0.0f;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        float d = std::max( fabsf( point[axis] - boxMin[axis] ), fabsf( point[axis] - boxMax[axis] ) );
+        squared += d * d;
+    }
+
+    return sqrtf( squared );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainHorizon::TerrainHorizon() :
+    heightField( nullptr ),
+    level( 0 )
+{
+    desc.columns = 0;
+    desc.blockQuads = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHorizon::Build( const TerrainHeightField& heightField, const TerrainHorizonDesc& desc )
+{
+    if ( heightField.GetLevelCount() == 0 || desc.columns == 0 || desc.blockQuads == 0 || ( desc.blockQuads & ( desc.blockQuads - 1 ) ) )
+        return false;
+
+    this->heightField = &heightField;
+    this->desc = desc;
+
+    level = 0;
+    while ( ( (size_t)1 << ( level + 1 ) ) <= desc.blockQuads && level + 1 < heightField.GetLevelCount() )
+        ++level;
+
+    horizon.assign( desc.columns, -1.0f );
+    blocks.reserve( heightField.GetNodeCountX( level ) * heightField.GetNodeCountZ( level ) );
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Terrain space box of a pyramid node, from its lowest height down to the lowest of the
+// terrain; for a block this is the solid it stands for
+//-------------------------------------------------------------------------------------
+void TerrainHorizon::GetNodeBounds( size_t nodeLevel, size_t x, size_t z, float boxMin[3], float boxMax[3] ) const
+{
+    const TerrainHeightFieldDesc& field = heightField->GetDesc();
+    size_t lastColumn = heightField->GetWidth() - 1;
+    size_t lastRow = heightField->GetDepth() - 1;
+    float originX = -0.5f * float( lastColumn ) * field.spacingX;
+    float originZ = 0.5f * float( lastRow ) * field.spacingZ;
+
+    size_t x0 = x << nodeLevel, x1 = std::min( ( x + 1 ) << nodeLevel, lastColumn );
+    size_t z0 = z << nodeLevel, z1 = std::min( ( z + 1 ) << nodeLevel, lastRow );
+
+    boxMin[0] = originX + float( x0 ) * field.spacingX;
+    boxMax[0] = originX + float( x1 ) * field.spacingX;
+    boxMin[1] = heightField->GetNodeMinY( heightField->GetLevelCount() - 1, 0, 0 );
+    boxMax[1] = heightField->GetNodeMinY( nodeLevel, x, z );
+    boxMin[2] = originZ - float( z1 ) * field.spacingZ;
+    boxMax[2] = originZ - float( z0 ) * field.spacingZ;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Blocks in view and nearer than farthest, found by walking the pyramid down from its
+// single top node so whole regions out of view or out of reach are skipped at once
+//-------------------------------------------------------------------------------------
+void TerrainHorizon::GatherBlocks( const float viewProjection[16], const float cameraPosition[3], float farthest )
+{
+    // Left, right, bottom, top and near planes, a*x + b*y + c*z + d >= 0 inside. Blocks
+    // beyond the far plane still hide what is drawn in front of it.
+    float planes[5][4];
+    for ( size_t i = 0; i < 4; ++i )
+    {
+        float x = viewProjection[i * 4], y = viewProjection[i * 4 + 1], z = viewProjection[i * 4 + 2], w = viewProjection[i * 4 + 3];
+        planes[0][i] = w + x;
+        planes[1][i] = w - x;
+        planes[2][i] = w + y;
+        planes[3][i] = w - y;
+        planes[4][i] = z;
+    }
+
+    // Columns per unit of width at unit distance, from the projection's x scale
+    float columnScale = 0.5f * float( desc.columns ) * sqrtf( viewProjection[0] * viewProjection[0] + viewProjection[4] * viewProjection[4] + viewProjection[8] * viewProjection[8] );
+
+    TraversalNode stack[MAX_TRAVERSAL_STACK];
+    size_t stackSize = 0;
+    TraversalNode root = { heightField->GetLevelCount() - 1, 0, 0 };
+    stack[stackSize++] = root;
+
+    while ( stackSize )
+    {
+        TraversalNode node = stack[--stackSize];
+
+        // Every block under the node lies in this box
+        float boxMin[3], boxMax[3];
+        GetNodeBounds( node.level, node.x, node.z, boxMin, boxMax );
+        boxMax[1] = heightField->GetNodeMaxY( node.level, node.x, node.z );
+        if ( DistanceToBox( cameraPosition, boxMin, boxMax ) >= farthest )
+            continue;
+
+        bool outside = false;
+        for ( size_t p = 0; p < 5 && !outside; ++p )
+        {
+            const float* plane = planes[p];
+            float x = plane[0] >= 0.0f ? boxMax[0] : boxMin[0];
+            float y = plane[1] >= 0.0f ? boxMax[1] : boxMin[1];
+            float z = plane[2] >= 0.0f ? boxMax[2] : boxMin[2];
+            outside = plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f;
+        }
+        if ( outside )
+            continue;
+
+        // Far enough away for the whole node to cover only a few columns, it stands in for its blocks
+        float side = std::max( boxMax[0] - boxMin[0], boxMax[2] - boxMin[2] );
+        bool coarseEnough = node.level <= level || side * columnScale < MIN_BLOCK_COLUMNS * DistanceToBox( cameraPosition, boxMin, boxMax );
+        if ( coarseEnough )
+        {
+            GetNodeBounds( node.level, node.x, node.z, boxMin, boxMax );
+            Block block = { FarthestCornerDistance( cameraPosition, boxMin, boxMax ), uint32_t( node.level ), uint32_t( node.x ), uint32_t( node.z ) };
+            if ( block.farDistance < farthest )
+                blocks.push_back( block );
+            continue;
+        }
+
+        size_t childLevel = node.level - 1;
+        size_t childrenX = heightField->GetNodeCountX( childLevel );
+        size_t childrenZ = heightField->GetNodeCountZ( childLevel );
+        for ( size_t z = 2 * node.z; z < std::min( 2 * node.z + 2, childrenZ ); ++z )
+        {
+            for ( size_t x = 2 * node.x; x < std::min( 2 * node.x + 2, childrenX ); ++x )
+            {
+                TraversalNode child = { childLevel, x, z };
+                stack[stackSize++] = child;
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+// Raises every column the block covers from the current horizon upwards
+//-------------------------------------------------------------------------------------
+bool TerrainHorizon::AddBlock( const float viewProjection[16], const Block& block )
+{
+    float boxMin[3], boxMax[3];
+    GetNodeBounds( block.level, block.x, block.z, boxMin, boxMax );
+
+    float clip[8][4];
+    TransformCorners( viewProjection, boxMin, boxMax, clip );
+
+    ScreenPoint points[MAX_OUTLINE_POINTS];
+    size_t count = ClipAndProject( clip, points );
+    if ( count < 3 )
+        return false;
+
+    // Most blocks behind a ridge stay under the horizon everywhere, which needs no outline
+    float minX = points[0].x, maxX = points[0].x, maxY = points[0].y;
+    for ( size_t i = 1; i < count; ++i )
+    {
+        minX = std::min( minX, points[i].x );
+        maxX = std::max( maxX, points[i].x );
+        maxY = std::max( maxY, points[i].y );
+    }
+    if ( maxX < -1.0f || minX > 1.0f )
+        return false;
+
+    float scale = 0.5f * float( desc.columns );
+    size_t firstColumn = size_t( std::max( ( minX + 1.0f ) * scale, 0.0f ) );
+    size_t lastColumn = std::min( size_t( std::min( ( maxX + 1.0f ) * scale, float( desc.columns ) ) ), desc.columns - 1 );
+    bool below = true;
+    for ( size_t column = firstColumn; column <= lastColumn && below; ++column )
+        below = maxY - COLUMN_EPSILON <= horizon[column];
+    if ( below )
+        return false;
+
+    ScreenPoint lower[MAX_OUTLINE_POINTS], upper[MAX_OUTLINE_POINTS];
+    size_t lowerCount, upperCount;
+    BuildHullChains( points, count, lower, lowerCount, upper, upperCount );
+    if ( lowerCount < 2 || upperCount < 2 )
+        return false;
+
+    // Only columns the outline spans from edge to edge
+    float columnWidth = 2.0f / float( desc.columns );
+    float first = ceilf( ( lower[0].x + 1.0f ) / columnWidth );
+    float end = floorf( ( lower[lowerCount - 1].x + 1.0f ) / columnWidth );
+    if ( first < 0.0f )
+        first = 0.0f;
+    if ( end > float( desc.columns ) )
+        end = float( desc.columns );
+    if ( first >= end )
+        return false;
+
+    size_t lowerSegment = 0, upperSegment = 0;
+    float edgeX = -1.0f + first * columnWidth;
+    float edgeLow = EvaluateChain( lower, lowerCount, edgeX, lowerSegment, false );
+    float edgeHigh = EvaluateChain( upper, upperCount, edgeX, upperSegment, true );
+
+    bool raised = false;
+    for ( size_t column = size_t( first ); column < size_t( end ); ++column )
+    {
+        edgeX = -1.0f + float( column + 1 ) * columnWidth;
+        float nextLow = EvaluateChain( lower, lowerCount, edgeX, lowerSegment, false );
+        float nextHigh = EvaluateChain( upper, upperCount, edgeX, upperSegment, true );
+
+        float low = std::max( edgeLow, nextLow ) + COLUMN_EPSILON;
+        float high = std::min( edgeHigh, nextHigh ) - COLUMN_EPSILON;
+        if ( low <= horizon[column] && high > horizon[column] )
+        {
+            horizon[column] = std::min( high, 1.0f );
+            raised = true;
+        }
+
+        edgeLow = nextLow;
+        edgeHigh = nextHigh;
+    }
+
+    return raised;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainHorizon::IsOccluded( const float viewProjection[16], const TerrainHorizonBounds& bounds ) const
+{
+    float clip[8][4];
+    TransformCorners( viewProjection, bounds.boundsMin, bounds.boundsMax, clip );
+
+    float minX = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    for ( size_t i = 0; i < 8; ++i )
+    {
+        // Anything reaching past the near plane is too close to be hidden
+        if ( clip[i][2] < 0.0f || clip[i][3] <= 0.0f )
+            return false;
+
+        float x = clip[i][0] / clip[i][3];
+        float y = clip[i][1] / clip[i][3];
+        minX = std::min( minX, x );
+        maxX = std::max( maxX, x );
+        maxY = std::max( maxY, y );
+    }
+
+    // Objects off the screen are left to frustum culling
+    if ( maxX < -1.0f || minX > 1.0f || maxY < -1.0f || maxY >= 1.0f )
+        return false;
+
+    float scale = 0.5f * float( desc.columns );
+    size_t first = size_t( std::max( ( minX + 1.0f ) * scale, 0.0f ) );
+    size_t last = std::min( size_t( std::min( ( maxX + 1.0f ) * scale, float( desc.columns ) ) ), desc.columns - 1 );
+    for ( size_t column = first; column <= last; ++column )
+    {
+        if ( !( maxY < horizon[column] ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainHorizon::Cull( const float viewProjection[16],
+                           const float cameraPosition[3],
+                           const TerrainHorizonBounds* objects,
+                           size_t count,
+                           std::vector<uint8_t>& occluded,
+                           TerrainHorizonStats* stats )
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    occluded.assign( count, 0 );
+    horizon.assign( desc.columns, -1.0f );
+    blocks.clear();
+    order.clear();
+
+    TerrainHorizonStats frame = {};
+    frame.objectsTested = count;
+
+    // Under the surface only counts as solid when looked at from above it, inside the grid
+    bool aboveSurface = false;
+    if ( heightField && count )
+    {
+        const TerrainHeightFieldDesc& field = heightField->GetDesc();
+        size_t lastColumn = heightField->GetWidth() - 1;
+        size_t lastRow = heightField->GetDepth() - 1;
+        float gx = ( cameraPosition[0] + 0.5f * float( lastColumn ) * field.spacingX ) / field.spacingX;
+        float gz = ( 0.5f * float( lastRow ) * field.spacingZ - cameraPosition[2] ) / field.spacingZ;
+        if ( gx >= 0.0f && gz >= 0.0f && gx <= float( lastColumn ) && gz <= float( lastRow ) )
+        {
+            size_t cellX = std::min( size_t( gx ), lastColumn - 1 );
+            size_t cellZ = std::min( size_t( gz ), lastRow - 1 );
+            aboveSurface = cameraPosition[1] > heightField->GetNodeMaxY( 0, cellX, cellZ );
+        }
+    }
+
+    if ( aboveSurface )
+    {
+        // Objects nearest first; blocks beyond the farthest object can never be needed
+        for ( size_t i = 0; i < count; ++i )
+        {
+            Object object = { DistanceToBox( cameraPosition, objects[i].boundsMin, objects[i].boundsMax ), i };
+            order.push_back( object );
+        }
+        std::sort( order.begin(), order.end(), []( const Object& a, const Object& b ) { return a.nearDistance < b.nearDistance; } );
+        float farthest = order.back().nearDistance;
+
+        GatherBlocks( viewProjection, cameraPosition, farthest );
+        std::sort( blocks.begin(), blocks.end(), []( const Block& a, const Block& b ) { return a.farDistance < b.farDistance; } );
+        frame.blocksConsidered = blocks.size();
+
+        // Each object sees only the blocks wholly nearer than it, so whatever covers it is in front
+        size_t next = 0;
+        for ( size_t i = 0; i < order.size(); ++i )
+        {
+            for ( ; next < blocks.size() && blocks[next].farDistance < order[i].nearDistance; ++next )
+            {
+                if ( AddBlock( viewProjection, blocks[next] ) )
+                    ++frame.blocksAdded;
+            }
+
+            if ( IsOccluded( viewProjection, objects[order[i].index] ) )
+            {
+                occluded[order[i].index] = 1;
+                ++frame.objectsOccluded;
+            }
+        }
+    }
+
+    if ( stats )
+    {
+        frame.seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+        *stats = frame;
+    }
+}
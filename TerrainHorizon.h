@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHorizon.h
+//
+// Culls objects hidden behind the terrain with a per-frame horizon in screen columns.
+//
+// Everything under the terrain surface is solid as seen from a camera above it, so each
+// block of the height field's min-max pyramid, from its lowest height down to the lowest
+// height of the whole terrain, is an occluder. Blocks are projected in front-to-back order
+// and every screen column keeps the highest point up to which it is covered, starting from
+// the bottom of the screen. An object is tested once every block wholly nearer than it has
+// been added, and is hidden when its projected bounds stay under the horizon in all of its
+// columns. The test is conservative for the full-resolution surface; it is skipped when the
+// camera is outside the grid or below the surface. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINHORIZON_H
+#define TERRAINHORIZON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "TerrainHeightField.h"
+
+namespace DirectX
+{
+    struct TerrainHorizonDesc
+    {
+        size_t      columns;            // horizon resolution across the screen
+        size_t      blockQuads;         // power of two, quads along an occluder block side
+    };
+
+    // An axis-aligned box in terrain space
+    struct TerrainHorizonBounds
+    {
+        float       boundsMin[3];
+        float       boundsMax[3];
+    };
+
+    struct TerrainHorizonStats
+    {
+        size_t      blocksConsidered;   // in view and nearer than the farthest object
+        size_t      blocksAdded;        // raised the horizon in at least one column
+        size_t      objectsTested;
+        size_t      objectsOccluded;
+        double      seconds;
+    };
+
+    class TerrainHorizon
+    {
+    public:
+        TerrainHorizon();
+
+        // The height field is referenced, not copied, and must outlive the horizon. Changes
+        // made through its UpdateRegion are seen by the next Cull.
+        bool Build( const TerrainHeightField& heightField, const TerrainHorizonDesc& desc );
+
+        // occluded[i] is set to 1 for objects[i] hidden behind the terrain and 0 otherwise.
+        // viewProjection maps terrain space to clip space ([x y z 1] * M, rows stored first,
+        // as XMFLOAT4X4 does); cameraPosition is in terrain space. stats is optional.
+        void Cull( const float viewProjection[16],
+                   const float cameraPosition[3],
+                   const TerrainHorizonBounds* objects,
+                   size_t count,
+                   std::vector<uint8_t>& occluded,
+                   TerrainHorizonStats* stats = nullptr );
+
+        // Per column, normalized device y up to which the screen was covered when the last
+        // object of the last Cull was tested (-1 where nothing was)
+        const std::vector<float>& GetHorizon() const { return horizon; }
+
+    private:
+        struct Block
+        {
+            float       farDistance;
+            uint32_t    level;
+            uint32_t    x;
+            uint32_t    z;
+        };
+
+        struct Object
+        {
+            float       nearDistance;
+            size_t      index;
+        };
+
+        void GatherBlocks( const float viewProjection[16], const float cameraPosition[3], float farthest );
+        bool AddBlock( const float viewProjection[16], const Block& block );
+        bool IsOccluded( const float viewProjection[16], const TerrainHorizonBounds& bounds ) const;
+        void GetNodeBounds( size_t nodeLevel, size_t x, size_t z, float boxMin[3], float boxMax[3] ) const;
+
+        const TerrainHeightField*   heightField;
+        TerrainHorizonDesc          desc;
+        size_t                      level;      // pyramid level of the blocks
+        std::vector<float>          horizon;
+        std::vector<Block>          blocks;
+        std::vector<Object>         order;
+    };
+}
+
+#endif // TERRAINHORIZON_H
@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainNormals.cpp
+//
+// Central difference terrain normals, row parallel with an SSE inner loop.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "TerrainNormals.h"
+#include "ParallelFor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define NORMALS_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+//-------------------------------------------------------------------------------------
+// One sample; the slope terms are already divided by the distance they span
+//-------------------------------------------------------------------------------------
+inline void StoreNormal( float slopeX, float slopeZ, float* normal )
+{
+    float length = sqrtf( slopeX * slopeX + 1.0f + slopeZ * slopeZ );
+    normal[0] = slopeX / length;
+    normal[1] = 1.0f / length;
+    normal[2] = slopeZ / length;
+}
+
+//-------------------------------------------------------------------------------------
+// Columns [x0, x1) of one row. up and down are the neighbouring rows (the row itself on
+// the grid edges), zScale is heightScale over the distance between them.
+//-------------------------------------------------------------------------------------
+void RowNormals( const float* row,
+                 const float* up,
+                 const float* down,
+                 size_t width,
+                 size_t x0,
+                 size_t x1,
+                 float xScale,
+                 float zScale,
+                 float edgeXScale,
+                 float* normals )
+{
+    size_t x = x0;
+
+    // Left edge, one-sided
+    if ( x == 0 && x < x1 )
+    {
+        size_t right = std::min<size_t>( 1, width - 1 );
+        StoreNormal( ( row[0] - row[right] ) * edgeXScale, ( down[0] - up[0] ) * zScale, normals );
+        ++x;
+    }
+
+    size_t interiorEnd = std::min( x1, width - 1 );
+
+#ifdef NORMALS_USE_SSE
+    const __m128 xs = _mm_set1_ps( xScale );
+    const __m128 zs = _mm_set1_ps( zScale );
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 half = _mm_set1_ps( 0.5f );
+    const __m128 three = _mm_set1_ps( 3.0f );
+
+    for ( ; x + 4 <= interiorEnd; x += 4 )
+    {
+        __m128 slopeX = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( row + x - 1 ), _mm_loadu_ps( row + x + 1 ) ), xs );
+        __m128 slopeZ = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( down + x ), _mm_loadu_ps( up + x ) ), zs );
+
+        // Reciprocal square root estimate refined by one Newton-Raphson step
+        __m128 lengthSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( slopeX, slopeX ), one ), _mm_mul_ps( slopeZ, slopeZ ) );
+        __m128 estimate = _mm_rsqrt_ps( lengthSq );
+        __m128 inverse = _mm_mul_ps( _mm_mul_ps( half, estimate ),
+                                     _mm_sub_ps( three, _mm_mul_ps( _mm_mul_ps( lengthSq, estimate ), estimate ) ) );
+
+        __m128 nx = _mm_mul_ps( slopeX, inverse );
+        __m128 ny = inverse;
+        __m128 nz = _mm_mul_ps( slopeZ, inverse );
+
+        // Four (x, y, z) triples, written as three unaligned quads
+        __m128 xyLow = _mm_unpacklo_ps( nx, ny );                                           // x0 y0 x1 y1
+        __m128 xyHigh = _mm_unpackhi_ps( nx, ny );                                          // x2 y2 x3 y3
+        __m128 zLow = _mm_unpacklo_ps( nz, nz );                                            // z0 z0 z1 z1
+        __m128 zHigh = _mm_unpackhi_ps( nz, nz );                                           // z2 z2 z3 z3
+
+        __m128 z0x1 = _mm_shuffle_ps( zLow, xyLow, _MM_SHUFFLE( 2, 2, 0, 0 ) );             // z0 z0 x1 x1
+        __m128 y1z1 = _mm_shuffle_ps( xyLow, zLow, _MM_SHUFFLE( 2, 2, 3, 3 ) );             // y1 y1 z1 z1
+        __m128 z2x3 = _mm_shuffle_ps( zHigh, xyHigh, _MM_SHUFFLE( 2, 2, 0, 0 ) );           // z2 z2 x3 x3
+        __m128 y3z3 = _mm_shuffle_ps( xyHigh, zHigh, _MM_SHUFFLE( 2, 2, 3, 3 ) );           // y3 y3 z3 z3
+
+        __m128 q0 = _mm_shuffle_ps( xyLow, z0x1, _MM_SHUFFLE( 2, 0, 1, 0 ) );               // x0 y0 z0 x1
+        __m128 q1 = _mm_shuffle_ps( y1z1, xyHigh, _MM_SHUFFLE( 1, 0, 2, 0 ) );              // y1 z1 x2 y2
+        __m128 q2 = _mm_shuffle_ps( z2x3, y3z3, _MM_SHUFFLE( 2, 0, 2, 0 ) );                // z2 x3 y3 z3
+
+        float* out = normals + ( x - x0 ) * 3;
+        _mm_storeu_ps( out, q0 );
+        _mm_storeu_ps( out + 4, q1 );
+        _mm_storeu_ps( out + 8, q2 );
+    }
+#endif
+
+    for ( ; x < interiorEnd; ++x )
+        StoreNormal( ( row[x - 1] - row[x + 1] ) * xScale, ( down[x] - up[x] ) * zScale, normals + ( x - x0 ) * 3 );
+
+    // Right edge, one-sided
+    if ( x < x1 )
+    {
+        size_t left = x ? x - 1 : 0;
+        StoreNormal( ( row[left] - row[x] ) * edgeXScale, ( down[x] - up[x] ) * zScale, normals + ( x - x0 ) * 3 );
+    }
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::UpdateTerrainNormals( const float* heights,
+                                    size_t width,
+                                    size_t depth,
+                                    const TerrainNormalDesc& desc,
+                                    size_t x0,
+                                    size_t z0,
+                                    size_t x1,
+                                    size_t z1,
+                                    float* normals,
+                                    TerrainNormalStats* stats,
+                                    unsigned int threadCount )
+{
+    if ( !heights || !normals || width < 2 || depth < 2 )
+        return false;
+
+    if ( desc.spacingX <= 0.0f || desc.spacingZ <= 0.0f )
+        return false;
+
+    x1 = std::min( x1, width );
+    z1 = std::min( z1, depth );
+    if ( x0 >= x1 || z0 >= z1 )
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    float xScale = desc.heightScale / ( 2.0f * desc.spacingX );
+    float edgeXScale = desc.heightScale / desc.spacingX;
+
+    ParallelFor( z1 - z0, threadCount, [&]( size_t index )
+    {
+        size_t z = z0 + index;
+        size_t up = z ? z - 1 : 0;
+        size_t down = std::min( z + 1, depth - 1 );
+        float zScale = desc.heightScale / ( float( down - up ) * desc.spacingZ );
+
+        RowNormals( heights + z * width,
+                    heights + up * width,
+                    heights + down * width,
+                    width, x0, x1,
+                    xScale, zScale, edgeXScale,
+                    normals + ( z * width + x0 ) * 3 );
+    } );
+
+    if ( stats )
+    {
+        double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+        stats->vertices = ( x1 - x0 ) * ( z1 - z0 );
+        stats->seconds = seconds;
+        stats->megaVerticesPerSecond = ( seconds > 0.0 ) ? double( stats->vertices ) / seconds / 1e6 : 0.0;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::ComputeTerrainNormals( const float* heights,
+                                     size_t width,
+                                     size_t depth,
+                                     const TerrainNormalDesc& desc,
+                                     float* normals,
+                                     TerrainNormalStats* stats,
+                                     unsigned int threadCount )
+{
+    return UpdateTerrainNormals( heights, width, depth, desc, 0, 0, width, depth, normals, stats, threadCount );
+}
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainNormals.h
+//
+// Vertex normals for a heightmap grid from central differences of the heights.
+//
+// Each sample's normal is (-dh/dx, 1, -dh/dz) normalised, with the slopes taken between
+// its left/right and up/down neighbours (one-sided on the grid edges). Rows are spread
+// over worker threads and four samples of a row are done at a time with SSE when
+// available. A sub-rectangle can be recomputed on its own after the heights under it
+// change. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINNORMALS_H
+#define TERRAINNORMALS_H
+
+#include <stddef.h>
+
+namespace DirectX
+{
+    struct TerrainNormalDesc
+    {
+        float       spacingX;           // world units between height samples
+        float       spacingZ;
+        float       heightScale;        // applied to the height samples
+    };
+
+    struct TerrainNormalStats
+    {
+        size_t      vertices;
+        double      seconds;                // wall clock
+        double      megaVerticesPerSecond;
+    };
+
+    // Writes three floats per sample of a width x depth height grid (row 0 is the far, +Z
+    // edge, as BuildTerrainTiles lays it out). threadCount of 0 uses every hardware thread.
+    bool ComputeTerrainNormals( const float* heights,
+                                size_t width,
+                                size_t depth,
+                                const TerrainNormalDesc& desc,
+                                float* normals,
+                                TerrainNormalStats* stats = nullptr,
+                                unsigned int threadCount = 0 );
+
+    // Recomputes the normals of samples [x0, x1) x [z0, z1) only, reading the heights
+    // around them as needed. Changing a height affects the normals one sample around it.
+    bool UpdateTerrainNormals( const float* heights,
+                               size_t width,
+                               size_t depth,
+                               const TerrainNormalDesc& desc,
+                               size_t x0,
+                               size_t z0,
+                               size_t x1,
+                               size_t z1,
+                               float* normals,
+                               TerrainNormalStats* stats = nullptr,
+                               unsigned int threadCount = 0 );
+}
+
+#endif // TERRAINNORMALS_H
@@ -0,0 +1,425 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtree.cpp
+//
+// CDLOD quadtree construction and per-camera node selection.
+//--------------------------------------------------------------------------------------
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "TerrainQuadtree.h"
+#include "ParallelFor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define QUADTREE_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+
+// The top level is never merged further, so it never morphs
+const float NO_MORPH_DISTANCE = 1e30f;
+
+//-------------------------------------------------------------------------------------
+// Four node boxes, one per lane
+//-------------------------------------------------------------------------------------
+struct Box4
+{
+    float   minX[4];
+    float   maxX[4];
+    float   minY[4];
+    float   maxY[4];
+    float   minZ[4];
+    float   maxZ[4];
+};
+
+#ifdef QUADTREE_USE_SSE
+
+// Bit i is set if box i is at least partly on the inside of every plane
+int FrustumMask( const Box4& box, const float planes[6][4] )
+{
+    __m128 minX = _mm_loadu_ps( box.minX ), maxX = _mm_loadu_ps( box.maxX );
+    __m128 minY = _mm_loadu_ps( box.minY ), maxY = _mm_loadu_ps( box.maxY );
+    __m128 minZ = _mm_loadu_ps( box.minZ ), maxZ = _mm_loadu_ps( box.maxZ );
+    __m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+
+    for ( int p = 0; p < 6; ++p )
+    {
+        // Corner furthest along the plane normal
+        __m128 x = planes[p][0] >= 0.0f ? maxX : minX;
+        __m128 y = planes[p][1] >= 0.0f ? maxY : minY;
+        __m128 z = planes[p][2] >= 0.0f ? maxZ : minZ;
+
+        __m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( planes[p][0] ) ),
+                                                  _mm_mul_ps( y, _mm_set1_ps( planes[p][1] ) ) ),
+                                      _mm_add_ps( _mm_mul_ps( z, _mm_set1_ps( planes[p][2] ) ),
+                                                  _mm_set1_ps( planes[p][3] ) ) );
+        inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, _mm_setzero_ps() ) );
+    }
+
+    return _mm_movemask_ps( inside );
+}
+
+// Bit i is set if box i reaches within range of the camera
+int RangeMask( const Box4& box, const float camera[3], float range )
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_set1_ps( camera[0] ), cy = _mm_set1_ps( camera[1] ), cz = _mm_set1_ps( camera[2] );
+
+    __m128 dx = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( box.minX ), cx ), _mm_sub_ps( cx, _mm_loadu_ps( box.maxX ) ) ), zero );
+    __m128 dy = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( box.minY ), cy ), _mm_sub_ps( cy, _mm_loadu_ps( box.maxY ) ) ), zero );
+    __m128 dz = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( box.minZ ), cz ), _mm_sub_ps( cz, _mm_loadu_ps( box.maxZ ) ) ), zero );
+
+    __m128 distanceSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+    return _mm_movemask_ps( _mm_cmple_ps( distanceSq, _mm_set1_ps( range * range ) ) );
+}
+
+#else
+
+int FrustumMask( const Box4& box, const float planes[6][4] )
+{
+    int mask = 0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        bool inside = true;
+        for ( int p = 0; p < 6 && inside; ++p )
+        {
+            float x = planes[p][0] >= 0.0f ? box.maxX[i] : box.minX[i];
+            float y = planes[p][1] >= 0.0f ? box.maxY[i] : box.minY[i];
+            float z = planes[p][2] >= 0.0f ? box.maxZ[i] : box.minZ[i];
+            inside = x * planes[p][0] + y * planes[p][1] + z * planes[p][2] + planes[p][3] >= 0.0f;
+        }
+        mask |= inside ? ( 1 << i ) : 0;
+    }
+    return mask;
+}
+
+int RangeMask( const Box4& box, const float camera[3], float range )
+{
+    int mask = 0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        float dx = std::max( std::max( box.minX[i] - camera[0], camera[0] - box.maxX[i] ), 0.0f );
+        float dy = std::max( std::max( box.minY[i] - camera[1], camera[1] - box.maxY[i] ), 0.0f );
+        float dz = std::max( std::max( box.minZ[i] - camera[2], camera[2] - box.maxZ[i] ), 0.0f );
+        mask |= ( dx * dx + dy * dy + dz * dz <= range * range ) ? ( 1 << i ) : 0;
+    }
+    return mask;
+}
+
+#endif
+
+};
+
+
+//-------------------------------------------------------------------------------------
+struct TerrainQuadtree::SelectContext
+{
+    const float*                        camera;
+    const float                         ( *planes )[4];
+    std::vector<TerrainNodeSelection>*  selection;
+    TerrainSelectStats                  stats;
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainQuadtree::TerrainQuadtree()
+    : width( 0 ),
+      depth( 0 ),
+      originX( 0.0f ),
+      originZ( 0.0f )
+{
+    memset( &desc, 0, sizeof( desc ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainQuadtree::Build( const float* heights,
+                             size_t width,
+                             size_t depth,
+                             const TerrainQuadtreeDesc& desc,
+                             unsigned int threadCount )
+{
+    if ( !heights || width < 2 || depth < 2 || !desc.lodCount || desc.lodCount > 16 )
+        return false;
+
+    if ( !desc.leafQuads || ( desc.leafQuads & ( desc.leafQuads - 1 ) ) != 0 )
+        return false;
+
+    this->desc = desc;
+    this->width = width;
+    this->depth = depth;
+    originX = -0.5f * float( width - 1 ) * desc.spacingX;
+    originZ = 0.5f * float( depth - 1 ) * desc.spacingZ;
+
+    levels.resize( desc.lodCount );
+    for ( size_t lod = 0; lod < desc.lodCount; ++lod )
+    {
+        size_t nodeQuads = desc.leafQuads << lod;
+        Level& level = levels[lod];
+        level.nodesX = ( width - 2 ) / nodeQuads + 1;
+        level.nodesZ = ( depth - 2 ) / nodeQuads + 1;
+        level.minY.assign( level.nodesX * level.nodesZ, 0.0f );
+        level.maxY.assign( level.nodesX * level.nodesZ, 0.0f );
+    }
+
+    // Leaves from the samples they cover, edges included so neighbours share them
+    Level& leaves = levels[0];
+    ParallelFor( leaves.nodesZ, threadCount, [&]( size_t z )
+    {
+        for ( size_t x = 0; x < leaves.nodesX; ++x )
+        {
+            UpdateLeaf( heights, x, z );
+        }
+    } );
+
+    // Every other level from the children it covers
+    for ( size_t lod = 1; lod < desc.lodCount; ++lod )
+    {
+        for ( size_t z = 0; z < levels[lod].nodesZ; ++z )
+        {
+            for ( size_t x = 0; x < levels[lod].nodesX; ++x )
+            {
+                UpdateParent( lod, x, z );
+            }
+        }
+    }
+
+    // Ranges double per level; each level morphs over the outer part of its band
+    ranges.resize( desc.lodCount );
+    morphStart.resize( desc.lodCount );
+    morphEnd.resize( desc.lodCount );
+
+    float previousRange = 0.0f;
+    for ( size_t lod = 0; lod < desc.lodCount; ++lod )
+    {
+        ranges[lod] = desc.firstLodRange * float( 1u << lod );
+        morphEnd[lod] = ranges[lod];
+        morphStart[lod] = previousRange + ( ranges[lod] - previousRange ) * desc.morphStartRatio;
+        previousRange = ranges[lod];
+    }
+    morphStart[desc.lodCount - 1] = NO_MORPH_DISTANCE;
+    morphEnd[desc.lodCount - 1] = NO_MORPH_DISTANCE;
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainQuadtree::UpdateRegion( const float* heights, size_t x0, size_t z0, size_t x1, size_t z1 )
+{
+    if ( !heights || levels.empty() )
+        return;
+
+    x1 = std::min( x1, width );
+    z1 = std::min( z1, depth );
+    if ( x0 >= x1 || z0 >= z1 )
+        return;
+
+    // Leaves share their edge samples, so a sample on a leaf edge is in up to four of them
+    size_t nodeX0 = x0 ? ( x0 - 1 ) / desc.leafQuads : 0;
+    size_t nodeZ0 = z0 ? ( z0 - 1 ) / desc.leafQuads : 0;
+    size_t nodeX1 = ( x1 - 1 ) / desc.leafQuads + 1;
+    size_t nodeZ1 = ( z1 - 1 ) / desc.leafQuads + 1;
+
+    for ( size_t lod = 0; lod < desc.lodCount; ++lod )
+    {
+        nodeX1 = std::min( nodeX1, levels[lod].nodesX );
+        nodeZ1 = std::min( nodeZ1, levels[lod].nodesZ );
+
+        for ( size_t z = nodeZ0; z < nodeZ1; ++z )
+        {
+            for ( size_t x = nodeX0; x < nodeX1; ++x )
+            {
+                if ( lod )
+                    UpdateParent( lod, x, z );
+                else
+                    UpdateLeaf( heights, x, z );
+            }
+        }
+
+        // The parents of those nodes
+        nodeX0 /= 2;
+        nodeZ0 /= 2;
+        nodeX1 = ( nodeX1 + 1 ) / 2;
+        nodeZ1 = ( nodeZ1 + 1 ) / 2;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainQuadtree::UpdateLeaf( const float* heights, size_t x, size_t z )
+{
+    Level& leaves = levels[0];
+    size_t z0 = z * desc.leafQuads;
+    size_t z1 = std::min( z0 + desc.leafQuads, depth - 1 );
+    size_t x0 = x * desc.leafQuads;
+    size_t x1 = std::min( x0 + desc.leafQuads, width - 1 );
+
+    float lo = heights[z0 * width + x0];
+    float hi = lo;
+    for ( size_t row = z0; row <= z1; ++row )
+    {
+        const float* sample = heights + row * width;
+        for ( size_t column = x0; column <= x1; ++column )
+        {
+            lo = std::min( lo, sample[column] );
+            hi = std::max( hi, sample[column] );
+        }
+    }
+
+    // A negative scale swaps which sample ends up lowest
+    float a = lo * desc.heightScale;
+    float b = hi * desc.heightScale;
+    leaves.minY[z * leaves.nodesX + x] = std::min( a, b );
+    leaves.maxY[z * leaves.nodesX + x] = std::max( a, b );
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainQuadtree::UpdateParent( size_t lod, size_t x, size_t z )
+{
+    const Level& children = levels[lod - 1];
+    Level& level = levels[lod];
+
+    float lo = children.minY[( 2 * z ) * children.nodesX + 2 * x];
+    float hi = children.maxY[( 2 * z ) * children.nodesX + 2 * x];
+
+    for ( size_t cz = 2 * z; cz < std::min( 2 * z + 2, children.nodesZ ); ++cz )
+    {
+        for ( size_t cx = 2 * x; cx < std::min( 2 * x + 2, children.nodesX ); ++cx )
+        {
+            lo = std::min( lo, children.minY[cz * children.nodesX + cx] );
+            hi = std::max( hi, children.maxY[cz * children.nodesX + cx] );
+        }
+    }
+
+    level.minY[z * level.nodesX + x] = lo;
+    level.maxY[z * level.nodesX + x] = hi;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Tests up to four nodes of one level together; visible nodes are either selected or,
+// if they reach into the next finer level's range, replaced by their children.
+//-------------------------------------------------------------------------------------
+void TerrainQuadtree::SelectGroup( SelectContext& context, size_t lod, const uint32_t* nodeX, const uint32_t* nodeZ, size_t count ) const
+{
+    const Level& level = levels[lod];
+    uint32_t nodeQuads = uint32_t( desc.leafQuads << lod );
+
+    Box4 box;
+    for ( size_t i = 0; i < 4; ++i )
+    {
+        // Unused lanes repeat the first node and are masked off below
+        size_t n = i < count ? i : 0;
+        size_t x0 = size_t( nodeX[n] ) * nodeQuads;
+        size_t z0 = size_t( nodeZ[n] ) * nodeQuads;
+        size_t x1 = std::min( x0 + nodeQuads, width - 1 );
+        size_t z1 = std::min( z0 + nodeQuads, depth - 1 );
+
+        box.minX[i] = originX + float( x0 ) * desc.spacingX;
+        box.maxX[i] = originX + float( x1 ) * desc.spacingX;
+        box.minZ[i] = originZ - float( z1 ) * desc.spacingZ;
+        box.maxZ[i] = originZ - float( z0 ) * desc.spacingZ;
+        box.minY[i] = level.minY[nodeZ[n] * level.nodesX + nodeX[n]];
+        box.maxY[i] = level.maxY[nodeZ[n] * level.nodesX + nodeX[n]];
+    }
+
+    int used = ( 1 << count ) - 1;
+    int visible = FrustumMask( box, context.planes ) & used;
+    int split = lod > 0 ? RangeMask( box, context.camera, ranges[lod - 1] ) & visible : 0;
+
+    context.stats.nodesVisited += count;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( !( visible & ( 1 << i ) ) )
+        {
+            ++context.stats.nodesCulled;
+            continue;
+        }
+
+        if ( !( split & ( 1 << i ) ) )
+        {
+            TerrainNodeSelection node;
+            node.gridX = nodeX[i] * nodeQuads;
+            node.gridZ = nodeZ[i] * nodeQuads;
+            node.size = nodeQuads;
+            node.lod = uint32_t( lod );
+            node.morphStart = morphStart[lod];
+            node.morphEnd = morphEnd[lod];
+            context.selection->push_back( node );
+            ++context.stats.nodesSelected;
+            continue;
+        }
+
+        const Level& children = levels[lod - 1];
+        uint32_t childX[4];
+        uint32_t childZ[4];
+        size_t childCount = 0;
+        for ( uint32_t cz = nodeZ[i] * 2; cz < nodeZ[i] * 2 + 2; ++cz )
+        {
+            for ( uint32_t cx = nodeX[i] * 2; cx < nodeX[i] * 2 + 2; ++cx )
+            {
+                if ( cx < children.nodesX && cz < children.nodesZ )
+                {
+                    childX[childCount] = cx;
+                    childZ[childCount] = cz;
+                    ++childCount;
+                }
+            }
+        }
+
+        SelectGroup( context, lod - 1, childX, childZ, childCount );
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainQuadtree::Select( const float cameraPosition[3],
+                              const float frustumPlanes[6][4],
+                              std::vector<TerrainNodeSelection>& selection,
+                              TerrainSelectStats* stats ) const
+{
+    selection.clear();
+
+    SelectContext context;
+    context.camera = cameraPosition;
+    context.planes = frustumPlanes;
+    context.selection = &selection;
+    memset( &context.stats, 0, sizeof( context.stats ) );
+
+    if ( !levels.empty() )
+    {
+        // The top level may hold several roots, taken four at a time
+        size_t top = levels.size() - 1;
+        uint32_t rootX[4];
+        uint32_t rootZ[4];
+        size_t count = 0;
+
+        for ( uint32_t z = 0; z < levels[top].nodesZ; ++z )
+        {
+            for ( uint32_t x = 0; x < levels[top].nodesX; ++x )
+            {
+                rootX[count] = x;
+                rootZ[count] = z;
+                if ( ++count == 4 )
+                {
+                    SelectGroup( context, top, rootX, rootZ, count );
+                    count = 0;
+                }
+            }
+        }
+
+        if ( count )
+            SelectGroup( context, top, rootX, rootZ, count );
+    }
+
+    if ( stats )
+        *stats = context.stats;
+}
@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtree.h
+//
+// CDLOD (continuous distance-dependent level of detail) quadtree over a heightmap.
+//
+// Every node covers a square of the height grid and keeps the minimum and maximum height
+// under it. Each LOD level has a view range twice the one below; a node is split while
+// its box reaches into the range of the next finer level. Selected nodes are all drawn
+// with the same grid patch, scaled to the node, and the vertex shader morphs each vertex
+// onto the next coarser grid over the outer part of the node's range, so neighbouring
+// levels meet without cracks or popping.
+//
+// Selection tests the four children of a node together (frustum and range) with SSE when
+// available. Node bounds can be brought up to date for part of the grid after its heights
+// change. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINQUADTREE_H
+#define TERRAINQUADTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    struct TerrainQuadtreeDesc
+    {
+        size_t      leafQuads;          // quads along a leaf node side and along the patch mesh
+        size_t      lodCount;           // levels, leaves are level 0
+        float       spacingX;           // world units between height samples
+        float       spacingZ;
+        float       heightScale;        // applied to the height samples
+        float       firstLodRange;      // view range of level 0, doubled for every level above
+        float       morphStartRatio;    // where in its range band a level starts morphing, 0..1
+    };
+
+    struct TerrainNodeSelection
+    {
+        uint32_t    gridX;              // first height sample covered by the node
+        uint32_t    gridZ;
+        uint32_t    size;               // height samples along the node side (leafQuads << lod)
+        uint32_t    lod;
+        float       morphStart;         // distances over which vertices morph to the coarser grid
+        float       morphEnd;
+    };
+
+    struct TerrainSelectStats
+    {
+        size_t      nodesVisited;
+        size_t      nodesCulled;
+        size_t      nodesSelected;
+    };
+
+    class TerrainQuadtree
+    {
+    public:
+        TerrainQuadtree();
+
+        // heights is a width x depth grid, row 0 at +Z, laid out in terrain space the same way
+        // as BuildTerrainTiles. Leaf bounds are computed in parallel.
+        bool Build( const float* heights,
+                    size_t width,
+                    size_t depth,
+                    const TerrainQuadtreeDesc& desc,
+                    unsigned int threadCount = 0 );
+
+        // Recomputes the bounds of the nodes over samples [x0, x1) x [z0, z1) after their
+        // heights changed; heights is the grid given to Build, edited
+        void UpdateRegion( const float* heights, size_t x0, size_t z0, size_t x1, size_t z1 );
+
+        // Picks the nodes to draw for a camera at cameraPosition. frustumPlanes hold six
+        // planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside, all in terrain space.
+        // stats is optional.
+        void Select( const float cameraPosition[3],
+                     const float frustumPlanes[6][4],
+                     std::vector<TerrainNodeSelection>& selection,
+                     TerrainSelectStats* stats = nullptr ) const;
+
+        size_t GetLodCount() const { return desc.lodCount; }
+        float GetLodRange( size_t lod ) const { return ranges[lod]; }
+
+    private:
+        struct Level
+        {
+            size_t              nodesX;
+            size_t              nodesZ;
+            std::vector<float>  minY;
+            std::vector<float>  maxY;
+        };
+
+        struct SelectContext;
+
+        void UpdateLeaf( const float* heights, size_t x, size_t z );
+        void UpdateParent( size_t lod, size_t x, size_t z );
+        void SelectGroup( SelectContext& context, size_t lod, const uint32_t* nodeX, const uint32_t* nodeZ, size_t count ) const;
+
+        TerrainQuadtreeDesc     desc;
+        size_t                  width;
+        size_t                  depth;
+        float                   originX;
+        float                   originZ;
+        std::vector<Level>      levels;
+        std::vector<float>      ranges;
+        std::vector<float>      morphStart;
+        std::vector<float>      morphEnd;
+    };
+}
+
+#endif // TERRAINQUADTREE_H
@@ -0,0 +1,340 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainRtin.cpp
+//
+// Adaptive RTIN terrain meshes.
+//
+// Every sample that is not a tile corner is the midpoint of the long edge of one or two
+// triangles of the hierarchy, a distance t along each axis from the ends of that edge:
+// - x an odd multiple of t, z an even one: a row edge, apexes t above and below
+// - x an even multiple of t, z an odd one: a column edge, apexes t left and right
+// - both odd multiples of t: the diagonal of a square of side 2t, apexes on the other two
+//   corners. The diagonal is the one that passes through the centre of the square twice
+//   the size, as it does when the square's parent triangles are split.
+// Splitting a triangle makes the midpoints of its short edges the next midpoints down, so
+// a midpoint's error is raised to the errors of those, and the errors of one level only
+// depend on the level below.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <vector>
+
+#include "TerrainRtin.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const size_t MAX_TILE_QUADS = 128;
+
+// Triangles that cross the last row or column of the grid are always split, since the
+// tile vertices past it are clamped back onto it
+const float ALWAYS_SPLIT = FLT_MAX;
+
+struct RtinGrid
+{
+    const float*    heights;
+    size_t          width;
+    size_t          depth;
+    float           heightScale;
+
+    float Height( ptrdiff_t x, ptrdiff_t z ) const
+    {
+        size_t column = std::min( size_t( x ), width - 1 );
+        size_t row = std::min( size_t( z ), depth - 1 );
+        return heights[row * width + column] * heightScale;
+    }
+
+    // Largest vertical distance of a sample inside the triangle from its plane
+    float TriangleError( ptrdiff_t ax, ptrdiff_t az, ptrdiff_t bx, ptrdiff_t bz, ptrdiff_t cx, ptrdiff_t cz ) const
+    {
+        ptrdiff_t minX = std::min( ax, std::min( bx, cx ) );
+        ptrdiff_t maxX = std::max( ax, std::max( bx, cx ) );
+        ptrdiff_t minZ = std::min( az, std::min( bz, cz ) );
+        ptrdiff_t maxZ = std::max( az, std::max( bz, cz ) );
+
+        ptrdiff_t lastX = ptrdiff_t( width - 1 );
+        ptrdiff_t lastZ = ptrdiff_t( depth - 1 );
+        if ( ( minX < lastX && lastX < maxX ) || ( minZ < lastZ && lastZ < maxZ ) )
+            return ALWAYS_SPLIT;
+
+        float ha = Height( ax, az );
+        float ux = float( bx - ax ), uz = float( bz - az ), uh = Height( bx, bz ) - ha;
+        float vx = float( cx - ax ), vz = float( cz - az ), vh = Height( cx, cz ) - ha;
+        float det = ux * vz - uz * vx;
+        float gradientX = ( uh * vz - uz * vh ) / det;
+        float gradientZ = ( ux * vh - uh * vx ) / det;
+
+        // Edge functions, signed so the inside is positive
+        ptrdiff_t sign = ( bx - ax ) * ( cz - az ) - ( bz - az ) * ( cx - ax ) > 0 ? 1 : -1;
+
+        float error = 0.0f;
+        for ( ptrdiff_t z = minZ; z <= maxZ; ++z )
+        {
+            for ( ptrdiff_t x = minX; x <= maxX; ++x )
+            {
+                if ( sign * ( ( bx - ax ) * ( z - az ) - ( bz - az ) * ( x - ax ) ) < 0
+                  || sign * ( ( cx - bx ) * ( z - bz ) - ( cz - bz ) * ( x - bx ) ) < 0
+                  || sign * ( ( ax - cx ) * ( z - cz ) - ( az - cz ) * ( x - cx ) ) < 0 )
+                    continue;
+
+                float plane = ha + gradientX * float( x - ax ) + gradientZ * float( z - az );
+                error = std::max( error, fabsf( Height( x, z ) - plane ) );
+            }
+        }
+        return error;
+    }
+};
+
+// Whether the square of side 2t centred on ( x, z ) is split along the diagonal from
+// ( x - t, z - t ) to ( x + t, z + t ) rather than the other one
+inline bool IsMainDiagonal( size_t x, size_t z, size_t t )
+{
+    size_t parentX = x / ( 4 * t ) * ( 4 * t ) + 2 * t;
+    size_t parentZ = z / ( 4 * t ) * ( 4 * t ) + 2 * t;
+    return ( parentX > x ) == ( parentZ > z );
+}
+
+struct RtinWalk
+{
+    const float*            errors;
+    size_t                  gridWidth;
+    size_t                  lastX;
+    size_t                  lastZ;
+    size_t                  x0;
+    size_t                  z0;
+    size_t                  stride;
+    float                   maxError;
+    std::vector<uint16_t>*  indices;
+
+    // Triangle with long edge a-b and apex c
+    void Triangle( size_t ax, size_t az, size_t bx, size_t bz, size_t cx, size_t cz )
+    {
+        size_t leg = ( ax > cx ? ax - cx : cx - ax ) + ( az > cz ? az - cz : cz - az );
+        size_t mx = ( ax + bx ) / 2;
+        size_t mz = ( az + bz ) / 2;
+        if ( leg > 1 && errors[mz * gridWidth + mx] > maxError )
+        {
+            Triangle( cx, cz, ax, az, mx, mz );
+            Triangle( bx, bz, cx, cz, mx, mz );
+            return;
+        }
+
+        // Wholly past the grid, flattened onto its edge
+        if ( std::min( ax, std::min( bx, cx ) ) >= lastX || std::min( az, std::min( bz, cz ) ) >= lastZ )
+            return;
+
+        // Same winding as BuildTerrainTileIndices
+        ptrdiff_t cross = ( ptrdiff_t( bx ) - ptrdiff_t( ax ) ) * ( ptrdiff_t( cz ) - ptrdiff_t( az ) )
+                        - ( ptrdiff_t( bz ) - ptrdiff_t( az ) ) * ( ptrdiff_t( cx ) - ptrdiff_t( ax ) );
+        indices->push_back( Index( ax, az ) );
+        indices->push_back( Index( cross > 0 ? bx : cx, cross > 0 ? bz : cz ) );
+        indices->push_back( Index( cross > 0 ? cx : bx, cross > 0 ? cz : bz ) );
+    }
+
+    uint16_t Index( size_t x, size_t z ) const
+    {
+        return uint16_t( ( z - z0 ) * stride + ( x - x0 ) );
+    }
+};
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainRtin::TerrainRtin() :
+    width( 0 ),
+    depth( 0 ),
+    tilesX( 0 ),
+    tilesZ( 0 ),
+    gridWidth( 0 ),
+    gridDepth( 0 )
+{
+    desc.tileQuads = 0;
+    desc.heightScale = 1.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainRtin::Build( const float* heights,
+                         size_t width,
+                         size_t depth,
+                         const TerrainRtinDesc& desc,
+                         unsigned int threadCount )
+{
+    size_t tileQuads = desc.tileQuads;
+    if ( !heights || width < 2 || depth < 2 || tileQuads < 2 || tileQuads > MAX_TILE_QUADS || ( tileQuads & ( tileQuads - 1 ) ) )
+        return false;
+
+    this->width = width;
+    this->depth = depth;
+    this->desc = desc;
+    tilesX = ( width - 2 ) / tileQuads + 1;
+    tilesZ = ( depth - 2 ) / tileQuads + 1;
+    gridWidth = tilesX * tileQuads + 1;
+    gridDepth = tilesZ * tileQuads + 1;
+
+    // Tile corners stay whatever the error
+    errors.assign( gridWidth * gridDepth, 0.0f );
+    for ( size_t z = 0; z < gridDepth; z += tileQuads )
+    {
+        for ( size_t x = 0; x < gridWidth; x += tileQuads )
+        {
+            errors[z * gridWidth + x] = ALWAYS_SPLIT;
+        }
+    }
+
+    RtinGrid grid = { heights, width, depth, desc.heightScale };
+    float* error = errors.data();
+    size_t stride = gridWidth;
+    size_t lastX = gridWidth - 1;
+    size_t lastZ = gridDepth - 1;
+
+    for ( size_t t = 1; t < tileQuads; t *= 2 )
+    {
+        // Edge midpoints first, then the square centres that are split into them. Each tile
+        // writes the samples from its first row and column up to, not including, the next
+        // tile's, so no sample is written twice.
+        for ( int pass = 0; pass < 2; ++pass )
+        {
+            ParallelFor( tilesX * tilesZ, threadCount, [&]( size_t tile )
+            {
+                size_t x0 = ( tile % tilesX ) * tileQuads;
+                size_t z0 = ( tile / tilesX ) * tileQuads;
+                size_t x1 = x0 + tileQuads + ( x0 + tileQuads == lastX ? 1 : 0 );
+                size_t z1 = z0 + tileQuads + ( z0 + tileQuads == lastZ ? 1 : 0 );
+
+                for ( size_t z = z0; z < z1; z += t )
+                {
+                    bool oddZ = ( ( z / t ) & 1 ) != 0;
+                    for ( size_t x = x0 + ( ( pass == 1 || !oddZ ) ? t : 0 ); x < x1; x += 2 * t )
+                    {
+                        bool oddX = ( ( x / t ) & 1 ) != 0;
+                        if ( ( pass == 1 ) != ( oddX && oddZ ) )
+                            continue;
+
+                        float e = 0.0f;
+                        if ( pass == 1 )
+                        {
+                            // Square centre, its halves and the midpoints of the square's sides
+                            if ( IsMainDiagonal( x, z, t ) )
+                            {
+                                e = std::max( grid.TriangleError( x - t, z - t, x + t, z + t, x + t, z - t ),
+                                              grid.TriangleError( x - t, z - t, x + t, z + t, x - t, z + t ) );
+                            }
+                            else
+                            {
+                                e = std::max( grid.TriangleError( x + t, z - t, x - t, z + t, x - t, z - t ),
+                                              grid.TriangleError( x + t, z - t, x - t, z + t, x + t, z + t ) );
+                            }
+                            e = std::max( e, std::max( std::max( error[z * stride + x - t], error[z * stride + x + t] ),
+                                                       std::max( error[( z - t ) * stride + x], error[( z + t ) * stride + x] ) ) );
+                        }
+                        else
+                        {
+                            // Row or column edge, the triangles on either side that exist and the
+                            // square centres a half step diagonally off it
+                            bool row = oddX;
+                            size_t h = t / 2;
+                            if ( row )
+                            {
+                                if ( z >= t )
+                                    e = std::max( e, grid.TriangleError( x - t, z, x + t, z, x, z - t ) );
+                                if ( z + t <= lastZ )
+                                    e = std::max( e, grid.TriangleError( x - t, z, x + t, z, x, z + t ) );
+                            }
+                            else
+                            {
+                                if ( x >= t )
+                                    e = std::max( e, grid.TriangleError( x, z - t, x, z + t, x - t, z ) );
+                                if ( x + t <= lastX )
+                                    e = std::max( e, grid.TriangleError( x, z - t, x, z + t, x + t, z ) );
+                            }
+
+                            if ( h )
+                            {
+                                for ( int corner = 0; corner < 4; ++corner )
+                                {
+                                    size_t cx = ( corner & 1 ) ? x + h : x - h;
+                                    size_t cz = ( corner & 2 ) ? z + h : z - h;
+                                    if ( ( corner & 1 ? x + h <= lastX : x >= h ) && ( corner & 2 ? z + h <= lastZ : z >= h ) )
+                                        e = std::max( e, error[cz * stride + cx] );
+                                }
+                            }
+                        }
+
+                        error[z * stride + x] = e;
+                    }
+                }
+            } );
+        }
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainRtin::BuildIndices( float maxError,
+                                std::vector<uint16_t>& indices,
+                                std::vector<TerrainRtinRange>& ranges,
+                                TerrainRtinStats* stats,
+                                unsigned int threadCount ) const
+{
+    if ( errors.empty() || !( maxError >= 0.0f ) )
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    size_t tileQuads = desc.tileQuads;
+    size_t tileCount = tilesX * tilesZ;
+    std::vector<std::vector<uint16_t>> tileIndices( tileCount );
+
+    ParallelFor( tileCount, threadCount, [&]( size_t tile )
+    {
+        size_t x0 = ( tile % tilesX ) * tileQuads;
+        size_t z0 = ( tile / tilesX ) * tileQuads;
+        size_t x1 = x0 + tileQuads;
+        size_t z1 = z0 + tileQuads;
+
+        RtinWalk walk = { errors.data(), gridWidth, width - 1, depth - 1, x0, z0, tileQuads + 1, maxError, &tileIndices[tile] };
+        if ( IsMainDiagonal( x0 + tileQuads / 2, z0 + tileQuads / 2, tileQuads / 2 ) )
+        {
+            walk.Triangle( x0, z0, x1, z1, x1, z0 );
+            walk.Triangle( x1, z1, x0, z0, x0, z1 );
+        }
+        else
+        {
+            walk.Triangle( x1, z0, x0, z1, x0, z0 );
+            walk.Triangle( x0, z1, x1, z0, x1, z1 );
+        }
+    } );
+
+    ranges.resize( tileCount );
+    size_t indexCount = 0;
+    for ( size_t tile = 0; tile < tileCount; ++tile )
+    {
+        ranges[tile].firstIndex = indexCount;
+        ranges[tile].indexCount = tileIndices[tile].size();
+        indexCount += tileIndices[tile].size();
+    }
+
+    indices.resize( indexCount );
+    for ( size_t tile = 0; tile < tileCount; ++tile )
+    {
+        std::copy( tileIndices[tile].begin(), tileIndices[tile].end(), indices.begin() + ranges[tile].firstIndex );
+    }
+
+    if ( stats )
+    {
+        stats->triangleCount = indexCount / 3;
+        stats->gridTriangleCount = ( width - 1 ) * ( depth - 1 ) * 2;
+        stats->seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    return true;
+}
@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainRtin.h
+//
+// Adaptive right-triangulated irregular network (RTIN) meshes over the terrain tiles.
+//
+// Each tile is split along a diagonal into two right triangles, and a triangle is split
+// again at the midpoint of its long edge for as long as it strays further than a chosen
+// height error from the samples it covers. The error of every midpoint is computed once,
+// as the largest vertical distance of any sample inside the triangles it would split from
+// their planes, raised to the errors of the midpoints under it, so a mesh for any error
+// is a single walk down each tile. The diagonals alternate in the pattern one RTIN over
+// the whole grid would use and errors on tile edges take both tiles' triangles into
+// account, so neighbouring tiles always agree on their shared edge and the mesh has no
+// cracks. The indices address the vertices BuildTerrainTiles makes for the same tiles, so
+// the RTIN is drawn from the same vertex buffers as the full grid. Has no Direct3D
+// dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINRTIN_H
+#define TERRAINRTIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    struct TerrainRtinDesc
+    {
+        size_t      tileQuads;          // power of two, as given to BuildTerrainTiles
+        float       heightScale;        // applied to the height samples
+    };
+
+    // Indices of one tile within the list, relative to the tile's first vertex
+    struct TerrainRtinRange
+    {
+        size_t      firstIndex;
+        size_t      indexCount;
+    };
+
+    struct TerrainRtinStats
+    {
+        size_t      triangleCount;
+        size_t      gridTriangleCount;  // the full grid over the same samples
+        double      seconds;
+    };
+
+    class TerrainRtin
+    {
+    public:
+        TerrainRtin();
+
+        // Computes the midpoint errors of a width x depth height grid. Levels are done finest
+        // first, the tiles of each level in parallel; threadCount of 0 uses every hardware
+        // thread. The heights are not kept.
+        bool Build( const float* heights,
+                    size_t width,
+                    size_t depth,
+                    const TerrainRtinDesc& desc,
+                    unsigned int threadCount = 0 );
+
+        // Triangle list indices, in tile order, for the coarsest mesh no further than maxError
+        // from any sample. ranges gets one entry per tile. stats is optional.
+        bool BuildIndices( float maxError,
+                           std::vector<uint16_t>& indices,
+                           std::vector<TerrainRtinRange>& ranges,
+                           TerrainRtinStats* stats = nullptr,
+                           unsigned int threadCount = 0 ) const;
+
+        // The error of the mesh at a sample, that is the smallest maxError that keeps it as
+        // a vertex; tile corners are always kept
+        float GetError( size_t x, size_t z ) const { return errors[z * gridWidth + x]; }
+
+    private:
+        size_t              width;
+        size_t              depth;
+        size_t              tilesX;
+        size_t              tilesZ;
+        size_t              gridWidth;  // samples across the whole tiles, past the grid too
+        size_t              gridDepth;
+        TerrainRtinDesc     desc;
+        std::vector<float>  errors;
+    };
+}
+
+#endif // TERRAINRTIN_H
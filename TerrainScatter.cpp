@@ -0,0 +1,568 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainScatter.cpp
+//
+// Poisson-disc placement of terrain instances and per-cell selection.
+//
+// A cell is filled as Bridson's algorithm fills a plane: points grow from the ones already
+// accepted, each trying candidates in the ring between one and two spacings around it
+// until none fits. Neighbours filled earlier can cut a cell into parts a single seed does
+// not reach, so growth restarts from random darts until a run of them all fail.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "TerrainScatter.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const float TWO_PI = 6.28318531f;
+
+// Candidates tried around a point, evenly spaced on a circle just over one spacing out,
+// before it stops growing
+const int GROWTH_TRIES = 12;
+const float GROWTH_RADIUS = 1.001f;
+
+// Darts in a row that must miss before a cell counts as full
+const int DART_MISSES = 64;
+
+//-------------------------------------------------------------------------------------
+// PCG32, seeded from the scatter seed, the layer and the cell
+//-------------------------------------------------------------------------------------
+class Random
+{
+public:
+    Random( uint32_t seed, size_t layer, size_t cellX, size_t cellZ )
+    {
+        uint64_t key = ( uint64_t( seed ) << 32 ) ^ ( uint64_t( layer ) << 48 ) ^ ( uint64_t( cellZ ) << 20 ) ^ uint64_t( cellX );
+        state = Mix( key + 0x9E3779B97F4A7C15ULL );
+        Next();
+    }
+
+    uint32_t Next()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t shifted = uint32_t( ( ( old >> 18 ) ^ old ) >> 27 );
+        uint32_t rotation = uint32_t( old >> 59 );
+        return ( shifted >> rotation ) | ( shifted << ( ( 32 - rotation ) & 31 ) );
+    }
+
+    // [0, 1)
+    float NextFloat()
+    {
+        return float( Next() >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+private:
+    static uint64_t Mix( uint64_t x )
+    {
+        x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+        x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBULL;
+        return x ^ ( x >> 31 );
+    }
+
+    uint64_t    state;
+};
+
+struct Point
+{
+    float   u;                  // across the terrain from its -X edge
+    float   v;                  // across the terrain from its +Z edge
+};
+
+//-------------------------------------------------------------------------------------
+// Points near one cell, binned so no bin holds more than one
+//-------------------------------------------------------------------------------------
+class DiscGrid
+{
+public:
+    void Reset( float u0, float v0, float u1, float v1, float spacing )
+    {
+        // Points spacing apart never share a bin of this size
+        binSize = spacing * 0.70710678f;
+        inverseBinSize = 1.0f / binSize;
+        spacingSq = spacing * spacing;
+        this->u0 = u0 - spacing;
+        this->v0 = v0 - spacing;
+
+        // Two bins of padding all round, so lookups need no bounds checks
+        binsU = size_t( ceilf( ( u1 - u0 + 2.0f * spacing ) * inverseBinSize ) ) + 5;
+        binsV = size_t( ceilf( ( v1 - v0 + 2.0f * spacing ) * inverseBinSize ) ) + 5;
+
+        // Empty bins hold a point too far away to matter
+        Point empty = { EMPTY_BIN, EMPTY_BIN };
+        bins.assign( binsU * binsV, empty );
+    }
+
+    bool Fits( float u, float v ) const
+    {
+        size_t bu = size_t( ( u - u0 ) * inverseBinSize ) + 2;
+        size_t bv = size_t( ( v - v0 ) * inverseBinSize ) + 2;
+
+        // Two bins either way reach past one spacing; the corners of that square are
+        // a full spacing away already
+        float closestSq = spacingSq;
+        for ( size_t j = bv - 2; j <= bv + 2; ++j )
+        {
+            size_t reach = ( j == bv - 2 || j == bv + 2 ) ? 1 : 2;
+            const Point* bin = &bins[j * binsU + bu - reach];
+            for ( size_t i = 0; i <= 2 * reach; ++i )
+            {
+                float du = bin[i].u - u;
+                float dv = bin[i].v - v;
+                closestSq = std::min( closestSq, du * du + dv * dv );
+            }
+        }
+        return closestSq >= spacingSq;
+    }
+
+    // Points outside the binned area are ignored
+    void Add( float u, float v )
+    {
+        float fu = floorf( ( u - u0 ) * inverseBinSize );
+        float fv = floorf( ( v - v0 ) * inverseBinSize );
+        if ( fu < 0.0f || fv < 0.0f || fu >= float( binsU - 4 ) || fv >= float( binsV - 4 ) )
+            return;
+
+        Point& bin = bins[( size_t( fv ) + 2 ) * binsU + size_t( fu ) + 2];
+        bin.u = u;
+        bin.v = v;
+    }
+
+private:
+    static const float  EMPTY_BIN;
+
+    float               u0;
+    float               v0;
+    float               binSize;
+    float               inverseBinSize;
+    float               spacingSq;
+    size_t              binsU;
+    size_t              binsV;
+    std::vector<Point>  bins;
+};
+
+const float DiscGrid::EMPTY_BIN = 1e18f;
+
+// 1 inside [low, high] further than fade from its ends, falling to 0 at them
+inline float RangeWeight( float value, float low, float high, float fade )
+{
+    if ( !( value >= low && value <= high ) )
+        return 0.0f;
+    if ( !( fade > 0.0f ) )
+        return 1.0f;
+
+    return std::min( std::min( value - low, high - value ) / fade, 1.0f );
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+TerrainScatter::TerrainScatter() :
+    cellsX( 0 ),
+    cellsZ( 0 ),
+    originX( 0.0f ),
+    originZ( 0.0f ),
+    extentX( 0.0f ),
+    extentZ( 0.0f )
+{
+    memset( &desc, 0, sizeof( desc ) );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool TerrainScatter::Build( const TerrainHeightField& heightField,
+                            const TerrainScatterDesc& desc,
+                            const TerrainScatterLayerDesc* layerDescs,
+                            size_t layerCount,
+                            TerrainScatterStats* stats,
+                            unsigned int threadCount )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    layers.clear();
+    cellsX = 0;
+    cellsZ = 0;
+
+    size_t width = heightField.GetWidth();
+    size_t depth = heightField.GetDepth();
+    const TerrainHeightFieldDesc& fieldDesc = heightField.GetDesc();
+    if ( width < 2 || depth < 2 || !( desc.cellSize > 0.0f ) || ( layerCount && !layerDescs ) )
+        return false;
+
+    for ( size_t i = 0; i < layerCount; ++i )
+    {
+        const TerrainScatterLayerDesc& layer = layerDescs[i];
+        if ( !( layer.spacing > 0.0f ) || layer.spacing > desc.cellSize || layer.minScale > layer.maxScale )
+            return false;
+
+        // Cells of a few bins still have to be cheap to clear
+        if ( desc.cellSize / layer.spacing > 4096.0f )
+            return false;
+    }
+
+    this->desc = desc;
+    extentX = float( width - 1 ) * fieldDesc.spacingX;
+    extentZ = float( depth - 1 ) * fieldDesc.spacingZ;
+    originX = -0.5f * extentX;
+    originZ = 0.5f * extentZ;
+    cellsX = std::max( size_t( ceilf( extentX / desc.cellSize ) ), size_t( 1 ) );
+    cellsZ = std::max( size_t( ceilf( extentZ / desc.cellSize ) ), size_t( 1 ) );
+
+    size_t cellCount = cellsX * cellsZ;
+    std::vector<std::vector<Point>> points( layerCount * cellCount );
+    std::vector<std::vector<TerrainScatterInstance>> kept( layerCount * cellCount );
+
+    // Every other cell in x and z at a time, so no two cells filled together are neighbours
+    for ( size_t pass = 0; pass < 4; ++pass )
+    {
+        size_t firstX = pass & 1;
+        size_t firstZ = pass >> 1;
+        size_t passX = ( cellsX - firstX + 1 ) / 2;
+        size_t passZ = ( cellsZ - firstZ + 1 ) / 2;
+        size_t passCells = passX * passZ;
+
+        ParallelFor( passCells * layerCount, threadCount, [&]( size_t item )
+        {
+            size_t layerIndex = item / passCells;
+            size_t cellX = firstX + 2 * ( item % passCells % passX );
+            size_t cellZ = firstZ + 2 * ( item % passCells / passX );
+            size_t cell = cellZ * cellsX + cellX;
+            const TerrainScatterLayerDesc& layer = layerDescs[layerIndex];
+
+            float u0 = float( cellX ) * desc.cellSize;
+            float v0 = float( cellZ ) * desc.cellSize;
+            float u1 = std::min( u0 + desc.cellSize, extentX );
+            float v1 = std::min( v0 + desc.cellSize, extentZ );
+
+            // Neighbours from earlier passes; the ones still to come are empty
+            DiscGrid grid;
+            grid.Reset( u0, v0, u1, v1, layer.spacing );
+            for ( size_t z = cellZ ? cellZ - 1 : 0; z <= std::min( cellZ + 1, cellsZ - 1 ); ++z )
+            {
+                for ( size_t x = cellX ? cellX - 1 : 0; x <= std::min( cellX + 1, cellsX - 1 ); ++x )
+                {
+                    for ( const Point& point : points[layerIndex * cellCount + z * cellsX + x] )
+                        grid.Add( point.u, point.v );
+                }
+            }
+
+            Random random( desc.seed, layerIndex, cellX, cellZ );
+            float growthRadius = layer.spacing * GROWTH_RADIUS;
+            float stepCos = cosf( TWO_PI / GROWTH_TRIES );
+            float stepSin = sinf( TWO_PI / GROWTH_TRIES );
+            std::vector<Point>& own = points[layerIndex * cellCount + cell];
+            std::vector<size_t> active;
+
+            for ( int misses = 0; misses < DART_MISSES; )
+            {
+                float u = u0 + ( u1 - u0 ) * random.NextFloat();
+                float v = v0 + ( v1 - v0 ) * random.NextFloat();
+                if ( !grid.Fits( u, v ) )
+                {
+                    ++misses;
+                    continue;
+                }
+
+                misses = 0;
+                grid.Add( u, v );
+                Point dart = { u, v };
+                own.push_back( dart );
+                active.push_back( own.size() - 1 );
+
+                while ( !active.empty() )
+                {
+                    size_t pick = random.Next() % active.size();
+                    Point center = own[active[pick]];
+
+                    // From a random angle, each candidate the last one turned by stepCos, stepSin
+                    float angle = TWO_PI * random.NextFloat();
+                    float du = growthRadius * cosf( angle );
+                    float dv = growthRadius * sinf( angle );
+
+                    bool grown = false;
+                    for ( int attempt = 0; attempt < GROWTH_TRIES && !grown; ++attempt )
+                    {
+                        float cu = center.u + du;
+                        float cv = center.v + dv;
+                        float turned = du * stepCos - dv * stepSin;
+                        dv = du * stepSin + dv * stepCos;
+                        du = turned;
+
+                        if ( cu < u0 || cv < v0 || cu >= u1 || cv >= v1 || !grid.Fits( cu, cv ) )
+                            continue;
+
+                        grid.Add( cu, cv );
+                        Point grownPoint = { cu, cv };
+                        own.push_back( grownPoint );
+                        active.push_back( own.size() - 1 );
+                        grown = true;
+                    }
+
+                    if ( !grown )
+                    {
+                        active[pick] = active.back();
+                        active.pop_back();
+                    }
+                }
+            }
+
+            // Thinned by the ground; every point draws the same numbers kept or not
+            std::vector<TerrainScatterInstance>& instances = kept[layerIndex * cellCount + cell];
+            for ( const Point& point : own )
+            {
+                float chance = random.NextFloat();
+                float scale = layer.minScale + ( layer.maxScale - layer.minScale ) * random.NextFloat();
+                float rotation = TWO_PI * random.NextFloat();
+                float tint = random.NextFloat();
+
+                TerrainScatterInstance instance;
+                instance.position[0] = originX + point.u;
+                instance.position[2] = originZ - point.v;
+
+                float normal[3];
+                if ( !heightField.GetHeightAt( instance.position[0], instance.position[2], &instance.position[1] )
+                  || !heightField.GetNormalAt( instance.position[0], instance.position[2], normal ) )
+                    continue;
+
+                float weight = layer.density
+                             * RangeWeight( instance.position[1], layer.minHeight, layer.maxHeight, layer.heightFade )
+                             * RangeWeight( normal[1], layer.minUp, layer.maxUp, layer.upFade );
+                if ( chance >= weight )
+                    continue;
+
+                instance.scale = scale;
+                instance.rotation = rotation;
+                instance.tint = tint;
+                instances.push_back( instance );
+            }
+        } );
+    }
+
+    // Cell by cell, rows in order, into one array per layer
+    size_t candidateCount = 0;
+    size_t instanceCount = 0;
+    layers.resize( layerCount );
+    for ( size_t i = 0; i < layerCount; ++i )
+    {
+        Layer& layer = layers[i];
+        layer.desc = layerDescs[i];
+        layer.margin = layer.desc.meshRadius * std::max( fabsf( layer.desc.minScale ), fabsf( layer.desc.maxScale ) );
+        layer.occupiedCells = 0;
+        layer.cells.resize( cellCount );
+
+        size_t total = 0;
+        for ( size_t cell = 0; cell < cellCount; ++cell )
+        {
+            total += kept[i * cellCount + cell].size();
+            candidateCount += points[i * cellCount + cell].size();
+        }
+        layer.instances.reserve( total );
+
+        for ( size_t cell = 0; cell < cellCount; ++cell )
+        {
+            const std::vector<TerrainScatterInstance>& instances = kept[i * cellCount + cell];
+            layer.cells[cell].firstInstance = layer.instances.size();
+            layer.cells[cell].instanceCount = instances.size();
+            layer.instances.insert( layer.instances.end(), instances.begin(), instances.end() );
+            layer.occupiedCells += instances.empty() ? 0 : 1;
+            UpdateBounds( layer, layer.cells[cell], cell % cellsX, cell / cellsX );
+        }
+
+        instanceCount += total;
+    }
+
+    if ( stats )
+    {
+        stats->candidateCount = candidateCount;
+        stats->instanceCount = instanceCount;
+        stats->seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    }
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainScatter::Select( size_t layerIndex,
+                             const float cameraPosition[3],
+                             const float frustumPlanes[6][4],
+                             std::vector<TerrainScatterRange>& ranges,
+                             TerrainScatterSelectStats* stats ) const
+{
+    ranges.clear();
+
+    TerrainScatterSelectStats counts;
+    memset( &counts, 0, sizeof( counts ) );
+
+    if ( layerIndex >= layers.size() )
+    {
+        if ( stats )
+            *stats = counts;
+        return;
+    }
+
+    const Layer& layer = layers[layerIndex];
+    float range = layer.desc.drawDistance;
+
+    // Only the cells whose bounds come within range across x and z are visited
+    float u = cameraPosition[0] - originX;
+    float v = originZ - cameraPosition[2];
+    float reach = range + layer.margin;
+    float firstX = std::max( floorf( ( u - reach ) / desc.cellSize ), 0.0f );
+    float firstZ = std::max( floorf( ( v - reach ) / desc.cellSize ), 0.0f );
+    float lastX = std::min( floorf( ( u + reach ) / desc.cellSize ), float( cellsX - 1 ) );
+    float lastZ = std::min( floorf( ( v + reach ) / desc.cellSize ), float( cellsZ - 1 ) );
+
+    for ( float fz = firstZ; fz <= lastZ; fz += 1.0f )
+    {
+        size_t cellZ = size_t( fz );
+        for ( size_t cellX = size_t( firstX ); float( cellX ) <= lastX; ++cellX )
+        {
+            const Cell& cell = layer.cells[cellZ * cellsX + cellX];
+            if ( !cell.instanceCount )
+                continue;
+
+            ++counts.cellsVisited;
+
+            float distanceSq = 0.0f;
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                float d = std::max( std::max( cell.boundsMin[axis] - cameraPosition[axis], cameraPosition[axis] - cell.boundsMax[axis] ), 0.0f );
+                distanceSq += d * d;
+            }
+            if ( distanceSq > range * range )
+            {
+                ++counts.cellsOutOfRange;
+                continue;
+            }
+
+            bool inside = true;
+            for ( int p = 0; p < 6 && inside; ++p )
+            {
+                // Corner furthest along the plane normal
+                float x = frustumPlanes[p][0] >= 0.0f ? cell.boundsMax[0] : cell.boundsMin[0];
+                float y = frustumPlanes[p][1] >= 0.0f ? cell.boundsMax[1] : cell.boundsMin[1];
+                float z = frustumPlanes[p][2] >= 0.0f ? cell.boundsMax[2] : cell.boundsMin[2];
+                inside = x * frustumPlanes[p][0] + y * frustumPlanes[p][1] + z * frustumPlanes[p][2] + frustumPlanes[p][3] >= 0.0f;
+            }
+            if ( !inside )
+            {
+                ++counts.cellsCulled;
+                continue;
+            }
+
+            ++counts.cellsSelected;
+            counts.instancesSelected += cell.instanceCount;
+
+            // Cells along a row follow each other in the array, whatever lies empty between them
+            if ( !ranges.empty() && ranges.back().firstInstance + ranges.back().instanceCount == cell.firstInstance )
+            {
+                ranges.back().instanceCount += cell.instanceCount;
+            }
+            else
+            {
+                TerrainScatterRange drawn = { cell.firstInstance, cell.instanceCount };
+                ranges.push_back( drawn );
+            }
+        }
+    }
+
+    counts.cellsOutOfRange += layer.occupiedCells - counts.cellsVisited;
+    counts.rangeCount = ranges.size();
+    if ( stats )
+        *stats = counts;
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainScatter::UpdateRegion( size_t layerIndex,
+                                   const TerrainHeightField& heightField,
+                                   size_t x0,
+                                   size_t z0,
+                                   size_t x1,
+                                   size_t z1,
+                                   std::vector<TerrainScatterRange>& changed )
+{
+    changed.clear();
+    if ( layerIndex >= layers.size() || x0 >= x1 || z0 >= z1 )
+        return;
+
+    Layer& layer = layers[layerIndex];
+    const TerrainHeightFieldDesc& fieldDesc = heightField.GetDesc();
+
+    // Ground heights are bilinear, so the quads on every side of the samples move too
+    float u0 = ( float( x0 ) - 1.0f ) * fieldDesc.spacingX;
+    float v0 = ( float( z0 ) - 1.0f ) * fieldDesc.spacingZ;
+    float u1 = float( x1 ) * fieldDesc.spacingX;
+    float v1 = float( z1 ) * fieldDesc.spacingZ;
+
+    size_t firstX = size_t( std::max( floorf( u0 / desc.cellSize ), 0.0f ) );
+    size_t firstZ = size_t( std::max( floorf( v0 / desc.cellSize ), 0.0f ) );
+    size_t lastX = std::min( size_t( std::max( floorf( u1 / desc.cellSize ), 0.0f ) ), cellsX - 1 );
+    size_t lastZ = std::min( size_t( std::max( floorf( v1 / desc.cellSize ), 0.0f ) ), cellsZ - 1 );
+
+    for ( size_t cellZ = firstZ; cellZ <= lastZ; ++cellZ )
+    {
+        for ( size_t cellX = firstX; cellX <= lastX; ++cellX )
+        {
+            Cell& cell = layer.cells[cellZ * cellsX + cellX];
+            size_t firstMoved = cell.instanceCount;
+            size_t lastMoved = 0;
+
+            for ( size_t i = 0; i < cell.instanceCount; ++i )
+            {
+                TerrainScatterInstance& instance = layer.instances[cell.firstInstance + i];
+                float u = instance.position[0] - originX;
+                float v = originZ - instance.position[2];
+                if ( u < u0 || v < v0 || u > u1 || v > v1 )
+                    continue;
+
+                heightField.GetHeightAt( instance.position[0], instance.position[2], &instance.position[1] );
+                firstMoved = std::min( firstMoved, i );
+                lastMoved = i;
+            }
+
+            if ( firstMoved == cell.instanceCount )
+                continue;
+
+            UpdateBounds( layer, cell, cellX, cellZ );
+
+            TerrainScatterRange moved = { cell.firstInstance + firstMoved, lastMoved - firstMoved + 1 };
+            if ( !changed.empty() && changed.back().firstInstance + changed.back().instanceCount == moved.firstInstance )
+                changed.back().instanceCount += moved.instanceCount;
+            else
+                changed.push_back( moved );
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+void TerrainScatter::UpdateBounds( const Layer& layer, Cell& cell, size_t cellX, size_t cellZ ) const
+{
+    // The cell's square across x and z, its instances' heights in y, all grown by the mesh
+    float minY = 1e30f;
+    float maxY = -1e30f;
+    for ( size_t i = 0; i < cell.instanceCount; ++i )
+    {
+        float y = layer.instances[cell.firstInstance + i].position[1];
+        minY = std::min( minY, y );
+        maxY = std::max( maxY, y );
+    }
+
+    cell.boundsMin[0] = originX + float( cellX ) * desc.cellSize - layer.margin;
+    cell.boundsMax[0] = originX + std::min( float( cellX + 1 ) * desc.cellSize, extentX ) + layer.margin;
+    cell.boundsMin[1] = minY - layer.margin;
+    cell.boundsMax[1] = maxY + layer.margin;
+    cell.boundsMin[2] = originZ - std::min( float( cellZ + 1 ) * desc.cellSize, extentZ ) - layer.margin;
+    cell.boundsMax[2] = originZ - float( cellZ ) * desc.cellSize + layer.margin;
+}
@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainScatter.h
+//
+// Grass, rocks and other small objects scattered over the terrain, drawn with instancing.
+//
+// The terrain is divided into square cells and every layer places its instances in each
+// cell as a Poisson-disc set, no two closer than the layer's spacing, from a random
+// stream seeded by the scatter seed, the layer and the cell alone. Cells are filled in
+// four passes of every other cell in x and z, so the cells filled at the same time never
+// touch and each one only has to keep clear of the points of neighbours filled in earlier
+// passes; the result is the same whatever the number of threads. The points are then
+// thinned by the ground height and slope under them. A layer's instances are stored cell
+// by cell in one array, so the visible cells of a row come out as one range of instances
+// and a layer is drawn in a few instanced draws. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINSCATTER_H
+#define TERRAINSCATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "TerrainHeightField.h"
+
+namespace DirectX
+{
+    struct TerrainScatterDesc
+    {
+        float       cellSize;           // world units along a cell side, no less than any layer's spacing
+        uint32_t    seed;
+    };
+
+    struct TerrainScatterLayerDesc
+    {
+        float       spacing;            // least distance between two instances
+        float       density;            // chance, 0..1, that a point on suitable ground is kept
+        float       minHeight;          // terrain space heights the layer grows between
+        float       maxHeight;
+        float       heightFade;         // height inside either end over which the density falls to 0
+        float       minUp;              // ground normal y, the cosine of the slope, it grows between
+        float       maxUp;
+        float       upFade;             // the same for the normal y
+        float       minScale;
+        float       maxScale;
+        float       meshRadius;         // bounding sphere of the mesh at scale 1, around its origin
+        float       drawDistance;
+    };
+
+    // One instance as the vertex shader reads it
+    struct TerrainScatterInstance
+    {
+        float       position[3];        // terrain space, on the ground
+        float       scale;
+        float       rotation;           // about y, radians
+        float       tint;               // 0..1
+    };
+
+    // Instances [firstInstance, firstInstance + instanceCount) of a layer
+    struct TerrainScatterRange
+    {
+        size_t      firstInstance;
+        size_t      instanceCount;
+    };
+
+    struct TerrainScatterStats
+    {
+        size_t      candidateCount;     // Poisson-disc points before thinning
+        size_t      instanceCount;
+        double      seconds;
+    };
+
+    // Cell counts are of the cells that hold instances
+    struct TerrainScatterSelectStats
+    {
+        size_t      cellsVisited;       // near enough to the camera across x and z to be tested
+        size_t      cellsOutOfRange;    // further than the draw distance, visited or not
+        size_t      cellsCulled;        // outside the frustum
+        size_t      cellsSelected;
+        size_t      instancesSelected;
+        size_t      rangeCount;
+    };
+
+    class TerrainScatter
+    {
+    public:
+        TerrainScatter();
+
+        // Places every layer's instances on the heightField's ground. Cells are filled in
+        // parallel; threadCount of 0 uses every hardware thread. stats is optional.
+        bool Build( const TerrainHeightField& heightField,
+                    const TerrainScatterDesc& desc,
+                    const TerrainScatterLayerDesc* layerDescs,
+                    size_t layerCount,
+                    TerrainScatterStats* stats = nullptr,
+                    unsigned int threadCount = 0 );
+
+        // Ranges of a layer's instances to draw for a camera at cameraPosition, with adjacent
+        // ones merged. frustumPlanes hold six planes (a, b, c, d) with a*x + b*y + c*z + d >= 0
+        // inside, all in terrain space. stats is optional.
+        void Select( size_t layer,
+                     const float cameraPosition[3],
+                     const float frustumPlanes[6][4],
+                     std::vector<TerrainScatterRange>& ranges,
+                     TerrainScatterSelectStats* stats = nullptr ) const;
+
+        // Puts a layer's instances back on the ground over samples [x0, x1) x [z0, z1) after
+        // their heights changed; changed gets the instances moved
+        void UpdateRegion( size_t layer,
+                           const TerrainHeightField& heightField,
+                           size_t x0,
+                           size_t z0,
+                           size_t x1,
+                           size_t z1,
+                           std::vector<TerrainScatterRange>& changed );
+
+        size_t GetLayerCount() const { return layers.size(); }
+        size_t GetInstanceCount( size_t layer ) const { return layers[layer].instances.size(); }
+        const TerrainScatterInstance* GetInstances( size_t layer ) const { return layers[layer].instances.data(); }
+
+    private:
+        struct Cell
+        {
+            size_t      firstInstance;
+            size_t      instanceCount;
+            float       boundsMin[3];
+            float       boundsMax[3];
+        };
+
+        struct Layer
+        {
+            TerrainScatterLayerDesc             desc;
+            std::vector<TerrainScatterInstance> instances;
+            std::vector<Cell>                   cells;
+            size_t                              occupiedCells;
+            float                               margin;     // reach of an instance past its position
+        };
+
+        void UpdateBounds( const Layer& layer, Cell& cell, size_t cellX, size_t cellZ ) const;
+
+        TerrainScatterDesc  desc;
+        size_t              cellsX;
+        size_t              cellsZ;
+        float               originX;
+        float               originZ;
+        float               extentX;
+        float               extentZ;
+        std::vector<Layer>  layers;
+    };
+}
+
+#endif // TERRAINSCATTER_H
@@ -0,0 +1,684 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainStream.cpp
+//
+// Terrain stream files, tile residency and streaming.
+//
+// Layout: TST_HEADER, then every tile of mip 0 in row order, then mip 1 and so on. Tiles
+// are all tileBytes long, so a tile's offset follows from its id and no table is stored.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "TerrainStream.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+#pragma pack(push,1)
+
+const uint32_t TST_MAGIC = 0x31545354; // "TST1"
+const uint32_t TST_VERSION = 1;
+
+struct TST_HEADER
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    width;
+    uint32_t    depth;
+    uint32_t    tileQuads;
+    uint32_t    tilesX;
+    uint32_t    tilesZ;
+    uint32_t    mipCount;
+    float       spacingX;
+    float       spacingZ;
+    float       heightOffset;
+    float       heightRange;
+    uint32_t    tileBytes;
+};
+
+#pragma pack(pop)
+
+// Tile ids hold 12 bits per coordinate, and tiles are drawn with 16-bit indices
+const size_t MAX_TILES = 4096;
+const size_t MAX_TILE_QUADS = 128;
+
+const unsigned int DEFAULT_WORKERS = 2;
+
+bool ValidTileQuads( size_t tileQuads )
+{
+    return tileQuads >= 2 && tileQuads <= MAX_TILE_QUADS && ( tileQuads & ( tileQuads - 1 ) ) == 0;
+}
+
+//-------------------------------------------------------------------------------------
+void ComputeLayout( size_t width, size_t depth, const TerrainStreamDesc& desc, TerrainStreamLayout& layout )
+{
+    layout.width = width;
+    layout.depth = depth;
+    layout.tileQuads = desc.tileQuads;
+    layout.tilesX = ( width - 1 + desc.tileQuads - 1 ) / desc.tileQuads;
+    layout.tilesZ = ( depth - 1 + desc.tileQuads - 1 ) / desc.tileQuads;
+    layout.spacingX = desc.spacingX;
+    layout.spacingZ = desc.spacingZ;
+    layout.heightOffset = desc.heightMin;
+    layout.heightRange = ( desc.heightMax > desc.heightMin ) ? desc.heightMax - desc.heightMin : 1.0f;
+    layout.tileBytes = layout.TileSamples() * layout.TileSamples() * sizeof( uint16_t );
+
+    layout.mipCount = 1;
+    while ( layout.TilesXAt( layout.mipCount - 1 ) > 1 || layout.TilesZAt( layout.mipCount - 1 ) > 1 )
+        ++layout.mipCount;
+}
+
+void ComputeMipBase( const TerrainStreamLayout& layout, std::vector<size_t>& mipBase )
+{
+    mipBase.resize( layout.mipCount + 1 );
+    mipBase[0] = 0;
+    for ( size_t mip = 0; mip < layout.mipCount; ++mip )
+    {
+        mipBase[mip + 1] = mipBase[mip] + layout.TilesXAt( mip ) * layout.TilesZAt( mip );
+    }
+}
+
+//-------------------------------------------------------------------------------------
+bool ReadHeader( std::istream& file, TerrainStreamLayout& layout )
+{
+    TST_HEADER header;
+    file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+    if ( !file.good() )
+        return false;
+
+    if ( header.magic != TST_MAGIC || header.version != TST_VERSION )
+        return false;
+
+    if ( !ValidTileQuads( header.tileQuads ) || header.width < 2 || header.depth < 2 )
+        return false;
+
+    if ( header.spacingX <= 0.0f || header.spacingZ <= 0.0f || header.heightRange <= 0.0f )
+        return false;
+
+    TerrainStreamDesc desc = { header.tileQuads, header.spacingX, header.spacingZ, header.heightOffset, header.heightOffset + header.heightRange };
+    ComputeLayout( header.width, header.depth, desc, layout );
+    layout.heightRange = header.heightRange;
+
+    return layout.tilesX == header.tilesX && layout.tilesZ == header.tilesZ
+        && layout.mipCount == header.mipCount && layout.tileBytes == header.tileBytes;
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainStreamFile( const char* fileName,
+                                      size_t width,
+                                      size_t depth,
+                                      const TerrainStreamDesc& desc,
+                                      const TerrainRowReader& readRow,
+                                      unsigned int threadCount )
+{
+    if ( !fileName || !readRow || width < 2 || depth < 2 || !ValidTileQuads( desc.tileQuads ) )
+        return false;
+
+    if ( desc.spacingX <= 0.0f || desc.spacingZ <= 0.0f )
+        return false;
+
+    TerrainStreamLayout layout;
+    ComputeLayout( width, depth, desc, layout );
+    if ( layout.tilesX > MAX_TILES || layout.tilesZ > MAX_TILES )
+        return false;
+
+    std::ofstream file( fileName, std::ios::out | std::ios::binary | std::ios::trunc );
+    if ( !file )
+        return false;
+
+    TST_HEADER header;
+    header.magic = TST_MAGIC;
+    header.version = TST_VERSION;
+    header.width = uint32_t( width );
+    header.depth = uint32_t( depth );
+    header.tileQuads = uint32_t( layout.tileQuads );
+    header.tilesX = uint32_t( layout.tilesX );
+    header.tilesZ = uint32_t( layout.tilesZ );
+    header.mipCount = uint32_t( layout.mipCount );
+    header.spacingX = layout.spacingX;
+    header.spacingZ = layout.spacingZ;
+    header.heightOffset = layout.heightOffset;
+    header.heightRange = layout.heightRange;
+    header.tileBytes = uint32_t( layout.tileBytes );
+    file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+    const ptrdiff_t quads = ptrdiff_t( layout.tileQuads );
+    const size_t samples = layout.TileSamples();
+    const float toSample = 65535.0f / layout.heightRange;
+
+    // One band of tiles at a time: the rows it samples, and its tiles in file order
+    std::vector<float> rows( samples * width );
+    std::vector<ptrdiff_t> rowSource( samples );
+    std::vector<uint16_t> band;
+
+    for ( size_t mip = 0; mip < layout.mipCount; ++mip )
+    {
+        const ptrdiff_t stride = ptrdiff_t( 1 ) << mip;
+        const size_t tilesX = layout.TilesXAt( mip );
+        const size_t tilesZ = layout.TilesZAt( mip );
+        band.resize( tilesX * samples * samples );
+
+        for ( size_t tz = 0; tz < tilesZ; ++tz )
+        {
+            // Border rows and rows past the last are clamped into the grid
+            for ( size_t j = 0; j < samples; ++j )
+            {
+                ptrdiff_t z = ( ptrdiff_t( tz ) * quads + ptrdiff_t( j ) - 1 ) * stride;
+                z = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( z, ptrdiff_t( depth ) - 1 ) );
+                rowSource[j] = z;
+
+                if ( j && rowSource[j - 1] == z )
+                    memcpy( &rows[j * width], &rows[( j - 1 ) * width], width * sizeof( float ) );
+                else if ( !readRow( size_t( z ), &rows[j * width] ) )
+                    return false;
+            }
+
+            ParallelFor( tilesX, threadCount, [&]( size_t tx )
+            {
+                uint16_t* out = &band[tx * samples * samples];
+                for ( size_t j = 0; j < samples; ++j )
+                {
+                    const float* row = &rows[j * width];
+                    for ( size_t i = 0; i < samples; ++i )
+                    {
+                        ptrdiff_t x = ( ptrdiff_t( tx ) * quads + ptrdiff_t( i ) - 1 ) * stride;
+                        x = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( x, ptrdiff_t( width ) - 1 ) );
+
+                        float s = ( row[x] - layout.heightOffset ) * toSample + 0.5f;
+                        s = std::max( 0.0f, std::min( s, 65535.0f ) );
+                        out[j * samples + i] = uint16_t( s );
+                    }
+                }
+            } );
+
+            file.write( reinterpret_cast<const char*>( band.data() ), band.size() * sizeof( uint16_t ) );
+        }
+    }
+
+    return file.good();
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainStreamFile( const char* fileName,
+                                      const float* heights,
+                                      size_t width,
+                                      size_t depth,
+                                      const TerrainStreamDesc& desc,
+                                      unsigned int threadCount )
+{
+    if ( !heights || width < 2 || depth < 2 )
+        return false;
+
+    TerrainStreamDesc rangeDesc = desc;
+    const float* last = heights + width * depth;
+    rangeDesc.heightMin = *std::min_element( heights, last );
+    rangeDesc.heightMax = *std::max_element( heights, last );
+
+    return BuildTerrainStreamFile( fileName, width, depth, rangeDesc, [&]( size_t z, float* row )
+    {
+        memcpy( row, heights + z * width, width * sizeof( float ) );
+        return true;
+    }, threadCount );
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::ReadTerrainStreamLayout( const char* fileName, TerrainStreamLayout& layout )
+{
+    std::ifstream file( fileName, std::ios::in | std::ios::binary );
+    if ( !file )
+        return false;
+
+    return ReadHeader( file, layout );
+}
+
+
+//=====================================================================================
+// TerrainStreamCache
+//=====================================================================================
+
+TerrainStreamCache::TerrainStreamCache( const TerrainStreamLayout& layout, size_t slotCount )
+    : layout( layout ),
+      frame( 1 )
+{
+    Slot freeSlot = { TERRAIN_NO_TILE, 0, false, 0.0f, 0.0f };
+    slots.assign( slotCount, freeSlot );
+
+    memset( &stats, 0, sizeof( stats ) );
+}
+
+int32_t TerrainStreamCache::FindSlot( uint32_t tileId ) const
+{
+    auto found = residentSlot.find( tileId );
+    return ( found != residentSlot.end() ) ? int32_t( found->second ) : -1;
+}
+
+bool TerrainStreamCache::IsResident( uint32_t tileId ) const
+{
+    return FindSlot( tileId ) >= 0;
+}
+
+//-------------------------------------------------------------------------------------
+// Terrain space x and z covered by a tile; x0 < x1 and z0 > z1 (row 0 is the +Z edge)
+//-------------------------------------------------------------------------------------
+void TerrainStreamCache::TileArea( uint32_t tileId, float& x0, float& z0, float& x1, float& z1 ) const
+{
+    size_t span = layout.tileQuads << TerrainTileIdMip( tileId );
+    size_t column0 = std::min( TerrainTileIdX( tileId ) * span, layout.width - 1 );
+    size_t column1 = std::min( column0 + span, layout.width - 1 );
+    size_t row0 = std::min( TerrainTileIdZ( tileId ) * span, layout.depth - 1 );
+    size_t row1 = std::min( row0 + span, layout.depth - 1 );
+
+    float originX = -0.5f * float( layout.width - 1 ) * layout.spacingX;
+    float originZ = 0.5f * float( layout.depth - 1 ) * layout.spacingZ;
+    x0 = originX + float( column0 ) * layout.spacingX;
+    x1 = originX + float( column1 ) * layout.spacingX;
+    z0 = originZ - float( row0 ) * layout.spacingZ;
+    z1 = originZ - float( row1 ) * layout.spacingZ;
+}
+
+bool TerrainStreamCache::GetTileBounds( uint32_t tileId, float boundsMin[3], float boundsMax[3] ) const
+{
+    int32_t slot = FindSlot( tileId );
+    if ( slot < 0 )
+        return false;
+
+    float x0, z0, x1, z1;
+    TileArea( tileId, x0, z0, x1, z1 );
+    boundsMin[0] = x0;
+    boundsMin[1] = slots[slot].minY;
+    boundsMin[2] = z1;
+    boundsMax[0] = x1;
+    boundsMax[1] = slots[slot].maxY;
+    boundsMax[2] = z0;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Splits a resident tile near the camera if all its children are resident, otherwise
+// draws it and asks for the missing children
+//-------------------------------------------------------------------------------------
+void TerrainStreamCache::Visit( uint32_t tileId, float cameraX, float cameraY, float cameraZ, float lodDistance,
+                                std::vector<TerrainStreamDrawTile>& draw, std::vector<uint32_t>& requests )
+{
+    size_t slot = size_t( FindSlot( tileId ) );
+    slots[slot].lastUsed = frame;
+
+    size_t mip = TerrainTileIdMip( tileId );
+    bool fallback = false;
+
+    if ( mip > 0 )
+    {
+        float x0, z0, x1, z1;
+        TileArea( tileId, x0, z0, x1, z1 );
+        float dx = std::max( std::max( x0 - cameraX, cameraX - x1 ), 0.0f );
+        float dy = std::max( std::max( slots[slot].minY - cameraY, cameraY - slots[slot].maxY ), 0.0f );
+        float dz = std::max( std::max( z1 - cameraZ, cameraZ - z0 ), 0.0f );
+        float split = lodDistance * float( layout.tileQuads << mip ) * std::max( layout.spacingX, layout.spacingZ );
+
+        if ( dx * dx + dy * dy + dz * dz < split * split )
+        {
+            uint32_t children[4];
+            size_t childCount = 0;
+            bool missing = false;
+
+            size_t x = TerrainTileIdX( tileId ) * 2, z = TerrainTileIdZ( tileId ) * 2;
+            for ( size_t cz = z; cz < std::min( z + 2, layout.TilesZAt( mip - 1 ) ); ++cz )
+            {
+                for ( size_t cx = x; cx < std::min( x + 2, layout.TilesXAt( mip - 1 ) ); ++cx )
+                {
+                    uint32_t child = MakeTerrainTileId( mip - 1, cx, cz );
+                    int32_t childSlot = FindSlot( child );
+                    if ( childSlot >= 0 )
+                    {
+                        // Kept while its siblings load
+                        slots[childSlot].lastUsed = frame;
+                    }
+                    else
+                    {
+                        requests.push_back( child );
+                        missing = true;
+                    }
+                    children[childCount++] = child;
+                }
+            }
+
+            if ( !missing )
+            {
+                for ( size_t i = 0; i < childCount; ++i )
+                    Visit( children[i], cameraX, cameraY, cameraZ, lodDistance, draw, requests );
+                return;
+            }
+
+            fallback = true;
+        }
+    }
+
+    TerrainStreamDrawTile tile;
+    tile.tileId = tileId;
+    tile.slot = slot;
+    memset( tile.coarserNeighbour, 0, sizeof( tile.coarserNeighbour ) );
+    tile.fallback = fallback;
+    draw.push_back( tile );
+}
+
+//-------------------------------------------------------------------------------------
+void TerrainStreamCache::Select( float cameraX,
+                                 float cameraY,
+                                 float cameraZ,
+                                 float lodDistance,
+                                 std::vector<TerrainStreamDrawTile>& draw,
+                                 std::vector<uint32_t>& requests )
+{
+    draw.clear();
+    requests.clear();
+
+    uint32_t root = MakeTerrainTileId( layout.mipCount - 1, 0, 0 );
+    if ( !IsResident( root ) )
+        requests.push_back( root );
+    else
+        Visit( root, cameraX, cameraY, cameraZ, lodDistance, draw, requests );
+
+    // Coarsest first so fallbacks fill in before detail, nearest first within a mip
+    std::vector<std::pair<float, uint32_t>> order( requests.size() );
+    for ( size_t i = 0; i < requests.size(); ++i )
+    {
+        float x0, z0, x1, z1;
+        TileArea( requests[i], x0, z0, x1, z1 );
+        float dx = 0.5f * ( x0 + x1 ) - cameraX;
+        float dz = 0.5f * ( z0 + z1 ) - cameraZ;
+        order[i] = std::make_pair( dx * dx + dz * dz, requests[i] );
+    }
+    std::sort( order.begin(), order.end(), []( const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b )
+    {
+        size_t mipA = TerrainTileIdMip( a.second ), mipB = TerrainTileIdMip( b.second );
+        return ( mipA != mipB ) ? mipA > mipB : a.first < b.first;
+    } );
+
+    // No more than can be mapped without evicting a tile used this frame
+    size_t used = 0;
+    for ( size_t slot = 0; slot < slots.size(); ++slot )
+    {
+        if ( slots[slot].tileId != TERRAIN_NO_TILE && ( slots[slot].lastUsed >= frame || slots[slot].locked ) )
+            ++used;
+    }
+    order.resize( std::min( order.size(), slots.size() - used ) );
+
+    requests.resize( order.size() );
+    for ( size_t i = 0; i < order.size(); ++i )
+        requests[i] = order[i].second;
+
+    // How much coarser the drawn tile across each edge is, if it is coarser at all
+    drawIndex.clear();
+    for ( size_t i = 0; i < draw.size(); ++i )
+        drawIndex[draw[i].tileId] = i;
+
+    static const int edgeX[4] = { 0, 1, 0, -1 };
+    static const int edgeZ[4] = { -1, 0, 1, 0 };
+    stats.fallbackTiles = 0;
+
+    for ( size_t i = 0; i < draw.size(); ++i )
+    {
+        TerrainStreamDrawTile& tile = draw[i];
+        size_t mip = TerrainTileIdMip( tile.tileId );
+
+        for ( int edge = 0; edge < 4; ++edge )
+        {
+            ptrdiff_t nx = ptrdiff_t( TerrainTileIdX( tile.tileId ) ) + edgeX[edge];
+            ptrdiff_t nz = ptrdiff_t( TerrainTileIdZ( tile.tileId ) ) + edgeZ[edge];
+            if ( nx < 0 || nz < 0 || size_t( nx ) >= layout.TilesXAt( mip ) || size_t( nz ) >= layout.TilesZAt( mip ) )
+                continue;
+
+            for ( size_t up = 1; mip + up < layout.mipCount; ++up )
+            {
+                if ( drawIndex.count( MakeTerrainTileId( mip + up, size_t( nx ) >> up, size_t( nz ) >> up ) ) )
+                {
+                    tile.coarserNeighbour[edge] = up;
+                    break;
+                }
+            }
+        }
+
+        if ( tile.fallback )
+            ++stats.fallbackTiles;
+    }
+
+    stats.drawnTiles = draw.size();
+    stats.requestedTiles = requests.size();
+}
+
+//-------------------------------------------------------------------------------------
+bool TerrainStreamCache::MapTile( uint32_t tileId, float minY, float maxY, bool locked, size_t& slot )
+{
+    size_t mip = TerrainTileIdMip( tileId );
+    if ( mip >= layout.mipCount || TerrainTileIdX( tileId ) >= layout.TilesXAt( mip ) || TerrainTileIdZ( tileId ) >= layout.TilesZAt( mip ) )
+        return false;
+
+    int32_t existing = FindSlot( tileId );
+    if ( existing >= 0 )
+    {
+        slots[existing].locked |= locked;
+        slots[existing].lastUsed = frame;
+        slot = size_t( existing );
+        return true;
+    }
+
+    // A free slot if there is one, otherwise the least recently used tile not needed this frame
+    size_t best = slots.size();
+    for ( size_t i = 0; i < slots.size(); ++i )
+    {
+        const Slot& candidate = slots[i];
+        if ( candidate.tileId == TERRAIN_NO_TILE )
+        {
+            best = i;
+            break;
+        }
+        if ( candidate.locked || candidate.lastUsed >= frame )
+            continue;
+        if ( best == slots.size() || candidate.lastUsed < slots[best].lastUsed )
+            best = i;
+    }
+
+    if ( best == slots.size() )
+        return false;
+
+    if ( slots[best].tileId != TERRAIN_NO_TILE )
+    {
+        residentSlot.erase( slots[best].tileId );
+        --stats.residentTiles;
+        ++stats.evictions;
+    }
+
+    Slot& target = slots[best];
+    target.tileId = tileId;
+    target.lastUsed = frame;
+    target.locked = locked;
+    target.minY = minY;
+    target.maxY = maxY;
+    residentSlot[tileId] = best;
+
+    ++stats.residentTiles;
+    ++stats.mappedTiles;
+
+    slot = best;
+    return true;
+}
+
+
+//=====================================================================================
+// TerrainStreamer
+//=====================================================================================
+
+TerrainStreamer::TerrainStreamer()
+    : quit( false )
+{
+    memset( &layout, 0, sizeof( layout ) );
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+    Close();
+}
+
+bool TerrainStreamer::Open( const char* name, unsigned int threadCount )
+{
+    Close();
+
+    std::ifstream file( name, std::ios::in | std::ios::binary );
+    if ( !file || !ReadHeader( file, layout ) )
+        return false;
+
+    ComputeMipBase( layout, mipBase );
+
+    // The file must hold every tile
+    file.seekg( 0, std::ios::end );
+    if ( size_t( file.tellg() ) < sizeof( TST_HEADER ) + mipBase[layout.mipCount] * layout.tileBytes )
+        return false;
+
+    fileName = name;
+    quit = false;
+    for ( unsigned int i = 0; i < ( threadCount ? threadCount : DEFAULT_WORKERS ); ++i )
+        workers.push_back( std::thread( &TerrainStreamer::WorkerMain, this ) );
+    return true;
+}
+
+void TerrainStreamer::Close()
+{
+    if ( !workers.empty() )
+    {
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            quit = true;
+        }
+        wake.notify_all();
+        for ( auto& worker : workers )
+            worker.join();
+        workers.clear();
+    }
+
+    queue.clear();
+    pending.clear();
+    completed.clear();
+}
+
+bool TerrainStreamer::ValidTile( uint32_t tileId ) const
+{
+    size_t mip = TerrainTileIdMip( tileId );
+    return mip < layout.mipCount && TerrainTileIdX( tileId ) < layout.TilesXAt( mip ) && TerrainTileIdZ( tileId ) < layout.TilesZAt( mip );
+}
+
+//-------------------------------------------------------------------------------------
+bool TerrainStreamer::ReadTileFrom( std::istream& file, uint32_t tileId, LoadedTile& tile ) const
+{
+    size_t mip = TerrainTileIdMip( tileId );
+    size_t index = mipBase[mip] + TerrainTileIdZ( tileId ) * layout.TilesXAt( mip ) + TerrainTileIdX( tileId );
+
+    tile.tileId = tileId;
+    tile.samples.resize( layout.TileSamples() * layout.TileSamples() );
+    file.clear();
+    file.seekg( sizeof( TST_HEADER ) + index * layout.tileBytes );
+    file.read( reinterpret_cast<char*>( tile.samples.data() ), layout.tileBytes );
+    if ( !file.good() )
+        return false;
+
+    // Bounds from the samples the tile draws, not its border
+    size_t samples = layout.TileSamples();
+    uint16_t lo = 0xFFFF, hi = 0;
+    for ( size_t j = 1; j + 1 < samples; ++j )
+    {
+        const uint16_t* row = &tile.samples[j * samples];
+        for ( size_t i = 1; i + 1 < samples; ++i )
+        {
+            lo = std::min( lo, row[i] );
+            hi = std::max( hi, row[i] );
+        }
+    }
+
+    tile.minY = layout.heightOffset + float( lo ) / 65535.0f * layout.heightRange;
+    tile.maxY = layout.heightOffset + float( hi ) / 65535.0f * layout.heightRange;
+    return true;
+}
+
+bool TerrainStreamer::ReadTile( uint32_t tileId, LoadedTile& tile )
+{
+    if ( fileName.empty() || !ValidTile( tileId ) )
+        return false;
+
+    std::ifstream file( fileName.c_str(), std::ios::in | std::ios::binary );
+    return file && ReadTileFrom( file, tileId, tile );
+}
+
+//-------------------------------------------------------------------------------------
+void TerrainStreamer::Request( const std::vector<uint32_t>& tileIds )
+{
+    {
+        std::lock_guard<std::mutex> guard( lock );
+
+        // Tiles still queued were wanted by an older frame
+        for ( size_t i = 0; i < queue.size(); ++i )
+            pending.erase( queue[i] );
+        queue.clear();
+
+        for ( size_t i = 0; i < tileIds.size(); ++i )
+        {
+            if ( ValidTile( tileIds[i] ) && pending.insert( tileIds[i] ).second )
+                queue.push_back( tileIds[i] );
+        }
+    }
+    wake.notify_all();
+}
+
+void TerrainStreamer::TakeCompleted( std::vector<LoadedTile>& tiles )
+{
+    tiles.clear();
+
+    std::lock_guard<std::mutex> guard( lock );
+    tiles.swap( completed );
+    for ( size_t i = 0; i < tiles.size(); ++i )
+    {
+        pending.erase( tiles[i].tileId );
+    }
+}
+
+size_t TerrainStreamer::GetPendingCount()
+{
+    std::lock_guard<std::mutex> guard( lock );
+    return pending.size();
+}
+
+void TerrainStreamer::WorkerMain()
+{
+    std::ifstream file( fileName.c_str(), std::ios::in | std::ios::binary );
+
+    std::unique_lock<std::mutex> guard( lock );
+    for ( ;; )
+    {
+        wake.wait( guard, [this]() { return quit || !queue.empty(); } );
+        if ( quit )
+            break;
+
+        uint32_t tileId = queue.front();
+        queue.pop_front();
+        guard.unlock();
+
+        LoadedTile tile;
+        bool ok = ReadTileFrom( file, tileId, tile );
+
+        guard.lock();
+        if ( ok )
+            completed.push_back( std::move( tile ) );
+        else
+            pending.erase( tileId );
+    }
+}
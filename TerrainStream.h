@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainStream.h
+//
+// Out-of-core terrain: tiled, mip-layered height files, tile residency and background
+// tile loading.
+//
+// A terrain stream file holds the height grid cut into square tiles of tileQuads quads,
+// for mip 0 and for every coarser mip, where mip m keeps every 2^m-th sample so a tile
+// covers 2^m times the area with the same vertex count. Tiles are 16-bit heights with a
+// one sample border for normals, all the same size, so nothing but the header is needed
+// to find one. Files are written from rows supplied one at a time, so the source grid
+// never has to be in memory as a whole.
+//
+// TerrainStreamCache is the Direct3D-free core: every frame it walks the tile quadtree
+// from the always-resident coarsest mip, refining near the camera only where all the
+// children are resident, which gives the draw list (coarse tiles stand in until the finer
+// ones arrive) and the loads to request. Resident tiles live in a fixed number of slots
+// with LRU replacement. TerrainStreamer reads tiles on worker threads.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINSTREAM_H
+#define TERRAINSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace DirectX
+{
+    const uint32_t TERRAIN_NO_TILE = 0xFFFFFFFF;
+
+    // Tile ids: x in bits 0-11, z in bits 12-23, mip in bits 24-31
+    inline uint32_t MakeTerrainTileId( size_t mip, size_t x, size_t z )
+    {
+        return uint32_t( x ) | ( uint32_t( z ) << 12 ) | ( uint32_t( mip ) << 24 );
+    }
+    inline size_t TerrainTileIdX( uint32_t id ) { return id & 0xFFF; }
+    inline size_t TerrainTileIdZ( uint32_t id ) { return ( id >> 12 ) & 0xFFF; }
+    inline size_t TerrainTileIdMip( uint32_t id ) { return id >> 24; }
+
+    struct TerrainStreamDesc
+    {
+        size_t      tileQuads;      // quads along each tile side, a power of two up to 128
+        float       spacingX;       // world units between mip 0 samples
+        float       spacingZ;
+        float       heightMin;      // range the 16-bit samples cover
+        float       heightMax;
+    };
+
+    struct TerrainStreamLayout
+    {
+        size_t      width;          // mip 0 samples
+        size_t      depth;
+        size_t      tileQuads;
+        size_t      tilesX;         // tiles across mip 0
+        size_t      tilesZ;
+        size_t      mipCount;       // down to the mip that is a single tile
+        float       spacingX;
+        float       spacingZ;
+        float       heightOffset;   // a sample s is heightOffset + s / 65535 * heightRange
+        float       heightRange;
+        size_t      tileBytes;
+
+        size_t TileSamples() const { return tileQuads + 3; }
+        size_t TilesXAt( size_t mip ) const { return ( tilesX + ( size_t( 1 ) << mip ) - 1 ) >> mip; }
+        size_t TilesZAt( size_t mip ) const { return ( tilesZ + ( size_t( 1 ) << mip ) - 1 ) >> mip; }
+    };
+
+    // A tile to draw, with how much coarser each neighbour is (0 for the same mip or finer);
+    // edges next to a coarser tile must follow that tile's edge to avoid cracks
+    struct TerrainStreamDrawTile
+    {
+        uint32_t    tileId;
+        size_t      slot;
+        size_t      coarserNeighbour[4];    // top (-z row), right, bottom, left
+        bool        fallback;               // drawn while finer tiles are still loading
+    };
+
+    struct TerrainStreamStats
+    {
+        size_t      residentTiles;
+        size_t      drawnTiles;             // in the last Select
+        size_t      fallbackTiles;
+        size_t      requestedTiles;
+        size_t      mappedTiles;            // since creation
+        size_t      evictions;
+    };
+
+    // Supplies mip 0 row z of the source grid (width heights, row 0 the far +Z edge)
+    typedef std::function<bool( size_t z, float* row )> TerrainRowReader;
+
+    // Writes a terrain stream file from a width x depth grid read a row at a time. Rows are
+    // read again for each mip, at most tileQuads + 3 of them held at once. Tiles are cut
+    // on all hardware threads.
+    bool BuildTerrainStreamFile( const char* fileName,
+                                 size_t width,
+                                 size_t depth,
+                                 const TerrainStreamDesc& desc,
+                                 const TerrainRowReader& readRow,
+                                 unsigned int threadCount = 0 );
+
+    // The same from a grid in memory; the height range is taken from the grid
+    bool BuildTerrainStreamFile( const char* fileName,
+                                 const float* heights,
+                                 size_t width,
+                                 size_t depth,
+                                 const TerrainStreamDesc& desc,
+                                 unsigned int threadCount = 0 );
+
+    bool ReadTerrainStreamLayout( const char* fileName, TerrainStreamLayout& layout );
+
+    //----------------------------------------------------------------------------------
+    class TerrainStreamCache
+    {
+    public:
+        TerrainStreamCache( const TerrainStreamLayout& layout, size_t slotCount );
+
+        // Picks the tiles to draw and the tiles to load for a camera in terrain space. A tile
+        // is split while the camera is within lodDistance tile widths of it. Requests are
+        // coarsest first, nearest first within a mip.
+        void Select( float cameraX,
+                     float cameraY,
+                     float cameraZ,
+                     float lodDistance,
+                     std::vector<TerrainStreamDrawTile>& draw,
+                     std::vector<uint32_t>& requests );
+
+        // Assigns a slot to a loaded tile, evicting the least recently used unlocked tile if
+        // every slot is taken. Fails if none can be freed. minY and maxY bound the tile.
+        bool MapTile( uint32_t tileId, float minY, float maxY, bool locked, size_t& slot );
+
+        bool IsResident( uint32_t tileId ) const;
+
+        // Terrain space bounds of a resident tile
+        bool GetTileBounds( uint32_t tileId, float boundsMin[3], float boundsMax[3] ) const;
+
+        // Starts a new frame for LRU purposes
+        void EndFrame() { ++frame; }
+
+        size_t GetSlotCount() const { return slots.size(); }
+        TerrainStreamStats GetStats() const { return stats; }
+        const TerrainStreamLayout& GetLayout() const { return layout; }
+
+    private:
+        struct Slot
+        {
+            uint32_t    tileId;         // TERRAIN_NO_TILE if free
+            uint64_t    lastUsed;
+            bool        locked;
+            float       minY;
+            float       maxY;
+        };
+
+        void Visit( uint32_t tileId, float cameraX, float cameraY, float cameraZ, float lodDistance,
+                    std::vector<TerrainStreamDrawTile>& draw, std::vector<uint32_t>& requests );
+        void TileArea( uint32_t tileId, float& x0, float& z0, float& x1, float& z1 ) const;
+        int32_t FindSlot( uint32_t tileId ) const;
+
+        TerrainStreamLayout                     layout;
+        std::vector<Slot>                       slots;
+        std::unordered_map<uint32_t, size_t>    residentSlot;
+        std::unordered_map<uint32_t, size_t>    drawIndex;      // tile id to draw list entry, during Select
+        uint64_t                                frame;
+        TerrainStreamStats                      stats;
+    };
+
+    //----------------------------------------------------------------------------------
+    class TerrainStreamer
+    {
+    public:
+        struct LoadedTile
+        {
+            uint32_t                tileId;
+            std::vector<uint16_t>   samples;    // TileSamples() squared, border included
+            float                   minY;       // heights of the samples inside the border
+            float                   maxY;
+        };
+
+        TerrainStreamer();
+        ~TerrainStreamer();
+
+        // threadCount of 0 uses two workers
+        bool Open( const char* fileName, unsigned int threadCount = 0 );
+        void Close();
+
+        const TerrainStreamLayout& GetLayout() const { return layout; }
+
+        // Reads a tile on the calling thread (used for the always-resident coarsest mip)
+        bool ReadTile( uint32_t tileId, LoadedTile& tile );
+
+        // Replaces the queue with these tiles, in order; tiles being read or already read
+        // but not yet taken are skipped
+        void Request( const std::vector<uint32_t>& tileIds );
+
+        // Moves finished tiles into tiles; they may be requested again from then on
+        void TakeCompleted( std::vector<LoadedTile>& tiles );
+
+        // Tiles queued or being read
+        size_t GetPendingCount();
+
+    private:
+        void WorkerMain();
+        bool ReadTileFrom( std::istream& file, uint32_t tileId, LoadedTile& tile ) const;
+        bool ValidTile( uint32_t tileId ) const;
+
+        TerrainStreamLayout                 layout;
+        std::vector<size_t>                 mipBase;
+        std::string                         fileName;
+
+        std::mutex                          lock;
+        std::condition_variable             wake;
+        std::deque<uint32_t>                queue;
+        std::set<uint32_t>                  pending;    // queued, being read or completed
+        std::vector<LoadedTile>             completed;
+        bool                                quit;
+        std::vector<std::thread>            workers;
+    };
+}
+
+#endif // TERRAINSTREAM_H
@@ -0,0 +1,469 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainTiles.cpp
+//
+// Tiled terrain grid generation.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "TerrainTiles.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const size_t MAX_TILE_QUADS = 255;
+
+// 0xFFFF is the strip cut value for 16-bit indices, so no vertex may use it
+const size_t MAX_RESTART_TILE_QUADS = 254;
+const uint16_t STRIP_CUT_INDEX = 0xFFFF;
+
+// Unsigned normalised sample for a scaled height, quantise being 65535 / heightRange (0 for
+// a flat grid)
+inline uint16_t QuantiseHeight( float y, float heightOffset, float quantise )
+{
+    float q = ( y - heightOffset ) * quantise + 0.5f;
+    return uint16_t( std::min( std::max( q, 0.0f ), 65535.0f ) );
+}
+
+// Vertex and bounds generation shared by building and updating tiles
+struct TileGrid
+{
+    const float*        heights;
+    const float*        normals;
+    size_t              width;
+    size_t              depth;
+    TerrainTileDesc     desc;
+    float               originX;
+    float               originZ;
+    float               du;
+    float               dv;
+
+    TileGrid( const float* heights, const float* normals, size_t width, size_t depth, const TerrainTileDesc& desc ) :
+        heights( heights ),
+        normals( normals ),
+        width( width ),
+        depth( depth ),
+        desc( desc ),
+        originX( -0.5f * float( width - 1 ) * desc.spacingX ),
+        originZ( 0.5f * float( depth - 1 ) * desc.spacingZ ),
+        du( 1.0f / float( width - 1 ) ),
+        dv( 1.0f / float( depth - 1 ) )
+    {
+    }
+
+    // Writes rows [firstRow, lastRow) of the tile's vertices, whole rows, and the height
+    // range they cover
+    void WriteRows( const TerrainTile& tile, size_t firstRow, size_t lastRow, TerrainTileVertex* v, float& minY, float& maxY ) const
+    {
+        size_t stride = desc.tileQuads + 1;
+        minY = heights[std::min( tile.gridZ + firstRow, depth - 1 ) * width + tile.gridX] * desc.heightScale;
+        maxY = minY;
+
+        for ( size_t i = firstRow; i < lastRow; ++i )
+        {
+            // Rows and columns past the grid repeat the last one
+            size_t row = std::min( tile.gridZ + i, depth - 1 );
+            const float* heightRow = heights + row * width;
+
+            for ( size_t j = 0; j < stride; ++j, ++v )
+            {
+                size_t column = std::min( tile.gridX + j, width - 1 );
+                float y = heightRow[column] * desc.heightScale;
+
+                v->position[0] = originX + float( column ) * desc.spacingX;
+                v->position[1] = y;
+                v->position[2] = originZ - float( row ) * desc.spacingZ;
+                if ( normals )
+                {
+                    const float* n = normals + ( row * width + column ) * 3;
+                    v->normal[0] = n[0];
+                    v->normal[1] = n[1];
+                    v->normal[2] = n[2];
+                }
+                else
+                {
+                    v->normal[0] = 0.0f;
+                    v->normal[1] = 1.0f;
+                    v->normal[2] = 0.0f;
+                }
+                v->texCoord[0] = float( column ) * du;
+                v->texCoord[1] = float( row ) * dv;
+
+                minY = std::min( minY, y );
+                maxY = std::max( maxY, y );
+            }
+        }
+    }
+
+    // Height range of every sample under the tile
+    void GetHeightRange( const TerrainTile& tile, float& minY, float& maxY ) const
+    {
+        size_t lastColumn = std::min( tile.gridX + desc.tileQuads, width - 1 );
+        size_t lastRow = std::min( tile.gridZ + desc.tileQuads, depth - 1 );
+
+        float lo = heights[tile.gridZ * width + tile.gridX];
+        float hi = lo;
+        for ( size_t row = tile.gridZ; row <= lastRow; ++row )
+        {
+            const float* heightRow = heights + row * width;
+            for ( size_t column = tile.gridX; column <= lastColumn; ++column )
+            {
+                lo = std::min( lo, heightRow[column] );
+                hi = std::max( hi, heightRow[column] );
+            }
+        }
+
+        // A negative scale swaps which sample ends up lowest
+        minY = std::min( lo * desc.heightScale, hi * desc.heightScale );
+        maxY = std::max( lo * desc.heightScale, hi * desc.heightScale );
+    }
+
+    void SetBounds( TerrainTile& tile, float minY, float maxY ) const
+    {
+        size_t lastColumn = std::min( tile.gridX + desc.tileQuads, width - 1 );
+        size_t lastRow = std::min( tile.gridZ + desc.tileQuads, depth - 1 );
+        tile.boundsMin[0] = originX + float( tile.gridX ) * desc.spacingX;
+        tile.boundsMin[1] = minY;
+        tile.boundsMin[2] = originZ - float( lastRow ) * desc.spacingZ;
+        tile.boundsMax[0] = originX + float( lastColumn ) * desc.spacingX;
+        tile.boundsMax[1] = maxY;
+        tile.boundsMax[2] = originZ - float( tile.gridZ ) * desc.spacingZ;
+    }
+};
+
+};
+
+
+//-------------------------------------------------------------------------------------
+size_t DirectX::TerrainTileVertexCount( size_t tileQuads )
+{
+    return ( tileQuads + 1 ) * ( tileQuads + 1 );
+}
+
+size_t DirectX::TerrainTileIndexCount( size_t tileQuads )
+{
+    return tileQuads * tileQuads * 6;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainTileIndices( size_t tileQuads, std::vector<uint16_t>& indices )
+{
+    if ( !tileQuads || tileQuads > MAX_TILE_QUADS )
+        return false;
+
+    size_t stride = tileQuads + 1;
+    indices.resize( TerrainTileIndexCount( tileQuads ) );
+
+    size_t k = 0;
+    for ( size_t i = 0; i < tileQuads; ++i )
+    {
+        for ( size_t j = 0; j < tileQuads; ++j )
+        {
+            indices[k]     = uint16_t( i * stride + j );
+            indices[k + 1] = uint16_t( i * stride + j + 1 );
+            indices[k + 2] = uint16_t( ( i + 1 ) * stride + j );
+            indices[k + 3] = uint16_t( ( i + 1 ) * stride + j );
+            indices[k + 4] = uint16_t( i * stride + j + 1 );
+            indices[k + 5] = uint16_t( ( i + 1 ) * stride + j + 1 );
+            k += 6;
+        }
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Each row runs top 0, bottom 0, top 1, bottom 1, ... so every cell gets the list's top
+// right to bottom left diagonal. The first triangle of that order winds the wrong way, so
+// the row's first vertex is placed on an odd strip position, repeating it if needed.
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainTileStripIndices( size_t tileQuads, TERRAIN_STRIP_JOIN join, std::vector<uint16_t>& indices )
+{
+    if ( !tileQuads || tileQuads > MAX_TILE_QUADS )
+        return false;
+
+    if ( join == TERRAIN_STRIP_RESTART && tileQuads > MAX_RESTART_TILE_QUADS )
+        return false;
+
+    size_t stride = tileQuads + 1;
+    indices.clear();
+    indices.reserve( tileQuads * ( 2 * stride + 4 ) );
+
+    size_t stripStart = 0;
+    for ( size_t i = 0; i < tileQuads; ++i )
+    {
+        uint16_t first = uint16_t( i * stride );
+
+        if ( i > 0 )
+        {
+            if ( join == TERRAIN_STRIP_RESTART )
+            {
+                indices.push_back( STRIP_CUT_INDEX );
+                stripStart = indices.size();
+            }
+            else
+            {
+                // Repeat the last vertex and the next first one, all four bridging triangles have no area
+                indices.push_back( indices.back() );
+                indices.push_back( first );
+            }
+        }
+
+        indices.push_back( first );
+        if ( ( indices.size() - stripStart ) % 2 == 1 )
+            indices.push_back( first );
+
+        for ( size_t j = 0; j < stride; ++j )
+        {
+            if ( j > 0 )
+                indices.push_back( uint16_t( i * stride + j ) );
+            indices.push_back( uint16_t( ( i + 1 ) * stride + j ) );
+        }
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+void DirectX::AnalyseTerrainIndices( const uint16_t* indices,
+                                     size_t indexCount,
+                                     bool strip,
+                                     size_t cacheSize,
+                                     TerrainIndexStats& stats )
+{
+    stats.indexCount = indexCount;
+    stats.triangleCount = 0;
+    stats.cacheMisses = 0;
+
+    // FIFO: a hit does not refresh an entry's age
+    std::vector<int> cache( std::max<size_t>( cacheSize, 1 ), -1 );
+    size_t next = 0;
+    std::vector<bool> seen;
+
+    size_t run = 0;
+    for ( size_t k = 0; k < indexCount; ++k )
+    {
+        uint16_t index = indices[k];
+        if ( strip && index == STRIP_CUT_INDEX )
+        {
+            run = 0;
+            continue;
+        }
+
+        if ( std::find( cache.begin(), cache.end(), int( index ) ) == cache.end() )
+        {
+            cache[next] = index;
+            next = ( next + 1 ) % cache.size();
+            ++stats.cacheMisses;
+        }
+
+        if ( index >= seen.size() )
+            seen.resize( index + 1, false );
+        seen[index] = true;
+
+        ++run;
+        bool completes = strip ? ( run >= 3 ) : ( run % 3 == 0 );
+        if ( completes )
+        {
+            uint16_t a = indices[k - 2], b = indices[k - 1];
+            if ( a != b && b != index && a != index )
+                ++stats.triangleCount;
+        }
+    }
+
+    size_t vertices = size_t( std::count( seen.begin(), seen.end(), true ) );
+    stats.missesPerTriangle = stats.triangleCount ? float( stats.cacheMisses ) / float( stats.triangleCount ) : 0.0f;
+    stats.missesPerVertex = vertices ? float( stats.cacheMisses ) / float( vertices ) : 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainTiles( const float* heights,
+                                 const float* normals,
+                                 size_t width,
+                                 size_t depth,
+                                 const TerrainTileDesc& desc,
+                                 std::vector<TerrainTileVertex>& vertices,
+                                 std::vector<TerrainTile>& tiles,
+                                 unsigned int threadCount )
+{
+    if ( !heights || width < 2 || depth < 2 || !desc.tileQuads || desc.tileQuads > MAX_TILE_QUADS )
+        return false;
+
+    size_t tileQuads = desc.tileQuads;
+    size_t stride = tileQuads + 1;
+    size_t tilesX = ( width - 2 ) / tileQuads + 1;
+    size_t tilesZ = ( depth - 2 ) / tileQuads + 1;
+    size_t tileVertices = TerrainTileVertexCount( tileQuads );
+
+    tiles.resize( tilesX * tilesZ );
+    vertices.resize( tiles.size() * tileVertices );
+
+    TileGrid grid( heights, normals, width, depth, desc );
+    ParallelFor( tiles.size(), threadCount, [&]( size_t t )
+    {
+        TerrainTile& tile = tiles[t];
+        tile.gridX = ( t % tilesX ) * tileQuads;
+        tile.gridZ = ( t / tilesX ) * tileQuads;
+        tile.firstVertex = t * tileVertices;
+
+        float minY, maxY;
+        grid.WriteRows( tile, 0, stride, &vertices[tile.firstVertex], minY, maxY );
+        grid.SetBounds( tile, minY, maxY );
+    } );
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::UpdateTerrainTiles( const float* heights,
+                                  const float* normals,
+                                  size_t width,
+                                  size_t depth,
+                                  const TerrainTileDesc& desc,
+                                  size_t x0,
+                                  size_t z0,
+                                  size_t x1,
+                                  size_t z1,
+                                  std::vector<TerrainTile>& tiles,
+                                  std::vector<TerrainTileVertex>& vertices,
+                                  std::vector<TerrainTileUpdate>& updates )
+{
+    vertices.clear();
+    updates.clear();
+
+    if ( !heights || width < 2 || depth < 2 || !desc.tileQuads || desc.tileQuads > MAX_TILE_QUADS )
+        return false;
+
+    size_t tileQuads = desc.tileQuads;
+    size_t stride = tileQuads + 1;
+    size_t tilesX = ( width - 2 ) / tileQuads + 1;
+    size_t tilesZ = ( depth - 2 ) / tileQuads + 1;
+    if ( tiles.size() != tilesX * tilesZ )
+        return false;
+
+    x1 = std::min( x1, width );
+    z1 = std::min( z1, depth );
+    if ( x0 >= x1 || z0 >= z1 )
+        return false;
+
+    // Tiles share their edge samples, so a sample on a tile edge is in up to four of them
+    size_t tileX0 = x0 ? ( x0 - 1 ) / tileQuads : 0;
+    size_t tileZ0 = z0 ? ( z0 - 1 ) / tileQuads : 0;
+    size_t tileX1 = std::min( ( x1 - 1 ) / tileQuads, tilesX - 1 );
+    size_t tileZ1 = std::min( ( z1 - 1 ) / tileQuads, tilesZ - 1 );
+
+    TileGrid grid( heights, normals, width, depth, desc );
+    for ( size_t tileZ = tileZ0; tileZ <= tileZ1; ++tileZ )
+    {
+        for ( size_t tileX = tileX0; tileX <= tileX1; ++tileX )
+        {
+            size_t t = tileZ * tilesX + tileX;
+            TerrainTile& tile = tiles[t];
+
+            // Rows of the tile holding the samples; the repeated rows past the last one
+            // change with it
+            size_t firstRow = z0 > tile.gridZ ? z0 - tile.gridZ : 0;
+            size_t lastRow = z1 >= depth ? stride : std::min( z1 - tile.gridZ, stride );
+            if ( firstRow >= lastRow )
+                continue;
+
+            TerrainTileUpdate update;
+            update.tile = t;
+            update.firstVertex = tile.firstVertex + firstRow * stride;
+            update.vertexCount = ( lastRow - firstRow ) * stride;
+            update.offset = vertices.size();
+            updates.push_back( update );
+
+            float minY, maxY;
+            vertices.resize( vertices.size() + update.vertexCount );
+            grid.WriteRows( tile, firstRow, lastRow, &vertices[update.offset], minY, maxY );
+
+            // Lowering a sample can shrink the box, so it is taken over the whole tile again
+            grid.GetHeightRange( tile, minY, maxY );
+            grid.SetBounds( tile, minY, maxY );
+        }
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildTerrainTileHeights( const float* heights,
+                                       size_t width,
+                                       size_t depth,
+                                       const TerrainTileDesc& desc,
+                                       std::vector<uint16_t>& samples,
+                                       float& heightOffset,
+                                       float& heightRange,
+                                       unsigned int threadCount )
+{
+    if ( !heights || width < 2 || depth < 2 || !desc.tileQuads || desc.tileQuads > MAX_TILE_QUADS )
+        return false;
+
+    // Quantise over the scaled range of the whole grid so tiles meet exactly
+    auto range = std::minmax_element( heights, heights + width * depth );
+    float a = *range.first * desc.heightScale;
+    float b = *range.second * desc.heightScale;
+    heightOffset = std::min( a, b );
+    heightRange = std::max( a, b ) - heightOffset;
+    float quantise = ( heightRange > 0.0f ) ? 65535.0f / heightRange : 0.0f;
+
+    size_t tileQuads = desc.tileQuads;
+    size_t stride = tileQuads + 1;
+    size_t tilesX = ( width - 2 ) / tileQuads + 1;
+    size_t tilesZ = ( depth - 2 ) / tileQuads + 1;
+    size_t tileVertices = TerrainTileVertexCount( tileQuads );
+
+    samples.resize( tilesX * tilesZ * tileVertices );
+
+    ParallelFor( tilesX * tilesZ, threadCount, [&]( size_t t )
+    {
+        size_t gridX = ( t % tilesX ) * tileQuads;
+        size_t gridZ = ( t / tilesX ) * tileQuads;
+
+        uint16_t* s = &samples[t * tileVertices];
+        for ( size_t i = 0; i < stride; ++i )
+        {
+            const float* heightRow = heights + std::min( gridZ + i, depth - 1 ) * width;
+            for ( size_t j = 0; j < stride; ++j, ++s )
+            {
+                float y = heightRow[std::min( gridX + j, width - 1 )] * desc.heightScale;
+                *s = QuantiseHeight( y, heightOffset, quantise );
+            }
+        }
+    } );
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::UpdateTerrainTileHeights( const std::vector<TerrainTileVertex>& vertices,
+                                        float heightOffset,
+                                        float heightRange,
+                                        std::vector<uint16_t>& samples )
+{
+    samples.resize( vertices.size() );
+
+    // Heights that left the range would clamp, the whole grid has to be quantised again
+    float quantise = ( heightRange > 0.0f ) ? 65535.0f / heightRange : 0.0f;
+    for ( size_t i = 0; i < vertices.size(); ++i )
+    {
+        float y = vertices[i].position[1];
+        if ( y < heightOffset || y > heightOffset + heightRange )
+            return false;
+        samples[i] = QuantiseHeight( y, heightOffset, quantise );
+    }
+
+    return true;
+}
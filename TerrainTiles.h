@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainTiles.h
+//
+// Splits a heightmap grid into fixed-size square tiles.
+//
+// Every tile has the same number of vertices in the same order, so a single 16-bit index
+// list serves all of them and each tile is drawn with its own base vertex. Tiles on the
+// far edges of grids that are not a whole number of tiles repeat the last row or column,
+// which only adds zero-area triangles. Each tile carries an axis-aligned bounding box for
+// culling. After heights change, only the rows of the tiles holding them are rebuilt.
+//
+// Tiles can also be stored as heights alone: one 16-bit sample per vertex, in the same
+// order, with the position and texture coordinates rebuilt from the vertex index in the
+// vertex shader. Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TERRAINTILES_H
+#define TERRAINTILES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    // Same layout as SimpleVertex
+    struct TerrainTileVertex
+    {
+        float       position[3];
+        float       normal[3];
+        float       texCoord[2];
+    };
+
+    struct TerrainTileDesc
+    {
+        size_t      tileQuads;      // quads along each tile side, at most 255 so indices fit 16 bits
+        float       spacingX;       // world units between samples
+        float       spacingZ;
+        float       heightScale;    // applied to the height samples
+    };
+
+    // How the rows of a strip index list are joined
+    enum TERRAIN_STRIP_JOIN
+    {
+        TERRAIN_STRIP_RESTART = 0,      // a 0xFFFF cut index between rows (tileQuads at most 254)
+        TERRAIN_STRIP_DEGENERATE,       // one strip, rows bridged by zero-area triangles
+    };
+
+    // Vertex cache behaviour of an index list, from a simulated FIFO cache
+    struct TerrainIndexStats
+    {
+        size_t      indexCount;
+        size_t      triangleCount;      // excluding degenerate triangles
+        size_t      cacheMisses;
+        float       missesPerTriangle;  // ACMR
+        float       missesPerVertex;    // ATVR, 1.0 is ideal
+    };
+
+    struct TerrainTile
+    {
+        size_t      gridX;          // first sample column and row covered by the tile
+        size_t      gridZ;
+        size_t      firstVertex;    // offset of the tile's vertices in the vertex list
+        float       boundsMin[3];
+        float       boundsMax[3];
+    };
+
+    // A run of one tile's vertices rebuilt by UpdateTerrainTiles
+    struct TerrainTileUpdate
+    {
+        size_t      tile;
+        size_t      firstVertex;    // in the vertex list BuildTerrainTiles made
+        size_t      vertexCount;
+        size_t      offset;         // of the new vertices in the update's vertex list
+    };
+
+    // Vertices and indices per tile
+    size_t TerrainTileVertexCount( size_t tileQuads );
+    size_t TerrainTileIndexCount( size_t tileQuads );
+
+    // The index list shared by every tile (triangle list, same winding as the old single grid)
+    bool BuildTerrainTileIndices( size_t tileQuads, std::vector<uint16_t>& indices );
+
+    // The same triangles as row-wise triangle strips, about a third of the indices.
+    // Each row starts on an odd strip position, so the strip winding matches the list.
+    bool BuildTerrainTileStripIndices( size_t tileQuads, TERRAIN_STRIP_JOIN join, std::vector<uint16_t>& indices );
+
+    // Counts the triangles an index list draws and the misses a FIFO cache of cacheSize
+    // vertices takes on it. strip selects triangle strip rules (0xFFFF restarts the strip).
+    void AnalyseTerrainIndices( const uint16_t* indices,
+                                size_t indexCount,
+                                bool strip,
+                                size_t cacheSize,
+                                TerrainIndexStats& stats );
+
+    // Builds the vertices of every tile of a width x depth height grid (row 0 is the far,
+    // +Z edge), centred on the origin with texture coordinates spanning [0,1]. normals
+    // holds three floats per sample (see ComputeTerrainNormals); nullptr leaves every
+    // normal pointing up. Tiles are generated in parallel; threadCount of 0 uses every
+    // hardware thread.
+    bool BuildTerrainTiles( const float* heights,
+                            const float* normals,
+                            size_t width,
+                            size_t depth,
+                            const TerrainTileDesc& desc,
+                            std::vector<TerrainTileVertex>& vertices,
+                            std::vector<TerrainTile>& tiles,
+                            unsigned int threadCount = 0 );
+
+    // Rebuilds the vertices of samples [x0, x1) x [z0, z1), after their heights or normals
+    // changed, in every tile that holds them, and those tiles' bounds. The new vertices go
+    // to vertices, one run of whole tile rows per tile listed in updates, ready to copy
+    // over the same range of the vertex list or buffer. Cost follows the rows changed, not
+    // the size of the grid.
+    bool UpdateTerrainTiles( const float* heights,
+                             const float* normals,
+                             size_t width,
+                             size_t depth,
+                             const TerrainTileDesc& desc,
+                             size_t x0,
+                             size_t z0,
+                             size_t x1,
+                             size_t z1,
+                             std::vector<TerrainTile>& tiles,
+                             std::vector<TerrainTileVertex>& vertices,
+                             std::vector<TerrainTileUpdate>& updates );
+
+    // Height-only vertices for the tiles BuildTerrainTiles makes from the same grid and
+    // desc: (tileQuads + 1)^2 unsigned normalised samples per tile, tile after tile.
+    // A sample s stands for the height heightOffset + s / 65535 * heightRange.
+    bool BuildTerrainTileHeights( const float* heights,
+                                  size_t width,
+                                  size_t depth,
+                                  const TerrainTileDesc& desc,
+                                  std::vector<uint16_t>& samples,
+                                  float& heightOffset,
+                                  float& heightRange,
+                                  unsigned int threadCount = 0 );
+
+    // Height-only samples for the vertices UpdateTerrainTiles rebuilt, at the same offsets,
+    // so each update's run goes over samples [firstVertex, firstVertex + vertexCount) of the
+    // list BuildTerrainTileHeights made. Returns false when a height is outside the range
+    // that list was quantised over; BuildTerrainTileHeights then has to run again.
+    bool UpdateTerrainTileHeights( const std::vector<TerrainTileVertex>& vertices,
+                                   float heightOffset,
+                                   float heightRange,
+                                   std::vector<uint16_t>& samples );
+}
+
+#endif // TERRAINTILES_H
@@ -0,0 +1,292 @@
+#include "TerrainVirtualTexture.h"
+#include <math.h>
+
+TerrainVirtualTexture::TerrainVirtualTexture()
+{
+	_cache = nullptr;
+	_physicalTexture = nullptr;
+	_physicalView = nullptr;
+	_pageTable = nullptr;
+	_pageTableView = nullptr;
+	_constantBuffer = nullptr;
+	_feedbackWidth = 0;
+	_feedbackHeight = 0;
+	_feedbackTarget = nullptr;
+	_feedbackView = nullptr;
+	_feedbackDepth = nullptr;
+	_feedbackDepthView = nullptr;
+	for (UINT i = 0; i < FEEDBACK_LATENCY; ++i)
+		_feedbackReadback[i] = nullptr;
+	_feedbackFrame = 0;
+	_savedTarget = nullptr;
+	_savedDepth = nullptr;
+	_savedBlend = nullptr;
+}
+
+TerrainVirtualTexture::~TerrainVirtualTexture()
+{
+	//Stop the loader before anything it fills goes away
+	_streamer.Close();
+	delete _cache;
+
+	if (_physicalView) _physicalView->Release();
+	if (_physicalTexture) _physicalTexture->Release();
+	if (_pageTableView) _pageTableView->Release();
+	if (_pageTable) _pageTable->Release();
+	if (_constantBuffer) _constantBuffer->Release();
+	if (_feedbackView) _feedbackView->Release();
+	if (_feedbackTarget) _feedbackTarget->Release();
+	if (_feedbackDepthView) _feedbackDepthView->Release();
+	if (_feedbackDepth) _feedbackDepth->Release();
+	for (UINT i = 0; i < FEEDBACK_LATENCY; ++i)
+	{
+		if (_feedbackReadback[i]) _feedbackReadback[i]->Release();
+	}
+}
+
+HRESULT TerrainVirtualTexture::Initialise(ID3D11Device* device, ID3D11DeviceContext* context, const char* fileName, UINT screenWidth, UINT screenHeight)
+{
+	HRESULT hr;
+
+	if (!_streamer.Open(fileName))
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+	const VirtualTextureLayout& layout = _streamer.GetLayout();
+	UINT tileSize = (UINT)layout.TileSize();
+
+	DXGI_FORMAT physicalFormat = DXGI_FORMAT_BC1_UNORM;
+	if (layout.format == BC_FORMAT_BC3)
+		physicalFormat = DXGI_FORMAT_BC3_UNORM;
+	else if (layout.format == BC_FORMAT_BC7)
+		physicalFormat = DXGI_FORMAT_BC7_UNORM;
+
+	//Physical pages, one texture holding PHYSICAL_PAGES x PHYSICAL_PAGES bordered pages
+	D3D11_TEXTURE2D_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = tileSize * PHYSICAL_PAGES;
+	texDesc.Height = tileSize * PHYSICAL_PAGES;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = physicalFormat;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	hr = device->CreateTexture2D(&texDesc, nullptr, &_physicalTexture);
+	if (FAILED(hr))
+		return hr;
+	hr = device->CreateShaderResourceView(_physicalTexture, nullptr, &_physicalView);
+	if (FAILED(hr))
+		return hr;
+
+	//Page table, one texel per page and one mip per virtual mip
+	texDesc.Width = (UINT)layout.pages;
+	texDesc.Height = (UINT)layout.pages;
+	texDesc.MipLevels = (UINT)layout.mipCount;
+	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+
+	hr = device->CreateTexture2D(&texDesc, nullptr, &_pageTable);
+	if (FAILED(hr))
+		return hr;
+	hr = device->CreateShaderResourceView(_pageTable, nullptr, &_pageTableView);
+	if (FAILED(hr))
+		return hr;
+
+	//Feedback target, its depth buffer and the staging copies it is read back through
+	_feedbackWidth = max(screenWidth / FEEDBACK_SCALE, 1u);
+	_feedbackHeight = max(screenHeight / FEEDBACK_SCALE, 1u);
+
+	texDesc.Width = _feedbackWidth;
+	texDesc.Height = _feedbackHeight;
+	texDesc.MipLevels = 1;
+	texDesc.Format = DXGI_FORMAT_R32_UINT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+
+	hr = device->CreateTexture2D(&texDesc, nullptr, &_feedbackTarget);
+	if (FAILED(hr))
+		return hr;
+	hr = device->CreateRenderTargetView(_feedbackTarget, nullptr, &_feedbackView);
+	if (FAILED(hr))
+		return hr;
+
+	texDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+
+	hr = device->CreateTexture2D(&texDesc, nullptr, &_feedbackDepth);
+	if (FAILED(hr))
+		return hr;
+	hr = device->CreateDepthStencilView(_feedbackDepth, nullptr, &_feedbackDepthView);
+	if (FAILED(hr))
+		return hr;
+
+	texDesc.Format = DXGI_FORMAT_R32_UINT;
+	texDesc.Usage = D3D11_USAGE_STAGING;
+	texDesc.BindFlags = 0;
+	texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+	for (UINT i = 0; i < FEEDBACK_LATENCY; ++i)
+	{
+		hr = device->CreateTexture2D(&texDesc, nullptr, &_feedbackReadback[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = sizeof(VirtualTextureConstants);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	VirtualTextureConstants constants;
+	constants.VTParams = XMFLOAT4((float)layout.pages, (float)layout.pageSize, (float)layout.border, (float)(layout.mipCount - 1));
+	float physicalScale = 1.0f / (float)(tileSize * PHYSICAL_PAGES);
+	//The feedback target is FEEDBACK_SCALE times coarser, so its derivatives pick mips that much too low
+	constants.VTPhysical = XMFLOAT4(physicalScale, physicalScale, (float)tileSize, -log2f((float)FEEDBACK_SCALE));
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = &constants;
+
+	hr = device->CreateBuffer(&bd, &initData, &_constantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	_cache = new VirtualTextureCache(layout, PHYSICAL_PAGES, PHYSICAL_PAGES);
+
+	//The coarsest mip is a single page that stays resident, so every lookup has something to show
+	VirtualTextureStreamer::LoadedPage root;
+	root.pageId = MakePageId(layout.mipCount - 1, 0, 0);
+	if (!_streamer.ReadPage(root.pageId, root.data))
+		return E_FAIL;
+	UploadPage(context, root, true);
+
+	return S_OK;
+}
+
+void TerrainVirtualTexture::UploadPage(ID3D11DeviceContext* context, const VirtualTextureStreamer::LoadedPage& page, bool locked)
+{
+	size_t slotX, slotY;
+	if (!_cache->MapPage(page.pageId, locked, slotX, slotY))
+		return;
+
+	UINT tileSize = (UINT)_cache->GetLayout().TileSize();
+	UINT blockBytes = (UINT)BCBlockSize(_cache->GetLayout().format);
+
+	D3D11_BOX box;
+	box.left = (UINT)slotX * tileSize;
+	box.top = (UINT)slotY * tileSize;
+	box.front = 0;
+	box.right = box.left + tileSize;
+	box.bottom = box.top + tileSize;
+	box.back = 1;
+
+	context->UpdateSubresource(_physicalTexture, 0, &box, page.data.data(), (tileSize / 4) * blockBytes, 0);
+}
+
+void TerrainVirtualTexture::ReadFeedback(ID3D11DeviceContext* context)
+{
+	//Not written yet for the first few frames
+	if (_feedbackFrame < FEEDBACK_LATENCY)
+		return;
+
+	//The oldest copy, about to be overwritten by this frame's feedback
+	ID3D11Texture2D* readback = _feedbackReadback[_feedbackFrame % FEEDBACK_LATENCY];
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(context->Map(readback, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+		return;
+
+	_feedback.resize(_feedbackWidth * _feedbackHeight);
+	for (UINT y = 0; y < _feedbackHeight; ++y)
+	{
+		memcpy(&_feedback[y * _feedbackWidth], (const uint8_t*)mapped.pData + y * mapped.RowPitch, _feedbackWidth * sizeof(uint32_t));
+	}
+	context->Unmap(readback, 0);
+
+	_cache->AnalyseFeedback(_feedback.data(), _feedback.size(), _requests);
+
+	//Requests are coarsest first, so a budget keeps the low detail arriving before the fine detail
+	size_t budget = MAX_REQUESTS_PER_FRAME;
+	size_t pending = _streamer.GetPendingCount();
+	for (size_t i = 0; i < _requests.size() && budget > 0 && pending < MAX_PENDING; ++i, --budget, ++pending)
+	{
+		_streamer.Request(_requests[i]);
+	}
+}
+
+void TerrainVirtualTexture::Update(ID3D11DeviceContext* context)
+{
+	if (!_cache)
+		return;
+
+	ReadFeedback(context);
+
+	_streamer.TakeCompleted(_loaded);
+	for (size_t i = 0; i < _loaded.size(); ++i)
+	{
+		UploadPage(context, _loaded[i], false);
+	}
+
+	const VirtualTextureLayout& layout = _cache->GetLayout();
+	for (size_t mip = 0; mip < layout.mipCount; ++mip)
+	{
+		if (!_cache->IsPageTableDirty(mip))
+			continue;
+
+		context->UpdateSubresource(_pageTable, (UINT)mip, nullptr, _cache->GetPageTable(mip).data(), (UINT)(layout.PagesAt(mip) * 4), 0);
+		_cache->ClearPageTableDirty(mip);
+	}
+
+	_cache->EndFrame();
+}
+
+void TerrainVirtualTexture::BeginFeedback(ID3D11DeviceContext* context)
+{
+	context->OMGetRenderTargets(1, &_savedTarget, &_savedDepth);
+	context->OMGetBlendState(&_savedBlend, _savedBlendFactor, &_savedSampleMask);
+	UINT viewports = 1;
+	context->RSGetViewports(&viewports, &_savedViewport);
+
+	//Cleared to VT_NO_PAGE, which a float converts to exactly
+	float clear[4] = { (float)VT_NO_PAGE, 0.0f, 0.0f, 0.0f };
+	context->ClearRenderTargetView(_feedbackView, clear);
+	context->ClearDepthStencilView(_feedbackDepthView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	context->OMSetRenderTargets(1, &_feedbackView, _feedbackDepthView);
+	//Integer targets cannot be blended
+	context->OMSetBlendState(nullptr, nullptr, 0xffffffff);
+
+	D3D11_VIEWPORT vp;
+	vp.Width = (FLOAT)_feedbackWidth;
+	vp.Height = (FLOAT)_feedbackHeight;
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+	context->RSSetViewports(1, &vp);
+
+	Bind(context);
+}
+
+void TerrainVirtualTexture::EndFeedback(ID3D11DeviceContext* context)
+{
+	context->CopyResource(_feedbackReadback[_feedbackFrame % FEEDBACK_LATENCY], _feedbackTarget);
+	++_feedbackFrame;
+
+	context->OMSetRenderTargets(1, &_savedTarget, _savedDepth);
+	context->OMSetBlendState(_savedBlend, _savedBlendFactor, _savedSampleMask);
+	context->RSSetViewports(1, &_savedViewport);
+
+	if (_savedTarget) _savedTarget->Release();
+	if (_savedDepth) _savedDepth->Release();
+	if (_savedBlend) _savedBlend->Release();
+	_savedTarget = nullptr;
+	_savedDepth = nullptr;
+	_savedBlend = nullptr;
+}
+
+void TerrainVirtualTexture::Bind(ID3D11DeviceContext* context)
+{
+	ID3D11ShaderResourceView* views[2] = { _physicalView, _pageTableView };
+	context->PSSetShaderResources(1, 2, views);
+	context->PSSetConstantBuffers(1, 1, &_constantBuffer);
+}
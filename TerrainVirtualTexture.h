@@ -0,0 +1,82 @@
+#pragma once
+#include <windows.h>
+#include <d3d11_1.h>
+#include <stdint.h>
+#include <vector>
+#include "VirtualTexture.h"
+
+using namespace DirectX;
+
+//Constants for the virtual texture shaders, bound at b1
+struct VirtualTextureConstants
+{
+	XMFLOAT4 VTParams;		//Pages across mip 0, page size, border, coarsest mip
+	XMFLOAT4 VTPhysical;	//1 / physical width, 1 / physical height, page size with borders, feedback mip bias
+};
+
+//GPU side of the terrain virtual texture. Owns the physical page texture, the page table texture and
+//the feedback target; page residency is decided by VirtualTextureCache and pages are read by
+//VirtualTextureStreamer's worker thread.
+//Each frame: Update (read back old feedback, request and upload pages), then draw the terrain with the
+//feedback shader between BeginFeedback and EndFeedback, then draw it for real with Bind applied.
+class TerrainVirtualTexture
+{
+private:
+	//Feedback is read back this many frames after it is drawn so the copy never stalls
+	static const UINT FEEDBACK_LATENCY = 3;
+	//Feedback is drawn at 1/FEEDBACK_SCALE of the screen size in each direction
+	static const UINT FEEDBACK_SCALE = 8;
+	static const UINT PHYSICAL_PAGES = 16;
+	static const size_t MAX_REQUESTS_PER_FRAME = 32;
+	static const size_t MAX_PENDING = 64;
+
+	VirtualTextureStreamer _streamer;
+	VirtualTextureCache* _cache;
+
+	ID3D11Texture2D* _physicalTexture;
+	ID3D11ShaderResourceView* _physicalView;
+	ID3D11Texture2D* _pageTable;
+	ID3D11ShaderResourceView* _pageTableView;
+	ID3D11Buffer* _constantBuffer;
+
+	UINT _feedbackWidth;
+	UINT _feedbackHeight;
+	ID3D11Texture2D* _feedbackTarget;
+	ID3D11RenderTargetView* _feedbackView;
+	ID3D11Texture2D* _feedbackDepth;
+	ID3D11DepthStencilView* _feedbackDepthView;
+	ID3D11Texture2D* _feedbackReadback[FEEDBACK_LATENCY];
+	UINT _feedbackFrame;
+
+	//State replaced by BeginFeedback and put back by EndFeedback
+	ID3D11RenderTargetView* _savedTarget;
+	ID3D11DepthStencilView* _savedDepth;
+	ID3D11BlendState* _savedBlend;
+	FLOAT _savedBlendFactor[4];
+	UINT _savedSampleMask;
+	D3D11_VIEWPORT _savedViewport;
+
+	std::vector<uint32_t> _feedback;
+	std::vector<uint32_t> _requests;
+	std::vector<VirtualTextureStreamer::LoadedPage> _loaded;
+
+	void UploadPage(ID3D11DeviceContext* context, const VirtualTextureStreamer::LoadedPage& page, bool locked);
+	void ReadFeedback(ID3D11DeviceContext* context);
+
+public:
+	TerrainVirtualTexture();
+	~TerrainVirtualTexture();
+
+	//Opens a file written by BuildVirtualTextureFile and creates the GPU resources
+	HRESULT Initialise(ID3D11Device* device, ID3D11DeviceContext* context, const char* fileName, UINT screenWidth, UINT screenHeight);
+
+	void Update(ID3D11DeviceContext* context);
+
+	void BeginFeedback(ID3D11DeviceContext* context);
+	void EndFeedback(ID3D11DeviceContext* context);
+
+	//Binds the physical pages at t1, the page table at t2 and the constants at b1
+	void Bind(ID3D11DeviceContext* context);
+
+	VirtualTextureStats GetStats() const { return _cache ? _cache->GetStats() : VirtualTextureStats(); }
+};
@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+// File: GeomipmapTests.cpp
+//
+// Checks the levels TerrainGeomipmap::SelectLods picks and the index ranges they draw.
+//
+// For a range of cameras and pixel thresholds over two grids, the selected ranges of all
+// patches together have to cover the grid exactly, with no inverted triangles, indices
+// inside their patch, every edge on a patch border shared with the neighbour's border
+// (so no cracks or T-junctions open between levels), and neighbouring levels at most one
+// apart. The extremes of the threshold have to give the finest and coarsest meshes.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "TestCommon.h"
+#include "ProceduralTerrain.h"
+#include "TerrainGeomipmap.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+// Repeatable values in [0, 1)
+class Random
+{
+public:
+    explicit Random( uint32_t seed ) : state( seed ) {}
+
+    float Next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return float( state >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+private:
+    uint32_t state;
+};
+
+typedef std::pair<uint64_t, uint64_t> Edge;
+
+uint64_t GridVertex( size_t x, size_t z )
+{
+    return ( uint64_t( z ) << 32 ) | x;
+}
+
+void CheckSelection( const TerrainGeomipmap& geomipmap, size_t width, size_t depth, size_t patchQuads,
+                     const std::vector<TerrainPatchLod>& patches )
+{
+    const std::vector<uint16_t>& indices = geomipmap.GetIndices();
+    const size_t stride = patchQuads + 1;
+    const size_t patchesX = geomipmap.GetPatchCountX();
+    const size_t patchesZ = geomipmap.GetPatchCountZ();
+    if ( !CHECK( patches.size() == patchesX * patchesZ ) )
+        return;
+
+    // Edges used by a single triangle of their patch, in grid samples; each has to be on
+    // the grid border or used once by the neighbour too
+    std::map<Edge, int> borderEdges;
+    double area = 0.0;
+    size_t failuresBefore = Test::FailureCount();
+
+    for ( size_t i = 0; i < patches.size(); ++i )
+    {
+        const TerrainPatchLod& patch = patches[i];
+        size_t patchX = i % patchesX;
+        size_t patchZ = i / patchesX;
+
+        CHECK( patch.lod < geomipmap.GetLodCount() );
+        CHECK( patch.stitch < TERRAIN_STITCH_COMBINATIONS );
+        CHECK( patch.indexCount % 3 == 0 && patch.firstIndex + patch.indexCount <= indices.size() );
+
+        // Neighbours to the right and below differ by at most one level
+        if ( patchX + 1 < patchesX )
+            CHECK( abs( int( patch.lod ) - int( patches[i + 1].lod ) ) <= 1 );
+        if ( patchZ + 1 < patchesZ )
+            CHECK( abs( int( patch.lod ) - int( patches[i + patchesX].lod ) ) <= 1 );
+
+        std::map<Edge, int> edges;
+        for ( uint32_t k = 0; k + 2 < patch.indexCount; k += 3 )
+        {
+            size_t x[3], z[3];
+            uint64_t vertex[3];
+            for ( int t = 0; t < 3; ++t )
+            {
+                uint16_t index = indices[patch.firstIndex + k + t];
+                CHECK( index < stride * stride );
+                x[t] = patchX * patchQuads + index % stride;
+                z[t] = patchZ * patchQuads + index / stride;
+                vertex[t] = GridVertex( x[t], z[t] );
+            }
+
+            // Same winding as the tiles, in grid terms where z grows down the rows
+            double doubledArea = ( double( x[1] ) - double( x[0] ) ) * ( double( z[2] ) - double( z[0] ) )
+                               - ( double( x[2] ) - double( x[0] ) ) * ( double( z[1] ) - double( z[0] ) );
+            CHECK( doubledArea > 0.0 );
+            area += 0.5 * doubledArea;
+
+            for ( int t = 0; t < 3; ++t )
+            {
+                uint64_t a = vertex[t];
+                uint64_t b = vertex[( t + 1 ) % 3];
+                ++edges[Edge( std::min( a, b ), std::max( a, b ) )];
+            }
+        }
+
+        for ( const auto& edge : edges )
+        {
+            CHECK( edge.second <= 2 );
+            if ( edge.second == 1 )
+                ++borderEdges[edge.first];
+        }
+
+        // One failure per selection is enough to go on
+        if ( Test::FailureCount() != failuresBefore )
+            return;
+    }
+
+    // The whole grid once, no more
+    CHECK( fabs( area - double( width - 1 ) * double( depth - 1 ) ) < 1e-6 );
+
+    size_t unmatched = 0;
+    for ( const auto& edge : borderEdges )
+    {
+        size_t x0 = size_t( edge.first.first & 0xFFFFFFFF ), z0 = size_t( edge.first.first >> 32 );
+        size_t x1 = size_t( edge.first.second & 0xFFFFFFFF ), z1 = size_t( edge.first.second >> 32 );
+        bool outer = ( z0 == z1 && ( z0 == 0 || z0 == depth - 1 ) ) || ( x0 == x1 && ( x0 == 0 || x0 == width - 1 ) );
+        unmatched += edge.second != ( outer ? 1 : 2 );
+    }
+    CHECK( unmatched == 0 );
+}
+
+void CheckGrid( const char* name, const std::vector<float>& heights, size_t width, size_t depth, size_t patchQuads )
+{
+    TerrainGeomipmap geomipmap;
+    TerrainGeomipmapDesc desc = { patchQuads, 1.0f, 1.0f, 1.0f };
+    if ( !CHECK( geomipmap.Build( heights.data(), width, depth, desc ) ) )
+        return;
+
+    size_t patchCount = geomipmap.GetPatchCountX() * geomipmap.GetPatchCountZ();
+    for ( size_t patch = 0; patch < patchCount; ++patch )
+    {
+        CHECK( geomipmap.GetPatchError( patch, 0 ) == 0.0f );
+        for ( size_t lod = 1; lod < geomipmap.GetLodCount(); ++lod )
+            CHECK( geomipmap.GetPatchError( patch, lod ) >= geomipmap.GetPatchError( patch, lod - 1 ) );
+    }
+
+    float halfX = 0.5f * float( width - 1 );
+    float halfZ = 0.5f * float( depth - 1 );
+    std::vector<TerrainPatchLod> patches;
+
+    // Nothing is too small to see at a threshold of zero, nothing large enough at a huge one
+    float centre[3] = { 0.0f, 40.0f, 0.0f };
+    geomipmap.SelectLods( centre, 500.0f, 0.0f, patches );
+    CheckSelection( geomipmap, width, depth, patchQuads, patches );
+    for ( const TerrainPatchLod& patch : patches )
+        CHECK( patch.lod == 0 && patch.stitch == 0 );
+
+    geomipmap.SelectLods( centre, 500.0f, 1e30f, patches );
+    CheckSelection( geomipmap, width, depth, patchQuads, patches );
+    for ( const TerrainPatchLod& patch : patches )
+        CHECK( patch.lod == geomipmap.GetLodCount() - 1 && patch.stitch == 0 );
+
+    // Above the middle, low over a corner, far outside the grid, then a spread of random ones
+    const float fixedCameras[3][3] =
+    {
+        { 0.0f, 30.0f, 0.0f },
+        { -halfX + 2.0f, 5.0f, halfZ - 2.0f },
+        { 4.0f * halfX, 80.0f, -3.0f * halfZ },
+    };
+    size_t levelsUsed[16] = {};
+    for ( const auto& camera : fixedCameras )
+    {
+        geomipmap.SelectLods( camera, 400.0f, 1.0f, patches );
+        CheckSelection( geomipmap, width, depth, patchQuads, patches );
+    }
+
+    Random random( 5 );
+    for ( int trial = 0; trial < 100; ++trial )
+    {
+        float camera[3] = { ( random.Next() - 0.5f ) * 3.0f * halfX, random.Next() * 60.0f, ( random.Next() - 0.5f ) * 3.0f * halfZ };
+        geomipmap.SelectLods( camera, 50.0f + random.Next() * 800.0f, 0.2f + random.Next() * 4.0f, patches );
+        CheckSelection( geomipmap, width, depth, patchQuads, patches );
+        for ( const TerrainPatchLod& patch : patches )
+            ++levelsUsed[patch.lod & 15];
+    }
+
+    // The random cameras have to reach more than one level, or the stitching went untested
+    size_t levelCount = 0;
+    for ( size_t count : levelsUsed )
+        levelCount += count != 0;
+    CHECK( levelCount > 1 );
+
+    printf( "%s %zux%zu, %zu quad patches: %zu levels, %zu of them selected, %zu indices\n", name, width, depth,
+            patchQuads, geomipmap.GetLodCount(), levelCount, geomipmap.GetIndices().size() );
+}
+
+};
+
+
+int main()
+{
+    // Gentle waves with some noise, so every patch has error at every coarser level
+    const size_t waveSize = 16 * 8 + 1;
+    std::vector<float> heights( waveSize * waveSize );
+    Random random( 1 );
+    for ( size_t z = 0; z < waveSize; ++z )
+    {
+        for ( size_t x = 0; x < waveSize; ++x )
+            heights[z * waveSize + x] = sinf( float( x ) * 0.05f ) * 4.0f + cosf( float( z ) * 0.07f ) * 3.0f + random.Next() * 0.1f;
+    }
+    CheckGrid( "waves", heights, waveSize, waveSize, 16 );
+
+    // The application's patches over ridged terrain
+    ProceduralTerrainDesc ridged = { PROCEDURAL_RIDGED, 1337, 6, 1.0f / 96.0f, 2.0f, 0.5f, 0.0f, 25.5f, 0.0f };
+    if ( CHECK( GenerateProceduralHeights( ridged, 0, 0, 257, 257, heights ) ) )
+        CheckGrid( "ridged", heights, 257, 257, 64 );
+
+    return Test::Finish( "GeomipmapTests" );
+}
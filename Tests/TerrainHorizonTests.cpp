@@ -0,0 +1,322 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHorizonTests.cpp
+//
+// Replays scripted camera paths over TerrainHorizon and reports how much it culls.
+//
+// Boxes are scattered on Heightmap.bmp and on a ridged procedural grid, and the camera
+// drives along the ground, orbits low around the centre and flies over high. Every box
+// the horizon hides has to be hidden for real: rays from the camera to its corners, edge
+// midpoints and face centres must all meet the terrain first. A camera outside the grid
+// or under the surface must not cull anything. The culled share of the boxes inside the
+// view frustum is printed per path.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "TestCommon.h"
+#include "HeightmapLoader.h"
+#include "ProceduralTerrain.h"
+#include "TerrainHorizon.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const int FRAMES = 120;
+const int CHECK_EVERY = 4;     // frames between full visibility checks of the culled boxes
+
+const float FOV_Y = 0.7854f;
+const float ASPECT = 16.0f / 9.0f;
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 5000.0f;
+
+enum CAMERA_PATH
+{
+    PATH_DRIVE,         // 3 units above the ground on a loop, looking ahead
+    PATH_ORBIT,         // 15 units above the ground, looking at the centre
+    PATH_FLYOVER,       // 20 units above the highest peak, looking forward and down
+    PATH_COUNT,
+};
+
+const char* const pathNames[PATH_COUNT] = { "drive", "low orbit", "flyover" };
+
+// Left-handed look-at and perspective, [x y z 1] * M with rows stored first
+void LookAtPerspective( const float eye[3], const float at[3], float matrix[16] )
+{
+    float forward[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+    float length = sqrtf( forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2] );
+    for ( int i = 0; i < 3; ++i )
+        forward[i] /= length;
+
+    float right[3] = { forward[2], 0.0f, -forward[0] };
+    length = sqrtf( right[0] * right[0] + right[2] * right[2] );
+    right[0] /= length;
+    right[2] /= length;
+
+    float up[3] = { forward[1] * right[2] - forward[2] * right[1],
+                    forward[2] * right[0] - forward[0] * right[2],
+                    forward[0] * right[1] - forward[1] * right[0] };
+
+    float view[16] =
+    {
+        right[0], up[0], forward[0], 0.0f,
+        right[1], up[1], forward[1], 0.0f,
+        right[2], up[2], forward[2], 0.0f,
+        -( right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2] ),
+        -( up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2] ),
+        -( forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2] ),
+        1.0f,
+    };
+
+    float scaleY = 1.0f / tanf( FOV_Y * 0.5f );
+    float q = Z_FAR / ( Z_FAR - Z_NEAR );
+    float projection[16] =
+    {
+        scaleY / ASPECT, 0.0f, 0.0f, 0.0f,
+        0.0f, scaleY, 0.0f, 0.0f,
+        0.0f, 0.0f, q, 1.0f,
+        0.0f, 0.0f, -Z_NEAR * q, 0.0f,
+    };
+
+    for ( int row = 0; row < 4; ++row )
+    {
+        for ( int column = 0; column < 4; ++column )
+        {
+            float sum = 0.0f;
+            for ( int k = 0; k < 4; ++k )
+                sum += view[row * 4 + k] * projection[k * 4 + column];
+            matrix[row * 4 + column] = sum;
+        }
+    }
+}
+
+// False when all eight corners are outside one clip plane
+bool InFrustum( const float matrix[16], const TerrainHorizonBounds& bounds )
+{
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        float point[3] = { ( corner & 1 ) ? bounds.boundsMax[0] : bounds.boundsMin[0],
+                           ( corner & 2 ) ? bounds.boundsMax[1] : bounds.boundsMin[1],
+                           ( corner & 4 ) ? bounds.boundsMax[2] : bounds.boundsMin[2] };
+        float clip[4];
+        for ( int k = 0; k < 4; ++k )
+            clip[k] = point[0] * matrix[k] + point[1] * matrix[4 + k] + point[2] * matrix[8 + k] + matrix[12 + k];
+
+        outside[0] += clip[0] < -clip[3];
+        outside[1] += clip[0] > clip[3];
+        outside[2] += clip[1] < -clip[3];
+        outside[3] += clip[1] > clip[3];
+        outside[4] += clip[2] < 0.0f;
+        outside[5] += clip[2] > clip[3];
+    }
+    for ( int plane = 0; plane < 6; ++plane )
+    {
+        if ( outside[plane] == 8 )
+            return false;
+    }
+    return true;
+}
+
+// True when the terrain blocks the ray from the eye to every corner, edge midpoint and
+// face centre of the box
+bool HiddenByTerrain( const TerrainHeightField& field, const float eye[3], const TerrainHorizonBounds& bounds )
+{
+    for ( int a = 0; a <= 2; ++a )
+    {
+        for ( int b = 0; b <= 2; ++b )
+        {
+            for ( int c = 0; c <= 2; ++c )
+            {
+                if ( a == 1 && b == 1 && c == 1 )
+                    continue;
+
+                int steps[3] = { a, b, c };
+                float direction[3];
+                for ( int axis = 0; axis < 3; ++axis )
+                {
+                    float point = bounds.boundsMin[axis] + ( bounds.boundsMax[axis] - bounds.boundsMin[axis] ) * float( steps[axis] ) * 0.5f;
+                    direction[axis] = point - eye[axis];
+                }
+
+                TerrainRayHit hit;
+                if ( !field.Raycast( eye, direction, 1.0f, &hit ) || hit.distance > 0.999f )
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void GetCamera( const TerrainHeightField& field, CAMERA_PATH path, int frame,
+                float halfX, float halfZ, float eye[3], float at[3] )
+{
+    float t = float( frame ) / float( FRAMES ) * 6.2831853f;
+    float radius = std::min( halfX, halfZ );
+
+    switch ( path )
+    {
+    case PATH_DRIVE:
+        radius *= 0.6f;
+        eye[0] = radius * cosf( t );
+        eye[2] = radius * sinf( t ) * 0.7f;
+        field.GetHeightAt( eye[0], eye[2], &eye[1] );
+        eye[1] += 3.0f;
+        at[0] = radius * cosf( t + 0.05f );
+        at[1] = eye[1];
+        at[2] = radius * sinf( t + 0.05f ) * 0.7f;
+        break;
+
+    case PATH_ORBIT:
+        radius *= 0.8f;
+        eye[0] = radius * cosf( t );
+        eye[2] = radius * sinf( t );
+        field.GetHeightAt( eye[0], eye[2], &eye[1] );
+        eye[1] += 15.0f;
+        at[0] = 0.0f;
+        at[2] = 0.0f;
+        field.GetHeightAt( 0.0f, 0.0f, &at[1] );
+        break;
+
+    default:
+        radius *= 0.5f;
+        eye[0] = -radius + 2.0f * radius * float( frame ) / float( FRAMES );
+        eye[1] = field.GetNodeMaxY( field.GetLevelCount() - 1, 0, 0 ) + 20.0f;
+        eye[2] = radius * 0.3f * sinf( t );
+        at[0] = eye[0] + 40.0f;
+        at[1] = eye[1] - 15.0f;
+        at[2] = eye[2];
+        break;
+    }
+}
+
+void ReplayPaths( const char* name, const std::vector<float>& heights, size_t width, size_t depth,
+                  float objectSize, size_t objectCount, bool expectCulling )
+{
+    TerrainHeightField field;
+    TerrainHeightFieldDesc fieldDesc = { 1.0f, 1.0f, 1.0f };
+    if ( !CHECK( field.Build( heights.data(), width, depth, fieldDesc ) ) )
+        return;
+
+    TerrainHorizon horizon;
+    TerrainHorizonDesc desc = { 256, 8 };
+    if ( !CHECK( horizon.Build( field, desc ) ) )
+        return;
+
+    // Boxes standing on the ground, away from the edges
+    float halfX = 0.5f * float( width - 1 );
+    float halfZ = 0.5f * float( depth - 1 );
+    std::vector<TerrainHorizonBounds> objects( objectCount );
+    uint32_t state = 2024;
+    for ( TerrainHorizonBounds& object : objects )
+    {
+        state = state * 1664525u + 1013904223u;
+        float x = ( float( state >> 8 ) * ( 1.0f / 16777216.0f ) - 0.5f ) * 2.0f * ( halfX - 2.0f );
+        state = state * 1664525u + 1013904223u;
+        float z = ( float( state >> 8 ) * ( 1.0f / 16777216.0f ) - 0.5f ) * 2.0f * ( halfZ - 2.0f );
+        float y;
+        field.GetHeightAt( x, z, &y );
+
+        object.boundsMin[0] = x - objectSize * 0.5f;
+        object.boundsMin[1] = y;
+        object.boundsMin[2] = z - objectSize * 0.5f;
+        object.boundsMax[0] = x + objectSize * 0.5f;
+        object.boundsMax[1] = y + objectSize;
+        object.boundsMax[2] = z + objectSize * 0.5f;
+    }
+
+    std::vector<uint8_t> occluded;
+    for ( int path = 0; path < PATH_COUNT; ++path )
+    {
+        size_t inFrustum = 0;
+        size_t culled = 0;
+        size_t checked = 0;
+        size_t wronglyCulled = 0;
+        double seconds = 0.0;
+
+        for ( int frame = 0; frame < FRAMES; ++frame )
+        {
+            float eye[3], at[3], viewProjection[16];
+            GetCamera( field, CAMERA_PATH( path ), frame, halfX, halfZ, eye, at );
+            LookAtPerspective( eye, at, viewProjection );
+
+            TerrainHorizonStats stats;
+            horizon.Cull( viewProjection, eye, objects.data(), objects.size(), occluded, &stats );
+            if ( !CHECK( occluded.size() == objects.size() ) )
+                return;
+            seconds += stats.seconds;
+
+            for ( size_t i = 0; i < objects.size(); ++i )
+            {
+                if ( !InFrustum( viewProjection, objects[i] ) )
+                    continue;
+                ++inFrustum;
+                if ( !occluded[i] )
+                    continue;
+                ++culled;
+
+                if ( frame % CHECK_EVERY == 0 )
+                {
+                    ++checked;
+                    wronglyCulled += !HiddenByTerrain( field, eye, objects[i] );
+                }
+            }
+        }
+
+        CHECK( wronglyCulled == 0 );
+        if ( expectCulling )
+            CHECK( culled > 0 );
+
+        printf( "%-14s %-9s culled %5.1f%% of %zu in-frustum tests, %zu of %zu checked were visible, %.3f ms per frame\n",
+                name, pathNames[path], inFrustum ? 100.0 * double( culled ) / double( inFrustum ) : 0.0,
+                inFrustum, wronglyCulled, checked, seconds * 1e3 / FRAMES );
+    }
+
+    // Nothing is culled from outside the grid or from under the surface
+    for ( int below = 0; below < 2; ++below )
+    {
+        float eye[3] = { 0.0f, 0.0f, 0.0f };
+        float at[3] = { 0.0f, 0.0f, 0.0f };
+        if ( below )
+        {
+            field.GetHeightAt( 0.0f, 0.0f, &eye[1] );
+            eye[1] -= 1.0f;
+            at[0] = 10.0f;
+            at[1] = eye[1];
+        }
+        else
+        {
+            eye[0] = -halfX - 50.0f;
+            eye[1] = 5.0f;
+            at[1] = 5.0f;
+        }
+
+        float viewProjection[16];
+        LookAtPerspective( eye, at, viewProjection );
+        horizon.Cull( viewProjection, eye, objects.data(), objects.size(), occluded );
+        CHECK( std::count( occluded.begin(), occluded.end(), uint8_t( 1 ) ) == 0 );
+    }
+}
+
+};
+
+
+int main()
+{
+    std::vector<float> heights;
+    HeightmapLoadDesc loadDesc = { HEIGHTMAP_UNKNOWN, 0, 0, false, 25.5f, 0.0f };
+    HeightmapInfo info;
+    if ( CHECK( LoadHeightmap( Test::SamplePath( "Heightmap.bmp" ).c_str(), loadDesc, heights, &info ) ) )
+        ReplayPaths( "Heightmap.bmp", heights, info.width, info.depth, 2.0f, 2000, false );
+
+    // Sharp ridges hide most of what stands behind them
+    ProceduralTerrainDesc ridged = { PROCEDURAL_RIDGED, 1337, 6, 1.0f / 64.0f, 2.0f, 0.5f, 0.0f, 60.0f, 0.0f };
+    if ( CHECK( GenerateProceduralHeights( ridged, 0, 0, 513, 513, heights ) ) )
+        ReplayPaths( "ridged 513", heights, 513, 513, 3.0f, 3000, true );
+
+    return Test::Finish( "TerrainHorizonTests" );
+}
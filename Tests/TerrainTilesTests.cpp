@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainTilesTests.cpp
+//
+// Checks the tiles BuildTerrainTiles cuts a height grid into.
+//
+// For grids that are and are not a whole number of tiles, and for a 4096x4096 grid with
+// the largest tiles 16-bit indices allow, every tile drawn with the shared index list and
+// its base vertex has to cover its part of the grid exactly once, with vertices at the
+// right samples and inside the tile's bounding box, and no index may reach past the
+// tile's vertices or collide with the strip cut index. Height-only samples patched after
+// an edit have to match the edited grid quantised again.
+//--------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "TestCommon.h"
+#include "TerrainTiles.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+void MakeHeights( size_t width, size_t depth, std::vector<float>& heights )
+{
+    heights.resize( width * depth );
+    uint32_t state = 12345;
+    for ( size_t i = 0; i < heights.size(); ++i )
+    {
+        state = state * 1664525u + 1013904223u;
+        heights[i] = float( state >> 24 );
+    }
+}
+
+void CheckGrid( size_t width, size_t depth, size_t tileQuads )
+{
+    std::vector<float> heights;
+    MakeHeights( width, depth, heights );
+
+    TerrainTileDesc desc = { tileQuads, 2.0f, 1.5f, 0.1f };
+    std::vector<TerrainTileVertex> vertices;
+    std::vector<TerrainTile> tiles;
+    if ( !CHECK( BuildTerrainTiles( heights.data(), nullptr, width, depth, desc, vertices, tiles ) ) )
+        return;
+
+    std::vector<uint16_t> indices;
+    if ( !CHECK( BuildTerrainTileIndices( tileQuads, indices ) ) )
+        return;
+
+    // Every index stays inside one tile's vertices, so a 16-bit list plus a base vertex
+    // reaches all of them however large the grid
+    size_t tileVertices = TerrainTileVertexCount( tileQuads );
+    CHECK( tileVertices <= 65536 );
+    CHECK( indices.size() == TerrainTileIndexCount( tileQuads ) );
+    uint16_t largest = 0;
+    for ( uint16_t index : indices )
+        largest = std::max( largest, index );
+    CHECK( largest == tileVertices - 1 );
+    CHECK( vertices.size() == tiles.size() * tileVertices );
+
+    const float originX = -0.5f * float( width - 1 ) * desc.spacingX;
+    const float originZ = 0.5f * float( depth - 1 ) * desc.spacingZ;
+
+    std::vector<uint8_t> covered( ( width - 1 ) * ( depth - 1 ), 0 );
+    size_t failuresBefore = Test::FailureCount();
+
+    for ( const TerrainTile& tile : tiles )
+    {
+        CHECK( tile.firstVertex + tileVertices <= vertices.size() );
+        const TerrainTileVertex* tileVertex = &vertices[tile.firstVertex];
+
+        // Vertices sit on their samples and inside the tile's bounds
+        for ( size_t i = 0; i < tileVertices; ++i )
+        {
+            const float* position = tileVertex[i].position;
+            size_t column = std::min( tile.gridX + i % ( tileQuads + 1 ), width - 1 );
+            size_t row = std::min( tile.gridZ + i / ( tileQuads + 1 ), depth - 1 );
+            CHECK( fabsf( position[0] - ( originX + float( column ) * desc.spacingX ) ) < 1e-3f );
+            CHECK( fabsf( position[2] - ( originZ - float( row ) * desc.spacingZ ) ) < 1e-3f );
+            CHECK( position[1] == heights[row * width + column] * desc.heightScale );
+
+            for ( int axis = 0; axis < 3; ++axis )
+                CHECK( position[axis] >= tile.boundsMin[axis] && position[axis] <= tile.boundsMax[axis] );
+        }
+
+        // Every triangle with area fills half of one grid quad, with the same winding
+        for ( size_t i = 0; i < indices.size(); i += 3 )
+        {
+            const float* a = tileVertex[indices[i]].position;
+            const float* b = tileVertex[indices[i + 1]].position;
+            const float* c = tileVertex[indices[i + 2]].position;
+
+            float area = ( b[0] - a[0] ) * ( c[2] - a[2] ) - ( c[0] - a[0] ) * ( b[2] - a[2] );
+            if ( fabsf( area ) < 1e-6f )
+                continue;
+            CHECK( area < 0.0f );
+            CHECK( fabsf( fabsf( area ) - desc.spacingX * desc.spacingZ ) < 1e-2f );
+
+            float minX = std::min( a[0], std::min( b[0], c[0] ) );
+            float maxZ = std::max( a[2], std::max( b[2], c[2] ) );
+            size_t column = size_t( lrintf( ( minX - originX ) / desc.spacingX ) );
+            size_t row = size_t( lrintf( ( originZ - maxZ ) / desc.spacingZ ) );
+            if ( CHECK( column < width - 1 && row < depth - 1 ) )
+                ++covered[row * ( width - 1 ) + column];
+        }
+
+        // One failure per tile is enough to go on
+        if ( Test::FailureCount() != failuresBefore )
+            break;
+    }
+
+    // Two triangles on every quad, none overlapping, no gaps
+    size_t wrong = 0;
+    for ( uint8_t count : covered )
+        wrong += count != 2;
+    CHECK( wrong == 0 );
+
+    printf( "%zux%zu grid, %zu quad tiles: %zu tiles, %zu vertices\n", width, depth, tileQuads, tiles.size(), vertices.size() );
+}
+
+void CheckIndexLimits()
+{
+    std::vector<uint16_t> indices;
+
+    // Larger tiles would need indices past 65535
+    CHECK( BuildTerrainTileIndices( 255, indices ) );
+    CHECK( !BuildTerrainTileIndices( 256, indices ) );
+
+    std::vector<float> heights;
+    MakeHeights( 300, 300, heights );
+    TerrainTileDesc desc = { 256, 1.0f, 1.0f, 1.0f };
+    std::vector<TerrainTileVertex> vertices;
+    std::vector<TerrainTile> tiles;
+    CHECK( !BuildTerrainTiles( heights.data(), nullptr, 300, 300, desc, vertices, tiles ) );
+
+    // The cut index must never be a vertex of the tile
+    CHECK( !BuildTerrainTileStripIndices( 255, TERRAIN_STRIP_RESTART, indices ) );
+    for ( size_t tileQuads : { size_t( 64 ), size_t( 254 ) } )
+    {
+        if ( !CHECK( BuildTerrainTileStripIndices( tileQuads, TERRAIN_STRIP_RESTART, indices ) ) )
+            continue;
+        for ( uint16_t index : indices )
+            CHECK( index == 0xFFFF || index < TerrainTileVertexCount( tileQuads ) );
+    }
+
+    for ( size_t tileQuads : { size_t( 64 ), size_t( 255 ) } )
+    {
+        if ( !CHECK( BuildTerrainTileStripIndices( tileQuads, TERRAIN_STRIP_DEGENERATE, indices ) ) )
+            continue;
+        for ( uint16_t index : indices )
+            CHECK( index < TerrainTileVertexCount( tileQuads ) );
+    }
+}
+
+void CheckHeightUpdates( size_t width, size_t depth, size_t tileQuads )
+{
+    std::vector<float> heights;
+    MakeHeights( width, depth, heights );
+
+    TerrainTileDesc desc = { tileQuads, 1.0f, 1.0f, 0.5f };
+    std::vector<TerrainTileVertex> vertices;
+    std::vector<TerrainTile> tiles;
+    std::vector<uint16_t> samples;
+    float heightOffset, heightRange;
+    if ( !CHECK( BuildTerrainTiles( heights.data(), nullptr, width, depth, desc, vertices, tiles ) ) ||
+         !CHECK( BuildTerrainTileHeights( heights.data(), width, depth, desc, samples, heightOffset, heightRange ) ) )
+        return;
+    CHECK( samples.size() == vertices.size() );
+
+    // An edit inside the range, across a tile corner, patched in place
+    const size_t x0 = tileQuads - 3, z0 = tileQuads - 5, x1 = tileQuads + 7, z1 = tileQuads + 2;
+    for ( size_t z = z0; z < z1; ++z )
+    {
+        for ( size_t x = x0; x < x1; ++x )
+            heights[z * width + x] = float( ( x * 7 + z * 13 ) % 200 ) + 20.5f;
+    }
+
+    std::vector<TerrainTileVertex> updated;
+    std::vector<TerrainTileUpdate> updates;
+    std::vector<uint16_t> updatedSamples;
+    if ( !CHECK( UpdateTerrainTiles( heights.data(), nullptr, width, depth, desc, x0, z0, x1, z1, tiles, updated, updates ) ) )
+        return;
+    if ( !CHECK( UpdateTerrainTileHeights( updated, heightOffset, heightRange, updatedSamples ) ) )
+        return;
+    for ( const TerrainTileUpdate& update : updates )
+        std::copy( &updatedSamples[update.offset], &updatedSamples[update.offset] + update.vertexCount, &samples[update.firstVertex] );
+
+    // Has to give what quantising the edited grid from scratch over the same range gives
+    std::vector<uint16_t> rebuilt;
+    float rebuiltOffset, rebuiltRange;
+    CHECK( BuildTerrainTileHeights( heights.data(), width, depth, desc, rebuilt, rebuiltOffset, rebuiltRange ) );
+    if ( CHECK( rebuiltOffset == heightOffset && rebuiltRange == heightRange ) )
+        CHECK( rebuilt == samples );
+
+    // A crater below the lowest sample cannot be patched
+    heights[z0 * width + x0] = -10.0f;
+    CHECK( UpdateTerrainTiles( heights.data(), nullptr, width, depth, desc, x0, z0, x0 + 1, z0 + 1, tiles, updated, updates ) );
+    CHECK( !UpdateTerrainTileHeights( updated, heightOffset, heightRange, updatedSamples ) );
+}
+
+};
+
+
+int main()
+{
+    CheckIndexLimits();
+    CheckHeightUpdates( 130, 67, 32 );
+
+    // Whole tiles, partial tiles on both edges, a single tile, and a grid narrower than a tile
+    CheckGrid( 225, 225, 32 );
+    CheckGrid( 130, 67, 32 );
+    CheckGrid( 200, 97, 64 );
+    CheckGrid( 33, 33, 32 );
+    CheckGrid( 20, 50, 64 );
+
+    // 4k grid with the largest tiles a 16-bit list can address
+    CheckGrid( 4096, 4096, 255 );
+
+    return Test::Finish( "TerrainTilesTests" );
+}
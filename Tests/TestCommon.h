@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// File: TestCommon.h
+//
+// Minimal checking for the test executables. A failed CHECK prints where it failed and
+// the test carries on, so one run reports every broken expectation; main returns
+// Test::Finish(), which is non-zero if anything failed.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TESTCOMMON_H
+#define TESTCOMMON_H
+
+#include <stdio.h>
+#include <string>
+
+#ifndef TEST_DATA_DIR
+#define TEST_DATA_DIR "."
+#endif
+
+#ifndef FRAMEWORK_DATA_DIR
+#define FRAMEWORK_DATA_DIR "."
+#endif
+
+namespace Test
+{
+    inline size_t& FailureCount()
+    {
+        static size_t failures = 0;
+        return failures;
+    }
+
+    inline bool Check( bool condition, const char* expression, const char* file, int line )
+    {
+        if ( !condition )
+        {
+            // Only the first few, a broken invariant inside a loop would bury everything else
+            if ( FailureCount() < 20 )
+                fprintf( stderr, "%s(%d): CHECK( %s ) failed\n", file, line, expression );
+            ++FailureCount();
+        }
+        return condition;
+    }
+
+    inline int Finish( const char* name )
+    {
+        if ( FailureCount() )
+        {
+            printf( "%s: %zu checks failed\n", name, FailureCount() );
+            return 1;
+        }
+        printf( "%s: passed\n", name );
+        return 0;
+    }
+
+    inline std::string DataPath( const char* fileName )
+    {
+        return std::string( TEST_DATA_DIR ) + "/" + fileName;
+    }
+
+    inline std::string SamplePath( const char* fileName )
+    {
+        return std::string( FRAMEWORK_DATA_DIR ) + "/" + fileName;
+    }
+}
+
+#define CHECK( condition ) Test::Check( ( condition ), #condition, __FILE__, __LINE__ )
+
+#endif // TESTCOMMON_H
@@ -0,0 +1,337 @@
+//--------------------------------------------------------------------------------------
+// File: VirtualTextureTests.cpp
+//
+// Replays recorded feedback through VirtualTextureCache.
+//
+// The frames in Data/VirtualTextureFeedback.txt are fed to the cache the way
+// TerrainVirtualTexture does it: the coarsest page is mapped and locked up front, each
+// frame's requests are loaded one frame later within an upload budget, and the physical
+// cache is much smaller than the pages the flight touches, so pages are evicted all the
+// time. A reference model of the cache, kept alongside, predicts which slot every page
+// lands in and which page is evicted for it, so after every frame the test checks the
+// requests, residency, eviction order and every page table entry.
+//--------------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TestCommon.h"
+#include "VirtualTexture.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+const size_t PHYSICAL_PAGES_X = 4;
+const size_t PHYSICAL_PAGES_Y = 4;
+const size_t UPLOADS_PER_FRAME = 8;
+
+struct Recording
+{
+    size_t                              pages;
+    size_t                              mipCount;
+    size_t                              width;
+    size_t                              height;
+    std::vector<std::vector<uint32_t>>  frames;
+};
+
+bool LoadRecording( const std::string& path, Recording& recording )
+{
+    std::ifstream file( path );
+    if ( !file )
+        return false;
+
+    recording = Recording();
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        std::istringstream fields( line );
+        std::string tag;
+        fields >> tag;
+        if ( tag == "layout" )
+        {
+            fields >> recording.pages >> recording.mipCount;
+        }
+        else if ( tag == "size" )
+        {
+            fields >> recording.width >> recording.height;
+        }
+        else if ( tag == "frame" )
+        {
+            std::vector<uint32_t> frame;
+            std::string token;
+            while ( fields >> token )
+            {
+                size_t star = token.find( '*' );
+                uint32_t id = uint32_t( strtoul( token.substr( 0, star ).c_str(), nullptr, 16 ) );
+                size_t run = star == std::string::npos ? 1 : size_t( atoi( token.c_str() + star + 1 ) );
+                frame.insert( frame.end(), run, id );
+            }
+            if ( frame.size() != recording.width * recording.height )
+                return false;
+            recording.frames.push_back( frame );
+        }
+    }
+
+    return recording.pages && recording.mipCount && !recording.frames.empty();
+}
+
+//--------------------------------------------------------------------------------------
+// What the cache should do, written as plainly as possible
+//--------------------------------------------------------------------------------------
+class ReferenceCache
+{
+public:
+    ReferenceCache( const VirtualTextureLayout& layout, size_t slotCount )
+        : layout( layout ),
+          pageInSlot( slotCount, VT_NO_PAGE ),
+          lastUsed( slotCount, 0 ),
+          locked( slotCount, false ),
+          frame( 1 ),
+          evictions( 0 )
+    {
+    }
+
+    // Slot holding a page, or -1
+    int FindSlot( uint32_t pageId ) const
+    {
+        auto found = std::find( pageInSlot.begin(), pageInSlot.end(), pageId );
+        return found == pageInSlot.end() ? -1 : int( found - pageInSlot.begin() );
+    }
+
+    // The finest resident page at or above pageId's mip that covers it, or VT_NO_PAGE
+    uint32_t Shown( uint32_t pageId ) const
+    {
+        size_t x = PageIdX( pageId );
+        size_t y = PageIdY( pageId );
+        for ( size_t mip = PageIdMip( pageId ); mip < layout.mipCount; ++mip, x >>= 1, y >>= 1 )
+        {
+            uint32_t ancestor = MakePageId( mip, x, y );
+            if ( FindSlot( ancestor ) >= 0 )
+                return ancestor;
+        }
+        return VT_NO_PAGE;
+    }
+
+    // Marks the pages a frame's feedback uses, or the pages drawn in place of missing ones
+    void Use( const std::vector<uint32_t>& feedback )
+    {
+        for ( uint32_t id : feedback )
+        {
+            if ( id == VT_NO_PAGE )
+                continue;
+            uint32_t shown = Shown( id );
+            if ( shown != VT_NO_PAGE )
+                lastUsed[FindSlot( shown )] = frame;
+        }
+    }
+
+    // Slot the page goes to, -1 if none can be freed; evicted is the page it replaces
+    int Map( uint32_t pageId, bool lock, uint32_t& evicted )
+    {
+        evicted = VT_NO_PAGE;
+        int slot = FindSlot( pageId );
+        if ( slot < 0 )
+        {
+            // First free slot, otherwise least recently used, lowest slot on a tie
+            for ( size_t i = 0; i < pageInSlot.size() && slot < 0; ++i )
+            {
+                if ( pageInSlot[i] == VT_NO_PAGE )
+                    slot = int( i );
+            }
+            for ( size_t i = 0; i < pageInSlot.size() && slot < 0; ++i )
+            {
+                if ( locked[i] || lastUsed[i] >= frame )
+                    continue;
+                bool oldest = true;
+                for ( size_t j = 0; j < pageInSlot.size(); ++j )
+                {
+                    if ( !locked[j] && lastUsed[j] < frame &&
+                         ( lastUsed[j] < lastUsed[i] || ( lastUsed[j] == lastUsed[i] && j < i ) ) )
+                        oldest = false;
+                }
+                if ( oldest )
+                    slot = int( i );
+            }
+            if ( slot < 0 )
+                return -1;
+
+            evicted = pageInSlot[slot];
+            if ( evicted != VT_NO_PAGE )
+                ++evictions;
+            pageInSlot[slot] = pageId;
+            locked[slot] = false;
+        }
+
+        locked[slot] = locked[slot] || lock;
+        lastUsed[slot] = frame;
+        return slot;
+    }
+
+    void EndFrame() { ++frame; }
+
+    size_t ResidentCount() const
+    {
+        return pageInSlot.size() - size_t( std::count( pageInSlot.begin(), pageInSlot.end(), VT_NO_PAGE ) );
+    }
+
+    size_t Evictions() const { return evictions; }
+
+private:
+    VirtualTextureLayout    layout;
+    std::vector<uint32_t>   pageInSlot;
+    std::vector<uint64_t>   lastUsed;
+    std::vector<bool>       locked;
+    uint64_t                frame;
+    size_t                  evictions;
+};
+
+//--------------------------------------------------------------------------------------
+void CheckRequests( const VirtualTextureCache& cache, const std::vector<uint32_t>& feedback,
+                    const std::vector<uint32_t>& requests )
+{
+    std::vector<uint32_t> ids( feedback );
+    std::sort( ids.begin(), ids.end() );
+    ids.erase( std::unique( ids.begin(), ids.end() ), ids.end() );
+
+    // Exactly the missing pages and their missing ancestors, once each, coarsest first
+    std::vector<uint32_t> expected;
+    for ( uint32_t id : ids )
+    {
+        if ( id == VT_NO_PAGE )
+            continue;
+        size_t x = PageIdX( id );
+        size_t y = PageIdY( id );
+        for ( size_t mip = PageIdMip( id ); mip < cache.GetLayout().mipCount; ++mip, x >>= 1, y >>= 1 )
+        {
+            uint32_t ancestor = MakePageId( mip, x, y );
+            if ( cache.IsResident( ancestor ) )
+                break;
+            expected.push_back( ancestor );
+        }
+    }
+    std::sort( expected.begin(), expected.end() );
+    expected.erase( std::unique( expected.begin(), expected.end() ), expected.end() );
+
+    std::vector<uint32_t> sorted( requests );
+    std::sort( sorted.begin(), sorted.end() );
+    CHECK( sorted == expected );
+
+    for ( size_t i = 1; i < requests.size(); ++i )
+        CHECK( PageIdMip( requests[i - 1] ) >= PageIdMip( requests[i] ) );
+}
+
+void CheckPageTables( const VirtualTextureCache& cache, const ReferenceCache& reference )
+{
+    const VirtualTextureLayout& layout = cache.GetLayout();
+    for ( size_t mip = 0; mip < layout.mipCount; ++mip )
+    {
+        const std::vector<uint32_t>& table = cache.GetPageTable( mip );
+        size_t pages = layout.PagesAt( mip );
+        if ( !CHECK( table.size() == pages * pages ) )
+            continue;
+
+        for ( size_t y = 0; y < pages; ++y )
+        {
+            for ( size_t x = 0; x < pages; ++x )
+            {
+                uint32_t pageId = MakePageId( mip, x, y );
+                CHECK( cache.IsResident( pageId ) == ( reference.FindSlot( pageId ) >= 0 ) );
+
+                uint32_t shown = reference.Shown( pageId );
+                uint32_t expected = 0;
+                if ( shown != VT_NO_PAGE )
+                {
+                    size_t slot = size_t( reference.FindSlot( shown ) );
+                    expected = uint32_t( slot % PHYSICAL_PAGES_X ) | ( uint32_t( slot / PHYSICAL_PAGES_X ) << 8 ) |
+                               ( uint32_t( PageIdMip( shown ) ) << 16 ) | 0xFF000000;
+                }
+                CHECK( table[y * pages + x] == expected );
+            }
+        }
+    }
+}
+
+};
+
+
+int main()
+{
+    Recording recording;
+    if ( !CHECK( LoadRecording( Test::DataPath( "VirtualTextureFeedback.txt" ), recording ) ) )
+        return Test::Finish( "VirtualTextureTests" );
+
+    VirtualTextureLayout layout = {};
+    layout.pages = recording.pages;
+    layout.pageSize = 128;
+    layout.border = 4;
+    layout.mipCount = recording.mipCount;
+    layout.format = BC_FORMAT_BC1;
+    layout.tileBytes = ( layout.TileSize() / 4 ) * ( layout.TileSize() / 4 ) * BCBlockSize( layout.format );
+
+    VirtualTextureCache cache( layout, PHYSICAL_PAGES_X, PHYSICAL_PAGES_Y );
+    ReferenceCache reference( layout, PHYSICAL_PAGES_X * PHYSICAL_PAGES_Y );
+
+    // Nothing is resident, so every entry is empty
+    CheckPageTables( cache, reference );
+
+    size_t slotX, slotY;
+    uint32_t evicted;
+    uint32_t root = MakePageId( layout.mipCount - 1, 0, 0 );
+    CHECK( cache.MapPage( root, true, slotX, slotY ) );
+    CHECK( reference.Map( root, true, evicted ) == int( slotY * PHYSICAL_PAGES_X + slotX ) );
+
+    std::vector<uint32_t> requests;
+    std::vector<uint32_t> loading;
+    size_t evictionChecks = 0;
+
+    for ( const std::vector<uint32_t>& feedback : recording.frames )
+    {
+        cache.AnalyseFeedback( feedback.data(), feedback.size(), requests );
+        CheckRequests( cache, feedback, requests );
+        reference.Use( feedback );
+
+        // Pages asked for last frame arrive now
+        for ( uint32_t pageId : loading )
+        {
+            int expectedSlot = reference.Map( pageId, false, evicted );
+            bool mapped = cache.MapPage( pageId, false, slotX, slotY );
+            CHECK( mapped == ( expectedSlot >= 0 ) );
+            if ( mapped && expectedSlot >= 0 )
+            {
+                CHECK( slotY * PHYSICAL_PAGES_X + slotX == size_t( expectedSlot ) );
+                CHECK( cache.IsResident( pageId ) );
+            }
+            if ( evicted != VT_NO_PAGE )
+            {
+                CHECK( !cache.IsResident( evicted ) );
+                ++evictionChecks;
+            }
+        }
+        loading.assign( requests.begin(), requests.begin() + std::min( requests.size(), UPLOADS_PER_FRAME ) );
+
+        CheckPageTables( cache, reference );
+        CHECK( cache.IsResident( root ) );
+
+        VirtualTextureStats stats = cache.GetStats();
+        CHECK( stats.residentPages == reference.ResidentCount() );
+        CHECK( stats.evictions == reference.Evictions() );
+
+        cache.EndFrame();
+        reference.EndFrame();
+    }
+
+    // The recording has to be big enough to exercise replacement
+    VirtualTextureStats stats = cache.GetStats();
+    CHECK( stats.residentPages == PHYSICAL_PAGES_X * PHYSICAL_PAGES_Y );
+    CHECK( evictionChecks > 0 );
+
+    printf( "%zu frames, %zu pages mapped, %zu evicted\n", recording.frames.size(), stats.mappedPages, stats.evictions );
+    return Test::Finish( "VirtualTextureTests" );
+}
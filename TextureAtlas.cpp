@@ -0,0 +1,419 @@
+//--------------------------------------------------------------------------------------
+// File: TextureAtlas.cpp
+//
+// Texture atlas building.
+//
+// Packing works in grid units of 2^(mipLevels-1) texels. A cell starting on that grid
+// box-filters down to whole texels at every atlas mip, so two cells never share a
+// filtered texel. The gutter inside each cell replicates the image edge, which gives
+// clamp-style filtering at the region border at every level.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "TextureAtlas.h"
+#include "BlockCompressor.h"
+#include "DDSParser.h"
+#include "MipGenerator.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+struct PackRect
+{
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+//--------------------------------------------------------------------------------------
+// MaxRects bin: keeps the list of maximal free rectangles of one page
+//--------------------------------------------------------------------------------------
+class MaxRectsBin
+{
+public:
+    MaxRectsBin( size_t width, size_t height )
+    {
+        PackRect all = { 0, 0, width, height };
+        freeRects.push_back( all );
+    }
+
+    // Best short side fit. Returns false if there is no free rectangle large enough.
+    bool Insert( size_t width, size_t height, PackRect& placed )
+    {
+        size_t bestShort = ~size_t(0);
+        size_t bestLong = ~size_t(0);
+        bool found = false;
+
+        for (size_t i = 0; i < freeRects.size(); ++i)
+        {
+            const PackRect& r = freeRects[i];
+            if (r.width < width || r.height < height)
+            {
+                continue;
+            }
+
+            size_t leftoverX = r.width - width;
+            size_t leftoverY = r.height - height;
+            size_t shortSide = std::min( leftoverX, leftoverY );
+            size_t longSide = std::max( leftoverX, leftoverY );
+            if (shortSide < bestShort || ( shortSide == bestShort && longSide < bestLong ))
+            {
+                placed.x = r.x;
+                placed.y = r.y;
+                placed.width = width;
+                placed.height = height;
+                bestShort = shortSide;
+                bestLong = longSide;
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+
+        SplitFreeRects( placed );
+        PruneFreeRects();
+        return true;
+    }
+
+    size_t usedWidth = 0;
+    size_t usedHeight = 0;
+
+private:
+    void SplitFreeRects( const PackRect& used )
+    {
+        usedWidth = std::max( usedWidth, used.x + used.width );
+        usedHeight = std::max( usedHeight, used.y + used.height );
+
+        std::vector<PackRect> next;
+        next.reserve( freeRects.size() + 4 );
+        for (size_t i = 0; i < freeRects.size(); ++i)
+        {
+            const PackRect& r = freeRects[i];
+            if (used.x >= r.x + r.width || used.x + used.width <= r.x
+                || used.y >= r.y + r.height || used.y + used.height <= r.y)
+            {
+                next.push_back( r );
+                continue;
+            }
+
+            // Up to four maximal rectangles around the used area
+            if (used.x > r.x)
+            {
+                PackRect left = { r.x, r.y, used.x - r.x, r.height };
+                next.push_back( left );
+            }
+            if (used.x + used.width < r.x + r.width)
+            {
+                PackRect right = { used.x + used.width, r.y, r.x + r.width - ( used.x + used.width ), r.height };
+                next.push_back( right );
+            }
+            if (used.y > r.y)
+            {
+                PackRect top = { r.x, r.y, r.width, used.y - r.y };
+                next.push_back( top );
+            }
+            if (used.y + used.height < r.y + r.height)
+            {
+                PackRect bottom = { r.x, used.y + used.height, r.width, r.y + r.height - ( used.y + used.height ) };
+                next.push_back( bottom );
+            }
+        }
+        freeRects.swap( next );
+    }
+
+    static bool Contains( const PackRect& outer, const PackRect& inner )
+    {
+        return inner.x >= outer.x && inner.y >= outer.y
+               && inner.x + inner.width <= outer.x + outer.width
+               && inner.y + inner.height <= outer.y + outer.height;
+    }
+
+    // Drops free rectangles that lie inside another one (keeps the first of duplicates)
+    void PruneFreeRects()
+    {
+        std::vector<PackRect> kept;
+        kept.reserve( freeRects.size() );
+        for (size_t i = 0; i < freeRects.size(); ++i)
+        {
+            bool redundant = false;
+            for (size_t j = 0; j < freeRects.size() && !redundant; ++j)
+            {
+                if (i != j && Contains( freeRects[j], freeRects[i] ))
+                {
+                    redundant = !Contains( freeRects[i], freeRects[j] ) || j < i;
+                }
+            }
+            if (!redundant)
+            {
+                kept.push_back( freeRects[i] );
+            }
+        }
+        freeRects.swap( kept );
+    }
+
+    std::vector<PackRect> freeRects;
+};
+
+//--------------------------------------------------------------------------------------
+// Copies an image into its cell, replicating the edge texels across the gutter
+//--------------------------------------------------------------------------------------
+void BlitCell( const AtlasImage& image,
+               size_t cellX, size_t cellY, size_t cellWidth, size_t cellHeight, size_t gutter,
+               uint8_t* page, size_t pageWidth )
+{
+    for (size_t y = 0; y < cellHeight; ++y)
+    {
+        size_t sy = std::min( size_t( std::max<ptrdiff_t>( 0, ptrdiff_t( y ) - ptrdiff_t( gutter ) ) ), image.height - 1 );
+        const uint8_t* srcRow = image.rgba + sy * image.rowPitch;
+        uint8_t* destRow = page + ( ( cellY + y ) * pageWidth + cellX ) * 4;
+
+        // Left gutter, image row, right gutter
+        size_t x = 0;
+        for (; x < gutter && x < cellWidth; ++x)
+        {
+            memcpy( destRow + x * 4, srcRow, 4 );
+        }
+        size_t copy = std::min( image.width, cellWidth - x );
+        memcpy( destRow + x * 4, srcRow, copy * 4 );
+        x += copy;
+        for (; x < cellWidth; ++x)
+        {
+            memcpy( destRow + x * 4, srcRow + ( image.width - 1 ) * 4, 4 );
+        }
+    }
+}
+
+};
+
+//--------------------------------------------------------------------------------------
+bool DirectX::BuildTextureAtlas( const AtlasImage* images,
+                                 size_t count,
+                                 const AtlasDesc& desc,
+                                 std::vector<AtlasPage>& pages,
+                                 std::vector<AtlasRegion>& regions )
+{
+    pages.clear();
+    regions.clear();
+
+    if (!images || !count || !desc.maxSize || !desc.mipLevels || desc.mipLevels > CountMips( desc.maxSize, desc.maxSize ))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!images[i].rgba || !images[i].width || !images[i].height || images[i].rowPitch < images[i].width * 4)
+        {
+            return false;
+        }
+    }
+
+    size_t align = size_t(1) << ( desc.mipLevels - 1 );
+    size_t gutter = desc.padding * align;
+    size_t pageUnits = desc.maxSize / align;
+
+    // Cells in grid units
+    std::vector<size_t> unitsWide( count );
+    std::vector<size_t> unitsHigh( count );
+    for (size_t i = 0; i < count; ++i)
+    {
+        unitsWide[i] = ( images[i].width + 2 * gutter + align - 1 ) / align;
+        unitsHigh[i] = ( images[i].height + 2 * gutter + align - 1 ) / align;
+    }
+
+    // Largest first packs tightest
+    std::vector<size_t> order( count );
+    for (size_t i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b )
+    {
+        return std::max( unitsWide[a], unitsHigh[a] ) > std::max( unitsWide[b], unitsHigh[b] );
+    } );
+
+    AtlasRegion unpacked = { ATLAS_NOT_PACKED, 0, 0, 0, 0, 0.0f, 0.0f, 1.0f, 1.0f };
+    regions.assign( count, unpacked );
+    std::vector<PackRect> cells( count );
+
+    std::vector<MaxRectsBin> bins;
+    for (size_t k = 0; k < count; ++k)
+    {
+        size_t i = order[k];
+        if (unitsWide[i] > pageUnits || unitsHigh[i] > pageUnits)
+        {
+            continue;
+        }
+
+        size_t page = 0;
+        for (; page < bins.size(); ++page)
+        {
+            if (bins[page].Insert( unitsWide[i], unitsHigh[i], cells[i] ))
+            {
+                break;
+            }
+        }
+        if (page == bins.size())
+        {
+            bins.push_back( MaxRectsBin( pageUnits, pageUnits ) );
+            bins.back().Insert( unitsWide[i], unitsHigh[i], cells[i] );
+        }
+
+        regions[i].page = page;
+    }
+
+    // Rasterize each page at its used size, then build the mip chain
+    pages.resize( bins.size() );
+    for (size_t page = 0; page < bins.size(); ++page)
+    {
+        AtlasPage& out = pages[page];
+        out.width = bins[page].usedWidth * align;
+        out.height = bins[page].usedHeight * align;
+        out.mipLevels = std::min( desc.mipLevels, CountMips( out.width, out.height ) );
+
+        std::vector<uint8_t> level0( out.width * out.height * 4, 0 );
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (regions[i].page != page)
+            {
+                continue;
+            }
+
+            size_t cellX = cells[i].x * align;
+            size_t cellY = cells[i].y * align;
+            BlitCell( images[i], cellX, cellY, cells[i].width * align, cells[i].height * align, gutter,
+                      &level0[0], out.width );
+
+            AtlasRegion& r = regions[i];
+            r.x = cellX + gutter;
+            r.y = cellY + gutter;
+            r.width = images[i].width;
+            r.height = images[i].height;
+            r.uOffset = float( r.x ) / float( out.width );
+            r.vOffset = float( r.y ) / float( out.height );
+            r.uScale = float( r.width ) / float( out.width );
+            r.vScale = float( r.height ) / float( out.height );
+        }
+
+        // Box filter only: a wider kernel would reach across cell boundaries
+        out.pixels.resize( ComputeMipChainSize( out.width, out.height, MIPGEN_FORMAT_R8G8B8A8_UNORM, out.mipLevels ) );
+        if (!GenerateMipChain( &level0[0], out.width, out.height, out.width * 4,
+                               MIPGEN_FORMAT_R8G8B8A8_UNORM, MIPGEN_FILTER_BOX, out.mipLevels, &out.pixels[0] ))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::RemapAtlasTexCoords( const AtlasRegion& region, float* texCoords, size_t count, size_t stride )
+{
+    if (!texCoords || region.page == ATLAS_NOT_PACKED)
+    {
+        return false;
+    }
+
+    // Small tolerance for exporters that write 1.000001
+    const float epsilon = 1e-4f;
+    uint8_t* base = reinterpret_cast<uint8_t*>( texCoords );
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float* uv = reinterpret_cast<const float*>( base + i * stride );
+        if (uv[0] < -epsilon || uv[0] > 1.0f + epsilon || uv[1] < -epsilon || uv[1] > 1.0f + epsilon)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        float* uv = reinterpret_cast<float*>( base + i * stride );
+        float u = std::min( std::max( uv[0], 0.0f ), 1.0f );
+        float v = std::min( std::max( uv[1], 0.0f ), 1.0f );
+        uv[0] = region.uOffset + u * region.uScale;
+        uv[1] = region.vOffset + v * region.vScale;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+bool DirectX::DecodeAtlasImageFromDDS( const uint8_t* ddsData,
+                                       size_t ddsDataSize,
+                                       std::vector<uint8_t>& rgba,
+                                       size_t& width,
+                                       size_t& height )
+{
+    DDSTextureInfo info;
+    if (ParseDDS( ddsData, ddsDataSize, info ) != DDS_PARSE_OK || info.dimension != DDS_DIMENSION_TEXTURE2D)
+    {
+        return false;
+    }
+
+    std::vector<DDSSubresource> layout;
+    if (BuildDDSLayout( info, layout ) != DDS_PARSE_OK)
+    {
+        return false;
+    }
+
+    const DDSSubresource& top = layout[0];
+    const uint8_t* bits = ddsData + info.dataOffset + top.offset;
+    width = top.width;
+    height = top.height;
+    rgba.resize( width * height * 4 );
+
+    switch (info.format)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        for (size_t y = 0; y < height; ++y)
+        {
+            memcpy( &rgba[y * width * 4], bits + y * top.rowPitch, width * 4 );
+        }
+        return true;
+
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        {
+            bool opaque = ( info.format == DXGI_FORMAT_B8G8R8X8_UNORM || info.format == DXGI_FORMAT_B8G8R8X8_UNORM_SRGB );
+            for (size_t y = 0; y < height; ++y)
+            {
+                const uint8_t* src = bits + y * top.rowPitch;
+                uint8_t* dest = &rgba[y * width * 4];
+                for (size_t x = 0; x < width; ++x, src += 4, dest += 4)
+                {
+                    dest[0] = src[2];
+                    dest[1] = src[1];
+                    dest[2] = src[0];
+                    dest[3] = opaque ? 255 : src[3];
+                }
+            }
+        }
+        return true;
+
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+        return DecompressSurface( bits, width, height, BC_FORMAT_BC1, &rgba[0] );
+
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+        return DecompressSurface( bits, width, height, BC_FORMAT_BC3, &rgba[0] );
+
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// File: TextureAtlas.h
+//
+// Packs small textures into shared RGBA8 atlas pages so the meshes that use them can
+// share one shader resource binding.
+//
+// Images are placed with a MaxRects packer (best short side fit) on a grid aligned to
+// the smallest atlas mip, and every cell is surrounded by an edge-replicated gutter wide
+// enough to survive that many box-filtered mip levels without neighbours bleeding in.
+// Texture coordinates are rewritten into the atlas at mesh import (see OBJLoader).
+// Has no Direct3D dependency.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectX
+{
+    const size_t ATLAS_NOT_PACKED = ~size_t(0);
+
+    struct AtlasImage
+    {
+        const uint8_t*  rgba;
+        size_t          width;
+        size_t          height;
+        size_t          rowPitch;
+    };
+
+    struct AtlasDesc
+    {
+        size_t          maxSize;        // page width and height limit in texels
+        size_t          padding;        // gutter texels kept at every mip level
+        size_t          mipLevels;      // mip levels the atlas will be created with
+    };
+
+    struct AtlasRegion
+    {
+        size_t          page;           // ATLAS_NOT_PACKED if the image did not fit
+        size_t          x;              // texel rectangle of the image on its page
+        size_t          y;
+        size_t          width;
+        size_t          height;
+        float           uOffset;        // atlasUV = offset + uv * scale
+        float           vOffset;
+        float           uScale;
+        float           vScale;
+    };
+
+    struct AtlasPage
+    {
+        size_t                  width;
+        size_t                  height;
+        size_t                  mipLevels;
+        std::vector<uint8_t>    pixels;     // tightly packed RGBA8 mip chain, level 0 first
+    };
+
+    // Packs count images into as few pages as possible. regions has one entry per image.
+    // Returns false on bad arguments; images too large for a page are left unpacked.
+    bool BuildTextureAtlas( const AtlasImage* images,
+                            size_t count,
+                            const AtlasDesc& desc,
+                            std::vector<AtlasPage>& pages,
+                            std::vector<AtlasRegion>& regions );
+
+    // Rewrites count texture coordinates (pairs of floats, stride bytes apart) into the
+    // atlas region. Coordinates outside [0,1] cannot be remapped because the atlas does
+    // not wrap; in that case nothing is written and false is returned.
+    bool RemapAtlasTexCoords( const AtlasRegion& region, float* texCoords, size_t count, size_t stride );
+
+    // Decodes the top level of a DDS file in memory to tightly packed RGBA8.
+    // Supports 8-bit RGBA/BGRA and BC1/BC3 surfaces.
+    bool DecodeAtlasImageFromDDS( const uint8_t* ddsData,
+                                  size_t ddsDataSize,
+                                  std::vector<uint8_t>& rgba,
+                                  size_t& width,
+                                  size_t& height );
+}
+
+#endif // TEXTUREATLAS_H
@@ -0,0 +1,274 @@
+#include "TextureCache.h"
+#include "BCZTextureLoader.h"
+#include "DDSTextureLoader.h"
+#include <fstream>
+#include <vector>
+
+TextureCache::TextureCache(ID3D11Device* device)
+{
+	_device = device;
+	_residentBytes = 0;
+	_requests = 0;
+	_hits = 0;
+}
+
+TextureCache::~TextureCache()
+{
+	//Anything still acquired at shutdown is released here
+	for (auto it = _byView.begin(); it != _byView.end(); ++it)
+	{
+		it->first->Release();
+		delete it->second;
+	}
+}
+
+std::wstring TextureCache::NormalisePath(const wchar_t* fileName)
+{
+	//Full path resolves relative paths, "." and "..", then case and separators are folded
+	wchar_t fullPath[MAX_PATH];
+	DWORD length = GetFullPathNameW(fileName, MAX_PATH, fullPath, nullptr);
+	std::wstring path = (length > 0 && length < MAX_PATH) ? std::wstring(fullPath, length) : std::wstring(fileName);
+
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		if (path[i] == L'/')
+			path[i] = L'\\';
+	}
+	CharLowerBuffW(&path[0], (DWORD)path.size());
+
+	return path;
+}
+
+uint64_t TextureCache::HashContents(const uint8_t* data, size_t size)
+{
+	//64-bit FNV-1a over 8-byte words, then the tail bytes, seeded with the size
+	const uint64_t prime = 0x100000001B3ull;
+	uint64_t hash = 0xCBF29CE484222325ull ^ size;
+
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; ++i)
+	{
+		uint64_t word;
+		memcpy(&word, data + i * 8, sizeof(word));
+		hash = (hash ^ word) * prime;
+	}
+	for (size_t i = words * 8; i < size; ++i)
+	{
+		hash = (hash ^ data[i]) * prime;
+	}
+
+	return hash;
+}
+
+size_t TextureCache::ComputeResidentBytes(ID3D11ShaderResourceView* view)
+{
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	if (!resource)
+		return 0;
+
+	size_t width = 1, height = 1, depth = 1, mipLevels = 1, arraySize = 1;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+	if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE1D)
+	{
+		D3D11_TEXTURE1D_DESC desc;
+		((ID3D11Texture1D*)resource)->GetDesc(&desc);
+		width = desc.Width; mipLevels = desc.MipLevels; arraySize = desc.ArraySize; format = desc.Format;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		((ID3D11Texture2D*)resource)->GetDesc(&desc);
+		width = desc.Width; height = desc.Height; mipLevels = desc.MipLevels; arraySize = desc.ArraySize; format = desc.Format;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
+	{
+		D3D11_TEXTURE3D_DESC desc;
+		((ID3D11Texture3D*)resource)->GetDesc(&desc);
+		width = desc.Width; height = desc.Height; depth = desc.Depth; mipLevels = desc.MipLevels; format = desc.Format;
+	}
+	resource->Release();
+
+	size_t bytes = 0;
+	for (size_t level = 0; level < mipLevels; ++level)
+	{
+		size_t surfaceBytes = 0;
+		GetSurfaceInfo(width, height, format, &surfaceBytes, nullptr, nullptr);
+		bytes += surfaceBytes * depth;
+
+		width = max(width >> 1, (size_t)1);
+		height = max(height >> 1, (size_t)1);
+		depth = max(depth >> 1, (size_t)1);
+	}
+
+	return bytes * arraySize;
+}
+
+HRESULT TextureCache::WaitForEntry(std::unique_lock<std::mutex>& lock, Entry* entry, ID3D11ShaderResourceView** textureView)
+{
+	++entry->refs;
+	_loaded.wait(lock, [entry]() { return !entry->loading; });
+
+	HRESULT hr = entry->result;
+	if (FAILED(hr))
+	{
+		//The loading thread already dropped it from the maps, last waiter out frees it
+		if (--entry->refs == 0)
+			delete entry;
+		return hr;
+	}
+
+	*textureView = entry->view;
+	return S_OK;
+}
+
+HRESULT TextureCache::Acquire(const wchar_t* fileName, ID3D11ShaderResourceView** textureView)
+{
+	if (!fileName || !textureView)
+		return E_INVALIDARG;
+
+	*textureView = nullptr;
+	std::wstring path = NormalisePath(fileName);
+
+	std::unique_lock<std::mutex> lock(_lock);
+	++_requests;
+
+	auto byPath = _byPath.find(path);
+	if (byPath != _byPath.end())
+	{
+		++_hits;
+		return WaitForEntry(lock, byPath->second, textureView);
+	}
+	lock.unlock();
+
+	//Read and hash outside the lock so other lookups carry on
+	std::ifstream inFile(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!inFile.good())
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+	std::vector<uint8_t> data((size_t)inFile.tellg());
+	inFile.seekg(0);
+	inFile.read((char*)data.data(), data.size());
+	if (!inFile.good() || data.size() < 4)
+		return E_FAIL;
+	inFile.close();
+
+	uint64_t hash = HashContents(data.data(), data.size());
+
+	lock.lock();
+
+	//Another thread may have started on this path, or on the same contents under another name
+	byPath = _byPath.find(path);
+	if (byPath != _byPath.end())
+	{
+		++_hits;
+		return WaitForEntry(lock, byPath->second, textureView);
+	}
+
+	auto byContent = _byContent.find(hash);
+	if (byContent != _byContent.end())
+	{
+		++_hits;
+		_byPath[path] = byContent->second;
+		return WaitForEntry(lock, byContent->second, textureView);
+	}
+
+	Entry* entry = new Entry();
+	entry->view = nullptr;
+	entry->contentHash = hash;
+	entry->bytes = 0;
+	entry->refs = 1;
+	entry->loading = true;
+	entry->result = S_OK;
+	_byPath[path] = entry;
+	_byContent[hash] = entry;
+	lock.unlock();
+
+	//Device creation is free threaded, so several textures can be created at once
+	ID3D11ShaderResourceView* view = nullptr;
+	HRESULT hr;
+	if (memcmp(data.data(), "BCZ1", 4) == 0)
+		hr = CreateBCZTextureFromMemory(_device, data.data(), data.size(), nullptr, &view);
+	else
+		hr = CreateDDSTextureFromMemory(_device, data.data(), data.size(), nullptr, &view);
+
+	size_t bytes = SUCCEEDED(hr) ? ComputeResidentBytes(view) : 0;
+
+	lock.lock();
+	entry->loading = false;
+	entry->result = hr;
+
+	if (FAILED(hr))
+	{
+		for (auto it = _byPath.begin(); it != _byPath.end(); )
+		{
+			if (it->second == entry)
+				it = _byPath.erase(it);
+			else
+				++it;
+		}
+		_byContent.erase(hash);
+
+		if (--entry->refs == 0)
+			delete entry;
+
+		_loaded.notify_all();
+		return hr;
+	}
+
+	entry->view = view;
+	entry->bytes = bytes;
+	_byView[view] = entry;
+	_residentBytes += bytes;
+	_loaded.notify_all();
+
+	*textureView = view;
+	return S_OK;
+}
+
+void TextureCache::Release(ID3D11ShaderResourceView* textureView)
+{
+	if (!textureView)
+		return;
+
+	std::lock_guard<std::mutex> lock(_lock);
+
+	auto byView = _byView.find(textureView);
+	if (byView == _byView.end())
+		return;
+
+	Entry* entry = byView->second;
+	if (--entry->refs > 0)
+		return;
+
+	//Last user gone: forget every path that led here and free the texture
+	for (auto it = _byPath.begin(); it != _byPath.end(); )
+	{
+		if (it->second == entry)
+			it = _byPath.erase(it);
+		else
+			++it;
+	}
+	_byContent.erase(entry->contentHash);
+	_byView.erase(byView);
+
+	_residentBytes -= entry->bytes;
+	entry->view->Release();
+	delete entry;
+}
+
+TextureCacheStats TextureCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	TextureCacheStats stats;
+	stats.textures = _byView.size();
+	stats.residentBytes = _residentBytes;
+	stats.requests = _requests;
+	stats.hits = _hits;
+	stats.hitRatio = _requests ? (double)_hits / (double)_requests : 0.0;
+	return stats;
+}
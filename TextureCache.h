@@ -0,0 +1,66 @@
+#pragma once
+#include <windows.h>
+#include <d3d11_1.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace DirectX;
+
+struct TextureCacheStats
+{
+	size_t textures;		//Distinct textures resident
+	size_t residentBytes;	//Texel memory of those textures, all mips and array slices
+	uint64_t requests;
+	uint64_t hits;			//Requests served without creating a texture (same path or same content)
+	double hitRatio;
+};
+
+//Hands out shader resource views for texture files (DDS or BCZ) and makes sure each texture exists once.
+//Entries are keyed by normalised full path and by a hash of the file contents, so two paths to the
+//same file, or two copies of the same file, share one SRV. Every Acquire must be matched by a Release;
+//the texture is freed when its last user releases it. Safe to call from several loading threads.
+class TextureCache
+{
+private:
+	struct Entry
+	{
+		ID3D11ShaderResourceView* view;
+		uint64_t contentHash;
+		size_t bytes;
+		int refs;
+		bool loading;		//Another thread is creating the texture, wait on _loaded
+		HRESULT result;
+	};
+
+	ID3D11Device* _device;
+
+	std::mutex _lock;
+	std::condition_variable _loaded;
+	std::map<std::wstring, Entry*> _byPath;
+	std::map<uint64_t, Entry*> _byContent;
+	std::map<ID3D11ShaderResourceView*, Entry*> _byView;
+
+	size_t _residentBytes;
+	uint64_t _requests;
+	uint64_t _hits;
+
+	static std::wstring NormalisePath(const wchar_t* fileName);
+	static uint64_t HashContents(const uint8_t* data, size_t size);
+	static size_t ComputeResidentBytes(ID3D11ShaderResourceView* view);
+
+	HRESULT WaitForEntry(std::unique_lock<std::mutex>& lock, Entry* entry, ID3D11ShaderResourceView** textureView);
+
+public:
+	TextureCache(ID3D11Device* device);
+	~TextureCache();
+
+	//Returns the SRV for fileName, loading it only if neither the path nor its contents are cached yet.
+	//The cache owns the SRV; call Release when done with it instead of textureView->Release().
+	HRESULT Acquire(const wchar_t* fileName, ID3D11ShaderResourceView** textureView);
+	void Release(ID3D11ShaderResourceView* textureView);
+
+	TextureCacheStats GetStats();
+};
@@ -0,0 +1,641 @@
+//--------------------------------------------------------------------------------------
+// File: VirtualTexture.cpp
+//
+// Virtual texture files, page cache and streaming.
+//
+// Layout: VTX_HEADER, then every page of mip 0 in row order, then mip 1 and so on. Pages
+// are all tileBytes long, so a page's offset follows from its id and no table is stored.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "VirtualTexture.h"
+#include "MipGenerator.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+
+#pragma pack(push,1)
+
+const uint32_t VTX_MAGIC = 0x31585456; // "VTX1"
+const uint32_t VTX_VERSION = 1;
+
+struct VTX_HEADER
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    pages;
+    uint32_t    pageSize;
+    uint32_t    border;
+    uint32_t    mipCount;
+    uint32_t    format;         // BC_FORMAT
+    uint32_t    tileBytes;
+};
+
+#pragma pack(pop)
+
+// Page ids hold 12 bits per coordinate and the page table stores slots in 8 bits
+const size_t MAX_PAGES = 4096;
+const size_t MAX_PHYSICAL_PAGES = 256;
+
+inline uint32_t MakeTableEntry( size_t slotX, size_t slotY, size_t mip )
+{
+    return uint32_t( slotX ) | ( uint32_t( slotY ) << 8 ) | ( uint32_t( mip ) << 16 ) | 0xFF000000;
+}
+
+inline bool EntryValid( uint32_t entry ) { return ( entry >> 24 ) != 0; }
+inline size_t EntryMip( uint32_t entry ) { return ( entry >> 16 ) & 0xFF; }
+
+//-------------------------------------------------------------------------------------
+// Resamples RGBA8 to a square size x size image with bilinear filtering
+//-------------------------------------------------------------------------------------
+void ResampleBilinear( const uint8_t* rgba, size_t width, size_t height, size_t rowPitch,
+                       size_t size, uint8_t* dest, unsigned int threadCount )
+{
+    float scaleX = float( width ) / float( size );
+    float scaleY = float( height ) / float( size );
+
+    ParallelFor( size, threadCount, [&]( size_t y )
+    {
+        float sy = ( float( y ) + 0.5f ) * scaleY - 0.5f;
+        if ( sy < 0.f ) sy = 0.f;
+        size_t y0 = std::min( size_t( sy ), height - 1 );
+        size_t y1 = std::min( y0 + 1, height - 1 );
+        float fy = sy - float( y0 );
+
+        const uint8_t* row0 = rgba + y0 * rowPitch;
+        const uint8_t* row1 = rgba + y1 * rowPitch;
+        uint8_t* out = dest + y * size * 4;
+
+        for ( size_t x = 0; x < size; ++x )
+        {
+            float sx = ( float( x ) + 0.5f ) * scaleX - 0.5f;
+            if ( sx < 0.f ) sx = 0.f;
+            size_t x0 = std::min( size_t( sx ), width - 1 );
+            size_t x1 = std::min( x0 + 1, width - 1 );
+            float fx = sx - float( x0 );
+
+            for ( size_t c = 0; c < 4; ++c )
+            {
+                float top = row0[x0 * 4 + c] + ( row0[x1 * 4 + c] - row0[x0 * 4 + c] ) * fx;
+                float bottom = row1[x0 * 4 + c] + ( row1[x1 * 4 + c] - row1[x0 * 4 + c] ) * fx;
+                out[x * 4 + c] = uint8_t( top + ( bottom - top ) * fy + 0.5f );
+            }
+        }
+    } );
+}
+
+//-------------------------------------------------------------------------------------
+bool ReadHeader( std::istream& file, VirtualTextureLayout& layout )
+{
+    VTX_HEADER header;
+    file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+    if ( !file.good() )
+        return false;
+
+    if ( header.magic != VTX_MAGIC || header.version != VTX_VERSION )
+        return false;
+
+    if ( header.pages == 0 || header.pages > MAX_PAGES || ( header.pages & ( header.pages - 1 ) ) != 0 )
+        return false;
+
+    if ( header.format > BC_FORMAT_BC7 || header.pageSize == 0 || ( ( header.pageSize + 2 * header.border ) & 3 ) != 0 )
+        return false;
+
+    layout.pages = header.pages;
+    layout.pageSize = header.pageSize;
+    layout.border = header.border;
+    layout.mipCount = header.mipCount;
+    layout.format = BC_FORMAT( header.format );
+    layout.tileBytes = header.tileBytes;
+
+    if ( layout.mipCount == 0 || layout.mipCount > 13 || layout.pages >> ( layout.mipCount - 1 ) != 1 )
+        return false;
+
+    return layout.tileBytes == ComputeBCSurfaceSize( layout.TileSize(), layout.TileSize(), layout.format );
+}
+
+void ComputeMipBase( const VirtualTextureLayout& layout, std::vector<size_t>& mipBase )
+{
+    mipBase.resize( layout.mipCount + 1 );
+    mipBase[0] = 0;
+    for ( size_t mip = 0; mip < layout.mipCount; ++mip )
+    {
+        mipBase[mip + 1] = mipBase[mip] + layout.PagesAt( mip ) * layout.PagesAt( mip );
+    }
+}
+
+};
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::BuildVirtualTextureFile( const char* fileName,
+                                       const uint8_t* rgba,
+                                       size_t width,
+                                       size_t height,
+                                       size_t rowPitch,
+                                       size_t pageSize,
+                                       size_t border,
+                                       BC_FORMAT format,
+                                       unsigned int threadCount )
+{
+    if ( !fileName || !rgba || !width || !height || !pageSize )
+        return false;
+
+    size_t tileSize = pageSize + 2 * border;
+    if ( ( tileSize & 3 ) != 0 || border > pageSize )
+        return false;
+
+    size_t pages = 1;
+    while ( pages * pageSize < std::max( width, height ) )
+        pages <<= 1;
+    if ( pages > MAX_PAGES )
+        return false;
+
+    size_t mipCount = 1;
+    while ( ( pages >> ( mipCount - 1 ) ) > 1 )
+        ++mipCount;
+
+    // Square power-of-two virtual size so every mip is an exact grid of pages
+    size_t size = pages * pageSize;
+    std::vector<uint8_t> resampled( size * size * 4 );
+    ResampleBilinear( rgba, width, height, rowPitch, size, resampled.data(), threadCount );
+
+    std::vector<uint8_t> chain( ComputeMipChainSize( size, size, MIPGEN_FORMAT_R8G8B8A8_UNORM, mipCount ) );
+    if ( !GenerateMipChain( resampled.data(), size, size, size * 4, MIPGEN_FORMAT_R8G8B8A8_UNORM,
+                            MIPGEN_FILTER_BOX, mipCount, chain.data() ) )
+        return false;
+    resampled.clear();
+
+    VirtualTextureLayout layout;
+    layout.pages = pages;
+    layout.pageSize = pageSize;
+    layout.border = border;
+    layout.mipCount = mipCount;
+    layout.format = format;
+    layout.tileBytes = ComputeBCSurfaceSize( tileSize, tileSize, format );
+
+    std::vector<size_t> mipBase;
+    ComputeMipBase( layout, mipBase );
+
+    std::vector<uint8_t> tiles( mipBase[mipCount] * layout.tileBytes );
+
+    const uint8_t* level = chain.data();
+    for ( size_t mip = 0; mip < mipCount; ++mip )
+    {
+        size_t levelSize = size >> mip;
+        size_t levelPages = layout.PagesAt( mip );
+
+        // One page per job; each compresses single threaded so pages run side by side
+        ParallelFor( levelPages * levelPages, threadCount, [&]( size_t page )
+        {
+            size_t pageX = page % levelPages;
+            size_t pageY = page / levelPages;
+
+            std::vector<uint8_t> tile( tileSize * tileSize * 4 );
+            for ( size_t y = 0; y < tileSize; ++y )
+            {
+                // Borders come from the neighbouring pages, clamped at the texture edge
+                ptrdiff_t sy = ptrdiff_t( pageY * pageSize + y ) - ptrdiff_t( border );
+                sy = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( sy, ptrdiff_t( levelSize ) - 1 ) );
+                const uint8_t* src = level + size_t( sy ) * levelSize * 4;
+
+                for ( size_t x = 0; x < tileSize; ++x )
+                {
+                    ptrdiff_t sx = ptrdiff_t( pageX * pageSize + x ) - ptrdiff_t( border );
+                    sx = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( sx, ptrdiff_t( levelSize ) - 1 ) );
+                    memcpy( &tile[( y * tileSize + x ) * 4], src + size_t( sx ) * 4, 4 );
+                }
+            }
+
+            CompressSurface( tile.data(), tileSize, tileSize, tileSize * 4, format,
+                             &tiles[( mipBase[mip] + page ) * layout.tileBytes], 1 );
+        } );
+
+        level += levelSize * levelSize * 4;
+    }
+
+    VTX_HEADER header;
+    header.magic = VTX_MAGIC;
+    header.version = VTX_VERSION;
+    header.pages = uint32_t( pages );
+    header.pageSize = uint32_t( pageSize );
+    header.border = uint32_t( border );
+    header.mipCount = uint32_t( mipCount );
+    header.format = uint32_t( format );
+    header.tileBytes = uint32_t( layout.tileBytes );
+
+    std::ofstream outFile( fileName, std::ios::out | std::ios::binary );
+    if ( !outFile )
+        return false;
+
+    outFile.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+    outFile.write( reinterpret_cast<const char*>( tiles.data() ), tiles.size() );
+    return outFile.good();
+}
+
+
+//-------------------------------------------------------------------------------------
+bool DirectX::ReadVirtualTextureLayout( const char* fileName, VirtualTextureLayout& layout )
+{
+    std::ifstream inFile( fileName, std::ios::in | std::ios::binary );
+    if ( !inFile )
+        return false;
+
+    return ReadHeader( inFile, layout );
+}
+
+
+//-------------------------------------------------------------------------------------
+// VirtualTextureCache
+//-------------------------------------------------------------------------------------
+VirtualTextureCache::VirtualTextureCache( const VirtualTextureLayout& layout, size_t physicalPagesX, size_t physicalPagesY )
+    : layout( layout ),
+      physicalPagesX( std::min( physicalPagesX, MAX_PHYSICAL_PAGES ) ),
+      frame( 1 )
+{
+    physicalPagesY = std::min( physicalPagesY, MAX_PHYSICAL_PAGES );
+
+    Slot freeSlot = { VT_NO_PAGE, 0, false };
+    slots.assign( this->physicalPagesX * physicalPagesY, freeSlot );
+
+    ComputeMipBase( layout, mipBase );
+    residentSlot.assign( mipBase[layout.mipCount], -1 );
+
+    pageTable.resize( layout.mipCount );
+    dirty.assign( layout.mipCount, true );
+    for ( size_t mip = 0; mip < layout.mipCount; ++mip )
+    {
+        pageTable[mip].assign( layout.PagesAt( mip ) * layout.PagesAt( mip ), 0 );
+    }
+
+    memset( &stats, 0, sizeof( stats ) );
+}
+
+size_t VirtualTextureCache::PageIndex( uint32_t pageId ) const
+{
+    size_t mip = PageIdMip( pageId );
+    return mipBase[mip] + PageIdY( pageId ) * layout.PagesAt( mip ) + PageIdX( pageId );
+}
+
+bool VirtualTextureCache::IsResident( uint32_t pageId ) const
+{
+    size_t mip = PageIdMip( pageId );
+    if ( mip >= layout.mipCount || PageIdX( pageId ) >= layout.PagesAt( mip ) || PageIdY( pageId ) >= layout.PagesAt( mip ) )
+        return false;
+
+    return residentSlot[PageIndex( pageId )] >= 0;
+}
+
+//-------------------------------------------------------------------------------------
+// Rewrites the page table entries under a page, at its own mip and every finer one.
+// Mapping takes over entries that show something coarser (or nothing); unmapping hands
+// the entries that showed this page back to the parent's entry.
+//-------------------------------------------------------------------------------------
+void VirtualTextureCache::UpdateCoverage( uint32_t pageId, uint32_t entry, bool unmapping )
+{
+    size_t mip = PageIdMip( pageId );
+    size_t pageX = PageIdX( pageId );
+    size_t pageY = PageIdY( pageId );
+
+    for ( size_t level = 0; level <= mip; ++level )
+    {
+        size_t shift = mip - level;
+        size_t span = size_t( 1 ) << shift;
+        size_t levelPages = layout.PagesAt( level );
+        std::vector<uint32_t>& table = pageTable[level];
+
+        for ( size_t y = pageY << shift; y < ( pageY << shift ) + span; ++y )
+        {
+            uint32_t* row = &table[y * levelPages];
+            for ( size_t x = pageX << shift; x < ( pageX << shift ) + span; ++x )
+            {
+                uint32_t current = row[x];
+                bool replace = unmapping
+                    ? ( EntryValid( current ) && EntryMip( current ) == mip )
+                    : ( !EntryValid( current ) || EntryMip( current ) >= mip );
+                if ( replace )
+                    row[x] = entry;
+            }
+        }
+
+        dirty[level] = true;
+    }
+}
+
+void VirtualTextureCache::UnmapSlot( size_t slot )
+{
+    uint32_t pageId = slots[slot].pageId;
+    size_t mip = PageIdMip( pageId );
+
+    uint32_t fallback = 0;
+    if ( mip + 1 < layout.mipCount )
+    {
+        fallback = pageTable[mip + 1][( PageIdY( pageId ) >> 1 ) * layout.PagesAt( mip + 1 ) + ( PageIdX( pageId ) >> 1 )];
+    }
+
+    residentSlot[PageIndex( pageId )] = -1;
+    slots[slot].pageId = VT_NO_PAGE;
+    slots[slot].locked = false;
+    UpdateCoverage( pageId, fallback, true );
+
+    --stats.residentPages;
+    ++stats.evictions;
+}
+
+//-------------------------------------------------------------------------------------
+bool VirtualTextureCache::MapPage( uint32_t pageId, bool locked, size_t& slotX, size_t& slotY )
+{
+    size_t mip = PageIdMip( pageId );
+    if ( mip >= layout.mipCount || PageIdX( pageId ) >= layout.PagesAt( mip ) || PageIdY( pageId ) >= layout.PagesAt( mip ) )
+        return false;
+
+    int32_t existing = residentSlot[PageIndex( pageId )];
+    if ( existing >= 0 )
+    {
+        slots[existing].locked |= locked;
+        Touch( existing );
+        slotX = existing % physicalPagesX;
+        slotY = existing / physicalPagesX;
+        return true;
+    }
+
+    // A free slot if there is one, otherwise the least recently used page not needed this frame
+    size_t best = slots.size();
+    for ( size_t slot = 0; slot < slots.size(); ++slot )
+    {
+        const Slot& candidate = slots[slot];
+        if ( candidate.pageId == VT_NO_PAGE )
+        {
+            best = slot;
+            break;
+        }
+        if ( candidate.locked || candidate.lastUsed >= frame )
+            continue;
+        if ( best == slots.size() || candidate.lastUsed < slots[best].lastUsed )
+            best = slot;
+    }
+
+    if ( best == slots.size() )
+        return false;
+
+    if ( slots[best].pageId != VT_NO_PAGE )
+        UnmapSlot( best );
+
+    slots[best].pageId = pageId;
+    slots[best].locked = locked;
+    Touch( best );
+    residentSlot[PageIndex( pageId )] = int32_t( best );
+
+    slotX = best % physicalPagesX;
+    slotY = best / physicalPagesX;
+    UpdateCoverage( pageId, MakeTableEntry( slotX, slotY, mip ), false );
+
+    ++stats.residentPages;
+    ++stats.mappedPages;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+void VirtualTextureCache::AnalyseFeedback( const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests )
+{
+    requests.clear();
+
+    std::vector<uint32_t> ids;
+    ids.reserve( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        uint32_t id = feedback[i];
+        size_t mip = PageIdMip( id );
+        if ( id == VT_NO_PAGE || mip >= layout.mipCount )
+            continue;
+        if ( PageIdX( id ) >= layout.PagesAt( mip ) || PageIdY( id ) >= layout.PagesAt( mip ) )
+            continue;
+        ids.push_back( id );
+    }
+    std::sort( ids.begin(), ids.end() );
+
+    struct Missing
+    {
+        uint32_t    pageId;
+        size_t      count;
+    };
+    std::vector<Missing> missing;
+
+    for ( size_t i = 0; i < ids.size(); )
+    {
+        uint32_t id = ids[i];
+        size_t run = 1;
+        while ( i + run < ids.size() && ids[i + run] == id )
+            ++run;
+        i += run;
+
+        int32_t slot = residentSlot[PageIndex( id )];
+        if ( slot >= 0 )
+        {
+            Touch( slot );
+            continue;
+        }
+
+        // Keep whatever is drawn in its place, and ask for the missing ancestors as well so
+        // detail arrives one level at a time
+        size_t mip = PageIdMip( id );
+        uint32_t shown = pageTable[mip][PageIdY( id ) * layout.PagesAt( mip ) + PageIdX( id )];
+        if ( EntryValid( shown ) )
+            Touch( ( ( shown >> 8 ) & 0xFF ) * physicalPagesX + ( shown & 0xFF ) );
+
+        size_t x = PageIdX( id );
+        size_t y = PageIdY( id );
+        for ( ; mip < layout.mipCount; ++mip, x >>= 1, y >>= 1 )
+        {
+            uint32_t ancestor = MakePageId( mip, x, y );
+            if ( residentSlot[PageIndex( ancestor )] >= 0 )
+                break;
+            Missing request = { ancestor, run };
+            missing.push_back( request );
+        }
+    }
+
+    // Merge ancestors requested by several pages, then coarsest mip first, busiest page first
+    std::sort( missing.begin(), missing.end(), []( const Missing& a, const Missing& b ) { return a.pageId < b.pageId; } );
+    size_t merged = 0;
+    for ( size_t i = 0; i < missing.size(); ++i )
+    {
+        if ( merged > 0 && missing[merged - 1].pageId == missing[i].pageId )
+            missing[merged - 1].count += missing[i].count;
+        else
+            missing[merged++] = missing[i];
+    }
+    missing.resize( merged );
+
+    std::sort( missing.begin(), missing.end(), []( const Missing& a, const Missing& b )
+    {
+        if ( PageIdMip( a.pageId ) != PageIdMip( b.pageId ) )
+            return PageIdMip( a.pageId ) > PageIdMip( b.pageId );
+        if ( a.count != b.count )
+            return a.count > b.count;
+        return a.pageId < b.pageId;
+    } );
+
+    requests.reserve( missing.size() );
+    for ( size_t i = 0; i < missing.size(); ++i )
+    {
+        requests.push_back( missing[i].pageId );
+    }
+
+    stats.requestedPages = requests.size();
+}
+
+
+//-------------------------------------------------------------------------------------
+// VirtualTextureStreamer
+//-------------------------------------------------------------------------------------
+VirtualTextureStreamer::VirtualTextureStreamer()
+    : quit( false )
+{
+    memset( &layout, 0, sizeof( layout ) );
+}
+
+VirtualTextureStreamer::~VirtualTextureStreamer()
+{
+    Close();
+}
+
+bool VirtualTextureStreamer::Open( const char* name )
+{
+    Close();
+
+    syncFile.open( name, std::ios::in | std::ios::binary );
+    if ( !syncFile || !ReadHeader( syncFile, layout ) )
+    {
+        syncFile.close();
+        return false;
+    }
+
+    fileName = name;
+    ComputeMipBase( layout, mipBase );
+
+    // The file must hold every page
+    syncFile.seekg( 0, std::ios::end );
+    if ( size_t( syncFile.tellg() ) < PageOffset( MakePageId( layout.mipCount - 1, 0, 0 ) ) + layout.tileBytes )
+    {
+        syncFile.close();
+        return false;
+    }
+
+    quit = false;
+    worker = std::thread( &VirtualTextureStreamer::WorkerMain, this );
+    return true;
+}
+
+void VirtualTextureStreamer::Close()
+{
+    if ( worker.joinable() )
+    {
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            quit = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    if ( syncFile.is_open() )
+        syncFile.close();
+
+    queue.clear();
+    pending.clear();
+    completed.clear();
+}
+
+size_t VirtualTextureStreamer::PageOffset( uint32_t pageId ) const
+{
+    size_t mip = PageIdMip( pageId );
+    size_t index = mipBase[mip] + PageIdY( pageId ) * layout.PagesAt( mip ) + PageIdX( pageId );
+    return sizeof( VTX_HEADER ) + index * layout.tileBytes;
+}
+
+bool VirtualTextureStreamer::ReadPage( uint32_t pageId, std::vector<uint8_t>& data )
+{
+    size_t mip = PageIdMip( pageId );
+    if ( !syncFile.is_open() || mip >= layout.mipCount
+        || PageIdX( pageId ) >= layout.PagesAt( mip ) || PageIdY( pageId ) >= layout.PagesAt( mip ) )
+        return false;
+
+    data.resize( layout.tileBytes );
+    syncFile.clear();
+    syncFile.seekg( PageOffset( pageId ) );
+    syncFile.read( reinterpret_cast<char*>( data.data() ), data.size() );
+    return syncFile.good();
+}
+
+void VirtualTextureStreamer::Request( uint32_t pageId )
+{
+    size_t mip = PageIdMip( pageId );
+    if ( mip >= layout.mipCount || PageIdX( pageId ) >= layout.PagesAt( mip ) || PageIdY( pageId ) >= layout.PagesAt( mip ) )
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        if ( !pending.insert( pageId ).second )
+            return;
+        queue.push_back( pageId );
+    }
+    wake.notify_one();
+}
+
+void VirtualTextureStreamer::TakeCompleted( std::vector<LoadedPage>& pages )
+{
+    pages.clear();
+
+    std::lock_guard<std::mutex> guard( lock );
+    pages.swap( completed );
+    for ( size_t i = 0; i < pages.size(); ++i )
+    {
+        pending.erase( pages[i].pageId );
+    }
+}
+
+size_t VirtualTextureStreamer::GetPendingCount()
+{
+    std::lock_guard<std::mutex> guard( lock );
+    return pending.size();
+}
+
+void VirtualTextureStreamer::WorkerMain()
+{
+    std::ifstream file( fileName.c_str(), std::ios::in | std::ios::binary );
+
+    std::unique_lock<std::mutex> guard( lock );
+    for ( ;; )
+    {
+        wake.wait( guard, [this]() { return quit || !queue.empty(); } );
+        if ( quit )
+            break;
+
+        uint32_t pageId = queue.front();
+        queue.pop_front();
+        guard.unlock();
+
+        LoadedPage page;
+        page.pageId = pageId;
+        page.data.resize( layout.tileBytes );
+        file.clear();
+        file.seekg( PageOffset( pageId ) );
+        file.read( reinterpret_cast<char*>( page.data.data() ), page.data.size() );
+        bool ok = file.good();
+
+        guard.lock();
+        if ( ok )
+            completed.push_back( std::move( page ) );
+        else
+            pending.erase( pageId );
+    }
+}
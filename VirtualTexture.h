@@ -0,0 +1,191 @@
+//--------------------------------------------------------------------------------------
+// File: VirtualTexture.h
+//
+// Virtual texturing: tiled source files, the CPU page cache and background tile loading.
+//
+// A virtual texture is a square power-of-two mip pyramid cut into fixed-size pages. Each page is
+// stored with a border of neighbouring texels so the physical cache can be bilinearly
+// filtered. Pages are BC compressed in the file and uploaded as-is.
+//
+// VirtualTextureCache is the Direct3D-free core: it turns feedback buffers (page ids
+// written by the feedback pass) into load requests, assigns physical slots with LRU
+// replacement, and maintains the page table, where every entry points at the finest
+// resident page covering it. It can be driven headlessly from recorded feedback.
+// VirtualTextureStreamer reads pages on a worker thread.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockCompressor.h"
+
+namespace DirectX
+{
+    // Feedback texels that did not touch the virtual texture hold this value (mip 255, which
+    // never exists, and exactly representable as a float so render targets can be cleared to it)
+    const uint32_t VT_NO_PAGE = 0xFF000000;
+
+    // Page ids: x in bits 0-11, y in bits 12-23, mip in bits 24-31 (same packing as the shader)
+    inline uint32_t MakePageId( size_t mip, size_t x, size_t y )
+    {
+        return uint32_t( x ) | ( uint32_t( y ) << 12 ) | ( uint32_t( mip ) << 24 );
+    }
+    inline size_t PageIdX( uint32_t id ) { return id & 0xFFF; }
+    inline size_t PageIdY( uint32_t id ) { return ( id >> 12 ) & 0xFFF; }
+    inline size_t PageIdMip( uint32_t id ) { return id >> 24; }
+
+    struct VirtualTextureLayout
+    {
+        size_t      pages;          // pages across mip 0 in each direction (a power of two)
+        size_t      pageSize;       // payload texels per page side
+        size_t      border;         // extra texels on each side of the payload
+        size_t      mipCount;       // down to the level that is a single page
+        BC_FORMAT   format;
+        size_t      tileBytes;      // compressed size of one page including its border
+
+        size_t TileSize() const { return pageSize + 2 * border; }
+        size_t PagesAt( size_t mip ) const { return pages >> mip; }
+    };
+
+    struct VirtualTextureStats
+    {
+        size_t      residentPages;
+        size_t      requestedPages;     // distinct missing pages seen in the last feedback
+        size_t      mappedPages;        // pages mapped since creation
+        size_t      evictions;
+    };
+
+    // Writes a tiled virtual texture file. The image is resampled to a square power-of-two
+    // number of pages, mipmapped, cut into bordered pages and compressed on all hardware
+    // threads. pageSize + 2 * border must be a multiple of 4.
+    bool BuildVirtualTextureFile( const char* fileName,
+                                  const uint8_t* rgba,
+                                  size_t width,
+                                  size_t height,
+                                  size_t rowPitch,
+                                  size_t pageSize,
+                                  size_t border,
+                                  BC_FORMAT format,
+                                  unsigned int threadCount = 0 );
+
+    // Reads the header of a virtual texture file
+    bool ReadVirtualTextureLayout( const char* fileName, VirtualTextureLayout& layout );
+
+    //----------------------------------------------------------------------------------
+    class VirtualTextureCache
+    {
+    public:
+        VirtualTextureCache( const VirtualTextureLayout& layout, size_t physicalPagesX, size_t physicalPagesY );
+
+        // Dedupes a feedback buffer, refreshes the resident pages it uses (and the fallbacks
+        // shown while pages are missing) and returns the missing pages, coarsest first and
+        // most requested first within a mip.
+        void AnalyseFeedback( const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests );
+
+        // Assigns a physical slot to a page, evicting the least recently used unlocked page
+        // if the cache is full. Fails if every slot is locked or was used this frame.
+        bool MapPage( uint32_t pageId, bool locked, size_t& slotX, size_t& slotY );
+
+        bool IsResident( uint32_t pageId ) const;
+
+        // Starts a new frame for LRU purposes
+        void EndFrame() { ++frame; }
+
+        // Page table entries for one mip, PagesAt(mip) squared RGBA8 texels packed as
+        // slotX | slotY << 8 | mappedMip << 16 | 0xFF << 24 (zero while nothing covers it)
+        const std::vector<uint32_t>& GetPageTable( size_t mip ) const { return pageTable[mip]; }
+        bool IsPageTableDirty( size_t mip ) const { return dirty[mip]; }
+        void ClearPageTableDirty( size_t mip ) { dirty[mip] = false; }
+
+        VirtualTextureStats GetStats() const { return stats; }
+        const VirtualTextureLayout& GetLayout() const { return layout; }
+
+    private:
+        struct Slot
+        {
+            uint32_t    pageId;         // VT_NO_PAGE if free
+            uint64_t    lastUsed;
+            bool        locked;
+        };
+
+        size_t PageIndex( uint32_t pageId ) const;
+        void Touch( size_t slot ) { slots[slot].lastUsed = frame; }
+        void UnmapSlot( size_t slot );
+        void UpdateCoverage( uint32_t pageId, uint32_t entry, bool unmapping );
+
+        VirtualTextureLayout                    layout;
+        size_t                                  physicalPagesX;
+        std::vector<Slot>                       slots;
+        std::vector<size_t>                     mipBase;        // first PageIndex of each mip
+        std::vector<int32_t>                    residentSlot;   // per page, -1 if not resident
+        std::vector<std::vector<uint32_t>>      pageTable;
+        std::vector<bool>                       dirty;
+        uint64_t                                frame;
+        VirtualTextureStats                     stats;
+    };
+
+    //----------------------------------------------------------------------------------
+    class VirtualTextureStreamer
+    {
+    public:
+        struct LoadedPage
+        {
+            uint32_t                pageId;
+            std::vector<uint8_t>    data;   // tileBytes of compressed blocks
+        };
+
+        VirtualTextureStreamer();
+        ~VirtualTextureStreamer();
+
+        bool Open( const char* fileName );
+        void Close();
+
+        const VirtualTextureLayout& GetLayout() const { return layout; }
+
+        // Reads a page on the calling thread (used for the always-resident coarsest mip)
+        bool ReadPage( uint32_t pageId, std::vector<uint8_t>& data );
+
+        // Queues a page for the worker thread; pages already queued or loading are ignored
+        void Request( uint32_t pageId );
+
+        // Moves finished pages into pages; they may be requested again from then on
+        void TakeCompleted( std::vector<LoadedPage>& pages );
+
+        // Pages queued or being read
+        size_t GetPendingCount();
+
+    private:
+        void WorkerMain();
+        size_t PageOffset( uint32_t pageId ) const;
+
+        VirtualTextureLayout                layout;
+        std::vector<size_t>                 mipBase;
+        std::string                         fileName;
+        std::ifstream                       syncFile;
+
+        std::mutex                          lock;
+        std::condition_variable             wake;
+        std::deque<uint32_t>                queue;
+        std::set<uint32_t>                  pending;
+        std::vector<LoadedPage>             completed;
+        bool                                quit;
+        std::thread                         worker;
+    };
+}
+
+#endif // VIRTUALTEXTURE_H